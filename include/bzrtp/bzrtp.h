@@ -166,6 +166,8 @@ typedef struct bzrtpSrtpSecrets_struct  {
 #define BZRTP_MESSAGE_PEERNOTBZRTP          0x03
 #define BZRTP_MESSAGE_PEERREQUESTGOCLEAR    0x04
 #define BZRTP_MESSAGE_PEERACKGOCLEAR		0x05
+#define BZRTP_MESSAGE_PEERERROR				0x06 /**< peer terminated the key agreement with an Error message, messageString describes the error */
+#define BZRTP_MESSAGE_ERRORSENT				0x07 /**< we terminated the key agreement with an Error message, messageString describes the error */
 
 /**
  * Function pointer used by bzrtp to free memory allocated by callbacks.
@@ -188,11 +190,36 @@ typedef struct bzrtpCallbacks_struct {
 
 	/* ready for exported keys */
 	int (* bzrtp_contextReadyForExportedKeys)(void *clientData, int zuid, uint8_t role); /**< Tell the client that this is the time to create any exported keys, s0 is erased just after the call to this callback. Callback is given the peerZID and zuid to adress the correct node in cache and current role which is needed to set a pair of keys for IM encryption */
+
+	/* channel status */
+	int (* bzrtp_channelStatusChanged)(void *clientData, uint32_t selfSSRC, int status); /**< Tell the client the status of a channel changed, status is one of the values returned by bzrtp_getChannelStatus (BZRTP_CHANNEL_ONGOING, BZRTP_CHANNEL_SECURE, BZRTP_CHANNEL_CLEAR, BZRTP_CHANNEL_ERROR...). Called only when the status actually changes so client does not need to poll bzrtp_getChannelStatus */
+	int (* bzrtp_peerNotZRTP)(void *clientData, uint32_t selfSSRC); /**< Tell the client the discovery budget of a channel is exhausted without any answer from peer: it most likely does not support ZRTP. A Hello arriving later still resumes the negotiation */
+	int (* bzrtp_cacheReadRequested)(void *clientData, uint32_t selfSSRC); /**< Optional, the peer Hello needs the secrets associated to the peer in cache: return 0 if the client calls bzrtp_readPeerCache (possibly on another thread) then bzrtp_cacheReadCompleted for this channel. The channel does not block meanwhile. Any other return value and the cache is read right away */
+
+	/* sending packets in transport buffers */
+	uint8_t *(* bzrtp_getSendBuffer)(void *clientData, uint16_t packetLength); /**< Optional, used only along with bzrtp_commitSendBuffer: get a transport buffer of at least packetLength bytes. Packets never resent (HelloACK, Conf2ACK, ClearACK, Error, ErrorACK, PingACK) are built directly in it, stored packets are copied in it. A buffer may be left uncommitted if the packet fails to build. Return NULL to fall back on bzrtp_sendData */
+	int (* bzrtp_commitSendBuffer)(void *clientData, uint8_t *buffer, uint16_t packetLength); /**< Send to peer the packet written in a buffer given by bzrtp_getSendBuffer. Shall return 0 on success */
+
+	/* receiving packets */
+	void (* bzrtp_releaseReceiveBuffer)(void *clientData, uint8_t *buffer); /**< Optional, give back a receive buffer transferred by bzrtp_processMessageTransfer once the library does not reference it anymore. When not set, these buffers are released using free() */
 } bzrtpCallbacks_t;
 
+/**
+ * @brief Limits applied to the Hello retransmissions while peer never answered, see bzrtp_setDiscoveryPolicy
+ */
+typedef struct bzrtpDiscoveryPolicy_struct {
+	int maxHelloCount; /**< Maximum number of Hello retransmissions after the first one, default is 20 */
+	uint64_t timeBudget; /**< Maximum time in ms spent sending Hello since the first one, 0 for no limit (default) */
+	uint32_t byteBudget; /**< Maximum number of bytes of Hello packets sent on a channel, 0 for no limit (default) */
+} bzrtpDiscoveryPolicy_t;
+
 #define ZRTP_MAGIC_COOKIE 0x5a525450
 #define ZRTP_VERSION	"1.10"
 
+/* Ping and PingACK packets have a fixed size: packet header(12) + message + CRC(4) */
+#define BZRTP_PING_PACKET_LENGTH		40
+#define BZRTP_PINGACK_PACKET_LENGTH		52
+
 /* error code definition */
 #define BZRTP_ERROR_INVALIDCALLBACKID				0x0001
 #define	BZRTP_ERROR_CONTEXTNOTREADY					0x0002
@@ -219,6 +246,28 @@ typedef struct bzrtpCallbacks_struct {
 #define BZRTP_CHANNEL_CLEAR                         0x1010
 #define BZRTP_CHANNEL_ERROR                         0x1008
 
+/* error codes carried by the ZRTP Error message - rfc section 5.9 */
+#define BZRTP_ZRTPERROR_MALFORMEDPACKET				0x10
+#define BZRTP_ZRTPERROR_CRITICALSOFTWARE			0x20
+#define BZRTP_ZRTPERROR_UNSUPPORTEDVERSION			0x30
+#define BZRTP_ZRTPERROR_HELLOCOMPONENTSMISMATCH		0x40
+#define BZRTP_ZRTPERROR_UNSUPPORTEDHASH				0x51
+#define BZRTP_ZRTPERROR_UNSUPPORTEDCIPHER			0x52
+#define BZRTP_ZRTPERROR_UNSUPPORTEDKEYAGREEMENT		0x53
+#define BZRTP_ZRTPERROR_UNSUPPORTEDAUTHTAG			0x54
+#define BZRTP_ZRTPERROR_UNSUPPORTEDSAS				0x55
+#define BZRTP_ZRTPERROR_NOSHAREDSECRET				0x56
+#define BZRTP_ZRTPERROR_BADPV						0x61
+#define BZRTP_ZRTPERROR_UNMATCHINGHVI				0x62
+#define BZRTP_ZRTPERROR_UNTRUSTEDMITM				0x63
+#define BZRTP_ZRTPERROR_BADCONFIRMMAC				0x70
+#define BZRTP_ZRTPERROR_NONCEREUSE					0x80
+#define BZRTP_ZRTPERROR_EQUALZID					0x90
+#define BZRTP_ZRTPERROR_SSRCCOLLISION				0x91
+#define BZRTP_ZRTPERROR_SERVICEUNAVAILABLE			0xA0
+#define BZRTP_ZRTPERROR_PROTOCOLTIMEOUT				0xB0
+#define BZRTP_ZRTPERROR_GOCLEARNOTALLOWED			0x100
+
 /* role mapping */
 #define BZRTP_ROLE_INITIATOR	0
 #define	BZRTP_ROLE_RESPONDER	1
@@ -242,6 +291,7 @@ typedef struct bzrtpCallbacks_struct {
 #define BZRTP_ZIDCACHE_UNABLETOUPDATE		0x2103
 #define BZRTP_ZIDCACHE_UNABLETOREAD		0x2104
 #define BZRTP_ZIDCACHE_BADINPUTDATA		0x2105
+#define BZRTP_ZIDCACHE_UNABLETOSNAPSHOT		0x2106
 #define BZRTP_ZIDCACHE_RUNTIME_CACHELESS	0x2110
 
 /**
@@ -250,6 +300,17 @@ typedef struct bzrtpCallbacks_struct {
 */
 typedef struct bzrtpContext_struct bzrtpContext_t;
 
+/**
+ * @brief bzrtpCryptoProfile_t Supported crypto algorithms lists shared by several ZRTP contexts
+ * Reference counted, it becomes immutable once a context was created with it
+*/
+typedef struct bzrtpCryptoProfile_struct bzrtpCryptoProfile_t;
+
+/**
+ * @brief bzrtpMemoryCache_t A ZID cache held in memory, made durable by periodic snapshots to a file
+*/
+typedef struct bzrtpMemoryCache_struct bzrtpMemoryCache_t;
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -299,8 +360,9 @@ BZRTP_EXPORT int bzrtp_setCallbacks(bzrtpContext_t *context, const bzrtpCallback
  *
  * @param[in,out]	context			The ZRTP context we're dealing with
  * @param[in]		zidCache		Used by internal function to access cache: turn into a sqlite3 pointer if cache is enabled
- * @param[in]		selfURI			Local URI used for this communication, needed to perform cache operation, NULL terminated string, duplicated by this function
- * @param[in]		peerURI			Peer URI used for this communication, needed to perform cache operation, NULL terminated string, duplicated by this function
+ * 						It may be the db of an in-memory cache, see bzrtp_memoryCache_open
+ * @param[in]		selfURI			Local URI used for this communication, needed to perform cache operation, NULL terminated string, interned by this function
+ * @param[in]		peerURI			Peer URI used for this communication, needed to perform cache operation, NULL terminated string, interned by this function
  * @param[in]		zidCacheMutex		Points to a mutex used to lock zidCache database access
  *
  * @return 0 or BZRTP_CACHE_SETUP(if cache is populated by this call) on success, error code otherwise
@@ -312,8 +374,8 @@ BZRTP_EXPORT int bzrtp_setZIDCache_lock(bzrtpContext_t *context, void *zidCache,
  *
  * @param[in,out]	context			The ZRTP context we're dealing with
  * @param[in]		zidCache		Used by internal function to access cache: turn into a sqlite3 pointer if cache is enabled
- * @param[in]   	selfURI			Local URI used for this communication, needed to perform cache operation, NULL terminated string, duplicated by this function
- * @param[in]   	peerURI			Peer URI used for this communication, needed to perform cache operation, NULL terminated string, duplicated by this function
+ * @param[in]   	selfURI			Local URI used for this communication, needed to perform cache operation, NULL terminated string, interned by this function
+ * @param[in]   	peerURI			Peer URI used for this communication, needed to perform cache operation, NULL terminated string, interned by this function
  *
  * @return 0 or BZRTP_CACHE_SETUP(if cache is populated by this call) on success, error code otherwise
 */
@@ -376,6 +438,22 @@ BZRTP_EXPORT int bzrtp_iterate(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, u
  */
 BZRTP_EXPORT int bzrtp_processMessage(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t *zrtpPacketString, uint16_t zrtpPacketStringLength);
 
+/**
+ * @brief Process a received message, transferring the ownership of the receive buffer to the library
+ * Hello, Commit, DHPart and Confirm messages are kept for the key agreement: the library then references
+ * the buffer instead of copying it. The buffer is given back through the bzrtp_releaseReceiveBuffer callback,
+ * at the latest when the channel is destroyed, it may be released before this function returns.
+ * The caller shall not access the buffer after this call, except when it returns BZRTP_ERROR_INVALIDCONTEXT with a NULL context.
+ *
+ * @param[in,out]	zrtpContext				The ZRTP context we're dealing with
+ * @param[in]		selfSSRC				The SSRC identifying the channel receiving the message
+ * @param[in]		zrtpPacketString		The packet received, its ownership is transferred to the library
+ * @param[in]		zrtpPacketStringLength	Length of the packet in bytes
+ *
+ * @return 	0 on success, errorcode otherwise
+ */
+BZRTP_EXPORT int bzrtp_processMessageTransfer(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t *zrtpPacketString, uint16_t zrtpPacketStringLength);
+
 /**
  * @brief Called by user when the SAS has been verified
  *
@@ -403,6 +481,84 @@ BZRTP_EXPORT void bzrtp_resetSASVerified(bzrtpContext_t *zrtpContext);
  */
 BZRTP_EXPORT int bzrtp_resetRetransmissionTimer(bzrtpContext_t *zrtpContext, uint32_t selfSSRC);
 
+/**
+ * @brief Set the discovery policy of a ZRTP context
+ * The policy limits the Hello retransmissions on channels whose peer never answered. When any of its limits is reached,
+ * the channel stops sending Hello, its status turns to BZRTP_CHANNEL_ERROR and the bzrtp_peerNotZRTP callback is called.
+ *
+ * @param[in,out]	zrtpContext		The ZRTP context we're dealing with
+ * @param[in]		policy			The policy to apply, copied into the context
+ *
+ * @return 0 on success, error code otherwise
+ */
+BZRTP_EXPORT int bzrtp_setDiscoveryPolicy(bzrtpContext_t *zrtpContext, const bzrtpDiscoveryPolicy_t *policy);
+
+/**
+ * @brief Get the discovery policy of a ZRTP context
+ *
+ * @param[in]		zrtpContext		The ZRTP context we're dealing with
+ * @param[out]		policy			The current policy
+ *
+ * @return 0 on success, error code otherwise
+ */
+BZRTP_EXPORT int bzrtp_getDiscoveryPolicy(const bzrtpContext_t *zrtpContext, bzrtpDiscoveryPolicy_t *policy);
+
+/**
+ * @brief Suspend or resume the Hello sending of a channel in discovery
+ * Client may suspend it when signaling gives a hint the peer does not support ZRTP (no zrtp-hash in SDP). A suspended
+ * channel does not send Hello but still answers a Hello from peer. Resuming restarts the discovery with a full budget.
+ * Can be called before the channel is started.
+ *
+ * @param[in,out]	zrtpContext		The ZRTP context we're dealing with
+ * @param[in]		selfSSRC		The SSRC identifying the channel
+ * @param[in]		suspended		1 to suspend the Hello sending, 0 to resume it
+ *
+ * @return 0 on success, error code otherwise
+ */
+BZRTP_EXPORT int bzrtp_setHelloSuspended(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t suspended);
+
+/**
+ * @brief Read from cache the secrets associated to the peer of a channel waiting for it
+ * To be called after the bzrtp_cacheReadRequested callback accepted the read, it may run on a cache worker thread
+ * and block on the cache access. Meanwhile the application may keep processing messages and timers of this
+ * context but shall not add or destroy any of its channels.
+ *
+ * @param[in,out]	zrtpContext		The ZRTP context we're dealing with
+ * @param[in]		selfSSRC		The SSRC identifying the channel
+ *
+ * @return 0 on success, BZRTP_ERROR_CONTEXTNOTREADY if the channel is not waiting for a cache read, error code otherwise
+ */
+BZRTP_EXPORT int bzrtp_readPeerCache(bzrtpContext_t *zrtpContext, uint32_t selfSSRC);
+
+/**
+ * @brief Resume the processing of the peer Hello once bzrtp_readPeerCache returned
+ * To be called from the thread processing the messages of this context. If the cache was not read, it is done now.
+ *
+ * @param[in,out]	zrtpContext		The ZRTP context we're dealing with
+ * @param[in]		selfSSRC		The SSRC identifying the channel
+ *
+ * @return 0 on success, BZRTP_ERROR_CONTEXTNOTREADY if the channel is not waiting for a cache read, error code otherwise
+ */
+BZRTP_EXPORT int bzrtp_cacheReadCompleted(bzrtpContext_t *zrtpContext, uint32_t selfSSRC);
+
+/**
+ * @brief Check a Ping packet and write the matching PingACK packet in a caller provided buffer
+ * This function does not use any ZRTP context and does not allocate memory so it can answer Ping on
+ * any stream, even before a channel is created or started. The sequence number of the Ping is not checked
+ * as answering it does not modify any state.
+ *
+ * @param[in]		pingPacket				The received packet
+ * @param[in]		pingPacketLength		Length of the received packet
+ * @param[in]		endpointHash			Our endpoint hash: 8 bytes inserted in the PingACK (rfc section 5.16)
+ * @param[in]		selfSSRC				The SSRC used in the PingACK packet header
+ * @param[in]		sequenceNumber			The sequence number used in the PingACK packet header
+ * @param[out]		pingAckPacket			The buffer receiving the PingACK packet
+ * @param[in,out]	pingAckPacketLength		in: size of pingAckPacket buffer, at least BZRTP_PINGACK_PACKET_LENGTH, out: length of the PingACK packet
+ *
+ * @return 0 on success, BZRTP_ERROR_INVALIDARGUMENT if the packet is not a valid Ping, BZRTP_ERROR_OUTPUTBUFFER_LENGTH if the buffer is too small
+ */
+BZRTP_EXPORT int bzrtp_buildPingAck(const uint8_t *pingPacket, uint16_t pingPacketLength, const uint8_t endpointHash[8], uint32_t selfSSRC, uint16_t sequenceNumber, uint8_t *pingAckPacket, uint16_t *pingAckPacketLength);
+
 /**
  * @brief Get the supported crypto types
  *
@@ -426,6 +582,55 @@ BZRTP_EXPORT uint8_t bzrtp_getSupportedCryptoTypes(bzrtpContext_t *zrtpContext,
  */
 BZRTP_EXPORT int bzrtp_setSupportedCryptoTypes(bzrtpContext_t *zrtpContext, uint8_t algoType, uint8_t supportedTypes[7], uint8_t supportedTypesCount);
 
+/**
+ * @brief Create a crypto profile holding all the crypto types provided by the crypto module
+ * Configure it with bzrtp_setCryptoProfileSupportedTypes, then create as many contexts as needed with bzrtp_createBzrtpContextWithProfile:
+ * the algorithms selection is done once, not at each context creation.
+ *
+ * @return The crypto profile, with a reference count of 1
+ */
+BZRTP_EXPORT bzrtpCryptoProfile_t *bzrtp_createCryptoProfile(void);
+
+/**
+ * @brief set the supported crypto types of a profile, same as bzrtp_setSupportedCryptoTypes on a context.
+ * This function must be called before any context is created with this profile.
+ *
+ * @param[in,out]	profile					The crypto profile
+ * @param[in]		algoType				mapped to defines, must be in [ZRTP_HASH_TYPE, ZRTP_CIPHERBLOCK_TYPE, ZRTP_AUTHTAG_TYPE, ZRTP_KEYAGREEMENT_TYPE or ZRTP_SAS_TYPE]
+ * @param[in]		supportedTypes			mapped to uint8_t value of the 4 char strings giving the supported types as string according to rfc section 5.1.2 to 5.1.6
+ * @param[in]		supportedTypesCount		number of supported crypto types
+ *
+ * @return 0 on success, BZRTP_ERROR_CONTEXTNOTREADY if the profile is already in use, error code otherwise
+ */
+BZRTP_EXPORT int bzrtp_setCryptoProfileSupportedTypes(bzrtpCryptoProfile_t *profile, uint8_t algoType, uint8_t supportedTypes[7], uint8_t supportedTypesCount);
+
+/**
+ * @brief Take a reference on a crypto profile
+ *
+ * @param[in,out]	profile		The crypto profile
+ *
+ * @return the profile
+ */
+BZRTP_EXPORT bzrtpCryptoProfile_t *bzrtp_cryptoProfileRef(bzrtpCryptoProfile_t *profile);
+
+/**
+ * @brief Release a reference on a crypto profile, the profile is destroyed with its last reference
+ * Contexts created with the profile hold their own reference.
+ *
+ * @param[in,out]	profile		The crypto profile
+ */
+BZRTP_EXPORT void bzrtp_cryptoProfileUnref(bzrtpCryptoProfile_t *profile);
+
+/**
+ * @brief Create context structure and initialise its supported crypto types from a profile
+ * The profile is frozen: it cannot be modified anymore. The context supported crypto types may still be modified with bzrtp_setSupportedCryptoTypes.
+ *
+ * @param[in,out]	profile		The crypto profile, NULL to get the crypto types provided by the crypto module as bzrtp_createBzrtpContext does
+ *
+ * @return The ZRTP engine context data
+ */
+BZRTP_EXPORT bzrtpContext_t *bzrtp_createBzrtpContextWithProfile(bzrtpCryptoProfile_t *profile);
+
 /**
  * @brief Set the selfAcceptGoClear flag
  *
@@ -676,6 +881,98 @@ BZRTP_EXPORT int bzrtp_exportKey(bzrtpContext_t *zrtpContext, char *label, size_
  */
 BZRTP_EXPORT int bzrtp_cache_getPeerStatus_lock(void *dbPointer, const char *peerURI, bctbx_mutex_t *zidCacheMutex);
 
+/**
+ * @brief Open a ZID cache held in memory
+ *
+ * Cache reads and writes never touch the disk: the cache is an in-memory sqlite3 db, loaded from the snapshot file if it exists.
+ * The cache content is written to the snapshot file every snapshotInterval milliseconds by a background thread, when it changed,
+ * and when the cache is closed. A snapshot is written in a temporary file renamed over the previous one, so a crash leaves
+ * the last complete snapshot in place: changes made since the last snapshot are lost.
+ *
+ * Give the db and mutex to bzrtp_setZIDCache_lock and to the other cache functions:
+ * 	bzrtp_setZIDCache_lock(context, bzrtp_memoryCache_getDb(cache), selfURI, peerURI, bzrtp_memoryCache_getMutex(cache));
+ *
+ * @param[in]	snapshotPath		Path of the snapshot file, NULL to keep the cache in memory only
+ * @param[in]	snapshotInterval	Interval between background snapshots in ms, 0 to snapshot only on bzrtp_memoryCache_snapshot and on close
+ * @param[out]	exitCode		0, BZRTP_CACHE_SETUP or BZRTP_CACHE_UPDATE on success, error code otherwise
+ *
+ * @return the in-memory cache, NULL on error
+ */
+BZRTP_EXPORT bzrtpMemoryCache_t *bzrtp_memoryCache_open(const char *snapshotPath, uint32_t snapshotInterval, int *exitCode);
+
+/**
+ * @brief Get the db of an in-memory cache, to be used as zidCache or dbPointer by the cache functions
+ *
+ * @param[in]	cache	The in-memory cache
+ *
+ * @return the sqlite3 db pointer
+ */
+BZRTP_EXPORT void *bzrtp_memoryCache_getDb(bzrtpMemoryCache_t *cache);
+
+/**
+ * @brief Get the mutex locking an in-memory cache, it must be given to every cache function accessing its db
+ *
+ * @param[in]	cache	The in-memory cache
+ *
+ * @return the cache mutex
+ */
+BZRTP_EXPORT bctbx_mutex_t *bzrtp_memoryCache_getMutex(bzrtpMemoryCache_t *cache);
+
+/**
+ * @brief Write the content of an in-memory cache to its snapshot file now, if it changed since the last snapshot
+ * The cache is locked only while it is copied in memory, not while the copy is written to disk
+ *
+ * @param[in]	cache	The in-memory cache
+ *
+ * @return 0 on success, BZRTP_ZIDCACHE_UNABLETOSNAPSHOT if the snapshot file could not be written
+ */
+BZRTP_EXPORT int bzrtp_memoryCache_snapshot(bzrtpMemoryCache_t *cache);
+
+/**
+ * @brief Stop the background snapshots, write a last snapshot and free an in-memory cache
+ * No bzrtp context may use the cache anymore
+ *
+ * @param[in]	cache	The in-memory cache
+ *
+ * @return 0 on success, BZRTP_ZIDCACHE_UNABLETOSNAPSHOT if the last snapshot could not be written
+ */
+BZRTP_EXPORT int bzrtp_memoryCache_close(bzrtpMemoryCache_t *cache);
+
+/**
+ * @brief Attach the process to a shared hot secrets cache, creating it if needed
+ *
+ * Worker processes sharing one sqlite cache file can attach to the same shared memory segment: the retained secrets of
+ * a peer read from sqlite by any worker are then served from shared memory to all of them, without sqlite query.
+ * Reads never block: an entry being written is read again, or read from sqlite. A worker dying while writing in the
+ * segment can't block the others, the entry it was writing is discarded.
+ * Every write to the zrtp table must go through the bzrtp cache functions of an attached process, or the shared cache
+ * may serve outdated secrets: the segment must be removed with bzrtp_sharedCache_unlink when the cache is modified otherwise.
+ * Call it before any cache access of the process, the shared cache is used by all its contexts.
+ * Not available on Windows and Android.
+ *
+ * @param[in]	name		Name of the POSIX shared memory segment, starting with '/'
+ * @param[in]	entriesCount	Number of cached peers when the segment is created, 0 for the default (4096). Ignored if it exists
+ *
+ * @return 0 on success, BZRTP_ZIDCACHE_INVALID_CACHE if the segment can't be created or was created by another version of the library,
+ *  BZRTP_ERROR_CACHEDISABLED if not supported by this build
+ */
+BZRTP_EXPORT int bzrtp_sharedCache_attach(const char *name, uint32_t entriesCount);
+
+/**
+ * @brief Detach the process from the shared hot secrets cache, the segment remains for the other processes
+ * No cache access may be running in the process
+ */
+BZRTP_EXPORT void bzrtp_sharedCache_detach(void);
+
+/**
+ * @brief Remove a shared hot secrets cache segment, processes still attached keep using it
+ *
+ * @param[in]	name		Name of the POSIX shared memory segment
+ *
+ * @return 0 on success, error code otherwise
+ */
+BZRTP_EXPORT int bzrtp_sharedCache_unlink(const char *name);
+
 /**
  * @brief	Retrieve the name of the algo in string
  *
@@ -723,6 +1020,37 @@ BZRTP_EXPORT uint8_t bzrtp_available_key_agreement(uint8_t availableTypes[256]);
  */
 BZRTP_EXPORT bool_t bzrtp_is_PQ_available(void);
 
+/**
+ * @brief Generate key pairs ahead of any call, out of the handshake critical path (at startup or when idle for example)
+ * They are stored in a process wide reserve shared by all ZRTP contexts. A key exchange uses one of them - never twice - before
+ * generating a new key pair. Mostly useful for DH2k and DH3k which public value generation is a costly modular exponentiation.
+ * From then on, a background thread keeps the reserve at the level reached: each key pair used is replaced.
+ * This function is thread safe.
+ *
+ * @param[in]	keyAgreementAlgo	ZRTP_KEYAGREEMENT_DH2k, ZRTP_KEYAGREEMENT_DH3k, ZRTP_KEYAGREEMENT_X255 or ZRTP_KEYAGREEMENT_X448
+ * @param[in]	cipherAlgo			The cipher algorithm expected to be agreed on (ZRTP_CIPHER_<ID>), DH private exponent length depends on it
+ * @param[in]	count				The number of key pairs to generate, the reserve holds at most 8 key pairs
+ *
+ * @return the number of key pairs actually added to the reserve
+ */
+BZRTP_EXPORT int bzrtp_reserveKeyPairs(uint8_t keyAgreementAlgo, uint8_t cipherAlgo, int count);
+
+/**
+ * @brief Get the number of key pairs available in the process wide reserve for the given algorithms
+ *
+ * @param[in]	keyAgreementAlgo	ZRTP_KEYAGREEMENT_DH2k, ZRTP_KEYAGREEMENT_DH3k, ZRTP_KEYAGREEMENT_X255 or ZRTP_KEYAGREEMENT_X448
+ * @param[in]	cipherAlgo			The cipher algorithm the key pairs were reserved for, ignored for X255 and X448
+ *
+ * @return the number of matching key pairs in the reserve
+ */
+BZRTP_EXPORT int bzrtp_getReservedKeyPairsCount(uint8_t keyAgreementAlgo, uint8_t cipherAlgo);
+
+/**
+ * @brief Stop the reserve background refill and destroy all the key pairs still in the process wide reserve
+ * To be called at application teardown, before unloading the library. It is otherwise called at process exit.
+ */
+BZRTP_EXPORT void bzrtp_clearKeyPairReserve(void);
+
 /**
  * @brief Create a GoClear event and send it to the state machine
  * The user is in secure state.
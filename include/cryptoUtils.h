@@ -342,6 +342,70 @@ int bzrtp_KEM_decaps(bzrtp_KEMContext_t *ctx, uint8_t *cipherText);
  * @return 0 on success
  */
 int bzrtp_destroyKEMContext(bzrtp_KEMContext_t *ctx);
+
+/**
+ * @brief Destroy a DHM, ECDH or KEM context according to the key agreement algorithm it was created for
+ *
+ * @param[in]	keyAgreementContext	the context to destroy, may be NULL
+ * @param[in]	keyAgreementAlgo	the key agreement algorithm the context was created for
+ */
+void bzrtp_destroyKeyAgreementContext(void *keyAgreementContext, uint8_t keyAgreementAlgo);
+
+/**
+ * @brief Create several ECDH contexts each holding a new key pair
+ * Equivalent to calling bctbx_CreateECDHContext and bctbx_ECDHCreateKeyPair count times. Batch consumers (like the key pair reserve refill)
+ * shall use it so they benefit from any batched key generation the crypto backend may offer.
+ *
+ * @param[in]	keyAgreementAlgo	ZRTP_KEYAGREEMENT_X255 or ZRTP_KEYAGREEMENT_X448
+ * @param[in]	RNGContext			The random number generator context used to create the private keys
+ * @param[out]	ECDHContexts		An array of at least count pointers, filled with the created contexts. Caller is responsible for destroying them
+ * @param[in]	count				The number of key pairs to generate
+ *
+ * @return count on success, 0 if a key pair could not be generated: the contexts already created are then destroyed
+ */
+BZRTP_EXPORT int bzrtp_createECDHKeyPairs(uint8_t keyAgreementAlgo, bctbx_rng_context_t *RNGContext, bctbx_ECDHContext_t **ECDHContexts, int count);
+
+/**
+ * @brief Generate ahead of time the key agreement context we will need if we play the given role on this channel
+ * A context from the keypair pool matching the agreed algorithms is used when available, a new key pair is generated otherwise.
+ * DHM and ECDH generate a key pair for both roles, KEM only for the initiator: the responder encapsulates to the peer's public key
+ * received in the Commit so there is nothing to prepare for it.
+ *
+ * @param[in,out]	zrtpContext			The zrtp context holding the prepared contexts and the keypair pool
+ * @param[in]		zrtpChannelContext	The channel context holding the agreed key agreement and cipher algorithms
+ * @param[in]		role				BZRTP_ROLE_INITIATOR or BZRTP_ROLE_RESPONDER
+ *
+ * @return 0 on success, BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT otherwise
+ */
+int bzrtp_prepareKeyAgreementContext(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint8_t role);
+
+/**
+ * @brief Turn the context prepared for the given role into the one used by the key exchange: zrtpContext->keyAgreementContext
+ * It is prepared first if needed. Its public value is about to be disclosed to the peer so it will never go back to the pool.
+ *
+ * @param[in,out]	zrtpContext			The zrtp context
+ * @param[in]		zrtpChannelContext	The channel context holding the agreed key agreement and cipher algorithms
+ * @param[in]		role				BZRTP_ROLE_INITIATOR or BZRTP_ROLE_RESPONDER
+ *
+ * @return 0 on success, BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT otherwise
+ */
+int bzrtp_useKeyAgreementContext(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint8_t role);
+
+/**
+ * @brief Move the context prepared for a role we will not play into the keypair pool
+ * Its public value was never disclosed so a later key exchange can safely use it. When the pool is full, the oldest context is destroyed.
+ *
+ * @param[in,out]	zrtpContext			The zrtp context
+ * @param[in]		role				BZRTP_ROLE_INITIATOR or BZRTP_ROLE_RESPONDER
+ */
+void bzrtp_recycleKeyAgreementContext(bzrtpContext_t *zrtpContext, uint8_t role);
+
+/**
+ * @brief Destroy the key agreement contexts: the one in use, the prepared ones and the keypair pool
+ *
+ * @param[in,out]	zrtpContext			The zrtp context
+ */
+void bzrtp_destroyAllKeyAgreementContexts(bzrtpContext_t *zrtpContext);
 #ifdef __cplusplus
 }
 #endif
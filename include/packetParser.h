@@ -127,19 +127,6 @@
 extern "C"{
 #endif
 
-/**
- * @brief Store all zrtpPacket informations
- * according to type a specific structure type is mapped to the void * data pointer
- */
-typedef struct bzrtpPacket_struct {
-	uint16_t sequenceNumber; /**< set by packet parser to enable caller to retrieve the packet sequence number. This field is not used buy the packet creator, sequence number is given as a parameter when converting the message to a packet string. Used only when parsing a string into a packet struct */
-	uint32_t sourceIdentifier; /**< the SSRC of current RTP stream */
-	uint8_t  messageType; /**< the ZRTP message type mapped from strings to hard defined byte */
-	uint16_t messageLength; /**< the ZRTP message length in bytes - the message length indicated in the message itself is in 32 bits words. Is not the packet length(do not include packet header and CRC) */
-	void *messageData; /**< a pointer to the structure containing all the message field according to message type */
-	uint8_t *packetString; /**< used to stored the string version of the packet build from the message data or keep a string copy of received packets */
-	bctbx_list_t *fragments; /**< This is a list of bzrtpPacket_t. If the packet is fragmented all fragments a are stored in this list, each one in a dedicated packet */
-} bzrtpPacket_t;
 
 /**
  * Structure definition for all zrtp message type according to rfc section 5.2 to 5.16
@@ -193,7 +180,7 @@ typedef struct bzrtpCommitMessage_struct {
 	uint8_t hvi[32]; /**< only for DH commit : a hash of initiator's DHPart2 and responder's Hello message rfc section 4.4.1.1 */
 	uint8_t nonce[16]; /**< only for preShared or Multistream modes : a 128 bits random number generated by the initiator */
 	uint8_t keyID[8]; /**< only for preShared mode : the preshared key identifier */
-	uint8_t *pv; /**< Key exchange public value (length depends on key agreement type), present only in KEM mode it then holds the public key */
+	uint8_t *pv; /**< Key exchange public value (length depends on key agreement type), present only in KEM mode it then holds the public key. Points into the packetString of the packet holding this message */
 	uint8_t MAC[8]; /**< HMAC over the whole message, keyed by the hash image H1 (64 bits)*/
 } bzrtpCommitMessage_t;
 
@@ -212,7 +199,7 @@ typedef struct bzrtpDHPartMessage_struct {
 	uint8_t rs2ID[8]; /**< hash of the retained secret 2 (64 bits) */
 	uint8_t auxsecretID[8]; /**< hash of the auxiliary shared secret (64 bits) */
 	uint8_t pbxsecretID[8]; /**< hash of the trusted MiTM PBX shared secret pbxsecret, defined in section 7.3.1 (64 bits) */
-	uint8_t *pv; /**< Key exchange public value (length depends on key agreement type). In KEM mode, this might hold a nonce in DHPart2 or the ciphertext in DHPart1 */
+	uint8_t *pv; /**< Key exchange public value (length depends on key agreement type). In KEM mode, this might hold a nonce in DHPart2 or the ciphertext in DHPart1. Points into the packetString of the packet holding this message */
 	uint8_t MAC[8]; /**< HMAC over the whole message, keyed by the hash image H1 (64 bits)*/
 } bzrtpDHPartMessage_t;
 
@@ -247,9 +234,10 @@ typedef struct bzrtpConfirmMessage_struct {
 /**
  * @brief Error Message rfc section 5.9
  * The Error message is sent to terminate an in-process ZRTP key agreement exchange due to an error.
- * There is no need to define a structure for this packet as it contains length and message type which are stored
- * in the bzrtpPacket_t structure and a 32 bits integer error code only
  */
+typedef struct bzrtpErrorMessage_struct {
+	uint32_t errorCode; /**< the error code, one of BZRTP_ZRTPERROR_* (32 bits) */
+} bzrtpErrorMessage_t;
 
 /**
  * @brief Error ACK Message rfc 5.10
@@ -320,10 +308,37 @@ typedef struct bzrtpPingAckMessage_struct {
 } bzrtpPingAckMessage_t;
 
 
+/**
+ * @brief Store all zrtpPacket informations
+ * according to type a specific message structure is stored in the message union, messageType tells which member is valid.
+ * The packet and its message are held in a single allocation: variable length fields (public values) of Commit and DHPart messages
+ * point into packetString and are not allocated on their own.
+ */
+typedef struct bzrtpPacket_struct {
+	uint16_t sequenceNumber; /**< set by packet parser to enable caller to retrieve the packet sequence number. This field is not used buy the packet creator, sequence number is given as a parameter when converting the message to a packet string. Used only when parsing a string into a packet struct */
+	uint32_t sourceIdentifier; /**< the SSRC of current RTP stream */
+	uint8_t  messageType; /**< the ZRTP message type mapped from strings to hard defined byte */
+	uint16_t messageLength; /**< the ZRTP message length in bytes - the message length indicated in the message itself is in 32 bits words. Is not the packet length(do not include packet header and CRC) */
+	union {
+		bzrtpHelloMessage_t hello; /**< MSGTYPE_HELLO */
+		bzrtpCommitMessage_t commit; /**< MSGTYPE_COMMIT */
+		bzrtpDHPartMessage_t dhPart; /**< MSGTYPE_DHPART1 and MSGTYPE_DHPART2 */
+		bzrtpConfirmMessage_t confirm; /**< MSGTYPE_CONFIRM1 and MSGTYPE_CONFIRM2 */
+		bzrtpErrorMessage_t error; /**< MSGTYPE_ERROR */
+		bzrtpGoClearMessage_t goClear; /**< MSGTYPE_GOCLEAR */
+		bzrtpPingMessage_t ping; /**< MSGTYPE_PING */
+		bzrtpPingAckMessage_t pingAck; /**< MSGTYPE_PINGACK */
+	} message; /**< the structure containing all the message fields, the valid member depends on messageType. Messages without data (ACKs) do not use it */
+	uint8_t *packetString; /**< used to stored the string version of the packet build from the message data or keep a string copy of received packets */
+	bctbx_list_t *fragments; /**< This is a list of bzrtpPacket_t. If the packet is fragmented all fragments a are stored in this list, each one in a dedicated packet */
+	void (*packetStringRelease)(void *clientData, uint8_t *packetString); /**< when set, packetString is a receive buffer transferred by the application and is given back with this function instead of being freed */
+	void *packetStringReleaseData; /**< the clientData given to packetStringRelease */
+} bzrtpPacket_t;
+
 /** 
  * @brief Parse a string which shall be a valid ZRTP packet
  * Check validity and allocate the bzrtpPacket structure but do not parse the message except for type and length.
- * messageData structure field is not allocated by this function (use then bzrtp_packetParse for that).
+ * message structure field is not filled by this function (use then bzrtp_packetParse for that).
  * The packet check and actual message parsing are split in two functions to avoid useless parsing when message is
  * to be discarded as the check will give message type (in case of message repetition for example)
  *
@@ -336,9 +351,19 @@ typedef struct bzrtpPingAckMessage_struct {
  */
 BZRTP_EXPORT bzrtpPacket_t *bzrtp_packetCheck(uint8_t ** inputPtr, uint16_t *inputLength, bzrtpChannelContext_t *zrtpChannelContext, int *exitCode);
 
+/**
+ * @brief Check a string is a valid Ping packet: length, header, message type and CRC
+ *
+ * @param[in]	pingPacket			The received packet
+ * @param[in]	pingPacketLength	Its length in bytes
+ *
+ * @return		0 if it is a valid Ping packet, BZRTP_ERROR_INVALIDARGUMENT otherwise
+ */
+int bzrtp_pingPacketCheck(const uint8_t *pingPacket, uint16_t pingPacketLength);
+
 
 /**
- * @brief Parse the packet to extract the message and allocate the matching message structure if needed
+ * @brief Parse the packet to extract the message and fill the matching message structure if needed
  *
  * @param[in]		zrtpContext			The current ZRTP context, some parameters(key agreement algorithm) may be needed to parse packet.
  * @param[in]		zrtpChannelContext	The channel context this packet is intended to(channel context and packet must match peer SSRC).
@@ -352,7 +377,7 @@ BZRTP_EXPORT int bzrtp_packetParser(bzrtpContext_t *zrtpContext, bzrtpChannelCon
 
 
 /**
- * @brief Create an empty packet and allocate the messageData according to requested packetType
+ * @brief Create an empty packet and initialise the message according to requested packetType
  *
  * @param[in]		zrtpContext			The current ZRTP context, some data (H chain or others, may be needed to create messages)
  * @param[in]		zrtpChannelContext	The channel context this packet is intended to
@@ -366,7 +391,8 @@ BZRTP_EXPORT bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext,
 
 /**
  * @brief Create a ZRTP packet string from the ZRTP packet values present in the structure
- * messageType, messageData and sourceIdentifier in zrtpPacket must have been correctly set before calling this function
+ * messageType, message and sourceIdentifier in zrtpPacket must have been correctly set before calling this function
+ * If the packet already holds a packetString(created packets with a public value or rebuilt packets), it is reused
  * The packet is not ready to be sent at that stage, sequenceNumber and CRC must be set using bzrtp_packetSetSequenceNumber
  *
  * @param[in]		zrtpContext				A zrtp context where to find H0-H3 to compute MAC requested by some paquets or encryption's key for commit/SASRelay packet
@@ -399,6 +425,15 @@ BZRTP_EXPORT void bzrtp_freeZrtpPacket(bzrtpPacket_t *zrtpPacket);
  */
 BZRTP_EXPORT int bzrtp_packetSetSequenceNumber(bzrtpPacket_t *zrtpPacket, uint16_t sequenceNumber);
 
+/**
+ * @brief Get the packet length of a message type whose length does not depend on the message content
+ *
+ * param[in]	messageType		The 32bit integer mapped to the message type
+ *
+ * return		the packet length (header, message and CRC) in bytes, 0 if it depends on the message content
+ */
+uint16_t bzrtp_packetFixedLength(uint32_t messageType);
+
 #ifdef __cplusplus
 }
 #endif
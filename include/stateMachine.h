@@ -29,6 +29,12 @@
 #define BZRTP_EVENT_GOCLEAR         3
 #define BZRTP_EVENT_ACCEPT_GOCLEAR  4
 #define BZRTP_EVENT_BACKTOSECURE    5
+#define BZRTP_EVENT_CACHEREAD       6
+
+/* asynchronous cache read status */
+#define BZRTP_CACHEREAD_NONE		0
+#define BZRTP_CACHEREAD_PENDING		1
+#define BZRTP_CACHEREAD_DONE		2
 
 /* error code definition */
 #define BZRTP_ERROR_UNSUPPORTEDZRTPVERSION		0xe001
@@ -103,6 +109,22 @@ int state_discovery_waitingForHello(bzrtpEvent_t event);
  */
 int state_discovery_waitingForHelloAck(bzrtpEvent_t event);
 
+/**
+ * @brief Peer Hello is accepted but the secrets associated to the peer are still being read from cache by the application.
+ * Hello repetitions are deduplicated, the Hello processing resumes on the cache read completion event
+ *
+ * Arrives from :
+ * 	- state_discovery_init upon Hello reception
+ * 	- state_discovery_waitingForHello upon Hello reception
+ * Goes to:
+ * 	- state_discovery_waitingForHelloAck upon cache read completion, when coming from state_discovery_init and no HelloACK was received
+ * 	- state_keyAgreement_sendingCommit upon cache read completion otherwise
+ * Send :
+ * 	- Hello until timer's end or HelloACK reception, when coming from state_discovery_init
+ *
+ */
+int state_discovery_waitingForCache(bzrtpEvent_t event);
+
 
 /**
  * @brief For any kind of key agreement (DHM, Mult, PreShared), we keep sending commit.
@@ -223,6 +245,16 @@ int state_sending_GoClear(bzrtpEvent_t event);
  */
 int state_clear(bzrtpEvent_t event);
 
+/**
+ * @brief The key agreement was terminated by an Error message, sent or received
+ * This is a final state: there is no timer and every incoming message is dropped
+ *
+ * Arrives from:
+ * 	- any state but state_secure and state_clear on Error reception or fatal local error
+ *
+ */
+int state_error(bzrtpEvent_t event);
+
 /**
  * @brief Compute the new rs1 and update the cached secrets according to rfc section 4.6.1
  *
@@ -233,6 +265,41 @@ int state_clear(bzrtpEvent_t event);
  */
 int bzrtp_updateCachedSecrets(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext);
 
+/**
+ * @brief Set the status of a channel and signal it to the client if it changed
+ *
+ * param[in]		zrtpContext			The context we are operation on (holds the callbacks)
+ * param[in/out]	zrtpChannelContext	The channel context we are operation on
+ * param[in]		status				The new channel status, one of BZRTP_CHANNEL_*
+ */
+void bzrtp_setChannelStatus(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, int status);
+
+/**
+ * @brief Terminate the key agreement in progress on a channel - rfc section 5.9
+ * Send an Error message to peer if requested, stop the retransmissions, release the stored packets and the key agreement material,
+ * signal the error to the client and move the channel to state_error
+ *
+ * param[in]		zrtpContext			The context we are operation on
+ * param[in/out]	zrtpChannelContext	The channel context we are operation on
+ * param[in]		errorCode			The ZRTP error code, one of BZRTP_ZRTPERROR_*
+ * param[in]		sendError			1 when the error is local and must be sent to peer, 0 when we are answering a peer Error message
+ *
+ * return 0 on success, error code otherwise
+ */
+int bzrtp_abortKeyAgreement(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint32_t errorCode, uint8_t sendError);
+
+/**
+ * @brief Manage an Error message received from peer: acknowledge it and terminate the key agreement in progress
+ * Error messages received on a secure or clear channel are ignored as there is no key agreement in progress to terminate
+ *
+ * param[in]		zrtpContext			The context we are operation on
+ * param[in/out]	zrtpChannelContext	The channel context we are operation on
+ * param[in]		zrtpPacket			The parsed Error packet, still owned by the caller
+ *
+ * return 0 on success, error code otherwise
+ */
+int bzrtp_processErrorMessage(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,7 +20,7 @@
 #define TYPEDEF_H
 
 /* maximum number of simultaneous channels opened in a ZRTP session */
-#define ZRTP_MAX_CHANNEL_NUMBER 64
+#define ZRTP_MAX_CHANNEL_NUMBER 4096 /* upper bound of the channel table, slots are allocated on demand */
 /* aux secret may rarely be used define his maximum length in bytes */
 #define MAX_AUX_SECRET_LENGTH	64
 /* the context will store some of the sent or received packets */
@@ -33,6 +33,11 @@
 #define CONFIRM_MESSAGE_STORE_ID    3
 #define GOCLEAR_MESSAGE_STORE_ID    4
 
+/* number of undisclosed key agreement contexts kept aside to be reused by a later key exchange */
+#define KEYPAIR_POOL_CAPACITY	2
+/* number of key pairs the process wide reserve can hold, see bzrtp_reserveKeyPairs */
+#define KEYPAIR_RESERVE_CAPACITY	8
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -139,6 +144,35 @@ typedef struct cachedSecretsHash_struct {
 	uint8_t pbxsecretID[8]; /**< pbx secret Hash */
 } cachedSecretsHash_t;
 
+/**
+ * @brief A key agreement context (DHM, ECDH or KEM) along with the algorithm needed to use and destroy it
+ */
+typedef struct keyAgreementSlot_struct {
+	void *context; /**< bctbx_DHMContext_t, bctbx_ECDHContext_t or bzrtp_KEMContext_t according to algo, NULL when the slot is empty */
+	uint8_t algo; /**< key agreement algorithm of the context, stored using integer mapping defined in cryptoUtils.h */
+	uint8_t secretLength; /**< DHM only: length in bytes of the private exponent, it depends on the cipher algorithm */
+} keyAgreementSlot_t;
+
+/**
+ * @brief Supported crypto algorithms lists shared by contexts, see bzrtp_createCryptoProfile
+ * Fields mirror the ones of the ZRTP context so they are copied as is at context creation
+ */
+struct bzrtpCryptoProfile_struct {
+	bctbx_mutex_t lock; /**< protects the reference count: contexts sharing a profile may live in different threads */
+	int refCount; /**< the profile is destroyed when it reaches 0 */
+	uint8_t isFrozen; /**< set when the first context is created with this profile, lists cannot be modified anymore */
+	uint8_t hc; /**< hash count */
+	uint8_t supportedHash[7]; /**< list of supported hash algorithms mapped to uint8_t */
+	uint8_t cc; /**< cipher count */
+	uint8_t supportedCipher[7]; /**< list of supported cipher algorithms mapped to uint8_t */
+	uint8_t ac; /**< auth tag count */
+	uint8_t supportedAuthTag[7]; /**< list of supported SRTP authentication tag algorithms mapped to uint8_t */
+	uint8_t kc; /**< key agreement count */
+	uint8_t supportedKeyAgreement[7]; /**< list of supported key agreement algorithms mapped to uint8_t */
+	uint8_t sc; /**< sas count */
+	uint8_t supportedSas[7]; /**< list of supported Sas representations mapped to uint8_t */
+};
+
 typedef struct fragmentInfo_struct {
 	uint16_t offset;
 	uint16_t length;
@@ -167,6 +201,12 @@ struct bzrtpChannelContext_struct {
 	/* flags */
 	uint8_t isSecure; /**< This flag is set to 1 when the ZRTP negociation ends and SRTP secrets are generated and confirmed for this channel */
 	uint8_t isMainChannel; /**< This flag is set for the firt channel only, allow to distinguish channel to be secured using DHM or multiStream */
+	int channelStatus; /**< Last channel status reported to the client through the bzrtp_channelStatusChanged callback, one of BZRTP_CHANNEL_* */
+	uint8_t helloSuspended; /**< When set, the channel does not send Hello in discovery init state */
+	uint64_t discoveryStartTime; /**< in ms, time of the first Hello sent, used to enforce the discovery time budget */
+	uint32_t discoveryBytesSent; /**< Hello bytes sent so far, used to enforce the discovery byte budget */
+	uint8_t cacheReadStatus; /**< Asynchronous cache read of the peer secrets: BZRTP_CACHEREAD_NONE, BZRTP_CACHEREAD_PENDING or BZRTP_CACHEREAD_DONE */
+	bzrtpStateMachine_t cacheReadNextState; /**< The state to go to once the cache read is completed */
 #ifdef GOCLEAR_ENABLED
 	uint8_t isClear; /**< This flag is set to 1 when this channel is in clear state */
 	uint8_t hasReceivedAGoClear; /**< This flag is set to 1 when this channel has received a GoClear message */
@@ -175,10 +215,12 @@ struct bzrtpChannelContext_struct {
 	/* Hash chains, self is generated at channel context init */
 	uint8_t selfH[4][32]; /**< Store self 256 bits Hash images H0-H3 used to generate messages MAC */
 	uint8_t peerH[4][32]; /**< Store peer 256 bits Hash images H0-H3 used to check messages authenticity */
+	uint8_t peerHVerified; /**< bit i is set when peerH[i] holds an image verified against the peer hash chain, so each link is computed only once */
 
 	/* packet storage : shall store some sent and received packets */
 	bzrtpPacket_t *selfPackets[PACKET_STORAGE_CAPACITY]; /**< Hello, Commit and DHPart packet locally generated */
 	bzrtpPacket_t *peerPackets[PACKET_STORAGE_CAPACITY]; /**< Hello, Commit and DHPart packet received from peer */
+	uint8_t peerPacketsMACVerified; /**< bit i is set when the MAC of peerPackets[i] has been verified */
 
 	/* peer Hello hash : store the peer hello hash when given by signaling */
 	uint8_t *peerHelloHash; /**< peer hello hash - SHA256 of peer Hello packet, given through signaling, shall be a 32 bytes buffer */
@@ -223,9 +265,6 @@ struct bzrtpChannelContext_struct {
 	/* We do not need to store more than one as there on no scenarii in wich we expect peer to send 2 messages in a parallel */
 	fragmentReassembly_t incomingFragmentedPacket;
 
-	/* temporary buffer stored in the channel context */
-	bzrtpPacket_t *pingPacket; /**< Temporary stores a ping packet when received to be used to create the pingACK response */
-
 };
 
 /**
@@ -237,6 +276,8 @@ struct bzrtpContext_struct {
 	bctbx_rng_context_t *RNGContext; /**< context for random number generation */
 	void *keyAgreementContext; /**< context for the key agreement operations. Only one key agreement computation may be done during a call, so this belongs to the general context and not the channel one */
 	uint8_t keyAgreementAlgo; /**< key agreement algorithm agreed on the first channel, the one performing key exchange, stored using integer mapping defined in cryptoUtils.h,  */
+	keyAgreementSlot_t preparedKeyAgreement[2]; /**< key agreement contexts generated ahead of time for each role, indexed by BZRTP_ROLE_INITIATOR or BZRTP_ROLE_RESPONDER. Their public value was not disclosed yet */
+	keyAgreementSlot_t keyPairPool[KEYPAIR_POOL_CAPACITY]; /**< undisclosed key agreement contexts recycled from the role we did not end up playing, used before generating new ones */
 
 	/* flags */
 	uint8_t isInitialised; /**< this flag is set once the context was initialised : self ZID retrieved from cache or generated, used to unlock the creation of addtional channels */
@@ -250,9 +291,13 @@ struct bzrtpContext_struct {
 
 	/* callbacks */
 	bzrtpCallbacks_t zrtpCallbacks; /**< structure holding all the pointers to callbacks functions needed by the ZRTP engine. Functions are set by client using the bzrtp_setCallback function */
+	bzrtpDiscoveryPolicy_t discoveryPolicy; /**< limits on Hello retransmissions to a peer which never answered */
 
 	/* channel contexts */
-	bzrtpChannelContext_t *channelContext[ZRTP_MAX_CHANNEL_NUMBER]; /**< All the context data needed for a channel are stored in a dedicated structure */
+	bzrtpChannelContext_t **channelContext; /**< All the context data needed for a channel are stored in a dedicated structure. This table grows on demand, slot 0 holds the main channel and free slots are NULL */
+	uint16_t channelContextSize; /**< number of slots in the channelContext table */
+	uint16_t *channelIndex; /**< open addressing hash table on the channels selfSSRC, holds the channelContext slot + 1, 0 for an empty bucket */
+	uint16_t channelIndexSize; /**< number of buckets in channelIndex: a power of 2, at least twice channelContextSize */
 
 	/* List of available algorithms, initialised with algo implemented in cryptoWrapper but can be then be modified according to user settings */
 	uint8_t hc; /**< hash count -zrtpPacket set to 0 means we support only HMAC-SHA256 (4 bits) */
@@ -265,6 +310,7 @@ struct bzrtpContext_struct {
 	uint8_t supportedKeyAgreement[7]; /**< list of supported key agreement algorithms mapped to uint8_t */
 	uint8_t sc; /**< sas count - set to 0 means we support only base32 (4 bits) */
 	uint8_t supportedSas[7]; /**< list of supported Sas representations mapped to uint8_t */
+	bzrtpCryptoProfile_t *cryptoProfile; /**< the profile the lists above come from, NULL when they were set on this context */
 
 	/* ZIDs and cache */
 #ifdef ZIDCACHE_ENABLED
@@ -274,9 +320,9 @@ struct bzrtpContext_struct {
 #endif /* ZIDCACHE_ENABLED */
 	bctbx_mutex_t *zidCacheMutex; /**< lock access to the cache if provided **/
 	int zuid; /**< internal id used to address zid cache SIP/ZID pair binding **/
-	char *selfURI; /**< a null terminated string storing the local user URI **/
+	const char *selfURI; /**< a null terminated string storing the local user URI, interned: see bzrtp_internURI **/
 	uint8_t selfZID[12]; /**< The ZRTP Identifier of this ZRTP end point - a random if running cache less */
-	char *peerURI; /**< a null terminated string storing the peer user URI **/
+	const char *peerURI; /**< a null terminated string storing the peer user URI, interned: see bzrtp_internURI **/
 	uint8_t peerZID[12]; /**< The ZRTP Identifier of the peer ZRTP end point - given by the Hello packet */
 	uint32_t peerBzrtpVersion; /**< The Bzrtp library version used by peer, retrieved from the peer Hello packet Client identifier and used for backward compatibility in exported key computation */
 	cachedSecrets_t cachedSecret; /**< the local cached secrets */
@@ -78,6 +78,88 @@ BZRTP_EXPORT int bzrtp_cache_getZuid(void *dbPointer, const char *selfURI, const
  */
 BZRTP_EXPORT int bzrtp_cache_write_active(bzrtpContext_t *context, const char *tableName, const char **columns, uint8_t **values, size_t *lengths, uint8_t columnsCount);
 
+/**
+ * @brief Get the process wide interned copy of an URI
+ * Contexts using the same local or peer URI share one copy: interned URIs can be compared by address and bound to
+ * cache queries without copy. Each call takes a reference, to be released with bzrtp_releaseURI.
+ *
+ * @param[in]	uri		NULL terminated string
+ *
+ * @return the interned URI, NULL if uri is NULL
+ */
+BZRTP_EXPORT const char *bzrtp_internURI(const char *uri);
+
+/**
+ * @brief Release a reference on an interned URI, the URI is freed with its last reference
+ *
+ * @param[in]	internedURI		an URI returned by bzrtp_internURI, NULL is ignored
+ */
+BZRTP_EXPORT void bzrtp_releaseURI(const char *internedURI);
+
+/**
+ * @brief Get the number of references held on an interned URI
+ *
+ * @param[in]	uri		NULL terminated string, interned or not
+ *
+ * @return the number of references, 0 if this URI is not interned
+ */
+BZRTP_EXPORT int bzrtp_getInternedURIRefCount(const char *uri);
+
+/**
+ * @brief Get the shared hot secrets cache generation, incremented by each write to the shared cache
+ * To be read before fetching secrets from the sqlite cache and given to bzrtp_sharedCache_put
+ *
+ * @return the current generation, 0 if the shared cache is not attached
+ */
+uint32_t bzrtp_sharedCache_generation(void);
+
+/**
+ * @brief Look for secrets in the shared hot secrets cache, allocate and set them in secrets when found
+ *
+ * @param[in]	selfURI		local URI
+ * @param[in]	peerURI		peer URI
+ * @param[in]	peerZID		peer ZID
+ * @param[out]	zuid		the cache internal id of this selfURI/peerURI/peerZID binding
+ * @param[out]	secrets		the secrets found, buffers are allocated and must be freed by caller
+ *
+ * @return 0 when found, BZRTP_CACHE_DATA_NOTFOUND otherwise
+ */
+int bzrtp_sharedCache_get(const char *selfURI, const char *peerURI, const uint8_t peerZID[12], int *zuid, cachedSecrets_t *secrets);
+
+/**
+ * @brief Insert secrets read from the sqlite cache in the shared hot secrets cache
+ * Ignored if the shared cache was written since generation was read, or if the secrets are too long to be cached.
+ *
+ * @param[in]	selfURI		local URI
+ * @param[in]	peerURI		peer URI
+ * @param[in]	peerZID		peer ZID
+ * @param[in]	zuid		the cache internal id of this selfURI/peerURI/peerZID binding
+ * @param[in]	secrets		the secrets to cache
+ * @param[in]	generation	bzrtp_sharedCache_generation, read before the secrets were read from sqlite
+ */
+void bzrtp_sharedCache_put(const char *selfURI, const char *peerURI, const uint8_t peerZID[12], int zuid, const cachedSecrets_t *secrets, uint32_t generation);
+
+/**
+ * @brief Report to the shared hot secrets cache a write in the sqlite zrtp table
+ * Columns rs1, rs2, aux, pbx and pvs are updated in the shared cache, the entry is dropped if any other column is written.
+ *
+ * @param[in]	selfURI		local URI
+ * @param[in]	peerURI		peer URI
+ * @param[in]	peerZID		peer ZID
+ * @param[in]	columns		the columns written
+ * @param[in]	values		their values
+ * @param[in]	lengths		their values lengths
+ * @param[in]	columnsCount	length common to columns,values and lengths arrays
+ */
+void bzrtp_sharedCache_update(const char *selfURI, const char *peerURI, const uint8_t peerZID[12], const char **columns, uint8_t **values, size_t *lengths, uint8_t columnsCount);
+
+/**
+ * @brief Drop the shared hot secrets cache entries of a zuid
+ *
+ * @param[in]	zuid		the cache internal id whose secrets were written in the sqlite zrtp table
+ */
+void bzrtp_sharedCache_invalidate(int zuid);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,7 +34,11 @@
 static int bzrtp_initChannelContext(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint32_t selfSSRC, uint8_t isMain);
 static void bzrtp_destroyChannelContext(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext);
 static bzrtpChannelContext_t *getChannelContext(bzrtpContext_t *zrtpContext, uint32_t selfSSRC);
+static int processMessage(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t *zrtpPacketString, uint16_t zrtpPacketStringLength, uint8_t *adopted);
+static int bzrtp_attachChannelContext(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext);
+static void bzrtp_rebuildChannelIndex(bzrtpContext_t *zrtpContext);
 static uint8_t copyCryptoTypes(uint8_t destination[7], uint8_t source[7], uint8_t size);
+static void selectSupportedCryptoTypes(uint8_t algoType, uint8_t supportedTypes[7], uint8_t supportedTypesCount, uint8_t selectedTypes[7], uint8_t *selectedTypesCount);
 
 /*
  * Create context structure and initialise it
@@ -43,7 +47,18 @@ static uint8_t copyCryptoTypes(uint8_t destination[7], uint8_t source[7], uint8_
  *
 */
 bzrtpContext_t *bzrtp_createBzrtpContext(void) {
-	int i;
+	return bzrtp_createBzrtpContextWithProfile(NULL);
+}
+
+/*
+ * Create context structure and initialise it, supported crypto types are copied from the given profile
+ *
+ * @param[in,out]	profile		The crypto profile, NULL to use the crypto types provided by the crypto module
+ *
+ * @return The ZRTP engine context data
+ *
+*/
+bzrtpContext_t *bzrtp_createBzrtpContextWithProfile(bzrtpCryptoProfile_t *profile) {
 	/*** create and intialise the context structure ***/
 	bzrtpContext_t *context = (bzrtpContext_t *)malloc(sizeof(bzrtpContext_t));
 	memset(context, 0, sizeof(bzrtpContext_t));
@@ -66,24 +81,51 @@ bzrtpContext_t *bzrtp_createBzrtpContext(void) {
 	/* set to NULL all callbacks pointer */
 	context->zrtpCallbacks.bzrtp_statusMessage = NULL;
 	context->zrtpCallbacks.bzrtp_sendData = NULL;
+	context->zrtpCallbacks.bzrtp_getSendBuffer = NULL;
+	context->zrtpCallbacks.bzrtp_commitSendBuffer = NULL;
+	context->zrtpCallbacks.bzrtp_releaseReceiveBuffer = NULL;
 	context->zrtpCallbacks.bzrtp_srtpSecretsAvailable = NULL;
 	context->zrtpCallbacks.bzrtp_startSrtpSession = NULL;
 	context->zrtpCallbacks.bzrtp_contextReadyForExportedKeys = NULL;
-
-
-
-	for (i=1; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
-		context->channelContext[i] = NULL;
+	context->zrtpCallbacks.bzrtp_channelStatusChanged = NULL;
+	context->zrtpCallbacks.bzrtp_peerNotZRTP = NULL;
+	context->zrtpCallbacks.bzrtp_cacheReadRequested = NULL;
+
+	/* default discovery policy: retransmissions count only */
+	context->discoveryPolicy.maxHelloCount = HELLO_MAX_RETRANSMISSION_NUMBER;
+	context->discoveryPolicy.timeBudget = 0;
+	context->discoveryPolicy.byteBudget = 0;
+
+
+	/* channel table and its index are allocated when the first channel is attached */
+	context->channelContext = NULL;
+	context->channelContextSize = 0;
+	context->channelIndex = NULL;
+	context->channelIndexSize = 0;
+
+	if (profile != NULL) {
+		/* the profile lists were already selected when it was configured: just copy them and freeze the profile */
+		bctbx_mutex_lock(&profile->lock);
+		profile->isFrozen = 1;
+		profile->refCount++;
+		context->hc = copyCryptoTypes(context->supportedHash, profile->supportedHash, profile->hc);
+		context->cc = copyCryptoTypes(context->supportedCipher, profile->supportedCipher, profile->cc);
+		context->ac = copyCryptoTypes(context->supportedAuthTag, profile->supportedAuthTag, profile->ac);
+		context->kc = copyCryptoTypes(context->supportedKeyAgreement, profile->supportedKeyAgreement, profile->kc);
+		context->sc = copyCryptoTypes(context->supportedSas, profile->supportedSas, profile->sc);
+		bctbx_mutex_unlock(&profile->lock);
+		context->cryptoProfile = profile;
+	} else {
+		/* get the list of crypto algorithms provided by the crypto module */
+		/* this list may then be updated according to users settings */
+		context->hc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_HASH_TYPE, context->supportedHash);
+		context->cc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_CIPHERBLOCK_TYPE, context->supportedCipher);
+		context->ac = bzrtpUtils_getAvailableCryptoTypes(ZRTP_AUTHTAG_TYPE, context->supportedAuthTag);
+		context->kc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_KEYAGREEMENT_TYPE, context->supportedKeyAgreement);
+		context->sc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_SAS_TYPE, context->supportedSas);
+		context->cryptoProfile = NULL;
 	}
 
-	/* get the list of crypto algorithms provided by the crypto module */
-	/* this list may then be updated according to users settings */
-	context->hc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_HASH_TYPE, context->supportedHash);
-	context->cc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_CIPHERBLOCK_TYPE, context->supportedCipher);
-	context->ac = bzrtpUtils_getAvailableCryptoTypes(ZRTP_AUTHTAG_TYPE, context->supportedAuthTag);
-	context->kc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_KEYAGREEMENT_TYPE, context->supportedKeyAgreement);
-	context->sc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_SAS_TYPE, context->supportedSas);
-
 	/* initialise cached secret buffer to null */
 	context->zidCache = NULL; /* a pointer to the sqlite3 db accessor, can be NULL if running cacheless */
 	context->zidCacheMutex = NULL; /* a pointer to a mutex provided by the environment to lock database during access, ignored if NULL */
@@ -122,13 +164,15 @@ bzrtpContext_t *bzrtp_createBzrtpContext(void) {
  *
  * @param[in,out]	context			The ZRTP context we're dealing with
  * @param[in]		zidCache		Used by internal function to access cache: turn into a sqlite3 pointer if cache is enabled
- * @param[in]   	selfURI			Local URI used for this communication, needed to perform cache operation, NULL terminated string, duplicated by this function
- * @param[in]   	peerURI			Peer URI used for this communication, needed to perform cache operation, NULL terminated string, duplicated by this function
+ * @param[in]   	selfURI			Local URI used for this communication, needed to perform cache operation, NULL terminated string, interned by this function
+ * @param[in]   	peerURI			Peer URI used for this communication, needed to perform cache operation, NULL terminated string, interned by this function
  *
  * @return 0 or BZRTP_CACHE_SETUP(if cache is populated by this call) on success, error code otherwise
 */
 int bzrtp_setZIDCache(bzrtpContext_t *context, void *zidCache, const char *selfURI, const char *peerURI) {
 #ifdef ZIDCACHE_ENABLED
+	const char *uri;
+
 	/* is zrtp context valid */
 	if (context==NULL) {
 		return BZRTP_ERROR_INVALIDCONTEXT;
@@ -136,15 +180,14 @@ int bzrtp_setZIDCache(bzrtpContext_t *context, void *zidCache, const char *selfU
 
 	/* zidCache pointer is actually a pointer to sqlite3 db, store it in context */
 	context->zidCache = (sqlite3 *)zidCache;
-	if (context->selfURI != NULL) {
-		free(context->selfURI);
-	}
-	context->selfURI = strdup(selfURI);
+	/* URIs are interned: contexts using the same ones share a single copy */
+	uri = bzrtp_internURI(selfURI);
+	bzrtp_releaseURI(context->selfURI);
+	context->selfURI = uri;
 
-	if (context->peerURI != NULL) {
-		free(context->peerURI);
-	}
-	context->peerURI = strdup(peerURI);
+	uri = bzrtp_internURI(peerURI);
+	bzrtp_releaseURI(context->peerURI);
+	context->peerURI = uri;
 
 	/* and init the cache(create needed tables if they don't exist) */
 	return bzrtp_initCache_lock(context->zidCache, context->zidCacheMutex);
@@ -159,8 +202,8 @@ int bzrtp_setZIDCache(bzrtpContext_t *context, void *zidCache, const char *selfU
  *
  * @param[in,out]	context			The ZRTP context we're dealing with
  * @param[in]		zidCache		Used by internal function to access cache: turn into a sqlite3 pointer if cache is enabled
- * @param[in]		selfURI			Local URI used for this communication, needed to perform cache operation, NULL terminated string, duplicated by this function
- * @param[in]		peerURI			Peer URI used for this communication, needed to perform cache operation, NULL terminated string, duplicated by this function
+ * @param[in]		selfURI			Local URI used for this communication, needed to perform cache operation, NULL terminated string, interned by this function
+ * @param[in]		peerURI			Peer URI used for this communication, needed to perform cache operation, NULL terminated string, interned by this function
  * @param[in]		zidCacheMutex		Points to a mutex used to lock zidCache database access
  *
  * @return 0 or BZRTP_CACHE_SETUP(if cache is populated by this call) on success, error code otherwise
@@ -193,6 +236,8 @@ int bzrtp_setZIDCache_lock(bzrtpContext_t *context, void *zidCache, const char *
  * @return 0 on success
  */
 int bzrtp_initBzrtpContext(bzrtpContext_t *context, uint32_t selfSSRC) {
+	bzrtpChannelContext_t *zrtpChannelContext;
+	int retval;
 
 	/* is zrtp context valid */
 	if (context==NULL) {
@@ -232,10 +277,19 @@ int bzrtp_initBzrtpContext(bzrtpContext_t *context, uint32_t selfSSRC) {
 		}
 	}
 
-	/* allocate 1 channel context, set all the others pointers to NULL */
-	context->channelContext[0] = (bzrtpChannelContext_t *)malloc(sizeof(bzrtpChannelContext_t));
-	memset(context->channelContext[0], 0, sizeof(bzrtpChannelContext_t));
-	return bzrtp_initChannelContext(context, context->channelContext[0], selfSSRC, 1);
+	/* allocate the main channel context, it takes the first slot of the channel table */
+	zrtpChannelContext = (bzrtpChannelContext_t *)malloc(sizeof(bzrtpChannelContext_t));
+	memset(zrtpChannelContext, 0, sizeof(bzrtpChannelContext_t));
+	retval = bzrtp_initChannelContext(context, zrtpChannelContext, selfSSRC, 1);
+	if (retval != 0) {
+		free(zrtpChannelContext);
+		return retval;
+	}
+	retval = bzrtp_attachChannelContext(context, zrtpChannelContext);
+	if (retval != 0) {
+		bzrtp_destroyChannelContext(context, zrtpChannelContext);
+	}
+	return retval;
 }
 
 /*
@@ -255,7 +309,7 @@ int bzrtp_destroyBzrtpContext(bzrtpContext_t *context, uint32_t selfSSRC) {
 	}
 
 	/* Find the channel to be destroyed, destroy it and check if we have anymore valid channels */
-	for (i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+	for (i=0; i<context->channelContextSize; i++) {
 		if (context->channelContext[i] != NULL) {
 			if (context->channelContext[i]->selfSSRC == selfSSRC) {
 				bzrtp_destroyChannelContext(context, context->channelContext[i]);
@@ -267,25 +321,22 @@ int bzrtp_destroyBzrtpContext(bzrtpContext_t *context, uint32_t selfSSRC) {
 	}
 
 	if (validChannelsNumber>0) {
+		bzrtp_rebuildChannelIndex(context); /* the destroyed channel must not be found anymore */
 		return validChannelsNumber; /* we have more valid channels, keep the zrtp context */
 	}
 
+	/* We have no more channel, release the channel table */
+	free(context->channelContext);
+	context->channelContext = NULL;
+	context->channelContextSize = 0;
+	free(context->channelIndex);
+	context->channelIndex = NULL;
+	context->channelIndexSize = 0;
+
 
 	/* We have no more channel, destroy the zrtp context */
-	/* key agreement context shall already been destroyed after s0 computation, but just in case */
-	if (context->keyAgreementContext != NULL) {
-		if (bzrtp_isKem(context->keyAgreementAlgo)) {
-			bzrtp_destroyKEMContext((bzrtp_KEMContext_t *)context->keyAgreementContext);
-		}
-		else if (context->keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || context->keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) {
-			bctbx_DestroyECDHContext((bctbx_ECDHContext_t *)context->keyAgreementContext);
-		}
-		else if (context->keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH2k || context->keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH3k) {
-			bctbx_DestroyDHMContext((bctbx_DHMContext_t *)context->keyAgreementContext);
-		}
-		context->keyAgreementContext = NULL;
-		context->keyAgreementAlgo = ZRTP_UNSET_ALGO;
-	}
+	/* key agreement context in use shall already been destroyed after s0 computation, but just in case, prepared and pooled ones are still there */
+	bzrtp_destroyAllKeyAgreementContexts(context);
 
 	/* Destroy keys and secrets */
 	/* rs1, rs2, pbxsecret and auxsecret shall already been destroyed, just in case */
@@ -322,8 +373,8 @@ int bzrtp_destroyBzrtpContext(bzrtpContext_t *context, uint32_t selfSSRC) {
 		context->ZRTPSess=NULL;
 	}
 
-	free(context->selfURI);
-	free(context->peerURI);
+	bzrtp_releaseURI(context->selfURI);
+	bzrtp_releaseURI(context->peerURI);
 
 	/* transient shared auxiliary secret */
 	if (context->transientAuxSecret != NULL) {
@@ -332,6 +383,9 @@ int bzrtp_destroyBzrtpContext(bzrtpContext_t *context, uint32_t selfSSRC) {
 		context->transientAuxSecret=NULL;
 	}
 
+	bzrtp_cryptoProfileUnref(context->cryptoProfile);
+	context->cryptoProfile = NULL;
+
 	/* destroy the RNG context at the end because it may be needed to destroy some keys */
 	bctbx_rng_context_free(context->RNGContext);
 	context->RNGContext = NULL;
@@ -366,7 +420,7 @@ int bzrtp_setCallbacks(bzrtpContext_t *context, const bzrtpCallbacks_t *cbs) {
  */
 int bzrtp_addChannel(bzrtpContext_t *zrtpContext, uint32_t selfSSRC) {
 	bzrtpChannelContext_t *zrtpChannelContext = NULL;
-	int i=0;
+	int retval;
 
 	/* is zrtp context valid */
 	if (zrtpContext==NULL) {
@@ -378,28 +432,26 @@ int bzrtp_addChannel(bzrtpContext_t *zrtpContext, uint32_t selfSSRC) {
 		return BZRTP_ERROR_CONTEXTNOTREADY;
 	}
 
-	/* get the first free channel context from ZRTP context and create a channel context */
-	while(i<ZRTP_MAX_CHANNEL_NUMBER && zrtpChannelContext==NULL) {
-		if (zrtpContext->channelContext[i] == NULL) {
-			int retval;
-			zrtpChannelContext = (bzrtpChannelContext_t *)malloc(sizeof(bzrtpChannelContext_t));
-			memset(zrtpChannelContext, 0, sizeof(bzrtpChannelContext_t));
-			retval = bzrtp_initChannelContext(zrtpContext, zrtpChannelContext, selfSSRC, 0);
-			if (retval != 0) {
-				free(zrtpChannelContext);
-				return retval;
-			}
-		} else {
-			i++;
-		}
+	/* SSRC identifies the channel, it must be unique in this context */
+	if (getChannelContext(zrtpContext, selfSSRC) != NULL) {
+		return BZRTP_ERROR_UNABLETOADDCHANNEL;
 	}
 
-	if (zrtpChannelContext == NULL) {
-		return BZRTP_ERROR_UNABLETOADDCHANNEL;
+	/* create a channel context */
+	zrtpChannelContext = (bzrtpChannelContext_t *)malloc(sizeof(bzrtpChannelContext_t));
+	memset(zrtpChannelContext, 0, sizeof(bzrtpChannelContext_t));
+	retval = bzrtp_initChannelContext(zrtpContext, zrtpChannelContext, selfSSRC, 0);
+	if (retval != 0) {
+		free(zrtpChannelContext);
+		return retval;
 	}
 
 	/* attach the created channel to the ZRTP context */
-	zrtpContext->channelContext[i] = zrtpChannelContext;
+	retval = bzrtp_attachChannelContext(zrtpContext, zrtpChannelContext);
+	if (retval != 0) {
+		bzrtp_destroyChannelContext(zrtpContext, zrtpChannelContext);
+		return retval;
+	}
 
 	return 0;
 
@@ -531,6 +583,48 @@ int bzrtp_setClientData(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, void *cl
  * @return 	0 on success, errorcode otherwise
  */
 int bzrtp_processMessage(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t *zrtpPacketString, uint16_t zrtpPacketStringLength) {
+	return processMessage(zrtpContext, selfSSRC, zrtpPacketString, zrtpPacketStringLength, NULL);
+}
+
+/*
+ * @brief Process a received message, transferring the ownership of the receive buffer to the library
+ *
+ * @param[in,out]	zrtpContext				The ZRTP context we're dealing with
+ * @param[in]		selfSSRC				The SSRC identifying the channel receiving the message
+ * @param[in]		zrtpPacketString		The packet received, its ownership is transferred to the library
+ * @param[in]		zrtpPacketStringLength	Length of the packet in bytes
+ *
+ * @return 	0 on success, errorcode otherwise
+ */
+int bzrtp_processMessageTransfer(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t *zrtpPacketString, uint16_t zrtpPacketStringLength) {
+	int retval;
+	uint8_t adopted = 0;
+	bzrtpChannelContext_t *zrtpChannelContext;
+
+	if (zrtpContext == NULL) {
+		return BZRTP_ERROR_INVALIDCONTEXT;
+	}
+
+	retval = processMessage(zrtpContext, selfSSRC, zrtpPacketString, zrtpPacketStringLength, &adopted);
+
+	/* the buffer was not retained by a packet: give it back right away */
+	if (adopted == 0) {
+		if (zrtpContext->zrtpCallbacks.bzrtp_releaseReceiveBuffer != NULL) {
+			zrtpChannelContext = getChannelContext(zrtpContext, selfSSRC);
+			zrtpContext->zrtpCallbacks.bzrtp_releaseReceiveBuffer((zrtpChannelContext!=NULL)?zrtpChannelContext->clientData:NULL, zrtpPacketString);
+		} else {
+			free(zrtpPacketString);
+		}
+	}
+
+	return retval;
+}
+
+/*
+ * @brief Process a received message, when adopted is not NULL the packet takes the ownership of the packet string
+ * and adopted is set to 1, the packet string is then released when the packet is freed
+ */
+static int processMessage(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t *zrtpPacketString, uint16_t zrtpPacketStringLength, uint8_t *adopted) {
 	int retval;
 	bzrtpPacket_t *zrtpPacket;
 	bzrtpEvent_t event;
@@ -542,6 +636,34 @@ int bzrtp_processMessage(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t
 		return BZRTP_ERROR_INVALIDCONTEXT;
 	}
 
+	/* Ping does not involve the channel state: answer it right away, even if the channel is not started yet.
+	 * The PingACK is built directly in the transport buffer when the client provides one, on the stack otherwise */
+	if (zrtpContext->isInitialised == 1 && zrtpPacketStringLength == BZRTP_PING_PACKET_LENGTH) {
+		uint8_t pingAckPacket[BZRTP_PINGACK_PACKET_LENGTH];
+		uint16_t pingAckPacketLength = BZRTP_PINGACK_PACKET_LENGTH;
+		uint8_t *transportBuffer = NULL;
+
+		/* request a transport buffer only once we know a PingACK will be written in it and committed */
+		if (zrtpContext->zrtpCallbacks.bzrtp_getSendBuffer!=NULL && zrtpContext->zrtpCallbacks.bzrtp_commitSendBuffer!=NULL
+			&& bzrtp_pingPacketCheck(zrtpPacketString, zrtpPacketStringLength) == 0) {
+			transportBuffer = zrtpContext->zrtpCallbacks.bzrtp_getSendBuffer(zrtpChannelContext->clientData, BZRTP_PINGACK_PACKET_LENGTH);
+		}
+
+		if (transportBuffer != NULL) {
+			if (bzrtp_buildPingAck(zrtpPacketString, zrtpPacketStringLength, zrtpContext->selfZID, zrtpChannelContext->selfSSRC, zrtpChannelContext->selfSequenceNumber, transportBuffer, &pingAckPacketLength) == 0) {
+				zrtpContext->zrtpCallbacks.bzrtp_commitSendBuffer(zrtpChannelContext->clientData, transportBuffer, pingAckPacketLength);
+				zrtpChannelContext->selfSequenceNumber++;
+				return 0;
+			}
+		} else if (bzrtp_buildPingAck(zrtpPacketString, zrtpPacketStringLength, zrtpContext->selfZID, zrtpChannelContext->selfSSRC, zrtpChannelContext->selfSequenceNumber, pingAckPacket, &pingAckPacketLength) == 0) {
+			if (zrtpContext->zrtpCallbacks.bzrtp_sendData!=NULL) {
+				zrtpContext->zrtpCallbacks.bzrtp_sendData(zrtpChannelContext->clientData, pingAckPacket, pingAckPacketLength);
+				zrtpChannelContext->selfSequenceNumber++;
+			}
+			return 0;
+		}
+	}
+
 	/* check the context is initialised (we may receive packets before initialisation is complete i.e. between channel initialisation and channel start) */
 	if (zrtpChannelContext->stateMachine == NULL) {
 		return BZRTP_ERROR_INVALIDCONTEXT; /* drop the message */
@@ -560,31 +682,36 @@ int bzrtp_processMessage(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t
 		return retval;
 	}
 
-	/* Intercept error(Not managed yet) and ping zrtp packets */
-	/* if we have a ping packet, just answer with a ping ACK and do not forward to the state machine */
-	if (zrtpPacket->messageType == MSGTYPE_PING) {
-		bzrtpPacket_t *pingAckPacket = NULL;
+	/* the receive buffer is ours: the packet references it instead of keeping a copy. Reassembled fragments are not
+	 * held in the receive buffer, they are copied as usual */
+	if (adopted != NULL && incomingPacket == zrtpPacketString) {
+		zrtpPacket->packetString = zrtpPacketString;
+		zrtpPacket->packetStringRelease = zrtpContext->zrtpCallbacks.bzrtp_releaseReceiveBuffer;
+		zrtpPacket->packetStringReleaseData = zrtpChannelContext->clientData;
+		*adopted = 1;
+	}
 
-		bzrtp_packetParser(zrtpContext, zrtpChannelContext, incomingPacket, incomingPacketLength, zrtpPacket);
-		/* store ping packet in the channel context as packet creator will need it to create the pingACK */
-		zrtpChannelContext->pingPacket = zrtpPacket;
-		/* create the pingAck packet */
-		pingAckPacket = bzrtp_createZrtpPacket(zrtpContext, zrtpChannelContext, MSGTYPE_PINGACK, &retval);
+	/* Intercept error and ping zrtp packets */
+	/* an Error packet terminates the key agreement whatever the current state is: acknowledge it and stop the channel right away */
+	if (zrtpPacket->messageType == MSGTYPE_ERROR) {
+		retval = bzrtp_packetParser(zrtpContext, zrtpChannelContext, incomingPacket, incomingPacketLength, zrtpPacket);
 		if (retval == 0) {
-			retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, pingAckPacket);
-			if (retval==0 && zrtpContext->zrtpCallbacks.bzrtp_sendData!=NULL) { /* send the packet */
-				bzrtp_packetSetSequenceNumber(pingAckPacket, zrtpChannelContext->selfSequenceNumber);
-				zrtpContext->zrtpCallbacks.bzrtp_sendData(zrtpChannelContext->clientData, pingAckPacket->packetString, pingAckPacket->messageLength+ZRTP_PACKET_OVERHEAD);
-				zrtpChannelContext->selfSequenceNumber++;
-			}
+			retval = bzrtp_processErrorMessage(zrtpContext, zrtpChannelContext, zrtpPacket);
 		}
+		bzrtp_freeZrtpPacket(zrtpPacket);
+		return retval;
+	}
 
-		/* free packets and reset channel context storage */
+	/* ErrorACK just confirms peer got our Error, there is nothing left to do on this channel */
+	if (zrtpPacket->messageType == MSGTYPE_ERRORACK) {
 		bzrtp_freeZrtpPacket(zrtpPacket);
-		bzrtp_freeZrtpPacket(pingAckPacket);
-		zrtpChannelContext->pingPacket = NULL;
+		return 0;
+	}
 
-		return retval;
+	/* a valid Ping was answered before the packet check, anything else of this type is malformed: drop it */
+	if (zrtpPacket->messageType == MSGTYPE_PING) {
+		bzrtp_freeZrtpPacket(zrtpPacket);
+		return BZRTP_PARSER_ERROR_INVALIDMESSAGE;
 	}
 
 	/* build a packet event of it and send it to the state machine */
@@ -700,6 +827,14 @@ int bzrtp_resetRetransmissionTimer(bzrtpContext_t *zrtpContext, uint32_t selfSSR
 	if (zrtpChannelContext == NULL) {
 		return BZRTP_ERROR_INVALIDCONTEXT;
 	}
+	/* a channel in discovery with Hello suspended stays silent until client resumes it */
+	if (zrtpChannelContext->stateMachine == state_discovery_init) {
+		if (zrtpChannelContext->helloSuspended == 1) {
+			return 0;
+		}
+		/* give the discovery a full budget again */
+		zrtpChannelContext->discoveryBytesSent = 0;
+	}
 	/* reset timer only when not in secure mode yet and for initiator(engine start as initiator so if we call this function in discovery phase, it will reset the timer */
 	if ((zrtpChannelContext->isSecure == 0) && (zrtpChannelContext->role == BZRTP_ROLE_INITIATOR)) {
 		zrtpChannelContext->timer.status = BZRTP_TIMER_ON;
@@ -716,6 +851,144 @@ int bzrtp_resetRetransmissionTimer(bzrtpContext_t *zrtpContext, uint32_t selfSSR
 	return 0;
 }
 
+/*
+ * @brief Set the discovery policy of a ZRTP context
+ *
+ * @param[in,out]	zrtpContext		The ZRTP context we're dealing with
+ * @param[in]		policy			The policy to apply, copied into the context
+ *
+ * @return 0 on success, error code otherwise
+ */
+int bzrtp_setDiscoveryPolicy(bzrtpContext_t *zrtpContext, const bzrtpDiscoveryPolicy_t *policy) {
+	if (zrtpContext == NULL) {
+		return BZRTP_ERROR_INVALIDCONTEXT;
+	}
+	if (policy == NULL || policy->maxHelloCount < 0) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+
+	zrtpContext->discoveryPolicy = *policy;
+	return 0;
+}
+
+/*
+ * @brief Get the discovery policy of a ZRTP context
+ *
+ * @param[in]		zrtpContext		The ZRTP context we're dealing with
+ * @param[out]		policy			The current policy
+ *
+ * @return 0 on success, error code otherwise
+ */
+int bzrtp_getDiscoveryPolicy(const bzrtpContext_t *zrtpContext, bzrtpDiscoveryPolicy_t *policy) {
+	if (zrtpContext == NULL) {
+		return BZRTP_ERROR_INVALIDCONTEXT;
+	}
+	if (policy == NULL) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+
+	*policy = zrtpContext->discoveryPolicy;
+	return 0;
+}
+
+/*
+ * @brief Suspend or resume the Hello sending of a channel in discovery
+ *
+ * @param[in,out]	zrtpContext		The ZRTP context we're dealing with
+ * @param[in]		selfSSRC		The SSRC identifying the channel
+ * @param[in]		suspended		1 to suspend the Hello sending, 0 to resume it
+ *
+ * @return 0 on success, error code otherwise
+ */
+int bzrtp_setHelloSuspended(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8_t suspended) {
+	/* get channel context */
+	bzrtpChannelContext_t *zrtpChannelContext = getChannelContext(zrtpContext, selfSSRC);
+
+	if (zrtpChannelContext == NULL) {
+		return BZRTP_ERROR_INVALIDCONTEXT;
+	}
+
+	zrtpChannelContext->helloSuspended = (suspended == 0)?0:1;
+
+	/* once peer answered, the Hello are not ours to suspend anymore: the protocol needs them */
+	if (zrtpChannelContext->stateMachine != state_discovery_init) {
+		return 0;
+	}
+
+	if (zrtpChannelContext->helloSuspended == 1) {
+		zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+	} else {
+		/* restart the discovery with a full budget, first Hello is sent at next timer tick */
+		zrtpChannelContext->timer.status = BZRTP_TIMER_ON;
+		zrtpChannelContext->timer.firingTime = 0;
+		zrtpChannelContext->timer.firingCount = 0;
+		zrtpChannelContext->timer.timerStep = HELLO_BASE_RETRANSMISSION_STEP;
+		zrtpChannelContext->discoveryBytesSent = 0;
+		bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ONGOING);
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Read from cache the secrets associated to the peer of a channel waiting for it
+ *
+ * @param[in,out]	zrtpContext		The ZRTP context we're dealing with
+ * @param[in]		selfSSRC		The SSRC identifying the channel
+ *
+ * @return 0 on success, error code otherwise
+ */
+int bzrtp_readPeerCache(bzrtpContext_t *zrtpContext, uint32_t selfSSRC) {
+	int retval;
+	/* get channel context */
+	bzrtpChannelContext_t *zrtpChannelContext = getChannelContext(zrtpContext, selfSSRC);
+
+	if (zrtpChannelContext == NULL) {
+		return BZRTP_ERROR_INVALIDCONTEXT;
+	}
+
+	if (zrtpChannelContext->cacheReadStatus != BZRTP_CACHEREAD_PENDING) {
+		return BZRTP_ERROR_CONTEXTNOTREADY;
+	}
+
+	/* peer ZID was set when the Hello was accepted and the channel does not touch the cached secrets while waiting */
+	retval = bzrtp_getPeerAssociatedSecrets(zrtpContext, zrtpContext->peerZID);
+	zrtpChannelContext->cacheReadStatus = BZRTP_CACHEREAD_DONE;
+	return retval;
+}
+
+/*
+ * @brief Resume the processing of the peer Hello once bzrtp_readPeerCache returned
+ *
+ * @param[in,out]	zrtpContext		The ZRTP context we're dealing with
+ * @param[in]		selfSSRC		The SSRC identifying the channel
+ *
+ * @return 0 on success, error code otherwise
+ */
+int bzrtp_cacheReadCompleted(bzrtpContext_t *zrtpContext, uint32_t selfSSRC) {
+	bzrtpEvent_t cacheReadEvent;
+	/* get channel context */
+	bzrtpChannelContext_t *zrtpChannelContext = getChannelContext(zrtpContext, selfSSRC);
+
+	if (zrtpChannelContext == NULL) {
+		return BZRTP_ERROR_INVALIDCONTEXT;
+	}
+
+	if (zrtpChannelContext->stateMachine != state_discovery_waitingForCache) {
+		return BZRTP_ERROR_CONTEXTNOTREADY;
+	}
+
+	/* create a cache read event and send it to the state machine */
+	cacheReadEvent.eventType = BZRTP_EVENT_CACHEREAD;
+	cacheReadEvent.bzrtpPacketString = NULL;
+	cacheReadEvent.bzrtpPacketStringLength = 0;
+	cacheReadEvent.bzrtpPacket = NULL;
+	cacheReadEvent.zrtpContext = zrtpContext;
+	cacheReadEvent.zrtpChannelContext = zrtpChannelContext;
+
+	return zrtpChannelContext->stateMachine(cacheReadEvent);
+}
+
 /**
  * @brief Get the supported crypto types
  *
@@ -765,37 +1038,129 @@ int bzrtp_setSupportedCryptoTypes(bzrtpContext_t *zrtpContext, uint8_t algoType,
 		return BZRTP_ERROR_CONTEXTNOTREADY;
 	}
 
-	uint8_t implementedTypes[256];
-	uint8_t implementedTypesCount;
-
-	implementedTypesCount = bzrtpUtils_getAllAvailableCryptoTypes(algoType, implementedTypes);
+	/* the lists of this context are not the profile ones anymore */
+	bzrtp_cryptoProfileUnref(zrtpContext->cryptoProfile);
+	zrtpContext->cryptoProfile = NULL;
 
 	switch(algoType) {
 	case ZRTP_HASH_TYPE:
-		zrtpContext->hc = bzrtp_selectCommonAlgo(supportedTypes, supportedTypesCount, implementedTypes, implementedTypesCount, zrtpContext->supportedHash);
-		bzrtp_addMandatoryCryptoTypesIfNeeded(algoType, zrtpContext->supportedHash, &zrtpContext->hc);
+		selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, zrtpContext->supportedHash, &zrtpContext->hc);
 		break;
 	case ZRTP_CIPHERBLOCK_TYPE:
-		zrtpContext->cc = bzrtp_selectCommonAlgo(supportedTypes, supportedTypesCount, implementedTypes, implementedTypesCount, zrtpContext->supportedCipher);
-		bzrtp_addMandatoryCryptoTypesIfNeeded(algoType, zrtpContext->supportedCipher, &zrtpContext->cc);
+		selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, zrtpContext->supportedCipher, &zrtpContext->cc);
 		break;
 	case ZRTP_AUTHTAG_TYPE:
-		zrtpContext->ac = bzrtp_selectCommonAlgo(supportedTypes, supportedTypesCount, implementedTypes, implementedTypesCount, zrtpContext->supportedAuthTag);
-		bzrtp_addMandatoryCryptoTypesIfNeeded(algoType, zrtpContext->supportedAuthTag, &zrtpContext->ac);
+		selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, zrtpContext->supportedAuthTag, &zrtpContext->ac);
 		break;
 	case ZRTP_KEYAGREEMENT_TYPE:
-		zrtpContext->kc = bzrtp_selectCommonAlgo(supportedTypes, supportedTypesCount, implementedTypes, implementedTypesCount, zrtpContext->supportedKeyAgreement);
-		bzrtp_addMandatoryCryptoTypesIfNeeded(algoType, zrtpContext->supportedKeyAgreement, &zrtpContext->kc);
+		selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, zrtpContext->supportedKeyAgreement, &zrtpContext->kc);
 		break;
 	case ZRTP_SAS_TYPE:
-		zrtpContext->sc = bzrtp_selectCommonAlgo(supportedTypes, supportedTypesCount, implementedTypes, implementedTypesCount, zrtpContext->supportedSas);
-		bzrtp_addMandatoryCryptoTypesIfNeeded(algoType, zrtpContext->supportedSas, &zrtpContext->sc);
+		selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, zrtpContext->supportedSas, &zrtpContext->sc);
 		break;
 	}
 
 	return 0;
 }
 
+/*
+ * @brief Create a crypto profile holding all the crypto types provided by the crypto module
+ *
+ * @return The crypto profile, with a reference count of 1
+ */
+bzrtpCryptoProfile_t *bzrtp_createCryptoProfile(void) {
+	bzrtpCryptoProfile_t *profile = (bzrtpCryptoProfile_t *)malloc(sizeof(bzrtpCryptoProfile_t));
+	memset(profile, 0, sizeof(bzrtpCryptoProfile_t));
+
+	bctbx_mutex_init(&profile->lock, NULL);
+	profile->refCount = 1;
+	profile->isFrozen = 0;
+
+	profile->hc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_HASH_TYPE, profile->supportedHash);
+	profile->cc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_CIPHERBLOCK_TYPE, profile->supportedCipher);
+	profile->ac = bzrtpUtils_getAvailableCryptoTypes(ZRTP_AUTHTAG_TYPE, profile->supportedAuthTag);
+	profile->kc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_KEYAGREEMENT_TYPE, profile->supportedKeyAgreement);
+	profile->sc = bzrtpUtils_getAvailableCryptoTypes(ZRTP_SAS_TYPE, profile->supportedSas);
+
+	return profile;
+}
+
+/*
+ * @brief set the supported crypto types of a profile, only before any context is created with it
+ *
+ * @param[in,out]	profile					The crypto profile
+ * @param[in]		algoType				mapped to defines, must be in [ZRTP_HASH_TYPE, ZRTP_CIPHERBLOCK_TYPE, ZRTP_AUTHTAG_TYPE, ZRTP_KEYAGREEMENT_TYPE or ZRTP_SAS_TYPE]
+ * @param[in]		supportedTypes			mapped to uint8_t value of the 4 char strings giving the supported types as string according to rfc section 5.1.2 to 5.1.6
+ * @param[in]		supportedTypesCount		number of supported crypto types
+ *
+ * @return 0 on success, error code otherwise
+ */
+int bzrtp_setCryptoProfileSupportedTypes(bzrtpCryptoProfile_t *profile, uint8_t algoType, uint8_t supportedTypes[7], uint8_t supportedTypesCount) {
+	int retval = 0;
+
+	if (profile == NULL) {
+		return BZRTP_ERROR_INVALIDCONTEXT;
+	}
+
+	bctbx_mutex_lock(&profile->lock);
+	if (profile->isFrozen) { /* contexts already use it, it is immutable */
+		retval = BZRTP_ERROR_CONTEXTNOTREADY;
+	} else {
+		switch(algoType) {
+		case ZRTP_HASH_TYPE:
+			selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, profile->supportedHash, &profile->hc);
+			break;
+		case ZRTP_CIPHERBLOCK_TYPE:
+			selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, profile->supportedCipher, &profile->cc);
+			break;
+		case ZRTP_AUTHTAG_TYPE:
+			selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, profile->supportedAuthTag, &profile->ac);
+			break;
+		case ZRTP_KEYAGREEMENT_TYPE:
+			selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, profile->supportedKeyAgreement, &profile->kc);
+			break;
+		case ZRTP_SAS_TYPE:
+			selectSupportedCryptoTypes(algoType, supportedTypes, supportedTypesCount, profile->supportedSas, &profile->sc);
+			break;
+		}
+	}
+	bctbx_mutex_unlock(&profile->lock);
+
+	return retval;
+}
+
+/*
+ * @brief Take a reference on a crypto profile
+ */
+bzrtpCryptoProfile_t *bzrtp_cryptoProfileRef(bzrtpCryptoProfile_t *profile) {
+	if (profile != NULL) {
+		bctbx_mutex_lock(&profile->lock);
+		profile->refCount++;
+		bctbx_mutex_unlock(&profile->lock);
+	}
+	return profile;
+}
+
+/*
+ * @brief Release a reference on a crypto profile, destroy it with the last one
+ */
+void bzrtp_cryptoProfileUnref(bzrtpCryptoProfile_t *profile) {
+	int refCount;
+
+	if (profile == NULL) {
+		return;
+	}
+
+	bctbx_mutex_lock(&profile->lock);
+	refCount = --profile->refCount;
+	bctbx_mutex_unlock(&profile->lock);
+
+	if (refCount == 0) {
+		bctbx_mutex_destroy(&profile->lock);
+		free(profile);
+	}
+}
+
 
 int bzrtp_setFlags(bzrtpContext_t *zrtpContext, uint8_t flagId, uint8_t value) {
 #ifdef GOCLEAR_ENABLED
@@ -879,6 +1244,7 @@ int bzrtp_setPeerHelloHash(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8
 			/* note: caller may decide to abort the ZRTP session */
 			/* reset state Machine */
 			zrtpChannelContext->stateMachine = NULL;
+			bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_INITIALISED);
 
 			/* set timer off */
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
@@ -914,6 +1280,8 @@ int bzrtp_setPeerHelloHash(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, uint8
 				bzrtp_freeZrtpPacket(zrtpChannelContext->peerPackets[i]);
 				zrtpChannelContext->peerPackets[i] = NULL;
 			}
+			zrtpChannelContext->peerHVerified = 0;
+			zrtpChannelContext->peerPacketsMACVerified = 0;
 
 			/* destroy and free the srtp and sas struture */
 			bzrtp_DestroyKey(zrtpChannelContext->srtpSecrets.selfSrtpKey, zrtpChannelContext->srtpSecrets.selfSrtpKeyLength, zrtpContext->RNGContext);
@@ -1036,7 +1404,7 @@ int bzrtp_setAuxiliarySharedSecret(bzrtpContext_t *zrtpContext, const uint8_t *a
 		return BZRTP_ERROR_INVALIDCONTEXT;
 	}
 
-	if (zrtpContext->channelContext[0] && zrtpContext->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID] != NULL) {
+	if (zrtpContext->channelContext != NULL && zrtpContext->channelContext[0] && zrtpContext->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID] != NULL) {
 		return BZRTP_ERROR_CONTEXTNOTREADY;
 	}
 
@@ -1088,6 +1456,10 @@ int bzrtp_getChannelStatus(bzrtpContext_t *zrtpContext, uint32_t selfSSRC) {
 		return BZRTP_CHANNEL_INITIALISED;
 	}
 
+	if (zrtpChannelContext->channelStatus == BZRTP_CHANNEL_ERROR) {
+		return BZRTP_CHANNEL_ERROR;
+	}
+
 	if (zrtpChannelContext->isSecure == 1) {
 		return BZRTP_CHANNEL_SECURE;
 	}
@@ -1101,6 +1473,16 @@ int bzrtp_getChannelStatus(bzrtpContext_t *zrtpContext, uint32_t selfSSRC) {
 
 /* Local functions implementation */
 
+/**
+ * @brief Spread the SSRC bits over the index buckets (32 bits integer finalizer)
+ */
+static inline uint16_t channelIndexHash(uint32_t SSRC) {
+	SSRC ^= SSRC >> 16;
+	SSRC *= 0x7feb352d;
+	SSRC ^= SSRC >> 15;
+	return (uint16_t)SSRC;
+}
+
 /**
  * @brief Look in the given ZRTP context for a channel referenced with given SSRC
  *
@@ -1110,22 +1492,120 @@ int bzrtp_getChannelStatus(bzrtpContext_t *zrtpContext, uint32_t selfSSRC) {
  * @return 		a pointer to the channel context, NULL if the context is invalid or channel not found
  */
 static bzrtpChannelContext_t *getChannelContext(bzrtpContext_t *zrtpContext, uint32_t selfSSRC) {
-	int i;
+	uint16_t mask, bucket;
 
-	if (zrtpContext==NULL) {
+	if (zrtpContext==NULL || zrtpContext->channelIndex==NULL) {
 		return NULL;
 	}
 
-	for (i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
-		if (zrtpContext->channelContext[i]!=NULL) {
-			if (zrtpContext->channelContext[i]->selfSSRC == selfSSRC) {
-				return zrtpContext->channelContext[i];
-			}
+	/* linear probing from the SSRC hash until we find it or hit an empty bucket */
+	mask = zrtpContext->channelIndexSize - 1;
+	for (bucket = channelIndexHash(selfSSRC) & mask; zrtpContext->channelIndex[bucket] != 0; bucket = (bucket+1) & mask) {
+		bzrtpChannelContext_t *zrtpChannelContext = zrtpContext->channelContext[zrtpContext->channelIndex[bucket]-1];
+		if (zrtpChannelContext->selfSSRC == selfSSRC) {
+			return zrtpChannelContext;
 		}
 	}
 
 	return NULL; /* found no channel with this SSRC */
 }
+
+/**
+ * @brief Insert a channel table slot in the SSRC index. The index must have at least one empty bucket
+ *
+ * @param[in,out]	zrtpContext	The zrtp context holding the channel table and its index
+ * @param[in]		slot		The slot of the channel in the channel table
+ */
+static void channelIndexInsert(bzrtpContext_t *zrtpContext, uint16_t slot) {
+	uint16_t mask = zrtpContext->channelIndexSize - 1;
+	uint16_t bucket = channelIndexHash(zrtpContext->channelContext[slot]->selfSSRC) & mask;
+
+	while (zrtpContext->channelIndex[bucket] != 0) {
+		bucket = (bucket+1) & mask;
+	}
+	zrtpContext->channelIndex[bucket] = slot+1;
+}
+
+/**
+ * @brief Rebuild the SSRC index from the channel table
+ * Used when the table grows and when a channel is removed: this happens rarely so we do not bother with deletion in the open addressing table
+ *
+ * @param[in,out]	zrtpContext	The zrtp context holding the channel table and its index
+ */
+static void bzrtp_rebuildChannelIndex(bzrtpContext_t *zrtpContext) {
+	uint16_t i;
+
+	memset(zrtpContext->channelIndex, 0, zrtpContext->channelIndexSize*sizeof(uint16_t));
+	for (i=0; i<zrtpContext->channelContextSize; i++) {
+		if (zrtpContext->channelContext[i] != NULL) {
+			channelIndexInsert(zrtpContext, i);
+		}
+	}
+}
+
+/**
+ * @brief Store a channel context in the first free slot of the channel table and index it
+ * The table doubles its size when full, up to ZRTP_MAX_CHANNEL_NUMBER slots
+ *
+ * @param[in,out]	zrtpContext			The zrtp context
+ * @param[in]		zrtpChannelContext	The channel context to attach, its selfSSRC must be set
+ *
+ * @return 0 on success, BZRTP_ERROR_UNABLETOADDCHANNEL when the table is full
+ */
+static int bzrtp_attachChannelContext(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext) {
+	uint16_t i;
+
+	/* get the first free slot */
+	for (i=0; i<zrtpContext->channelContextSize; i++) {
+		if (zrtpContext->channelContext[i] == NULL) {
+			break;
+		}
+	}
+
+	/* none: grow the table and its index */
+	if (i == zrtpContext->channelContextSize) {
+		uint16_t newSize = (zrtpContext->channelContextSize==0)?1:2*zrtpContext->channelContextSize;
+		uint16_t newIndexSize = zrtpContext->channelIndexSize;
+		bzrtpChannelContext_t **newTable;
+		uint16_t *newIndex;
+
+		if (zrtpContext->channelContextSize >= ZRTP_MAX_CHANNEL_NUMBER) {
+			return BZRTP_ERROR_UNABLETOADDCHANNEL;
+		}
+		if (newSize > ZRTP_MAX_CHANNEL_NUMBER) {
+			newSize = ZRTP_MAX_CHANNEL_NUMBER;
+		}
+		newTable = (bzrtpChannelContext_t **)realloc(zrtpContext->channelContext, newSize*sizeof(bzrtpChannelContext_t *));
+		if (newTable == NULL) {
+			return BZRTP_ERROR_UNABLETOADDCHANNEL;
+		}
+		memset(newTable+zrtpContext->channelContextSize, 0, (newSize-zrtpContext->channelContextSize)*sizeof(bzrtpChannelContext_t *));
+		zrtpContext->channelContext = newTable;
+		zrtpContext->channelContextSize = newSize;
+
+		/* keep the index at most half full so probing sequences stay short */
+		if (newIndexSize == 0) {
+			newIndexSize = 2;
+		}
+		while (newIndexSize < 2*newSize) {
+			newIndexSize *= 2;
+		}
+		if (newIndexSize != zrtpContext->channelIndexSize) {
+			newIndex = (uint16_t *)realloc(zrtpContext->channelIndex, newIndexSize*sizeof(uint16_t));
+			if (newIndex == NULL) {
+				return BZRTP_ERROR_UNABLETOADDCHANNEL;
+			}
+			zrtpContext->channelIndex = newIndex;
+			zrtpContext->channelIndexSize = newIndexSize;
+			bzrtp_rebuildChannelIndex(zrtpContext);
+		}
+	}
+
+	zrtpContext->channelContext[i] = zrtpChannelContext;
+	channelIndexInsert(zrtpContext, i);
+
+	return 0;
+}
 /**
  * @brief Initialise the context of a channel and create and store the Hello packet
  * Initialise some vectors
@@ -1160,6 +1640,12 @@ static int bzrtp_initChannelContext(bzrtpContext_t *zrtpContext, bzrtpChannelCon
 	/* flags */
 	zrtpChannelContext->isSecure = 0;
 	zrtpChannelContext->isMainChannel = isMain;
+	zrtpChannelContext->channelStatus = BZRTP_CHANNEL_INITIALISED;
+	zrtpChannelContext->helloSuspended = 0;
+	zrtpChannelContext->cacheReadStatus = BZRTP_CACHEREAD_NONE;
+	zrtpChannelContext->cacheReadNextState = NULL;
+	zrtpChannelContext->discoveryStartTime = 0;
+	zrtpChannelContext->discoveryBytesSent = 0;
 #ifdef GOCLEAR_ENABLED
 	zrtpChannelContext->isClear = 0;
 	zrtpChannelContext->hasReceivedAGoClear = BZRTP_RECEPTION_UNKNOWN;
@@ -1180,6 +1666,8 @@ static int bzrtp_initChannelContext(bzrtpContext_t *zrtpContext, bzrtpChannelCon
 		zrtpChannelContext->peerPackets[i] = NULL;
 	}
 	zrtpChannelContext->peerHelloHash = NULL;
+	zrtpChannelContext->peerHVerified = 0;
+	zrtpChannelContext->peerPacketsMACVerified = 0;
 
 	/* initialisation of fragmented packet reception */
 	zrtpChannelContext->incomingFragmentedPacket.fragments = NULL;
@@ -1303,6 +1791,24 @@ static uint8_t copyCryptoTypes(uint8_t destination[7], uint8_t source[7], uint8_
 	return size;
 }
 
+/**
+ * @brief Select among the given crypto types the ones we implement and add the mandatory ones
+ *
+ * @param[in]	algoType				mapped to defines, must be in [ZRTP_HASH_TYPE, ZRTP_CIPHERBLOCK_TYPE, ZRTP_AUTHTAG_TYPE, ZRTP_KEYAGREEMENT_TYPE or ZRTP_SAS_TYPE]
+ * @param[in]	supportedTypes			the crypto types requested by user
+ * @param[in]	supportedTypesCount		number of requested crypto types
+ * @param[out]	selectedTypes			the crypto types to use
+ * @param[out]	selectedTypesCount		number of crypto types to use
+ */
+static void selectSupportedCryptoTypes(uint8_t algoType, uint8_t supportedTypes[7], uint8_t supportedTypesCount, uint8_t selectedTypes[7], uint8_t *selectedTypesCount) {
+	uint8_t implementedTypes[256];
+	uint8_t implementedTypesCount;
+
+	implementedTypesCount = bzrtpUtils_getAllAvailableCryptoTypes(algoType, implementedTypes);
+	*selectedTypesCount = bzrtp_selectCommonAlgo(supportedTypes, supportedTypesCount, implementedTypes, implementedTypesCount, selectedTypes);
+	bzrtp_addMandatoryCryptoTypesIfNeeded(algoType, selectedTypes, selectedTypesCount);
+}
+
 const char *bzrtp_algoToString(uint8_t algo){
 	switch(algo) {
 	case(ZRTP_UNSET_ALGO): return "unset";
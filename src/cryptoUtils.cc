@@ -21,9 +21,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <list>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "cryptoUtils.h"
 #include "bctoolbox/crypto.hh"
+#include "bctoolbox/logging.h"
 #ifdef HAVE_BCTBXPQ
 #include "postquantumcryptoengine/crypto.hh"
 #endif /* HAVE_BCTBXPQ */
@@ -1605,3 +1610,501 @@ int bzrtp_destroyKEMContext(bzrtp_KEMContext_t *ctx) {
 }
 
 #endif /* HAVE_BCTBXPQ */
+
+void bzrtp_destroyKeyAgreementContext(void *keyAgreementContext, uint8_t keyAgreementAlgo) {
+	if (keyAgreementContext == NULL) {
+		return;
+	}
+	if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH2k || keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH3k) {
+		bctbx_DestroyDHMContext((bctbx_DHMContext_t *)keyAgreementContext);
+	} else if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) {
+		bctbx_DestroyECDHContext((bctbx_ECDHContext_t *)keyAgreementContext);
+	} else if (bzrtp_isKem(keyAgreementAlgo)) {
+		bzrtp_destroyKEMContext((bzrtp_KEMContext_t *)keyAgreementContext);
+	}
+}
+
+/**
+ * @brief Empty a key agreement slot, destroying the context it holds
+ */
+static void bzrtp_clearKeyAgreementSlot(keyAgreementSlot_t *slot) {
+	bzrtp_destroyKeyAgreementContext(slot->context, slot->algo);
+	memset(slot, 0, sizeof(keyAgreementSlot_t));
+}
+
+/**
+ * @brief Get the DHM secret length in bytes for the agreed cipher: twice the size of cipher block key length - rfc section 5.1.5
+ */
+static uint8_t bzrtp_getDHMSecretLength(uint8_t cipherAlgo) {
+	switch (cipherAlgo) {
+		case ZRTP_CIPHER_AES3:
+		case ZRTP_CIPHER_2FS3:
+			return 64;
+		case ZRTP_CIPHER_AES2:
+		case ZRTP_CIPHER_2FS2:
+			return 48;
+		case ZRTP_CIPHER_AES1:
+		case ZRTP_CIPHER_2FS1:
+		default:
+			return 32;
+	}
+}
+
+/* bctbx_DHMCreatePublic and bctbx_ECDHCreateKeyPair do not report errors: watch the random source they draw the private key from */
+typedef struct keyPairRNG_struct {
+	bctbx_rng_context_t *RNGContext;
+	int error; /**< last error returned by the random number generator, 0 if none */
+} keyPairRNG_t;
+
+static int bzrtp_keyPairRNGGet(void *keyPairRNG, uint8_t *output, size_t outputLength) {
+	keyPairRNG_t *rng = (keyPairRNG_t *)keyPairRNG;
+	int ret = bctbx_rng_get(rng->RNGContext, output, outputLength);
+	if (ret != 0) {
+		rng->error = ret;
+	}
+	return ret;
+}
+
+/**
+ * @brief Generate the key pair of an ECDH context
+ *
+ * @return 0 on success, BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT if the private key could not be drawn or the public key computed
+ */
+static int bzrtp_ECDHCreateKeyPair(bctbx_ECDHContext_t *ECDHContext, bctbx_rng_context_t *RNGContext) {
+	keyPairRNG_t rng = {RNGContext, 0};
+
+	bctbx_ECDHCreateKeyPair(ECDHContext, bzrtp_keyPairRNGGet, &rng);
+	if (rng.error != 0 || ECDHContext->selfPublic == NULL) {
+		return BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT;
+	}
+	return 0;
+}
+
+/**
+ * @brief Generate a new key agreement context in the given slot, with a key pair for all modes but the KEM responder
+ *
+ * @return 0 on success, BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT otherwise
+ */
+static int bzrtp_generateKeyAgreementContext(bctbx_rng_context_t *RNGContext, uint8_t keyAgreementAlgo, uint8_t secretLength, uint8_t hashAlgo, uint8_t role, keyAgreementSlot_t *slot) {
+	void *context = NULL;
+
+	if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH2k || keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH3k) {
+		bctbx_DHMContext_t *DHMContext = bctbx_CreateDHMContext((keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH2k)?BCTBX_DHM_2048:BCTBX_DHM_3072, secretLength);
+		if (DHMContext != NULL) {
+			/* create private key and compute the public value */
+			keyPairRNG_t rng = {RNGContext, 0};
+			bctbx_DHMCreatePublic(DHMContext, bzrtp_keyPairRNGGet, &rng);
+			if (rng.error != 0 || DHMContext->self == NULL) {
+				bctbx_DestroyDHMContext(DHMContext);
+				DHMContext = NULL;
+			}
+		}
+		context = (void *)DHMContext;
+	} else if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) {
+		bctbx_ECDHContext_t *ECDHContext = bctbx_CreateECDHContext((keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255)?BCTBX_ECDH_X25519:BCTBX_ECDH_X448);
+		/* create private key and compute the public value */
+		if (ECDHContext != NULL && bzrtp_ECDHCreateKeyPair(ECDHContext, RNGContext) != 0) {
+			bctbx_DestroyECDHContext(ECDHContext);
+			ECDHContext = NULL;
+		}
+		context = (void *)ECDHContext;
+	} else if (bzrtp_isKem(keyAgreementAlgo)) {
+		bzrtp_KEMContext_t *KEMContext = bzrtp_createKEMContext(keyAgreementAlgo, hashAlgo);
+		if (KEMContext != NULL && role == BZRTP_ROLE_INITIATOR) {
+			bzrtp_KEM_generateKeyPair(KEMContext);
+		}
+		context = (void *)KEMContext;
+	}
+
+	if (context == NULL) {
+		return BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT;
+	}
+
+	slot->context = context;
+	slot->algo = keyAgreementAlgo;
+	slot->secretLength = secretLength;
+	return 0;
+}
+
+/**
+ * @brief Check a slot holds a context usable for the given algorithms: DHM private exponent length depends on the cipher
+ */
+static bool_t bzrtp_keyAgreementSlotMatches(const keyAgreementSlot_t *slot, uint8_t keyAgreementAlgo, uint8_t secretLength) {
+	if (slot->context == NULL || slot->algo != keyAgreementAlgo) {
+		return FALSE;
+	}
+	if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH2k || keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH3k) {
+		return (slot->secretLength == secretLength)?TRUE:FALSE;
+	}
+	return TRUE;
+}
+
+/* Process wide reserve of key pairs generated ahead of any call, shared by all the zrtp contexts.
+ * bctoolbox does not expose its bignum so we cannot speed up DHM public value generation itself with a fixed-base table,
+ * but we can move it out of the handshake: key pairs are generated when the application asks for it and used only once.
+ * A background thread then keeps the reserve at the level the application asked for, replacing the key pairs used. */
+typedef struct keyPairReserveTarget_struct {
+	uint8_t algo;
+	uint8_t secretLength;
+	int count; /**< number of key pairs of this kind the refill keeps in the reserve */
+} keyPairReserveTarget_t;
+
+static std::mutex keyPairReserveMutex;
+static std::condition_variable keyPairReserveCondition;
+static keyAgreementSlot_t keyPairReserve[KEYPAIR_RESERVE_CAPACITY];
+static std::vector<keyPairReserveTarget_t> keyPairReserveTargets;
+static std::thread keyPairReserveRefill;
+static bool keyPairReserveStopping = false;
+
+/**
+ * @brief Count the key pairs of the reserve matching the given algorithms, must be called with keyPairReserveMutex locked
+ */
+static int bzrtp_countReservedKeyPairs(uint8_t keyAgreementAlgo, uint8_t secretLength) {
+	int count = 0;
+	for (int i=0; i<KEYPAIR_RESERVE_CAPACITY; i++) {
+		if (bzrtp_keyAgreementSlotMatches(&keyPairReserve[i], keyAgreementAlgo, secretLength)) {
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief Store a key pair in the first free slot of the reserve, must be called with keyPairReserveMutex locked
+ *
+ * @return TRUE if it was stored, FALSE if the reserve is full
+ */
+static bool_t bzrtp_storeInKeyPairReserve(const keyAgreementSlot_t *slot) {
+	for (int i=0; i<KEYPAIR_RESERVE_CAPACITY; i++) {
+		if (keyPairReserve[i].context == NULL) {
+			keyPairReserve[i] = *slot;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * @brief Get a refill target the reserve is below, must be called with keyPairReserveMutex locked
+ *
+ * @return the target, NULL if the reserve is at its level or full
+ */
+static const keyPairReserveTarget_t *bzrtp_getKeyPairReserveDeficit(void) {
+	const keyPairReserveTarget_t *deficit = NULL;
+	int freeSlots = 0;
+
+	for (int i=0; i<KEYPAIR_RESERVE_CAPACITY; i++) {
+		if (keyPairReserve[i].context == NULL) {
+			freeSlots++;
+		}
+	}
+	if (freeSlots == 0) {
+		return NULL;
+	}
+	for (const auto &target : keyPairReserveTargets) {
+		if (bzrtp_countReservedKeyPairs(target.algo, target.secretLength) < target.count) {
+			deficit = &target;
+			break;
+		}
+	}
+	return deficit;
+}
+
+/**
+ * @brief Background refill of the reserve: generate, one at a time, the key pairs used since the application reserved them
+ */
+static void bzrtp_refillKeyPairReserve(void) {
+	bctbx_rng_context_t *RNGContext = bctbx_rng_context_new();
+	std::unique_lock<std::mutex> lock(keyPairReserveMutex);
+
+	while (!keyPairReserveStopping) {
+		const keyPairReserveTarget_t *deficit = bzrtp_getKeyPairReserveDeficit();
+		if (deficit == NULL) {
+			keyPairReserveCondition.wait(lock);
+			continue;
+		}
+
+		/* generation is the costly part, do not hold the lock during it */
+		uint8_t algo = deficit->algo;
+		uint8_t secretLength = deficit->secretLength;
+		keyAgreementSlot_t slot = {NULL, ZRTP_UNSET_ALGO, 0};
+		lock.unlock();
+		int retval = bzrtp_generateKeyAgreementContext(RNGContext, algo, secretLength, ZRTP_UNSET_ALGO, BZRTP_ROLE_INITIATOR, &slot);
+		lock.lock();
+
+		if (retval != 0) { /* do not spin on a failing generation, wait for the next key pair to be used */
+			bctbx_warning("Unable to refill the key pairs reserve: key pair generation failed");
+			keyPairReserveCondition.wait(lock);
+			continue;
+		}
+		if (keyPairReserveStopping || bzrtp_storeInKeyPairReserve(&slot) == FALSE) {
+			bzrtp_clearKeyAgreementSlot(&slot);
+		}
+	}
+	lock.unlock();
+	bctbx_rng_context_free(RNGContext);
+}
+
+/**
+ * @brief Move a key pair matching the given algorithms from the process wide reserve into the slot, the refill replaces it
+ *
+ * @return TRUE if a key pair was found, FALSE otherwise
+ */
+static bool_t bzrtp_takeFromKeyPairReserve(uint8_t keyAgreementAlgo, uint8_t secretLength, keyAgreementSlot_t *slot) {
+	std::lock_guard<std::mutex> lock(keyPairReserveMutex);
+	for (int i=0; i<KEYPAIR_RESERVE_CAPACITY; i++) {
+		if (bzrtp_keyAgreementSlotMatches(&keyPairReserve[i], keyAgreementAlgo, secretLength)) {
+			*slot = keyPairReserve[i];
+			memset(&keyPairReserve[i], 0, sizeof(keyAgreementSlot_t));
+			keyPairReserveCondition.notify_one();
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+int bzrtp_createECDHKeyPairs(uint8_t keyAgreementAlgo, bctbx_rng_context_t *RNGContext, bctbx_ECDHContext_t **ECDHContexts, int count) {
+	uint8_t bctbx_keyAgreementAlgo;
+	int i;
+
+	if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255) {
+		bctbx_keyAgreementAlgo = BCTBX_ECDH_X25519;
+	} else if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) {
+		bctbx_keyAgreementAlgo = BCTBX_ECDH_X448;
+	} else {
+		return 0;
+	}
+
+	/* bctoolbox offers no multi-lane key generation, so this runs the scalar path for each key pair */
+	for (i=0; i<count; i++) {
+		ECDHContexts[i] = bctbx_CreateECDHContext(bctbx_keyAgreementAlgo);
+		if (ECDHContexts[i] == NULL || bzrtp_ECDHCreateKeyPair(ECDHContexts[i], RNGContext) != 0) {
+			/* do not hand out a partial batch */
+			if (ECDHContexts[i] != NULL) {
+				bctbx_DestroyECDHContext(ECDHContexts[i]);
+				ECDHContexts[i] = NULL;
+			}
+			while (i>0) {
+				i--;
+				bctbx_DestroyECDHContext(ECDHContexts[i]);
+				ECDHContexts[i] = NULL;
+			}
+			return 0;
+		}
+	}
+	return count;
+}
+
+static bool_t bzrtp_isReservableKeyAgreement(uint8_t keyAgreementAlgo) {
+	/* KEM contexts depend on the hash algorithm and only the initiator has a key pair, do not reserve them */
+	return (keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH2k || keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH3k
+		|| keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448)?TRUE:FALSE;
+}
+
+int bzrtp_reserveKeyPairs(uint8_t keyAgreementAlgo, uint8_t cipherAlgo, int count) {
+	uint8_t secretLength = bzrtp_getDHMSecretLength(cipherAlgo);
+	int freeSlots = 0;
+	int generated = 0;
+	int added = 0;
+	int i;
+
+	if (bzrtp_isReservableKeyAgreement(keyAgreementAlgo) == FALSE) {
+		return 0;
+	}
+	if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) {
+		secretLength = 0; /* ECDH key pairs do not depend on the cipher */
+	}
+
+	/* do not generate more than the reserve can take */
+	{
+		std::lock_guard<std::mutex> lock(keyPairReserveMutex);
+		for (i=0; i<KEYPAIR_RESERVE_CAPACITY; i++) {
+			if (keyPairReserve[i].context == NULL) {
+				freeSlots++;
+			}
+		}
+	}
+	if (count > freeSlots) {
+		count = freeSlots;
+	}
+
+	/* generation is the costly part, do not hold the lock during it */
+	std::vector<keyAgreementSlot_t> slots(count>0?count:0, keyAgreementSlot_t{NULL, ZRTP_UNSET_ALGO, 0});
+	if (count > 0) {
+		bctbx_rng_context_t *RNGContext = bctbx_rng_context_new();
+		if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) {
+			std::vector<bctbx_ECDHContext_t *> ECDHContexts(count);
+			generated = bzrtp_createECDHKeyPairs(keyAgreementAlgo, RNGContext, ECDHContexts.data(), count);
+			for (i=0; i<generated; i++) {
+				slots[i].context = (void *)ECDHContexts[i];
+				slots[i].algo = keyAgreementAlgo;
+			}
+		} else {
+			while (generated < count && bzrtp_generateKeyAgreementContext(RNGContext, keyAgreementAlgo, secretLength, ZRTP_UNSET_ALGO, BZRTP_ROLE_INITIATOR, &slots[generated]) == 0) {
+				generated++;
+			}
+		}
+		bctbx_rng_context_free(RNGContext);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(keyPairReserveMutex);
+		while (added<generated && bzrtp_storeInKeyPairReserve(&slots[added]) == TRUE) {
+			added++;
+		}
+
+		/* from now on the refill keeps the reserve at this level */
+		int level = bzrtp_countReservedKeyPairs(keyAgreementAlgo, secretLength);
+		auto target = keyPairReserveTargets.begin();
+		for (; target != keyPairReserveTargets.end(); ++target) {
+			if (target->algo == keyAgreementAlgo && target->secretLength == secretLength) {
+				break;
+			}
+		}
+		if (target == keyPairReserveTargets.end()) {
+			keyPairReserveTargets.push_back(keyPairReserveTarget_t{keyAgreementAlgo, secretLength, level});
+		} else if (level > target->count) {
+			target->count = level;
+		}
+		if (!keyPairReserveRefill.joinable()) {
+			keyPairReserveStopping = false;
+			keyPairReserveRefill = std::thread(bzrtp_refillKeyPairReserve);
+		}
+	}
+	/* the reserve may have been refilled concurrently */
+	for (i=added; i<generated; i++) {
+		bzrtp_clearKeyAgreementSlot(&slots[i]);
+	}
+
+	return added;
+}
+
+int bzrtp_getReservedKeyPairsCount(uint8_t keyAgreementAlgo, uint8_t cipherAlgo) {
+	uint8_t secretLength = bzrtp_getDHMSecretLength(cipherAlgo);
+	if (bzrtp_isReservableKeyAgreement(keyAgreementAlgo) == FALSE) {
+		return 0;
+	}
+	if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) {
+		secretLength = 0;
+	}
+	std::lock_guard<std::mutex> lock(keyPairReserveMutex);
+	return bzrtp_countReservedKeyPairs(keyAgreementAlgo, secretLength);
+}
+
+void bzrtp_clearKeyPairReserve(void) {
+	std::unique_lock<std::mutex> lock(keyPairReserveMutex);
+
+	/* stop the refill first so it does not replace the key pairs destroyed */
+	if (keyPairReserveRefill.joinable()) {
+		keyPairReserveStopping = true;
+		keyPairReserveCondition.notify_all();
+		lock.unlock();
+		keyPairReserveRefill.join();
+		lock.lock();
+	}
+	keyPairReserveTargets.clear();
+	for (int i=0; i<KEYPAIR_RESERVE_CAPACITY; i++) {
+		bzrtp_clearKeyAgreementSlot(&keyPairReserve[i]);
+	}
+}
+
+/* applications shall call bzrtp_clearKeyPairReserve at teardown, do it at process exit for the ones which don't */
+static struct keyPairReserveCleanup_struct {
+	~keyPairReserveCleanup_struct() {
+		bzrtp_clearKeyPairReserve();
+	}
+} keyPairReserveCleanup;
+
+int bzrtp_prepareKeyAgreementContext(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint8_t role) {
+	uint8_t keyAgreementAlgo = zrtpChannelContext->keyAgreementAlgo;
+	uint8_t secretLength = bzrtp_getDHMSecretLength(zrtpChannelContext->cipherAlgo);
+	keyAgreementSlot_t *prepared = &zrtpContext->preparedKeyAgreement[role];
+	int i;
+
+	/* KEM responder encapsulates to the peer's public key, there is no key pair to generate ahead of time */
+	if (bzrtp_isKem(keyAgreementAlgo) && role == BZRTP_ROLE_RESPONDER) {
+		return 0;
+	}
+
+	if (bzrtp_keyAgreementSlotMatches(prepared, keyAgreementAlgo, secretLength)) { /* already prepared */
+		return 0;
+	}
+	/* algorithms changed since it was prepared: keep it for later */
+	bzrtp_recycleKeyAgreementContext(zrtpContext, role);
+
+	/* look for a matching key pair in the pool */
+	for (i=0; i<KEYPAIR_POOL_CAPACITY; i++) {
+		if (bzrtp_keyAgreementSlotMatches(&zrtpContext->keyPairPool[i], keyAgreementAlgo, secretLength)) {
+			*prepared = zrtpContext->keyPairPool[i];
+			memset(&zrtpContext->keyPairPool[i], 0, sizeof(keyAgreementSlot_t));
+			return 0;
+		}
+	}
+
+	/* then in the process wide reserve */
+	if (bzrtp_takeFromKeyPairReserve(keyAgreementAlgo, secretLength, prepared) == TRUE) {
+		return 0;
+	}
+
+	return bzrtp_generateKeyAgreementContext(zrtpContext->RNGContext, keyAgreementAlgo, secretLength, zrtpChannelContext->hashAlgo, role, prepared);
+}
+
+int bzrtp_useKeyAgreementContext(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint8_t role) {
+	keyAgreementSlot_t *prepared = &zrtpContext->preparedKeyAgreement[role];
+	keyAgreementSlot_t active;
+	int retval;
+
+	if (bzrtp_isKem(zrtpChannelContext->keyAgreementAlgo) && role == BZRTP_ROLE_RESPONDER) {
+		/* nothing prepared for the KEM responder, just create the context */
+		retval = bzrtp_generateKeyAgreementContext(zrtpContext->RNGContext, zrtpChannelContext->keyAgreementAlgo, 0, zrtpChannelContext->hashAlgo, role, &active);
+	} else {
+		retval = bzrtp_prepareKeyAgreementContext(zrtpContext, zrtpChannelContext, role);
+		active = *prepared;
+		memset(prepared, 0, sizeof(keyAgreementSlot_t));
+	}
+	if (retval != 0) {
+		return retval;
+	}
+
+	/* a previous context in use was already disclosed, it cannot be reused */
+	bzrtp_destroyKeyAgreementContext(zrtpContext->keyAgreementContext, zrtpContext->keyAgreementAlgo);
+	zrtpContext->keyAgreementContext = active.context;
+	zrtpContext->keyAgreementAlgo = active.algo; /* store algo in global context to be able to destroy it correctly */
+	return 0;
+}
+
+void bzrtp_recycleKeyAgreementContext(bzrtpContext_t *zrtpContext, uint8_t role) {
+	keyAgreementSlot_t *prepared = &zrtpContext->preparedKeyAgreement[role];
+	int i;
+
+	if (prepared->context == NULL) {
+		return;
+	}
+
+	for (i=0; i<KEYPAIR_POOL_CAPACITY; i++) {
+		if (zrtpContext->keyPairPool[i].context == NULL) {
+			break;
+		}
+	}
+	if (i == KEYPAIR_POOL_CAPACITY) { /* pool is full, drop the oldest one */
+		bzrtp_clearKeyAgreementSlot(&zrtpContext->keyPairPool[0]);
+		memmove(&zrtpContext->keyPairPool[0], &zrtpContext->keyPairPool[1], (KEYPAIR_POOL_CAPACITY-1)*sizeof(keyAgreementSlot_t));
+		i = KEYPAIR_POOL_CAPACITY-1;
+	}
+	zrtpContext->keyPairPool[i] = *prepared;
+	memset(prepared, 0, sizeof(keyAgreementSlot_t));
+}
+
+void bzrtp_destroyAllKeyAgreementContexts(bzrtpContext_t *zrtpContext) {
+	int i;
+
+	bzrtp_destroyKeyAgreementContext(zrtpContext->keyAgreementContext, zrtpContext->keyAgreementAlgo);
+	zrtpContext->keyAgreementContext = NULL;
+	zrtpContext->keyAgreementAlgo = ZRTP_UNSET_ALGO;
+
+	bzrtp_clearKeyAgreementSlot(&zrtpContext->preparedKeyAgreement[BZRTP_ROLE_INITIATOR]);
+	bzrtp_clearKeyAgreementSlot(&zrtpContext->preparedKeyAgreement[BZRTP_ROLE_RESPONDER]);
+	for (i=0; i<KEYPAIR_POOL_CAPACITY; i++) {
+		bzrtp_clearKeyAgreementSlot(&zrtpContext->keyPairPool[i]);
+	}
+}
@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include "typedef.h"
@@ -51,6 +52,123 @@
 #define ZRTP_PINGMESSAGE_FIXED_LENGTH 			24
 #define ZRTP_PINGACKMESSAGE_FIXED_LENGTH 		36
 
+/*** Message schemas ***/
+/* The fixed offset part of the messages is described by the tables below: for each field, its offset and length in the
+ * message (message header excluded) and the offset of its storage in the message structure.
+ * Parser and builder both use these tables, so a field layout is defined in one place only.
+ * Variable parts (algorithms lists, public values, signature) and bit fields are still handled by the parser and builder */
+typedef enum {
+	BZRTP_FIELD_BYTES, /**< raw bytes, copied as is */
+	BZRTP_FIELD_UINT32, /**< 32 bits unsigned integer, network byte order on the wire */
+	BZRTP_FIELD_ALGO /**< 4 chars algorithm identifier on the wire, mapped to an uint8_t in the message structure */
+} bzrtpFieldType_t;
+
+typedef struct {
+	uint16_t wireOffset; /**< offset of the field in the message, message header excluded */
+	uint16_t wireLength; /**< length of the field in the message, in bytes */
+	uint16_t structOffset; /**< offset of the field in the message structure */
+	uint8_t type; /**< one of bzrtpFieldType_t */
+	uint8_t algoFamily; /**< for BZRTP_FIELD_ALGO only: ZRTP_HASH_TYPE, ZRTP_CIPHERBLOCK_TYPE, ... */
+} bzrtpFieldDescriptor_t;
+
+typedef struct {
+	const bzrtpFieldDescriptor_t *fields; /**< fields, sorted by wire offset */
+	uint8_t fieldsCount; /**< number of fields */
+	uint16_t wireLength; /**< length in bytes of the message part described, all fields fit in it */
+} bzrtpMessageSchema_t;
+
+#define BZRTP_BYTES_FIELD(messageStruct, field, offset, length) {(offset), (length), (uint16_t)offsetof(messageStruct, field), BZRTP_FIELD_BYTES, 0}
+#define BZRTP_UINT32_FIELD(messageStruct, field, offset) {(offset), 4, (uint16_t)offsetof(messageStruct, field), BZRTP_FIELD_UINT32, 0}
+#define BZRTP_ALGO_FIELD(messageStruct, field, offset, family) {(offset), 4, (uint16_t)offsetof(messageStruct, field), BZRTP_FIELD_ALGO, (family)}
+#define BZRTP_SCHEMA(fieldsTable, length) {(fieldsTable), (uint8_t)(sizeof(fieldsTable)/sizeof(bzrtpFieldDescriptor_t)), (length)}
+
+/* compile time check of the schemas consistency: the build fails on a negative array size */
+#define BZRTP_SCHEMA_CHECK(name, condition) typedef char bzrtpSchemaCheck_##name[(condition)?1:-1]
+
+/* Hello: version, client identifier, H3 and ZID. Followed by flags and algorithms counts(4 bytes), algorithms lists and MAC */
+#define ZRTP_HELLO_SCHEMA_LENGTH 64
+static const bzrtpFieldDescriptor_t helloFields[] = {
+	BZRTP_BYTES_FIELD(bzrtpHelloMessage_t, version, 0, 4),
+	BZRTP_BYTES_FIELD(bzrtpHelloMessage_t, clientIdentifier, 4, 16),
+	BZRTP_BYTES_FIELD(bzrtpHelloMessage_t, H3, 20, 32),
+	BZRTP_BYTES_FIELD(bzrtpHelloMessage_t, ZID, 52, 12)
+};
+static const bzrtpMessageSchema_t helloSchema = BZRTP_SCHEMA(helloFields, ZRTP_HELLO_SCHEMA_LENGTH);
+BZRTP_SCHEMA_CHECK(hello, ZRTP_HELLO_SCHEMA_LENGTH + 4 + 8 == ZRTP_HELLOMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH);
+
+/* Commit: H2, ZID and the selected algorithms. Followed by the key agreement dependent part and MAC */
+#define ZRTP_COMMIT_SCHEMA_LENGTH 64
+static const bzrtpFieldDescriptor_t commitFields[] = {
+	BZRTP_BYTES_FIELD(bzrtpCommitMessage_t, H2, 0, 32),
+	BZRTP_BYTES_FIELD(bzrtpCommitMessage_t, ZID, 32, 12),
+	BZRTP_ALGO_FIELD(bzrtpCommitMessage_t, hashAlgo, 44, ZRTP_HASH_TYPE),
+	BZRTP_ALGO_FIELD(bzrtpCommitMessage_t, cipherAlgo, 48, ZRTP_CIPHERBLOCK_TYPE),
+	BZRTP_ALGO_FIELD(bzrtpCommitMessage_t, authTagAlgo, 52, ZRTP_AUTHTAG_TYPE),
+	BZRTP_ALGO_FIELD(bzrtpCommitMessage_t, keyAgreementAlgo, 56, ZRTP_KEYAGREEMENT_TYPE),
+	BZRTP_ALGO_FIELD(bzrtpCommitMessage_t, sasAlgo, 60, ZRTP_SAS_TYPE)
+};
+static const bzrtpMessageSchema_t commitSchema = BZRTP_SCHEMA(commitFields, ZRTP_COMMIT_SCHEMA_LENGTH);
+BZRTP_SCHEMA_CHECK(commit, ZRTP_COMMIT_SCHEMA_LENGTH + 8 == ZRTP_COMMITMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH);
+
+/* DHPart: H1 and the secrets IDs. Followed by the public value and MAC */
+#define ZRTP_DHPART_SCHEMA_LENGTH 64
+static const bzrtpFieldDescriptor_t dhPartFields[] = {
+	BZRTP_BYTES_FIELD(bzrtpDHPartMessage_t, H1, 0, 32),
+	BZRTP_BYTES_FIELD(bzrtpDHPartMessage_t, rs1ID, 32, 8),
+	BZRTP_BYTES_FIELD(bzrtpDHPartMessage_t, rs2ID, 40, 8),
+	BZRTP_BYTES_FIELD(bzrtpDHPartMessage_t, auxsecretID, 48, 8),
+	BZRTP_BYTES_FIELD(bzrtpDHPartMessage_t, pbxsecretID, 56, 8)
+};
+static const bzrtpMessageSchema_t dhPartSchema = BZRTP_SCHEMA(dhPartFields, ZRTP_DHPART_SCHEMA_LENGTH);
+BZRTP_SCHEMA_CHECK(dhPart, ZRTP_DHPART_SCHEMA_LENGTH + 8 == ZRTP_DHPARTMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH);
+
+/* Confirm: confirm_mac and CFB IV, followed by the encrypted part */
+#define ZRTP_CONFIRM_SCHEMA_LENGTH 24
+static const bzrtpFieldDescriptor_t confirmFields[] = {
+	BZRTP_BYTES_FIELD(bzrtpConfirmMessage_t, confirm_mac, 0, 8),
+	BZRTP_BYTES_FIELD(bzrtpConfirmMessage_t, CFBIV, 8, 16)
+};
+static const bzrtpMessageSchema_t confirmSchema = BZRTP_SCHEMA(confirmFields, ZRTP_CONFIRM_SCHEMA_LENGTH);
+
+/* Confirm encrypted part: H0, one unused byte, sig_len and flags(3 bytes) and cache expiration interval. Followed by the optional signature */
+#define ZRTP_CONFIRM_PLAIN_SCHEMA_LENGTH 40
+static const bzrtpFieldDescriptor_t confirmPlainFields[] = {
+	BZRTP_BYTES_FIELD(bzrtpConfirmMessage_t, H0, 0, 32),
+	BZRTP_UINT32_FIELD(bzrtpConfirmMessage_t, cacheExpirationInterval, 36)
+};
+static const bzrtpMessageSchema_t confirmPlainSchema = BZRTP_SCHEMA(confirmPlainFields, ZRTP_CONFIRM_PLAIN_SCHEMA_LENGTH);
+BZRTP_SCHEMA_CHECK(confirm, ZRTP_CONFIRM_SCHEMA_LENGTH + ZRTP_CONFIRM_PLAIN_SCHEMA_LENGTH == ZRTP_CONFIRMMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH);
+
+/* Error: error code */
+static const bzrtpFieldDescriptor_t errorFields[] = {
+	BZRTP_UINT32_FIELD(bzrtpErrorMessage_t, errorCode, 0)
+};
+static const bzrtpMessageSchema_t errorSchema = BZRTP_SCHEMA(errorFields, ZRTP_ERRORMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH);
+
+#ifdef GOCLEAR_ENABLED
+/* GoClear: clear_mac */
+static const bzrtpFieldDescriptor_t goClearFields[] = {
+	BZRTP_BYTES_FIELD(bzrtpGoClearMessage_t, clear_mac, 0, 8)
+};
+static const bzrtpMessageSchema_t goClearSchema = BZRTP_SCHEMA(goClearFields, ZRTP_GOCLEARMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH);
+#endif /* GOCLEAR_ENABLED */
+
+/* Ping: version and endpoint hash */
+static const bzrtpFieldDescriptor_t pingFields[] = {
+	BZRTP_BYTES_FIELD(bzrtpPingMessage_t, version, 0, 4),
+	BZRTP_BYTES_FIELD(bzrtpPingMessage_t, endpointHash, 4, 8)
+};
+static const bzrtpMessageSchema_t pingSchema = BZRTP_SCHEMA(pingFields, ZRTP_PINGMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH);
+
+/* PingACK: version, endpoint hashes and SSRC of the acknowledged Ping */
+static const bzrtpFieldDescriptor_t pingAckFields[] = {
+	BZRTP_BYTES_FIELD(bzrtpPingAckMessage_t, version, 0, 4),
+	BZRTP_BYTES_FIELD(bzrtpPingAckMessage_t, endpointHash, 4, 8),
+	BZRTP_BYTES_FIELD(bzrtpPingAckMessage_t, endpointHashReceived, 12, 8),
+	BZRTP_UINT32_FIELD(bzrtpPingAckMessage_t, SSRC, 20)
+};
+static const bzrtpMessageSchema_t pingAckSchema = BZRTP_SCHEMA(pingAckFields, ZRTP_PINGACKMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH);
+
 /*** local functions prototypes ***/
 /**
  * @brief Retrieve the 8 char string value message type from the int32_t code
@@ -88,6 +206,81 @@ static void zrtpMessageSetHeader(uint8_t *outputBuffer, uint16_t messageLength,
  */
 static void zrtpPacketSetHeader(bzrtpPacket_t *zrtpPacket);
 
+/**
+ * @brief Allocate the packetString buffer of a packet if it does not hold one already
+ *        (parsed packets, rebuilt packets or created packets holding a public value)
+ *
+ * @param[in/out]	zrtpPacket		the zrtp packet
+ * @param[in]		packetLength	the packet length in bytes: header + message + CRC
+ */
+static void zrtpPacketStringAlloc(bzrtpPacket_t *zrtpPacket, uint16_t packetLength);
+
+/**
+ * @brief Release the packet string: free it, or give it back to its owner when it is a buffer belonging to the application
+ *
+ * @param[in/out]	zrtpPacket		the packet, its packetString is set to NULL
+ */
+static void zrtpPacketStringFree(bzrtpPacket_t *zrtpPacket);
+
+/**
+ * @brief Keep the string of a received packet: copy it unless the packet already holds it because the application
+ *        transferred the receive buffer ownership (see bzrtp_processMessageTransfer)
+ *
+ * @param[in/out]	zrtpPacket		the parsed zrtp packet
+ * @param[in]		input			the received packet string
+ * @param[in]		inputLength		the received packet length in bytes
+ */
+static void zrtpPacketStoreReceivedString(bzrtpPacket_t *zrtpPacket, const uint8_t *input, uint16_t inputLength);
+
+/**
+ * @brief Check a hash image received from peer is part of its hash chain: hashing it must give the expected image
+ * Verified images are recorded in the channel context peerH so each link of the chain is computed at most once
+ *
+ * @param[in,out]	zrtpChannelContext	The channel context holding the peer hash images
+ * @param[in]		hashImage			The hash image received
+ * @param[in]		index				Index in the chain of the received image (0 for H0)
+ * @param[in]		expected			The expected image, retrieved from a message previously received
+ * @param[in]		expectedIndex		Index in the chain of the expected image
+ *
+ * @return	0 if the received image matches the chain, BZRTP_PARSER_ERROR_UNMATCHINGHASHCHAIN otherwise
+ */
+static int zrtpCheckPeerHashChain(bzrtpChannelContext_t *zrtpChannelContext, const uint8_t *hashImage, uint8_t index, const uint8_t *expected, uint8_t expectedIndex);
+
+/**
+ * @brief Check the MAC of a stored peer packet, it is computed only once per channel
+ *
+ * @param[in,out]	zrtpChannelContext	The channel context holding the peer packets
+ * @param[in]		storeId				The peer packet storage index
+ * @param[in]		key					The verified peer hash image keying the MAC (32 bytes)
+ * @param[in]		MAC					The MAC received in the stored packet (8 bytes)
+ *
+ * @return	0 if the MAC is correct, BZRTP_PARSER_ERROR_UNMATCHINGMAC otherwise
+ */
+static int zrtpCheckPeerPacketMAC(bzrtpChannelContext_t *zrtpChannelContext, uint8_t storeId, const uint8_t *key, const uint8_t *MAC);
+
+/**
+ * @brief Decode the fixed offset fields described by a schema into a message structure
+ *
+ * @param[in]	schema			The message schema
+ * @param[in]	input			The message, message header excluded
+ * @param[in]	inputLength		Length of the input buffer in bytes
+ * @param[out]	messageData		The message structure to fill
+ *
+ * @return	0 on success, BZRTP_PARSER_ERROR_INVALIDMESSAGE if the input is too short to hold the described fields
+ */
+static int zrtpSchemaDecode(const bzrtpMessageSchema_t *schema, const uint8_t *input, uint16_t inputLength, void *messageData);
+
+/**
+ * @brief Encode the fixed offset fields described by a schema from a message structure
+ *
+ * @param[in]	schema			The message schema
+ * @param[in]	messageData		The message structure holding the fields values
+ * @param[out]	output			The message, message header excluded
+ * @param[in]	outputLength	Length of the output buffer in bytes
+ *
+ * @return	0 on success, BZRTP_BUILDER_ERROR_INVALIDMESSAGE if the output is too short to hold the described fields
+ */
+static int zrtpSchemaEncode(const bzrtpMessageSchema_t *schema, const void *messageData, uint8_t *output, uint16_t outputLength);
 
 /*** Public functions implementation ***/
 
@@ -281,7 +474,6 @@ bzrtpPacket_t *bzrtp_packetCheck(uint8_t **inputPtr, uint16_t *inputLength, bzrt
 	zrtpPacket->sequenceNumber = sequenceNumber;
 	zrtpPacket->messageLength = messageLength;
 	zrtpPacket->messageType = messageType;
-	zrtpPacket->messageData = NULL;
 	zrtpPacket->packetString = NULL;
 	zrtpPacket->fragments = NULL;
 
@@ -293,12 +485,13 @@ bzrtpPacket_t *bzrtp_packetCheck(uint8_t **inputPtr, uint16_t *inputLength, bzrt
 }
 
 
-/* Call this function after the packetCheck one, to actually parse the packet : create and fill the messageData structure */
+/* Call this function after the packetCheck one, to actually parse the packet : fill the message structure */
 int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelContext_t *zrtpChannelContext, const uint8_t * input, uint16_t inputLength, bzrtpPacket_t *zrtpPacket) {
 
 	int i;
+	int retval;
 
-	/* now allocate and fill the correct message structure according to the message type */
+	/* now fill the correct message structure according to the message type */
 	/* messageContent points to the begining of the ZRTP message */
 	uint8_t *messageContent = (uint8_t *)(input+ZRTP_PACKET_HEADER_LENGTH+ZRTP_MESSAGE_HEADER_LENGTH);
 
@@ -322,20 +515,21 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 			}
 		}
 
-		/* allocate a Hello message structure */
-		messageData = (bzrtpHelloMessage_t *)malloc(sizeof(bzrtpHelloMessage_t));
-		memset(messageData, 0, sizeof(bzrtpHelloMessage_t));
+		/* the fixed part holds the flags and algorithms counts we need to check the length */
+		if (zrtpPacket->messageLength < ZRTP_HELLOMESSAGE_FIXED_LENGTH) {
+			return BZRTP_PARSER_ERROR_INVALIDMESSAGE;
+		}
+
+		/* the Hello message structure is held by the packet */
+		messageData = &zrtpPacket->message.hello;
 
 		/* fill it */
-		memcpy(messageData->version, messageContent, 4);
-		messageContent +=4;
-		memcpy(messageData->clientIdentifier, messageContent, 16);
+		retval = zrtpSchemaDecode(&helloSchema, messageContent, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH, messageData);
+		if (retval != 0) {
+			return retval;
+		}
 		messageData->clientIdentifier[16] = '\0'; /* be sure the clientIdentifier is a NULL terminated string */
-		messageContent +=16;
-		memcpy(messageData->H3, messageContent, 32);
-		messageContent +=32;
-		memcpy(messageData->ZID, messageContent, 12);
-		messageContent +=12;
+		messageContent += ZRTP_HELLO_SCHEMA_LENGTH;
 		messageData->S = ((*messageContent)>>6)&0x01;
 		messageData->M = ((*messageContent)>>5)&0x01;
 		messageData->P = ((*messageContent)>>4)&0x01;
@@ -351,7 +545,6 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 
 		/* Check message length according to value in hc, cc, ac, kc and sc */
 		if (zrtpPacket->messageLength != ZRTP_HELLOMESSAGE_FIXED_LENGTH + 4*((uint16_t)(messageData->hc)+(uint16_t)(messageData->cc)+(uint16_t)(messageData->ac)+(uint16_t)(messageData->kc)+(uint16_t)(messageData->sc))) {
-			free(messageData);
 			return BZRTP_PARSER_ERROR_INVALIDMESSAGE;
 		}
 
@@ -385,12 +578,8 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 
 		memcpy(messageData->MAC, messageContent, 8);
 
-		/* attach the message structure to the packet one */
-		zrtpPacket->messageData = (void *)messageData;
-
 		/* the parsed Hello packet must be saved as it may be used to generate commit message or the total_hash */
-		zrtpPacket->packetString = (uint8_t *)malloc(inputLength*sizeof(uint8_t));
-		memcpy(zrtpPacket->packetString, input, inputLength); /* store the whole packet even if we may use the message only */
+		zrtpPacketStoreReceivedString(zrtpPacket, input, inputLength); /* store the whole packet even if we may use the message only */
 	}
 		break; /* MSGTYPE_HELLO */
 
@@ -407,64 +596,47 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 
 	case MSGTYPE_COMMIT:
 	{
-		uint8_t checkH3[32];
-		uint8_t checkMAC[32];
 		bzrtpHelloMessage_t *peerHelloMessageData;
 		uint16_t variableLength = 0;
+		uint16_t pvOffset = 0;
 
-		/* allocate a commit message structure */
+		/* the commit message structure is held by the packet */
 		bzrtpCommitMessage_t *messageData;
-		messageData = (bzrtpCommitMessage_t *)malloc(sizeof(bzrtpCommitMessage_t));
-		memset(messageData, 0, sizeof(bzrtpCommitMessage_t));
+		messageData = &zrtpPacket->message.commit;
 
-		/* fill the structure */
-		memcpy(messageData->H2, messageContent, 32);
-		messageContent +=32;
+		/* fill the structure: H2, ZID and algorithms */
+		retval = zrtpSchemaDecode(&commitSchema, messageContent, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH, messageData);
+		if (retval != 0) {
+			return retval;
+		}
+		messageContent += ZRTP_COMMIT_SCHEMA_LENGTH;
 
 		/* We have now H2, check it matches the H3 we had in the hello message H3=SHA256(H2) and that the Hello message MAC is correct */
 		if (zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID] == NULL) {
-			free (messageData);
 			/* we have no Hello message in this channel, this commit shall never have arrived, discard it as invalid */
 			return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
 		}
-		peerHelloMessageData = (bzrtpHelloMessage_t *)zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->messageData;
+		peerHelloMessageData = &zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->message.hello;
 		/* Check H3 = SHA256(H2) */
-		bctbx_sha256(messageData->H2, 32, 32, checkH3);
-		if (memcmp(checkH3, peerHelloMessageData->H3, 32) != 0) {
-			free (messageData);
-			return BZRTP_PARSER_ERROR_UNMATCHINGHASHCHAIN;
-		}
-		/* Check the hello MAC message.
-				 * MAC is 8 bytes long and is computed on the message(skip the ZRTP_PACKET_HEADER) and exclude the mac itself (-8 bytes from message Length) */
-		bctbx_hmacSha256(messageData->H2, 32, zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->packetString+ZRTP_PACKET_HEADER_LENGTH, zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->messageLength-8, 8, checkMAC);
-		if (memcmp(checkMAC, peerHelloMessageData->MAC, 8) != 0) {
-			free (messageData);
-			return BZRTP_PARSER_ERROR_UNMATCHINGMAC;
-		}
-
-		memcpy(messageData->ZID, messageContent, 12);
-		messageContent +=12;
-		messageData->hashAlgo = bzrtp_cryptoAlgoTypeStringToInt(messageContent, ZRTP_HASH_TYPE);
-		messageContent += 4;
-		messageData->cipherAlgo = bzrtp_cryptoAlgoTypeStringToInt(messageContent, ZRTP_CIPHERBLOCK_TYPE);
-		messageContent += 4;
-		messageData->authTagAlgo = bzrtp_cryptoAlgoTypeStringToInt(messageContent, ZRTP_AUTHTAG_TYPE);
-		messageContent += 4;
-		messageData->keyAgreementAlgo = bzrtp_cryptoAlgoTypeStringToInt(messageContent, ZRTP_KEYAGREEMENT_TYPE);
-		messageContent += 4;
+		retval = zrtpCheckPeerHashChain(zrtpChannelContext, messageData->H2, 2, peerHelloMessageData->H3, 3);
+		if (retval != 0) {
+			return retval;
+		}
+		/* Check the hello MAC message */
+		retval = zrtpCheckPeerPacketMAC(zrtpChannelContext, HELLO_MESSAGE_STORE_ID, messageData->H2, peerHelloMessageData->MAC);
+		if (retval != 0) {
+			return retval;
+		}
+
 		/* commit message length depends on the key agreement type choosen (and set in the zrtpContext->keyAgreementAlgo) */
 		variableLength = bzrtp_computeCommitMessageVariableLength(messageData->keyAgreementAlgo);
 		if (variableLength == 0) { /* keyAgreement Algo unknown */
-			free(messageData);
 			return BZRTP_PARSER_ERROR_INVALIDMESSAGE;
 		}
 
 		if (zrtpPacket->messageLength != ZRTP_COMMITMESSAGE_FIXED_LENGTH + variableLength) {
-			free(messageData);
 			return BZRTP_PARSER_ERROR_INVALIDMESSAGE;
 		}
-		messageData->sasAlgo = bzrtp_cryptoAlgoTypeStringToInt(messageContent, ZRTP_SAS_TYPE);
-		messageContent += 4;
 
 		/* if it is a multistream or preshared commit, get the 16 bytes nonce */
 		if ((messageData->keyAgreementAlgo == ZRTP_KEYAGREEMENT_Prsh) || (messageData->keyAgreementAlgo == ZRTP_KEYAGREEMENT_Mult)) {
@@ -482,25 +654,26 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 			/* if the key exchange algo is of type KEM, there is also the public key */
 			if (bzrtp_isKem(messageData->keyAgreementAlgo)) {
 				uint16_t pvLength = bzrtp_computeKeyAgreementPublicValueLength(messageData->keyAgreementAlgo, MSGTYPE_COMMIT);
-				messageData->pv = (uint8_t *)malloc(pvLength*sizeof(uint8_t));
-				memcpy(messageData->pv, messageContent, pvLength);
+				pvOffset = (uint16_t)(messageContent - input); /* pv is not copied, it will point into the stored packet string */
 				messageContent += pvLength;
 			}
 		}
 
-		/* get the MAC and attach the message data to the packet structure */
+		/* get the MAC */
 		memcpy(messageData->MAC, messageContent, 8);
-		zrtpPacket->messageData = (void *)messageData;
 
 		/* the parsed commit packet must be saved as it is used to generate the total_hash */
-		zrtpPacket->packetString = (uint8_t *)malloc(inputLength*sizeof(uint8_t));
-		memcpy(zrtpPacket->packetString, input, inputLength); /* store the whole packet even if we may use the message only */
+		zrtpPacketStoreReceivedString(zrtpPacket, input, inputLength); /* store the whole packet even if we may use the message only */
+		if (pvOffset != 0) {
+			messageData->pv = zrtpPacket->packetString + pvOffset;
+		}
 	}
 		break; /* MSGTYPE_COMMIT */
 	case MSGTYPE_DHPART1 :
 	case MSGTYPE_DHPART2 :
 	{
 		bzrtpDHPartMessage_t *messageData;
+		uint16_t pvOffset;
 
 		/*check message length, depends on the selected key agreement algo set in zrtpContext */
 		uint16_t pvLength = bzrtp_computeKeyAgreementPublicValueLength(zrtpChannelContext->keyAgreementAlgo, zrtpPacket->messageType);
@@ -512,38 +685,34 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 			return BZRTP_PARSER_ERROR_INVALIDMESSAGE;
 		}
 
-		/* allocate a DHPart message structure and pv */
-		messageData = (bzrtpDHPartMessage_t *)malloc(sizeof(bzrtpDHPartMessage_t));
-		memset(messageData, 0, sizeof(bzrtpDHPartMessage_t));
+		/* the DHPart message structure is held by the packet */
+		messageData = &zrtpPacket->message.dhPart;
 
-		/* fill the structure */
-		memcpy(messageData->H1, messageContent, 32);
-		messageContent +=32;
+		/* fill the structure: H1 and secrets IDs */
+		retval = zrtpSchemaDecode(&dhPartSchema, messageContent, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH, messageData);
+		if (retval != 0) {
+			return retval;
+		}
+		messageContent += ZRTP_DHPART_SCHEMA_LENGTH;
 
 		/* We have now H1, check it matches the H2 we had in the commit message H2=SHA256(H1) and that the Commit message MAC is correct */
 		if ( zrtpChannelContext->role == BZRTP_ROLE_RESPONDER) { /* do it only if we are responder (we received a commit packet) */
-			uint8_t checkH2[32];
-			uint8_t checkMAC[32];
 			bzrtpCommitMessage_t *peerCommitMessageData;
 
 			if (zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID] == NULL) {
-				free (messageData);
 				/* we have no Commit message in this channel, this DHPart2 shall never have arrived, discard it as invalid */
 				return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
 			}
-			peerCommitMessageData = (bzrtpCommitMessage_t *)zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->messageData;
+			peerCommitMessageData = &zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->message.commit;
 			/* Check H2 = SHA256(H1) */
-			bctbx_sha256(messageData->H1, 32, 32, checkH2);
-			if (memcmp(checkH2, peerCommitMessageData->H2, 32) != 0) {
-				free (messageData);
-				return BZRTP_PARSER_ERROR_UNMATCHINGHASHCHAIN;
+			retval = zrtpCheckPeerHashChain(zrtpChannelContext, messageData->H1, 1, peerCommitMessageData->H2, 2);
+			if (retval != 0) {
+				return retval;
 			}
-			/* Check the Commit MAC message.
-					 * MAC is 8 bytes long and is computed on the message(skip the ZRTP_PACKET_HEADER) and exclude the mac itself (-8 bytes from message Length) */
-			bctbx_hmacSha256(messageData->H1, 32, zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->packetString+ZRTP_PACKET_HEADER_LENGTH, zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->messageLength-8, 8, checkMAC);
-			if (memcmp(checkMAC, peerCommitMessageData->MAC, 8) != 0) {
-				free (messageData);
-				return BZRTP_PARSER_ERROR_UNMATCHINGMAC;
+			/* Check the Commit MAC message */
+			retval = zrtpCheckPeerPacketMAC(zrtpChannelContext, COMMIT_MESSAGE_STORE_ID, messageData->H1, peerCommitMessageData->MAC);
+			if (retval != 0) {
+				return retval;
 			}
 
 			/* Check the hvi received in the commit message  - RFC section 4.4.1.1*/
@@ -566,61 +735,38 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 
 				/* Compare computed and received hvi */
 				if (memcmp(computedHvi, peerCommitMessageData->hvi, 32)!=0) {
-					free (messageData);
 					return BZRTP_PARSER_ERROR_UNMATCHINGHVI;
 				}
 			}
 
 		} else { /* if we are initiator(we didn't received any commit message and then no H2), we must check that H3=SHA256(SHA256(H1)) and the Hello message MAC */
-			uint8_t checkH2[32];
-			uint8_t checkH3[32];
-			uint8_t checkMAC[32];
 			bzrtpHelloMessage_t *peerHelloMessageData;
 
 			if (zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID] == NULL) {
-				free (messageData);
 				/* we have no Hello message in this channel, this DHPart1 shall never have arrived, discard it as invalid */
 				return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
 			}
-			peerHelloMessageData = (bzrtpHelloMessage_t *)zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->messageData;
-			/* Check H3 = SHA256(SHA256(H1)) */
-			bctbx_sha256(messageData->H1, 32, 32, checkH2);
-			bctbx_sha256(checkH2, 32, 32, checkH3);
-			if (memcmp(checkH3, peerHelloMessageData->H3, 32) != 0) {
-				free (messageData);
-				return BZRTP_PARSER_ERROR_UNMATCHINGHASHCHAIN;
+			peerHelloMessageData = &zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->message.hello;
+			/* Check H3 = SHA256(SHA256(H1)), the intermediate H2 is then stored in peerH */
+			retval = zrtpCheckPeerHashChain(zrtpChannelContext, messageData->H1, 1, peerHelloMessageData->H3, 3);
+			if (retval != 0) {
+				return retval;
 			}
-			/* Check the hello MAC message.
-					 * MAC is 8 bytes long and is computed on the message(skip the ZRTP_PACKET_HEADER) and exclude the mac itself (-8 bytes from message Length) */
-			bctbx_hmacSha256(checkH2, 32, zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->packetString+ZRTP_PACKET_HEADER_LENGTH, zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->messageLength-8, 8, checkMAC);
-			if (memcmp(checkMAC, peerHelloMessageData->MAC, 8) != 0) {
-				free (messageData);
-				return BZRTP_PARSER_ERROR_UNMATCHINGMAC;
+			/* Check the hello MAC message */
+			retval = zrtpCheckPeerPacketMAC(zrtpChannelContext, HELLO_MESSAGE_STORE_ID, zrtpChannelContext->peerH[2], peerHelloMessageData->MAC);
+			if (retval != 0) {
+				return retval;
 			}
 
 		}
 
-		/* alloc pv once all check are passed */
-		messageData->pv = (uint8_t *)malloc(pvLength*sizeof(uint8_t));
-
-		memcpy(messageData->rs1ID, messageContent, 8);
-		messageContent +=8;
-		memcpy(messageData->rs2ID, messageContent, 8);
-		messageContent +=8;
-		memcpy(messageData->auxsecretID, messageContent, 8);
-		messageContent +=8;
-		memcpy(messageData->pbxsecretID, messageContent, 8);
-		messageContent +=8;
-		memcpy(messageData->pv, messageContent, pvLength);
+		pvOffset = (uint16_t)(messageContent - input); /* pv is not copied, it will point into the stored packet string */
 		messageContent +=pvLength;
 		memcpy(messageData->MAC, messageContent, 8);
 
-		/* attach the message structure to the packet one */
-		zrtpPacket->messageData = (void *)messageData;
-
 		/* the parsed packet must be saved as it is used to generate the total_hash */
-		zrtpPacket->packetString = (uint8_t *)malloc(inputLength*sizeof(uint8_t));
-		memcpy(zrtpPacket->packetString, input, inputLength); /* store the whole packet even if we may use the message only */
+		zrtpPacketStoreReceivedString(zrtpPacket, input, inputLength); /* store the whole packet even if we may use the message only */
+		messageData->pv = zrtpPacket->packetString + pvOffset;
 	}
 		break; /* MSGTYPE_DHPART1 and MSGTYPE_DHPART2 */
 	case MSGTYPE_CONFIRM1:
@@ -651,17 +797,20 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 			confirmMessageMacKey = zrtpChannelContext->mackeyr;
 		}
 
-		/* allocate a confirm message structure */
-		messageData = (bzrtpConfirmMessage_t *)malloc(sizeof(bzrtpConfirmMessage_t));
-		memset(messageData, 0, sizeof(bzrtpConfirmMessage_t));
-
-		/* get the mac and the IV */
-		memcpy(messageData->confirm_mac, messageContent, 8);
-		messageContent +=8;
-		memcpy(messageData->CFBIV, messageContent, 16);
-		messageContent +=16;
+		/* the confirm message structure is held by the packet */
+		messageData = &zrtpPacket->message.confirm;
 
+		/* the encrypted part holds at least H0, sig_len, flags and cache expiration interval */
+		if (zrtpPacket->messageLength < ZRTP_CONFIRMMESSAGE_FIXED_LENGTH) {
+			return BZRTP_PARSER_ERROR_INVALIDMESSAGE;
+		}
 
+		/* get the mac and the IV */
+		retval = zrtpSchemaDecode(&confirmSchema, messageContent, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH, messageData);
+		if (retval != 0) {
+			return retval;
+		}
+		messageContent += ZRTP_CONFIRM_SCHEMA_LENGTH;
 
 		/* get the cipher text length */
 		cipherTextLength = zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH - 24; /* confirm message is header, confirm_mac(8 bytes), CFB IV(16 bytes), encrypted part */
@@ -670,7 +819,6 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 		zrtpChannelContext->hmacFunction(confirmMessageMacKey, zrtpChannelContext->hashLength, messageContent, cipherTextLength, 8, computedHmac);
 
 		if (memcmp(computedHmac, messageData->confirm_mac, 8) != 0) { /* confirm_mac doesn't match */
-			free(messageData);
 			return BZRTP_PARSER_ERROR_UNMATCHINGCONFIRMMAC;
 		}
 
@@ -679,93 +827,80 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 		zrtpChannelContext->cipherDecryptionFunction(confirmMessageKey, messageData->CFBIV, messageContent, cipherTextLength, confirmPlainMessageBuffer);
 		confirmPlainMessage = confirmPlainMessageBuffer; /* point into the allocated buffer */
 
-		/* parse it */
-		memcpy(messageData->H0, confirmPlainMessage, 32);
+		/* parse it: H0 and cache expiration interval */
+		retval = zrtpSchemaDecode(&confirmPlainSchema, confirmPlainMessage, cipherTextLength, messageData);
+		if (retval != 0) {
+			free(confirmPlainMessageBuffer);
+			return retval;
+		}
 		confirmPlainMessage +=33; /* +33 because next 8 bits are unused */
 
 		/* Hash chain checking: if we are in multichannel or shared mode, we had not DHPart and then no H1 */
 		if (zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_Prsh || zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_Mult) {
-			/* compute the H1=SHA256(H0) we never received */
-			uint8_t checkH1[32];
-			bctbx_sha256(messageData->H0, 32, 32, checkH1);
-
+			/* H1=SHA256(H0) we never received is computed while checking the chain and then stored in peerH */
 			/* if we are responder, we received a commit packet with H2 then check that H2=SHA256(H1) and that the commit message MAC keyed with H1 match */
 			if ( zrtpChannelContext->role == BZRTP_ROLE_RESPONDER) {
-				uint8_t checkH2[32];
-				uint8_t checkMAC[32];
 				bzrtpCommitMessage_t *peerCommitMessageData;
 
 				if (zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID] == NULL) {
-					free (messageData);
 					/* we have no Commit message in this channel, this Confirm2 shall never have arrived, discard it as invalid */
 					return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
 				}
-				peerCommitMessageData = (bzrtpCommitMessage_t *)zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->messageData;
-				/* Check H2 = SHA256(H1) */
-				bctbx_sha256(checkH1, 32, 32, checkH2);
-				if (memcmp(checkH2, peerCommitMessageData->H2, 32) != 0) {
-					free (messageData);
-					return BZRTP_PARSER_ERROR_UNMATCHINGHASHCHAIN;
+				peerCommitMessageData = &zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->message.commit;
+				/* Check H2 = SHA256(SHA256(H0)) */
+				retval = zrtpCheckPeerHashChain(zrtpChannelContext, messageData->H0, 0, peerCommitMessageData->H2, 2);
+				if (retval != 0) {
+					free(confirmPlainMessageBuffer);
+					return retval;
 				}
-				/* Check the Commit MAC message.
-						 * MAC is 8 bytes long and is computed on the message(skip the ZRTP_PACKET_HEADER) and exclude the mac itself (-8 bytes from message Length) */
-				bctbx_hmacSha256(checkH1, 32, zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->packetString+ZRTP_PACKET_HEADER_LENGTH, zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->messageLength-8, 8, checkMAC);
-				if (memcmp(checkMAC, peerCommitMessageData->MAC, 8) != 0) {
-					free (messageData);
-					return BZRTP_PARSER_ERROR_UNMATCHINGMAC;
+				/* Check the Commit MAC message */
+				retval = zrtpCheckPeerPacketMAC(zrtpChannelContext, COMMIT_MESSAGE_STORE_ID, zrtpChannelContext->peerH[1], peerCommitMessageData->MAC);
+				if (retval != 0) {
+					free(confirmPlainMessageBuffer);
+					return retval;
 				}
 			} else { /* if we are initiator(we didn't received any commit message and then no H2), we must check that H3=SHA256(SHA256(H1)) and the Hello message MAC */
-				uint8_t checkH2[32];
-				uint8_t checkH3[32];
-				uint8_t checkMAC[32];
 				bzrtpHelloMessage_t *peerHelloMessageData;
 
 				if (zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID] == NULL) {
-					free (messageData);
 					/* we have no Hello message in this channel, this Confirm1 shall never have arrived, discard it as invalid */
 					return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
 				}
-				peerHelloMessageData = (bzrtpHelloMessage_t *)zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->messageData;
-				/* Check H3 = SHA256(SHA256(H1)) */
-				bctbx_sha256(checkH1, 32, 32, checkH2);
-				bctbx_sha256(checkH2, 32, 32, checkH3);
-				if (memcmp(checkH3, peerHelloMessageData->H3, 32) != 0) {
-					free (messageData);
-					return BZRTP_PARSER_ERROR_UNMATCHINGHASHCHAIN;
+				peerHelloMessageData = &zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->message.hello;
+				/* Check H3 = SHA256(SHA256(SHA256(H0))) */
+				retval = zrtpCheckPeerHashChain(zrtpChannelContext, messageData->H0, 0, peerHelloMessageData->H3, 3);
+				if (retval != 0) {
+					free(confirmPlainMessageBuffer);
+					return retval;
 				}
-				/* Check the hello MAC message.
-						 * MAC is 8 bytes long and is computed on the message(skip the ZRTP_PACKET_HEADER) and exclude the mac itself (-8 bytes from message Length) */
-				bctbx_hmacSha256(checkH2, 32, zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->packetString+ZRTP_PACKET_HEADER_LENGTH, zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->messageLength-8, 8, checkMAC);
-				if (memcmp(checkMAC, peerHelloMessageData->MAC, 8) != 0) {
-					free (messageData);
-					return BZRTP_PARSER_ERROR_UNMATCHINGMAC;
+				/* Check the hello MAC message */
+				retval = zrtpCheckPeerPacketMAC(zrtpChannelContext, HELLO_MESSAGE_STORE_ID, zrtpChannelContext->peerH[2], peerHelloMessageData->MAC);
+				if (retval != 0) {
+					free(confirmPlainMessageBuffer);
+					return retval;
 				}
 
 			}
 		} else { /* we are in DHM mode */
 			/* We have now H0, check it matches the H1 we had in the DHPart message H1=SHA256(H0) and that the DHPart message MAC is correct */
-			uint8_t checkH1[32];
-			uint8_t checkMAC[32];
 			bzrtpDHPartMessage_t *peerDHPartMessageData;
 
 			if (zrtpChannelContext->peerPackets[DHPART_MESSAGE_STORE_ID] == NULL) {
-				free (messageData);
 				/* we have no DHPART message in this channel, this confirm shall never have arrived, discard it as invalid */
 				return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
 			}
-			peerDHPartMessageData = (bzrtpDHPartMessage_t *)zrtpChannelContext->peerPackets[DHPART_MESSAGE_STORE_ID]->messageData;
+			peerDHPartMessageData = &zrtpChannelContext->peerPackets[DHPART_MESSAGE_STORE_ID]->message.dhPart;
 			/* Check H1 = SHA256(H0) */
-			bctbx_sha256(messageData->H0, 32, 32, checkH1);
-			if (memcmp(checkH1, peerDHPartMessageData->H1, 32) != 0) {
-				free (messageData);
-				return BZRTP_PARSER_ERROR_UNMATCHINGHASHCHAIN;
+			retval = zrtpCheckPeerHashChain(zrtpChannelContext, messageData->H0, 0, peerDHPartMessageData->H1, 1);
+			if (retval != 0) {
+				free(confirmPlainMessageBuffer);
+				return retval;
 			}
-			/* Check the DHPart message.
-					 * MAC is 8 bytes long and is computed on the message(skip the ZRTP_PACKET_HEADER) and exclude the mac itself (-8 bytes from message Length) */
-			bctbx_hmacSha256(messageData->H0, 32, zrtpChannelContext->peerPackets[DHPART_MESSAGE_STORE_ID]->packetString+ZRTP_PACKET_HEADER_LENGTH, zrtpChannelContext->peerPackets[DHPART_MESSAGE_STORE_ID]->messageLength-8, 8, checkMAC);
-			if (memcmp(checkMAC, peerDHPartMessageData->MAC, 8) != 0) {
-				free (messageData);
-				return BZRTP_PARSER_ERROR_UNMATCHINGMAC;
+			/* Check the DHPart message */
+			retval = zrtpCheckPeerPacketMAC(zrtpChannelContext, DHPART_MESSAGE_STORE_ID, messageData->H0, peerDHPartMessageData->MAC);
+			if (retval != 0) {
+				free(confirmPlainMessageBuffer);
+				return retval;
 			}
 		}
 
@@ -775,10 +910,7 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 		messageData->V = ((*confirmPlainMessage)&0x04)>>2;
 		messageData->A = ((*confirmPlainMessage)&0x02)>>1;
 		messageData->D = (*confirmPlainMessage)&0x01;
-		confirmPlainMessage += 1;
-
-		messageData->cacheExpirationInterval = (((uint32_t)confirmPlainMessage[0])<<24) | (((uint32_t)confirmPlainMessage[1])<<16) | (((uint32_t)confirmPlainMessage[2])<<8) | ((uint32_t)confirmPlainMessage[3]);
-		confirmPlainMessage += 4;
+		confirmPlainMessage += 5; /* cache expiration interval was decoded with H0 */
 
 
 		/* if sig_len indicate a signature, parse it */
@@ -789,53 +921,70 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 			messageData->signatureBlock = (uint8_t *)malloc(4*(messageData->sig_len-1)*sizeof(uint8_t));
 			memcpy(messageData->signatureBlock, confirmPlainMessage, 4*(messageData->sig_len-1));
 		} else {
-			messageData->signatureBlock  = NULL;
+			messageData->signatureBlock = NULL;
 		}
 
 		/* free plain buffer */
 		free(confirmPlainMessageBuffer);
 
 		/* the parsed commit packet must be saved as it is used to check correct packet repetition */
-		zrtpPacket->packetString = (uint8_t *)malloc(inputLength*sizeof(uint8_t));
-		memcpy(zrtpPacket->packetString, input, inputLength); /* store the whole packet even if we may use the message only */
-
-		/* attach the message structure to the packet one */
-		zrtpPacket->messageData = (void *)messageData;
+		zrtpPacketStoreReceivedString(zrtpPacket, input, inputLength); /* store the whole packet even if we may use the message only */
 	}
 		break; /* MSGTYPE_CONFIRM1 and MSGTYPE_CONFIRM2 */
 
 	case MSGTYPE_CONF2ACK:
 		/* nothing to do for this one */
 		break; /* MSGTYPE_CONF2ACK */
+
+	case MSGTYPE_ERROR :
+	{
+		/* Error message structure is held by the packet */
+		bzrtpErrorMessage_t *messageData;
+
+		/* check message length */
+		if (zrtpPacket->messageLength != ZRTP_ERRORMESSAGE_FIXED_LENGTH) {
+			return BZRTP_PARSER_ERROR_INVALIDMESSAGE;
+		}
+
+		messageData = &zrtpPacket->message.error;
+
+		/* fill the structure */
+		retval = zrtpSchemaDecode(&errorSchema, messageContent, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH, messageData);
+		if (retval != 0) {
+			return retval;
+		}
+	}
+		break; /* MSGTYPE_ERROR */
+
+	case MSGTYPE_ERRORACK:
+		/* nothing to do for this one */
+		break; /* MSGTYPE_ERRORACK */
 #ifdef GOCLEAR_ENABLED
 	case MSGTYPE_GOCLEAR :
 	{
-		/* allocate a GoClear message structure */
+		/* GoClear message structure is held by the packet */
 		bzrtpGoClearMessage_t *messageData;
-		messageData = (bzrtpGoClearMessage_t *)malloc(sizeof(bzrtpGoClearMessage_t));
+		messageData = &zrtpPacket->message.goClear;
 
 		/* fill the structure */
-		memcpy(messageData->clear_mac, messageContent, 8);
-
-		/* attach the message structure to the packet one */
-		zrtpPacket->messageData = (void *)messageData;
+		retval = zrtpSchemaDecode(&goClearSchema, messageContent, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH, messageData);
+		if (retval != 0) {
+			return retval;
+		}
 	}
 		break; /* MSGTYPE_GOCLEAR */
 #endif /* GOCLEAR_ENABLED */
 	case MSGTYPE_PING:
 	{
-		/* allocate a ping message structure */
+		/* ping message structure is held by the packet */
 		bzrtpPingMessage_t *messageData;
-		messageData = (bzrtpPingMessage_t *)malloc(sizeof(bzrtpPingMessage_t));
-		memset(messageData, 0, sizeof(bzrtpPingMessage_t));
+		messageData = &zrtpPacket->message.ping;
 
 		/* fill the structure */
-		memcpy(messageData->version, messageContent, 4);
-		messageContent +=4;
-		memcpy(messageData->endpointHash, messageContent, 8);
-
-		/* attach the message structure to the packet one */
-		zrtpPacket->messageData = (void *)messageData;
+		retval = zrtpSchemaDecode(&pingSchema, messageContent, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH, messageData);
+		if (retval != 0) {
+			return retval;
+		}
 	}
 		break; /* MSGTYPE_PING */
 
@@ -844,7 +993,7 @@ int bzrtp_packetParser(BCTBX_UNUSED(bzrtpContext_t *zrtpContext), bzrtpChannelCo
 	return 0;
 }
 
-/* Create the packet string from the messageData contained into the zrtp Packet structure */
+/* Create the packet string from the message contained into the zrtp Packet structure */
 int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket) {
 	
 	int i;
@@ -871,30 +1020,23 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 	{
 		bzrtpHelloMessage_t *messageData;
 
-		/* get the Hello message structure */
-		if (zrtpPacket->messageData == NULL) {
-			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
-		}
-		messageData = (bzrtpHelloMessage_t *)zrtpPacket->messageData;
+		messageData = &zrtpPacket->message.hello;
 
 		/* compute the message length in bytes : fixed length and optionnal algorithms parts */
 		zrtpPacket->messageLength = ZRTP_HELLOMESSAGE_FIXED_LENGTH + 4*((uint16_t)(messageData->hc)+(uint16_t)(messageData->cc)+(uint16_t)(messageData->ac)+(uint16_t)(messageData->kc)+(uint16_t)(messageData->sc));
 
 		/* allocate the packetString buffer : packet is header+message+crc */
-		zrtpPacket->packetString = (uint8_t *)malloc((ZRTP_PACKET_HEADER_LENGTH+zrtpPacket->messageLength+ZRTP_PACKET_CRC_LENGTH)*sizeof(uint8_t));
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+zrtpPacket->messageLength+ZRTP_PACKET_CRC_LENGTH);
 		/* have the messageString pointer to the begining of message(after the message header wich is computed for all messages after the switch)
 				 * within the packetString buffer*/
 		messageString = zrtpPacket->packetString + ZRTP_PACKET_HEADER_LENGTH + ZRTP_MESSAGE_HEADER_LENGTH;
 
-		/* set the version (shall be 1.10), Client identifier, H3, ZID, S,M,P flags and  hc,cc,ac,kc,sc */
-		memcpy(messageString, messageData->version, 4);
-		messageString += 4;
-		memcpy(messageString, messageData->clientIdentifier, 16);
-		messageString += 16;
-		memcpy(messageString, messageData->H3, 32);
-		messageString += 32;
-		memcpy(messageString, messageData->ZID, 12);
-		messageString += 12;
+		/* set the version (shall be 1.10), Client identifier, H3, ZID, then S,M,P flags and  hc,cc,ac,kc,sc */
+		if (zrtpSchemaEncode(&helloSchema, messageData, messageString, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH) != 0) {
+			zrtpPacketStringFree(zrtpPacket);
+			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
+		}
+		messageString += ZRTP_HELLO_SCHEMA_LENGTH;
 		*messageString = ((((messageData->S)&0x01)<<6) | (((messageData->M)&0x01)<<5) | (((messageData->P)&0x01)<<4))&0x70;
 		messageString += 1;
 		*messageString = (messageData->hc)&0x0F;
@@ -939,7 +1081,7 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 		zrtpPacket->messageLength = ZRTP_HELLOACKMESSAGE_FIXED_LENGTH;
 
 		/* allocate the packetString buffer : packet is header+message+crc */
-		zrtpPacket->packetString = (uint8_t *)malloc((ZRTP_PACKET_HEADER_LENGTH+ZRTP_HELLOACKMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH)*sizeof(uint8_t));
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+ZRTP_HELLOACKMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH);
 	}
 		break; /* MSGTYPE_HELLOACK */
 
@@ -948,12 +1090,7 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 		bzrtpCommitMessage_t *messageData;
 		uint16_t variableLength = 0;
 
-		/* get the Commit message structure */
-		if (zrtpPacket->messageData == NULL) {
-			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
-		}
-
-		messageData = (bzrtpCommitMessage_t *)zrtpPacket->messageData;
+		messageData = &zrtpPacket->message.commit;
 
 		/* compute message length */
 		variableLength = bzrtp_computeCommitMessageVariableLength(messageData->keyAgreementAlgo);
@@ -963,26 +1100,17 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 		zrtpPacket->messageLength = ZRTP_COMMITMESSAGE_FIXED_LENGTH + variableLength;
 
 		/* allocate the packetString buffer : packet is header+message+crc */
-		zrtpPacket->packetString = (uint8_t *)malloc((ZRTP_PACKET_HEADER_LENGTH+zrtpPacket->messageLength+ZRTP_PACKET_CRC_LENGTH)*sizeof(uint8_t));
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+zrtpPacket->messageLength+ZRTP_PACKET_CRC_LENGTH);
 		/* have the messageString pointer to the begining of message(after the message header wich is computed for all messages after the switch)
 				 * within the packetString buffer*/
 		messageString = zrtpPacket->packetString + ZRTP_PACKET_HEADER_LENGTH + ZRTP_MESSAGE_HEADER_LENGTH;
 
 		/* now insert the different message parts into the packetString */
-		memcpy(messageString, messageData->H2, 32);
-		messageString += 32;
-		memcpy(messageString, messageData->ZID, 12);
-		messageString += 12;
-		bzrtp_cryptoAlgoTypeIntToString(messageData->hashAlgo, messageString);
-		messageString += 4;
-		bzrtp_cryptoAlgoTypeIntToString(messageData->cipherAlgo, messageString);
-		messageString += 4;
-		bzrtp_cryptoAlgoTypeIntToString(messageData->authTagAlgo, messageString);
-		messageString += 4;
-		bzrtp_cryptoAlgoTypeIntToString(messageData->keyAgreementAlgo, messageString);
-		messageString += 4;
-		bzrtp_cryptoAlgoTypeIntToString(messageData->sasAlgo, messageString);
-		messageString += 4;
+		if (zrtpSchemaEncode(&commitSchema, messageData, messageString, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH) != 0) {
+			zrtpPacketStringFree(zrtpPacket);
+			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
+		}
+		messageString += ZRTP_COMMIT_SCHEMA_LENGTH;
 
 		/* if it is a multistream or preshared commit insert the 16 bytes nonce */
 		if ((messageData->keyAgreementAlgo == ZRTP_KEYAGREEMENT_Prsh) || (messageData->keyAgreementAlgo == ZRTP_KEYAGREEMENT_Mult)) {
@@ -999,7 +1127,9 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 			messageString +=32;
 			/* for KEM type, insert the public key after the hvi */
 			if (bzrtp_isKem(messageData->keyAgreementAlgo)) {
-				memcpy(messageString, messageData->pv, bzrtp_computeKeyAgreementPublicValueLength(messageData->keyAgreementAlgo, MSGTYPE_COMMIT));
+				if (messageData->pv != messageString) { /* pv may already be in place when it references the packetString */
+					memcpy(messageString, messageData->pv, bzrtp_computeKeyAgreementPublicValueLength(messageData->keyAgreementAlgo, MSGTYPE_COMMIT));
+				}
 				messageString += bzrtp_computeKeyAgreementPublicValueLength(messageData->keyAgreementAlgo, MSGTYPE_COMMIT);
 			}
 		}
@@ -1016,12 +1146,7 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 		bzrtpDHPartMessage_t *messageData;
 		uint16_t pvLength;
 
-		/* get the DHPart message structure */
-		if (zrtpPacket->messageData == NULL) {
-			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
-		}
-
-		messageData = (bzrtpDHPartMessage_t *)zrtpPacket->messageData;
+		messageData = &zrtpPacket->message.dhPart;
 
 		/* compute message length */
 		pvLength = bzrtp_computeKeyAgreementPublicValueLength(zrtpChannelContext->keyAgreementAlgo, zrtpPacket->messageType);
@@ -1031,23 +1156,20 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 		zrtpPacket->messageLength = ZRTP_DHPARTMESSAGE_FIXED_LENGTH + pvLength;
 
 		/* allocate the packetString buffer : packet is header+message+crc */
-		zrtpPacket->packetString = (uint8_t *)malloc((ZRTP_PACKET_HEADER_LENGTH+zrtpPacket->messageLength+ZRTP_PACKET_CRC_LENGTH)*sizeof(uint8_t));
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+zrtpPacket->messageLength+ZRTP_PACKET_CRC_LENGTH);
 		/* have the messageString pointer to the begining of message(after the message header wich is computed for all messages after the switch)
 				 * within the packetString buffer*/
 		messageString = zrtpPacket->packetString + ZRTP_PACKET_HEADER_LENGTH + ZRTP_MESSAGE_HEADER_LENGTH;
 
 		/* now insert the different message parts into the packetString */
-		memcpy(messageString, messageData->H1, 32);
-		messageString += 32;
-		memcpy(messageString, messageData->rs1ID, 8);
-		messageString += 8;
-		memcpy(messageString, messageData->rs2ID, 8);
-		messageString += 8;
-		memcpy(messageString, messageData->auxsecretID, 8);
-		messageString += 8;
-		memcpy(messageString, messageData->pbxsecretID, 8);
-		messageString += 8;
-		memcpy(messageString, messageData->pv, pvLength);
+		if (zrtpSchemaEncode(&dhPartSchema, messageData, messageString, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH) != 0) {
+			zrtpPacketStringFree(zrtpPacket);
+			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
+		}
+		messageString += ZRTP_DHPART_SCHEMA_LENGTH;
+		if (messageData->pv != messageString) { /* pv may already be in place when it references the packetString */
+			memcpy(messageString, messageData->pv, pvLength);
+		}
 		messageString += pvLength;
 
 		/* there is a MAC to compute, set the pointers to the key and MAC output buffer */
@@ -1065,6 +1187,7 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 		uint16_t encryptedPartLength;
 		uint8_t *plainMessageString;
 		uint16_t plainMessageStringIndex = 0;
+		uint8_t confirmMac[8];
 
 		/* we will have to encrypt and validate the message, check we have the keys to do it */
 		if (zrtpChannelContext->role == BZRTP_ROLE_INITIATOR) {
@@ -1083,18 +1206,13 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 			confirmMessageMacKey = zrtpChannelContext->mackeyr;
 		}
 
-		/* get the Confirm message structure */
-		if (zrtpPacket->messageData == NULL) {
-			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
-		}
-
-		messageData = (bzrtpConfirmMessage_t *)zrtpPacket->messageData;
+		messageData = &zrtpPacket->message.confirm;
 
 		/* compute message length */
 		zrtpPacket->messageLength = ZRTP_CONFIRMMESSAGE_FIXED_LENGTH + messageData->sig_len*4; /* sig_len is in word of 4 bytes */
 
 		/* allocate the packetString buffer : packet is header+message+crc */
-		zrtpPacket->packetString = (uint8_t *)malloc((ZRTP_PACKET_HEADER_LENGTH+zrtpPacket->messageLength+ZRTP_PACKET_CRC_LENGTH)*sizeof(uint8_t));
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+zrtpPacket->messageLength+ZRTP_PACKET_CRC_LENGTH);
 		/* have the messageString pointer to the begining of message(after the message header wich is computed for all messages after the switch)
 				 * within the packetString buffer*/
 		messageString = zrtpPacket->packetString + ZRTP_PACKET_HEADER_LENGTH + ZRTP_MESSAGE_HEADER_LENGTH;
@@ -1103,18 +1221,18 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 		encryptedPartLength = zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH - 24; /* message header, confirm_mac(8 bytes) and CFB IV(16 bytes) are not encrypted */
 		plainMessageString = (uint8_t *)malloc(encryptedPartLength*sizeof(uint8_t));
 
-		/* fill the plain message buffer with data from the message structure */
-		memcpy(plainMessageString, messageData->H0, 32);
+		/* fill the plain message buffer with data from the message structure: H0 and cache expiration interval from the schema, then sig_len and flags */
+		if (zrtpSchemaEncode(&confirmPlainSchema, messageData, plainMessageString, encryptedPartLength) != 0) {
+			free(plainMessageString);
+			zrtpPacketStringFree(zrtpPacket);
+			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
+		}
 		plainMessageStringIndex += 32;
 		plainMessageString[plainMessageStringIndex++] = 0x00;
 		plainMessageString[plainMessageStringIndex++] = (uint8_t)(((messageData->sig_len)>>8)&0x0001);
 		plainMessageString[plainMessageStringIndex++] = (uint8_t)((messageData->sig_len)&0x00FF);
 		plainMessageString[plainMessageStringIndex++] = (uint8_t)((messageData->E&0x01)<<3) | (uint8_t)((messageData->V&0x01)<<2) | (uint8_t)((messageData->A&0x01)<<1) | (uint8_t)(messageData->D&0x01) ;
-		/* cache expiration in a 32 bits unsigned int */
-		plainMessageString[plainMessageStringIndex++] = (uint8_t)((messageData->cacheExpirationInterval>>24)&0xFF);
-		plainMessageString[plainMessageStringIndex++] = (uint8_t)((messageData->cacheExpirationInterval>>16)&0xFF);
-		plainMessageString[plainMessageStringIndex++] = (uint8_t)((messageData->cacheExpirationInterval>>8)&0xFF);
-		plainMessageString[plainMessageStringIndex++] = (uint8_t)((messageData->cacheExpirationInterval)&0xFF);
+		plainMessageStringIndex += 4; /* cache expiration interval */
 
 		if (messageData->sig_len>0) {
 			memcpy(plainMessageString+plainMessageStringIndex, messageData->signatureBlockType, 4);
@@ -1127,11 +1245,15 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 		zrtpChannelContext->cipherEncryptionFunction(confirmMessageKey, messageData->CFBIV, plainMessageString, encryptedPartLength, messageString+24);
 		free(plainMessageString); /* free the plain message string temporary buffer */
 
+		/* add the CFB IV, the confirm_mac field is overwritten by the computed mac below */
+		if (zrtpSchemaEncode(&confirmSchema, messageData, messageString, zrtpPacket->messageLength - ZRTP_MESSAGE_HEADER_LENGTH) != 0) {
+			zrtpPacketStringFree(zrtpPacket);
+			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
+		}
+
 		/* compute the mac over the encrypted part of the message and set the result in the messageString */
-		zrtpChannelContext->hmacFunction(confirmMessageMacKey, zrtpChannelContext->hashLength, messageString+24, encryptedPartLength, 8, messageString);
-		messageString += 8;
-		/* add the CFB IV */
-		memcpy(messageString, messageData->CFBIV, 16);
+		zrtpChannelContext->hmacFunction(confirmMessageMacKey, zrtpChannelContext->hashLength, messageString+24, encryptedPartLength, 8, confirmMac);
+		memcpy(messageString, confirmMac, 8);
 	}
 		break; /* MSGTYPE_CONFIRM1 and MSGTYPE_CONFIRM2 */
 
@@ -1141,64 +1263,72 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 		zrtpPacket->messageLength = ZRTP_CONF2ACKMESSAGE_FIXED_LENGTH;
 
 		/* allocate the packetString buffer : packet is header+message+crc */
-		zrtpPacket->packetString = (uint8_t *)malloc((ZRTP_PACKET_HEADER_LENGTH+ZRTP_CONF2ACKMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH)*sizeof(uint8_t));
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+ZRTP_CONF2ACKMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH);
 	}
 		break; /* MSGTYPE_CONF2ACK */
-#ifdef GOCLEAR_ENABLED
-	case MSGTYPE_GOCLEAR:
+
+	case MSGTYPE_ERROR:
 	{
-		bzrtpGoClearMessage_t *messageData;
+		bzrtpErrorMessage_t *messageData;
 
 		/* the message length is fixed */
-		zrtpPacket->messageLength = ZRTP_GOCLEARMESSAGE_FIXED_LENGTH;
+		zrtpPacket->messageLength = ZRTP_ERRORMESSAGE_FIXED_LENGTH;
 
 		/* allocate the packetString buffer : packet is header+message+crc */
-		zrtpPacket->packetString = (uint8_t *)malloc((ZRTP_PACKET_HEADER_LENGTH+ZRTP_GOCLEARMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH)*sizeof(uint8_t));
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+ZRTP_ERRORMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH);
 		messageString = zrtpPacket->packetString + ZRTP_PACKET_HEADER_LENGTH + ZRTP_MESSAGE_HEADER_LENGTH;
 
-		/* now insert the different message parts into the packetString */
-		messageData = (bzrtpGoClearMessage_t *)zrtpPacket->messageData;
+		/* now insert the error code into the packetString */
+		messageData = &zrtpPacket->message.error;
 
-		memcpy(messageString, messageData->clear_mac, 8);
+		if (zrtpSchemaEncode(&errorSchema, messageData, messageString, ZRTP_ERRORMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH) != 0) {
+			zrtpPacketStringFree(zrtpPacket);
+			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
+		}
 	}
-		break; /* MSGTYPE_GOCLEAR */
+		break; /* MSGTYPE_ERROR */
 
-	case MSGTYPE_CLEARACK:
+	case MSGTYPE_ERRORACK:
 	{
 		/* the message length is fixed */
-		zrtpPacket->messageLength = ZRTP_CLEARACKMESSAGE_FIXED_LENGTH;
+		zrtpPacket->messageLength = ZRTP_ERRORACKMESSAGE_FIXED_LENGTH;
 
 		/* allocate the packetString buffer : packet is header+message+crc */
-		zrtpPacket->packetString = (uint8_t *)malloc((ZRTP_PACKET_HEADER_LENGTH+ZRTP_CLEARACKMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH)*sizeof(uint8_t));
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+ZRTP_ERRORACKMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH);
 	}
-		break; /* MSGTYPE_CLEARACK */
-#endif /* GOCLEAR_ENABLED */
-	case MSGTYPE_PINGACK:
+		break; /* MSGTYPE_ERRORACK */
+#ifdef GOCLEAR_ENABLED
+	case MSGTYPE_GOCLEAR:
 	{
-		bzrtpPingAckMessage_t *messageData;
+		bzrtpGoClearMessage_t *messageData;
 
 		/* the message length is fixed */
-		zrtpPacket->messageLength = ZRTP_PINGACKMESSAGE_FIXED_LENGTH;
+		zrtpPacket->messageLength = ZRTP_GOCLEARMESSAGE_FIXED_LENGTH;
 
 		/* allocate the packetString buffer : packet is header+message+crc */
-		zrtpPacket->packetString = (uint8_t *)malloc((ZRTP_PACKET_HEADER_LENGTH+ZRTP_PINGACKMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH)*sizeof(uint8_t));
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+ZRTP_GOCLEARMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH);
 		messageString = zrtpPacket->packetString + ZRTP_PACKET_HEADER_LENGTH + ZRTP_MESSAGE_HEADER_LENGTH;
 
 		/* now insert the different message parts into the packetString */
-		messageData = (bzrtpPingAckMessage_t *)zrtpPacket->messageData;
+		messageData = &zrtpPacket->message.goClear;
 
-		memcpy(messageString, messageData->version, 4);
-		messageString += 4;
-		memcpy(messageString, messageData->endpointHash, 8);
-		messageString += 8;
-		memcpy(messageString, messageData->endpointHashReceived, 8);
-		messageString += 8;
-		*messageString++ = (uint8_t)((messageData->SSRC>>24)&0xFF);
-		*messageString++ = (uint8_t)((messageData->SSRC>>16)&0xFF);
-		*messageString++ = (uint8_t)((messageData->SSRC>>8)&0xFF);
-		*messageString++ = (uint8_t)(messageData->SSRC&0xFF);
+		if (zrtpSchemaEncode(&goClearSchema, messageData, messageString, ZRTP_GOCLEARMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH) != 0) {
+			zrtpPacketStringFree(zrtpPacket);
+			return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
+		}
 	}
-		break; /* MSGTYPE_PINGACK */
+		break; /* MSGTYPE_GOCLEAR */
+
+	case MSGTYPE_CLEARACK:
+	{
+		/* the message length is fixed */
+		zrtpPacket->messageLength = ZRTP_CLEARACKMESSAGE_FIXED_LENGTH;
+
+		/* allocate the packetString buffer : packet is header+message+crc */
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH+ZRTP_CLEARACKMESSAGE_FIXED_LENGTH+ZRTP_PACKET_CRC_LENGTH);
+	}
+		break; /* MSGTYPE_CLEARACK */
+#endif /* GOCLEAR_ENABLED */
 
 	}
 
@@ -1307,8 +1437,7 @@ int bzrtp_packetBuild(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpCh
 bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint32_t messageType, int *exitCode) {
 	/* allocate packet */
 	bzrtpPacket_t *zrtpPacket = (bzrtpPacket_t *)malloc(sizeof(bzrtpPacket_t));
-	memset(zrtpPacket, 0, sizeof(bzrtpPacket_t));
-	zrtpPacket->messageData = NULL;
+	memset(zrtpPacket, 0, sizeof(bzrtpPacket_t)); /* also set to 0 the message structure held by the packet */
 	zrtpPacket->packetString = NULL;
 	zrtpPacket->fragments = NULL;
 
@@ -1317,8 +1446,7 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 	case MSGTYPE_HELLO:
 	{
 		int i;
-		bzrtpHelloMessage_t *zrtpHelloMessage = (bzrtpHelloMessage_t *)malloc(sizeof(bzrtpHelloMessage_t));
-		memset(zrtpHelloMessage, 0, sizeof(bzrtpHelloMessage_t));
+		bzrtpHelloMessage_t *zrtpHelloMessage = &zrtpPacket->message.hello;
 		/* initialise some fields using zrtp context data */
 		memcpy(zrtpHelloMessage->version, ZRTP_VERSION, 4);
 		strncpy((char*)zrtpHelloMessage->clientIdentifier, ZRTP_CLIENT_IDENTIFIER, 16);
@@ -1352,9 +1480,6 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 		for (i=0; i<zrtpContext->sc; i++) {
 			zrtpHelloMessage->supportedSas[i] = zrtpContext->supportedSas[i];
 		}
-
-		/* attach the message data to the packet */
-		zrtpPacket->messageData = zrtpHelloMessage;
 	}
 		break; /* MSGTYPE_HELLO */
 
@@ -1366,8 +1491,7 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 		/* In case of DH commit, this one must be called after the DHPart build and the self DH message and peer Hello message are stored in the context */
 	case MSGTYPE_COMMIT :
 	{
-		bzrtpCommitMessage_t *zrtpCommitMessage = (bzrtpCommitMessage_t *)malloc(sizeof(bzrtpCommitMessage_t));
-		memset(zrtpCommitMessage, 0, sizeof(bzrtpCommitMessage_t));
+		bzrtpCommitMessage_t *zrtpCommitMessage = &zrtpPacket->message.commit;
 
 		/* initialise some fields using zrtp context data */
 		memcpy(zrtpCommitMessage->H2, zrtpChannelContext->selfH[2], 32);
@@ -1404,24 +1528,20 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 
 			zrtpChannelContext->hashFunction(DHPartHelloMessageString, DHPartHelloMessageStringLength, 32, zrtpCommitMessage->hvi);
 
-			/* if the DH is of type KEM, generate now the key pair, store the KEM context in the  */
+			/* if the DH is of type KEM, get the initiator key pair - generated now if it was not prepared - the KEM context is stored in the main context */
 			if (bzrtp_isKem(zrtpCommitMessage->keyAgreementAlgo)) {
-				bzrtp_KEMContext_t *KEMContext = bzrtp_createKEMContext(zrtpCommitMessage->keyAgreementAlgo, zrtpChannelContext->hashAlgo);
-				if (KEMContext != NULL) {
-					bzrtp_KEM_generateKeyPair(KEMContext);
+				if (bzrtp_useKeyAgreementContext(zrtpContext, zrtpChannelContext, BZRTP_ROLE_INITIATOR) == 0) {
+					bzrtp_KEMContext_t *KEMContext = (bzrtp_KEMContext_t *)zrtpContext->keyAgreementContext; // Stored in main channel so we can decaps the answer and we can destroy it
 					uint16_t pvLength = bzrtp_computeKeyAgreementPublicValueLength(zrtpCommitMessage->keyAgreementAlgo, MSGTYPE_COMMIT);
-					zrtpCommitMessage->pv = (uint8_t *)malloc(pvLength*sizeof(uint8_t));
-					memset(zrtpCommitMessage->pv, 0, pvLength); // Set the memory to zero as the buffer is expanded to have a size multiple of 0, so there might be padding at the end.
+					/* allocate the packet string now and write the public key directly in it: after H2(32), ZID(12), algorithms(5*4) and hvi(32) */
+					zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH + ZRTP_COMMITMESSAGE_FIXED_LENGTH + bzrtp_computeCommitMessageVariableLength(zrtpCommitMessage->keyAgreementAlgo) + ZRTP_PACKET_CRC_LENGTH);
+					zrtpCommitMessage->pv = zrtpPacket->packetString + ZRTP_PACKET_HEADER_LENGTH + ZRTP_MESSAGE_HEADER_LENGTH + 96;
+					memset(zrtpCommitMessage->pv, 0, pvLength); // Set the memory to zero as the buffer is expanded to have a size multiple of 4, so there might be padding at the end.
 					bzrtp_KEM_getPublicKey(KEMContext, zrtpCommitMessage->pv);
-					zrtpContext->keyAgreementContext = (void *)KEMContext; // Store the KEM context in main channel so we can decaps the answer and we can destroy it
-					zrtpContext->keyAgreementAlgo = zrtpCommitMessage->keyAgreementAlgo;
 				}
 			}
 			free(DHPartHelloMessageString);
 		}
-
-		/* attach the message data to the packet */
-		zrtpPacket->messageData = zrtpCommitMessage;
 	}
 		break; /* MSGTYPE_COMMIT */
 
@@ -1429,10 +1549,7 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 	case MSGTYPE_DHPART1 :
 	case MSGTYPE_DHPART2 :
 	{
-		uint8_t secretLength; /* is in bytes */
-		uint8_t bctbx_keyAgreementAlgo = BCTBX_DHM_UNSET;
-		bzrtpDHPartMessage_t *zrtpDHPartMessage = (bzrtpDHPartMessage_t *)malloc(sizeof(bzrtpDHPartMessage_t));
-		memset(zrtpDHPartMessage, 0, sizeof(bzrtpDHPartMessage_t));
+		bzrtpDHPartMessage_t *zrtpDHPartMessage = &zrtpPacket->message.dhPart;
 		/* initialise some fields using zrtp context data */
 		memcpy(zrtpDHPartMessage->H1, zrtpChannelContext->selfH[1], 32);
 		if (messageType == MSGTYPE_DHPART2) { /* initiator creates the DHPart2 */
@@ -1449,111 +1566,47 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 			memcpy(zrtpDHPartMessage->pbxsecretID, zrtpContext->responderCachedSecretHash.pbxsecretID, 8);
 		}
 
-		/* compute the public value and insert it in the message, will then be used whatever role - initiator or responder - we assume */
-		/* initialise the dhm context, secret length shall be twice the size of cipher block key length - rfc section 5.1.5 */
-		switch (zrtpChannelContext->cipherAlgo) {
-		case ZRTP_CIPHER_AES3:
-		case ZRTP_CIPHER_2FS3:
-			secretLength = 64;
-			break;
-		case ZRTP_CIPHER_AES2:
-		case ZRTP_CIPHER_2FS2:
-			secretLength = 48;
-			break;
-		case ZRTP_CIPHER_AES1:
-		case ZRTP_CIPHER_2FS1:
-		default:
-			secretLength = 32;
-			break;
-		}
-
 		uint16_t pvLength = bzrtp_computeKeyAgreementPublicValueLength(zrtpChannelContext->keyAgreementAlgo, messageType);
-		/* DHM key exchange */
-		if (zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH2k || zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH3k) {
-			bctbx_DHMContext_t *DHMContext = NULL;
-			if (zrtpChannelContext->keyAgreementAlgo==ZRTP_KEYAGREEMENT_DH2k) {
-				bctbx_keyAgreementAlgo = BCTBX_DHM_2048;
-			} else {
-				bctbx_keyAgreementAlgo = BCTBX_DHM_3072;
-			}
-			/* create DHM context */
-			DHMContext = bctbx_CreateDHMContext(bctbx_keyAgreementAlgo, secretLength);
-			if (DHMContext == NULL) {
-				free(zrtpPacket);
-				free(zrtpDHPartMessage);
-				*exitCode = BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT;
-				return NULL;
-			}
+		if (pvLength == 0) {
+			free(zrtpPacket);
+			*exitCode = BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT;
+			return NULL;
+		}
+		/* allocate the packet string now so the public value is written directly in it: after H1(32) and the four secrets IDs(4*8) */
+		zrtpPacketStringAlloc(zrtpPacket, ZRTP_PACKET_HEADER_LENGTH + ZRTP_DHPARTMESSAGE_FIXED_LENGTH + pvLength + ZRTP_PACKET_CRC_LENGTH);
+		zrtpDHPartMessage->pv = zrtpPacket->packetString + ZRTP_PACKET_HEADER_LENGTH + ZRTP_MESSAGE_HEADER_LENGTH + 64;
 
-			/* create private key and compute the public value */
-			bctbx_DHMCreatePublic(DHMContext, (int (*)(void *, uint8_t *, size_t))bctbx_rng_get, zrtpContext->RNGContext);
-			zrtpDHPartMessage->pv = (uint8_t *)malloc(pvLength*sizeof(uint8_t));
-			memcpy(zrtpDHPartMessage->pv, DHMContext->self, pvLength);
-			zrtpContext->keyAgreementContext = (void *)DHMContext; /* save DHM context in zrtp Context */
-			zrtpContext->keyAgreementAlgo = zrtpChannelContext->keyAgreementAlgo; /* store algo in global context to be able to destroy it correctly*/
-
-			/* ECDH key exchange */
-		} else if (zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) {
-			bctbx_ECDHContext_t *ECDHContext = NULL;
-			if (zrtpChannelContext->keyAgreementAlgo==ZRTP_KEYAGREEMENT_X255) {
-				bctbx_keyAgreementAlgo = BCTBX_ECDH_X25519;
-			} else {
-				bctbx_keyAgreementAlgo = BCTBX_ECDH_X448;
-			}
+		/* Key agreement of KEM type, DHPart2 holds a nonce, DHPart1 holds the crypto */
+		if (bzrtp_isKem(zrtpChannelContext->keyAgreementAlgo) && messageType == MSGTYPE_DHPART2) {
+			bctbx_rng_get(zrtpContext->RNGContext, zrtpDHPartMessage->pv, pvLength);
+			break;
+		}
 
-			/* Create the ECDH context */
-			ECDHContext = bctbx_CreateECDHContext(bctbx_keyAgreementAlgo);
-			if (ECDHContext == NULL) {
-				free(zrtpPacket);
-				free(zrtpDHPartMessage);
-				*exitCode = BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT;
-				return NULL;
-			}
-			/* create private key and compute the public value */
-			bctbx_ECDHCreateKeyPair(ECDHContext, (int (*)(void *, uint8_t *, size_t))bctbx_rng_get, zrtpContext->RNGContext);
-			zrtpDHPartMessage->pv = (uint8_t *)malloc(pvLength*sizeof(uint8_t));
-			memcpy(zrtpDHPartMessage->pv, ECDHContext->selfPublic, pvLength);
-			/* we might already have a keyAgreement context in the zrtpContext (if we are building a DHPart1 after having built a DHPart2) */
-			zrtpContext->keyAgreementContext = (void *)ECDHContext; /* save ECDH context in zrtp Context */
-			zrtpContext->keyAgreementAlgo = zrtpChannelContext->keyAgreementAlgo; /* store algo in global context to be able to destroy it correctly*/
-
-			/* KEM key exchange*/
-		} else if (bzrtp_isKem(zrtpChannelContext->keyAgreementAlgo)) {
-			/* Key agreement of KEM type, DHPart2 holds a nonce, DHPart1 holds the crypto */
-			if (messageType == MSGTYPE_DHPART1) { /* DHPart1: generate a secret and encapsulate it. Peer's public key is in the commit packet */
-				bzrtp_KEMContext_t *KEMContext = bzrtp_createKEMContext(zrtpChannelContext->keyAgreementAlgo, zrtpChannelContext->hashAlgo);
-				if (KEMContext == NULL) {
-					free(zrtpPacket);
-					free(zrtpDHPartMessage);
-					*exitCode = BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT;
-					return NULL;
-				}
-				zrtpDHPartMessage->pv = (uint8_t *)malloc(pvLength*sizeof(uint8_t));
-				memset(zrtpDHPartMessage->pv, 0, pvLength); // Set the buffer to 0 as its size might be expanded to be multiple of 4, so the ciphertext may not fill it all, pad with 0
-				bzrtpCommitMessage_t *peerCommitMessageData = (bzrtpCommitMessage_t *)zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->messageData;
-				bzrtp_KEM_encaps(KEMContext, peerCommitMessageData->pv, zrtpDHPartMessage->pv);
-				zrtpContext->keyAgreementContext = (void *)KEMContext; // Store the KEM context in main channel so we can get the shared secret when needed and we can destroy it
-				zrtpContext->keyAgreementAlgo = zrtpChannelContext->keyAgreementAlgo; /* store algo in global context to be able to destroy it correctly*/
-			} else { /* this is a DHPArt2, generate a nonce */
-				zrtpDHPartMessage->pv = (uint8_t *)malloc(pvLength*sizeof(uint8_t));
-				bctbx_rng_get(zrtpContext->RNGContext, zrtpDHPartMessage->pv, pvLength);
-			}
-		} else {
+		/* get the key agreement context - prepared ahead of time when possible - it is stored in the zrtp context so we can compute the shared secret later and destroy it */
+		if (bzrtp_useKeyAgreementContext(zrtpContext, zrtpChannelContext, (messageType == MSGTYPE_DHPART2)?BZRTP_ROLE_INITIATOR:BZRTP_ROLE_RESPONDER) != 0) {
+			free(zrtpPacket->packetString);
 			free(zrtpPacket);
-			free(zrtpDHPartMessage);
 			*exitCode = BZRTP_CREATE_ERROR_UNABLETOCREATECRYPTOCONTEXT;
 			return NULL;
 		}
-		/* attach the message data to the packet */
-		zrtpPacket->messageData = zrtpDHPartMessage;
+
+		/* insert the public value in the message, for DH and ECDH it will then be used whatever role - initiator or responder - we assume */
+		if (zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH2k || zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH3k) { /* DHM key exchange */
+			memcpy(zrtpDHPartMessage->pv, ((bctbx_DHMContext_t *)zrtpContext->keyAgreementContext)->self, pvLength);
+		} else if (zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) { /* ECDH key exchange */
+			memcpy(zrtpDHPartMessage->pv, ((bctbx_ECDHContext_t *)zrtpContext->keyAgreementContext)->selfPublic, pvLength);
+		} else { /* KEM key exchange, DHPart1: generate a secret and encapsulate it. Peer's public key is in the commit packet */
+			bzrtpCommitMessage_t *peerCommitMessageData = &zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID]->message.commit;
+			memset(zrtpDHPartMessage->pv, 0, pvLength); // Set the buffer to 0 as its size might be expanded to be multiple of 4, so the ciphertext may not fill it all, pad with 0
+			bzrtp_KEM_encaps((bzrtp_KEMContext_t *)zrtpContext->keyAgreementContext, peerCommitMessageData->pv, zrtpDHPartMessage->pv);
+		}
 	}
 		break; /* MSGTYPE_DHPART1 and MSGTYPE_DHPART2 */
 
 	case MSGTYPE_CONFIRM1:
 	case MSGTYPE_CONFIRM2:
 	{
-		bzrtpConfirmMessage_t *zrtpConfirmMessage = (bzrtpConfirmMessage_t *)malloc(sizeof(bzrtpConfirmMessage_t));
-		memset(zrtpConfirmMessage, 0, sizeof(bzrtpConfirmMessage_t));
+		bzrtpConfirmMessage_t *zrtpConfirmMessage = &zrtpPacket->message.confirm;
 		/* initialise some fields using zrtp context data */
 		memcpy(zrtpConfirmMessage->H0, zrtpChannelContext->selfH[0], 32);
 		zrtpConfirmMessage->sig_len = 0; /* signature is not supported */
@@ -1567,9 +1620,6 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 
 		/* generate a random CFB IV */
 		bctbx_rng_get(zrtpContext->RNGContext, zrtpConfirmMessage->CFBIV, 16);
-
-		/* attach the message data to the packet */
-		zrtpPacket->messageData = zrtpConfirmMessage;
 	}
 		break; /* MSGTYPE_CONFIRM1 and MSGTYPE_CONFIRM2 */
 
@@ -1578,11 +1628,23 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 		/* nothing to do for the conf2ACK packet as it just contains it's type */
 	}
 		break; /* MSGTYPE_CONF2ACK */
+
+	case MSGTYPE_ERROR :
+	{
+		/* error code is not known here, caller must set it before building the packet */
+		zrtpPacket->message.error.errorCode = BZRTP_ZRTPERROR_CRITICALSOFTWARE;
+	}
+		break; /* MSGTYPE_ERROR */
+
+	case MSGTYPE_ERRORACK :
+	{
+		/* nothing to do for the ErrorACK packet as it just contains it's type */
+	}
+		break; /* MSGTYPE_ERRORACK */
 #ifdef GOCLEAR_ENABLED
 	case MSGTYPE_GOCLEAR :
 	{
-		bzrtpGoClearMessage_t *zrtpGoClearMessage = (bzrtpGoClearMessage_t *)malloc(sizeof (bzrtpGoClearMessage_t));
-		memset(zrtpGoClearMessage, 0, sizeof(bzrtpGoClearMessage_t));
+		bzrtpGoClearMessage_t *zrtpGoClearMessage = &zrtpPacket->message.goClear;
 
 		/* Compute the clear_mac */
 		if (zrtpChannelContext->role == BZRTP_ROLE_INITIATOR){
@@ -1590,9 +1652,6 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 		} else {
 			zrtpChannelContext->hmacFunction(zrtpChannelContext->mackeyr, zrtpChannelContext->hashLength, (uint8_t *)"GoClear ", 8, 8, zrtpGoClearMessage->clear_mac);
 		}
-
-		/* attach the message data to the packet */
-		zrtpPacket->messageData = zrtpGoClearMessage;
 	}
 		break; /* MSGTYPE_GOCLEAR */
 
@@ -1602,33 +1661,6 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 	}
 		break; /* MSGTYPE_CLEARACK */
 #endif /* GOCLEAR_ENABLED */
-	case MSGTYPE_PINGACK:
-	{
-		bzrtpPingMessage_t *pingMessage;
-		bzrtpPingAckMessage_t *zrtpPingAckMessage;
-
-		/* to create a pingACK we must have a ping packet in the channel context, check it */
-		bzrtpPacket_t *pingPacket = zrtpChannelContext->pingPacket;
-		if (pingPacket == NULL) {
-			*exitCode = BZRTP_CREATE_ERROR_INVALIDCONTEXT;
-			return NULL;
-		}
-		pingMessage = (bzrtpPingMessage_t *)pingPacket->messageData;
-
-		/* create the message */
-		zrtpPingAckMessage = (bzrtpPingAckMessage_t *)malloc(sizeof(bzrtpPingAckMessage_t));
-		memset(zrtpPingAckMessage, 0, sizeof(bzrtpPingAckMessage_t));
-
-		/* initialise all fields using zrtp context data and the received ping message */
-		memcpy(zrtpPingAckMessage->version,ZRTP_VERSION , 4); /* we support version 1.10 only, so no need to even check what was sent in the ping */
-		memcpy(zrtpPingAckMessage->endpointHash, zrtpContext->selfZID, 8); /* as suggested in rfc section 5.16, use the truncated ZID as endPoint hash */
-		memcpy(zrtpPingAckMessage->endpointHashReceived, pingMessage->endpointHash, 8);
-		zrtpPingAckMessage->SSRC = pingPacket->sourceIdentifier;
-
-		/* attach the message data to the packet */
-		zrtpPacket->messageData = zrtpPingAckMessage;
-	} /* MSGTYPE_PINGACK */
-		break;
 	case MSGTYPE_FRAGMENT :
 	{
 		/* nothing to do, it uses the common fields only */
@@ -1653,41 +1685,14 @@ bzrtpPacket_t *bzrtp_createZrtpPacket(bzrtpContext_t *zrtpContext, bzrtpChannelC
 
 void bzrtp_freeZrtpPacket(bzrtpPacket_t *zrtpPacket) {
 	if (zrtpPacket != NULL) {
-		/* some messages have fields to be freed */
-		if (zrtpPacket->messageData != NULL) {
-			switch(zrtpPacket->messageType) {
-			case MSGTYPE_COMMIT :
-			{
-				bzrtpCommitMessage_t *typedMessageData = (bzrtpCommitMessage_t *)(zrtpPacket->messageData);
-				if (typedMessageData != NULL) {
-					free(typedMessageData->pv);
-				}
-			}
-				break;
-			case MSGTYPE_DHPART1 :
-			case MSGTYPE_DHPART2 :
-			{
-				bzrtpDHPartMessage_t *typedMessageData = (bzrtpDHPartMessage_t *)(zrtpPacket->messageData);
-				if (typedMessageData != NULL) {
-					free(typedMessageData->pv);
-				}
-			}
-				break;
-			case MSGTYPE_CONFIRM1:
-			case MSGTYPE_CONFIRM2:
-			{
-				bzrtpConfirmMessage_t *typedMessageData = (bzrtpConfirmMessage_t *)(zrtpPacket->messageData);
-				if (typedMessageData != NULL) {
-					free(typedMessageData->signatureBlock);
-				}
-			}
-				break;
-			}
+		/* message structure is held by the packet and Commit/DHPart public values point into the packetString,
+		 * only the Confirm signature block is allocated apart */
+		if (zrtpPacket->messageType == MSGTYPE_CONFIRM1 || zrtpPacket->messageType == MSGTYPE_CONFIRM2) {
+			free(zrtpPacket->message.confirm.signatureBlock);
 		}
-		free(zrtpPacket->messageData);
 		/* if we have fragments, free them too */
 		bctbx_list_free_with_data(zrtpPacket->fragments, (bctbx_list_free_func)bzrtp_freeZrtpPacket);
-		free(zrtpPacket->packetString);
+		zrtpPacketStringFree(zrtpPacket);
 		free(zrtpPacket);
 	}
 }
@@ -1732,6 +1737,122 @@ int bzrtp_packetSetSequenceNumber(bzrtpPacket_t *zrtpPacket, uint16_t sequenceNu
 	return 0;
 }
 
+uint16_t bzrtp_packetFixedLength(uint32_t messageType) {
+	switch (messageType) {
+		case MSGTYPE_HELLOACK:
+			return ZRTP_PACKET_OVERHEAD+ZRTP_HELLOACKMESSAGE_FIXED_LENGTH;
+		case MSGTYPE_CONF2ACK:
+			return ZRTP_PACKET_OVERHEAD+ZRTP_CONF2ACKMESSAGE_FIXED_LENGTH;
+		case MSGTYPE_ERROR:
+			return ZRTP_PACKET_OVERHEAD+ZRTP_ERRORMESSAGE_FIXED_LENGTH;
+		case MSGTYPE_ERRORACK:
+			return ZRTP_PACKET_OVERHEAD+ZRTP_ERRORACKMESSAGE_FIXED_LENGTH;
+#ifdef GOCLEAR_ENABLED
+		case MSGTYPE_GOCLEAR:
+			return ZRTP_PACKET_OVERHEAD+ZRTP_GOCLEARMESSAGE_FIXED_LENGTH;
+		case MSGTYPE_CLEARACK:
+			return ZRTP_PACKET_OVERHEAD+ZRTP_CLEARACKMESSAGE_FIXED_LENGTH;
+#endif /* GOCLEAR_ENABLED */
+		case MSGTYPE_PINGACK:
+			return ZRTP_PACKET_OVERHEAD+ZRTP_PINGACKMESSAGE_FIXED_LENGTH;
+		default:
+			return 0;
+	}
+}
+
+int bzrtp_pingPacketCheck(const uint8_t *pingPacket, uint16_t pingPacketLength) {
+	uint32_t CRC;
+	const uint8_t *pingMessage;
+
+	if (pingPacket == NULL) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+
+	/* cheap checks first: packet length, header and message type, so any other packet is discarded before computing the CRC */
+	if (pingPacketLength != ZRTP_PACKET_OVERHEAD+ZRTP_PINGMESSAGE_FIXED_LENGTH) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+	if (pingPacket[0] != 0x10 || pingPacket[1] != 0x00
+		|| pingPacket[4] != (uint8_t)((ZRTP_MAGIC_COOKIE>>24)&0xFF) || pingPacket[5] != (uint8_t)((ZRTP_MAGIC_COOKIE>>16)&0xFF)
+		|| pingPacket[6] != (uint8_t)((ZRTP_MAGIC_COOKIE>>8)&0xFF) || pingPacket[7] != (uint8_t)(ZRTP_MAGIC_COOKIE&0xFF)) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+	pingMessage = pingPacket+ZRTP_PACKET_HEADER_LENGTH;
+	if (pingMessage[0] != 0x50 || pingMessage[1] != 0x5a
+		|| pingMessage[2] != 0x00 || pingMessage[3] != (ZRTP_PINGMESSAGE_FIXED_LENGTH>>2)
+		|| memcmp(pingMessage+4, "Ping    ", 8) != 0) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+
+	/* check the CRC */
+	CRC = ((uint32_t)pingPacket[pingPacketLength-4])<<24 | ((uint32_t)pingPacket[pingPacketLength-3])<<16 | ((uint32_t)pingPacket[pingPacketLength-2])<<8 | ((uint32_t)pingPacket[pingPacketLength-1]);
+	if (bzrtp_CRC32((uint8_t *)pingPacket, pingPacketLength - ZRTP_PACKET_CRC_LENGTH) != CRC) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Check a Ping packet and write the matching PingACK packet in a caller provided buffer
+ * Everything is done in place: no packet structure is created nor allocated.
+ *
+ * return		0 on success, error code otherwise
+ */
+int bzrtp_buildPingAck(const uint8_t *pingPacket, uint16_t pingPacketLength, const uint8_t endpointHash[8], uint32_t selfSSRC, uint16_t sequenceNumber, uint8_t *pingAckPacket, uint16_t *pingAckPacketLength) {
+	uint32_t CRC;
+	const uint8_t *pingMessage;
+	bzrtpPingAckMessage_t pingAckMessage;
+	uint8_t *CRCbuffer;
+	int retval;
+
+	if (pingPacket == NULL || endpointHash == NULL || pingAckPacket == NULL || pingAckPacketLength == NULL) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+
+	if ((retval = bzrtp_pingPacketCheck(pingPacket, pingPacketLength)) != 0) {
+		return retval;
+	}
+	pingMessage = pingPacket+ZRTP_PACKET_HEADER_LENGTH;
+
+	if (*pingAckPacketLength < ZRTP_PACKET_OVERHEAD+ZRTP_PINGACKMESSAGE_FIXED_LENGTH) {
+		return BZRTP_ERROR_OUTPUTBUFFER_LENGTH;
+	}
+
+	/* packet header */
+	pingAckPacket[0] = 0x10;
+	pingAckPacket[1] = 0x00;
+	pingAckPacket[2] = (uint8_t)((sequenceNumber>>8)&0x00FF);
+	pingAckPacket[3] = (uint8_t)(sequenceNumber&0x00FF);
+	memcpy(pingAckPacket+4, pingPacket+4, 4); /* magic cookie, already checked */
+	pingAckPacket[8] = (uint8_t)((selfSSRC>>24)&0xFF);
+	pingAckPacket[9] = (uint8_t)((selfSSRC>>16)&0xFF);
+	pingAckPacket[10] = (uint8_t)((selfSSRC>>8)&0xFF);
+	pingAckPacket[11] = (uint8_t)(selfSSRC&0xFF);
+
+	/* message: header, version, our endpoint hash, peer endpoint hash and the SSRC of the Ping packet */
+	zrtpMessageSetHeader(pingAckPacket+ZRTP_PACKET_HEADER_LENGTH, ZRTP_PINGACKMESSAGE_FIXED_LENGTH, messageTypeInttoString(MSGTYPE_PINGACK));
+	memcpy(pingAckMessage.version, ZRTP_VERSION, 4); /* we support version 1.10 only, so no need to even check what was sent in the ping */
+	memcpy(pingAckMessage.endpointHash, endpointHash, 8);
+	memcpy(pingAckMessage.endpointHashReceived, pingMessage+ZRTP_MESSAGE_HEADER_LENGTH+4, 8);
+	pingAckMessage.SSRC = ((uint32_t)pingPacket[8])<<24 | ((uint32_t)pingPacket[9])<<16 | ((uint32_t)pingPacket[10])<<8 | ((uint32_t)pingPacket[11]);
+	if (zrtpSchemaEncode(&pingAckSchema, &pingAckMessage, pingAckPacket+ZRTP_PACKET_HEADER_LENGTH+ZRTP_MESSAGE_HEADER_LENGTH, ZRTP_PINGACKMESSAGE_FIXED_LENGTH - ZRTP_MESSAGE_HEADER_LENGTH) != 0) {
+		return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
+	}
+
+	/* CRC */
+	CRC = bzrtp_CRC32(pingAckPacket, ZRTP_PACKET_HEADER_LENGTH+ZRTP_PINGACKMESSAGE_FIXED_LENGTH);
+	CRCbuffer = pingAckPacket+ZRTP_PACKET_HEADER_LENGTH+ZRTP_PINGACKMESSAGE_FIXED_LENGTH;
+	*CRCbuffer++ = (uint8_t)((CRC>>24)&0xFF);
+	*CRCbuffer++ = (uint8_t)((CRC>>16)&0xFF);
+	*CRCbuffer++ = (uint8_t)((CRC>>8)&0xFF);
+	*CRCbuffer = (uint8_t)(CRC&0xFF);
+
+	*pingAckPacketLength = ZRTP_PACKET_OVERHEAD+ZRTP_PINGACKMESSAGE_FIXED_LENGTH;
+
+	return 0;
+}
+
 
 /*** Local functions implementation ***/
 
@@ -1882,3 +2003,170 @@ static void zrtpPacketSetHeader(bzrtpPacket_t *zrtpPacket) {
 	zrtpPacket->packetString[10] = (uint8_t)(((zrtpPacket->sourceIdentifier)>>8)&0xFF);
 	zrtpPacket->packetString[11] = (uint8_t)((zrtpPacket->sourceIdentifier)&0xFF);
 }
+
+/**
+ * @brief Allocate the packetString buffer of a packet if it does not hold one already
+ *        (parsed packets, rebuilt packets or created packets holding a public value)
+ *
+ * @param[in/out]	zrtpPacket		the zrtp packet
+ * @param[in]		packetLength	the packet length in bytes: header + message + CRC
+ */
+static void zrtpPacketStringAlloc(bzrtpPacket_t *zrtpPacket, uint16_t packetLength) {
+	if (zrtpPacket->packetString == NULL) {
+		zrtpPacket->packetString = (uint8_t *)malloc(packetLength*sizeof(uint8_t));
+	}
+}
+
+static void zrtpPacketStringFree(bzrtpPacket_t *zrtpPacket) {
+	if (zrtpPacket->packetStringRelease != NULL) { /* the buffer belongs to the application */
+		zrtpPacket->packetStringRelease(zrtpPacket->packetStringReleaseData, zrtpPacket->packetString);
+	} else {
+		free(zrtpPacket->packetString);
+	}
+	zrtpPacket->packetString = NULL;
+}
+
+static void zrtpPacketStoreReceivedString(bzrtpPacket_t *zrtpPacket, const uint8_t *input, uint16_t inputLength) {
+	if (zrtpPacket->packetString == NULL) {
+		zrtpPacket->packetString = (uint8_t *)malloc(inputLength*sizeof(uint8_t));
+		memcpy(zrtpPacket->packetString, input, inputLength);
+	}
+}
+
+/**
+ * @brief Check a hash image received from peer is part of its hash chain: hashing it must give the expected image
+ * Verified images are recorded in the channel context peerH so each link of the chain is computed at most once
+ *
+ * @param[in,out]	zrtpChannelContext	The channel context holding the peer hash images
+ * @param[in]		hashImage			The hash image received
+ * @param[in]		index				Index in the chain of the received image (0 for H0)
+ * @param[in]		expected			The expected image, retrieved from a message previously received
+ * @param[in]		expectedIndex		Index in the chain of the expected image
+ *
+ * @return	0 if the received image matches the chain, BZRTP_PARSER_ERROR_UNMATCHINGHASHCHAIN otherwise
+ */
+static int zrtpCheckPeerHashChain(bzrtpChannelContext_t *zrtpChannelContext, const uint8_t *hashImage, uint8_t index, const uint8_t *expected, uint8_t expectedIndex) {
+	uint8_t images[4][32];
+	uint8_t i;
+
+	/* this image was already verified */
+	if ((zrtpChannelContext->peerHVerified & (1<<index)) && memcmp(zrtpChannelContext->peerH[index], hashImage, 32) == 0) {
+		return 0;
+	}
+
+	memcpy(images[index], hashImage, 32);
+	for (i=index; i<expectedIndex; i++) {
+		bctbx_sha256(images[i], 32, 32, images[i+1]);
+		/* reaching an image already verified is enough: they all link to the same chain */
+		if ((zrtpChannelContext->peerHVerified & (1<<(i+1))) && memcmp(zrtpChannelContext->peerH[i+1], images[i+1], 32) == 0) {
+			expectedIndex = i+1;
+			break;
+		}
+	}
+	if (i == expectedIndex && memcmp(images[expectedIndex], expected, 32) != 0) {
+		return BZRTP_PARSER_ERROR_UNMATCHINGHASHCHAIN;
+	}
+
+	/* record the verified images */
+	for (i=index; i<=expectedIndex; i++) {
+		memcpy(zrtpChannelContext->peerH[i], images[i], 32);
+		zrtpChannelContext->peerHVerified |= (uint8_t)(1<<i);
+	}
+	return 0;
+}
+
+/**
+ * @brief Check the MAC of a stored peer packet, it is computed only once per channel
+ *
+ * @param[in,out]	zrtpChannelContext	The channel context holding the peer packets
+ * @param[in]		storeId				The peer packet storage index
+ * @param[in]		key					The verified peer hash image keying the MAC (32 bytes)
+ * @param[in]		MAC					The MAC received in the stored packet (8 bytes)
+ *
+ * @return	0 if the MAC is correct, BZRTP_PARSER_ERROR_UNMATCHINGMAC otherwise
+ */
+static int zrtpCheckPeerPacketMAC(bzrtpChannelContext_t *zrtpChannelContext, uint8_t storeId, const uint8_t *key, const uint8_t *MAC) {
+	uint8_t checkMAC[32];
+	bzrtpPacket_t *peerPacket = zrtpChannelContext->peerPackets[storeId];
+
+	if (zrtpChannelContext->peerPacketsMACVerified & (1<<storeId)) {
+		return 0;
+	}
+
+	/* MAC is 8 bytes long and is computed on the message(skip the ZRTP_PACKET_HEADER) and exclude the mac itself (-8 bytes from message Length) */
+	bctbx_hmacSha256(key, 32, peerPacket->packetString+ZRTP_PACKET_HEADER_LENGTH, peerPacket->messageLength-8, 8, checkMAC);
+	if (memcmp(checkMAC, MAC, 8) != 0) {
+		return BZRTP_PARSER_ERROR_UNMATCHINGMAC;
+	}
+	zrtpChannelContext->peerPacketsMACVerified |= (uint8_t)(1<<storeId);
+	return 0;
+}
+
+static int zrtpSchemaDecode(const bzrtpMessageSchema_t *schema, const uint8_t *input, uint16_t inputLength, void *messageData) {
+	uint8_t i;
+	uint8_t *messageBytes = (uint8_t *)messageData;
+
+	/* a single bound check for all fields: they all fit in the schema length */
+	if (inputLength < schema->wireLength) {
+		return BZRTP_PARSER_ERROR_INVALIDMESSAGE;
+	}
+
+	for (i=0; i<schema->fieldsCount; i++) {
+		const bzrtpFieldDescriptor_t *field = schema->fields+i;
+		const uint8_t *wire = input+field->wireOffset;
+		uint8_t *target = messageBytes+field->structOffset;
+
+		switch (field->type) {
+		case BZRTP_FIELD_BYTES:
+			memcpy(target, wire, field->wireLength);
+			break;
+		case BZRTP_FIELD_UINT32:
+		{
+			uint32_t value = (((uint32_t)wire[0])<<24) | (((uint32_t)wire[1])<<16) | (((uint32_t)wire[2])<<8) | ((uint32_t)wire[3]);
+			memcpy(target, &value, sizeof(uint32_t));
+		}
+			break;
+		case BZRTP_FIELD_ALGO:
+			*target = bzrtp_cryptoAlgoTypeStringToInt((uint8_t *)wire, field->algoFamily);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int zrtpSchemaEncode(const bzrtpMessageSchema_t *schema, const void *messageData, uint8_t *output, uint16_t outputLength) {
+	uint8_t i;
+	const uint8_t *messageBytes = (const uint8_t *)messageData;
+
+	if (outputLength < schema->wireLength) {
+		return BZRTP_BUILDER_ERROR_INVALIDMESSAGE;
+	}
+
+	for (i=0; i<schema->fieldsCount; i++) {
+		const bzrtpFieldDescriptor_t *field = schema->fields+i;
+		uint8_t *wire = output+field->wireOffset;
+		const uint8_t *source = messageBytes+field->structOffset;
+
+		switch (field->type) {
+		case BZRTP_FIELD_BYTES:
+			memcpy(wire, source, field->wireLength);
+			break;
+		case BZRTP_FIELD_UINT32:
+		{
+			uint32_t value;
+			memcpy(&value, source, sizeof(uint32_t));
+			wire[0] = (uint8_t)((value>>24)&0xFF);
+			wire[1] = (uint8_t)((value>>16)&0xFF);
+			wire[2] = (uint8_t)((value>>8)&0xFF);
+			wire[3] = (uint8_t)(value&0xFF);
+		}
+			break;
+		case BZRTP_FIELD_ALGO:
+			bzrtp_cryptoAlgoTypeIntToString(*source, wire);
+			break;
+		}
+	}
+
+	return 0;
+}
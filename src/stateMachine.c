@@ -30,12 +30,16 @@
 
 /* Local functions prototypes */
 static int bzrtp_turnIntoResponder(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket, bzrtpCommitMessage_t *commitMessage);
-static int bzrtp_responseToHelloMessage(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket);
+static int bzrtp_responseToHelloMessage(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket, bzrtpStateMachine_t nextState);
+static int bzrtp_completeResponseToHelloMessage(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint8_t useRetainedSecrets);
+static int bzrtp_enterNextDiscoveryState(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpStateMachine_t nextState);
 static int bzrtp_computeS0DHMMode(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext);
 static int bzrtp_computeS0MultiStreamMode(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext);
 static int bzrtp_deriveKeysFromS0(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext);
 static int bzrtp_deriveSrtpKeysFromS0(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext);
 static int bzrtp_sendPacket ( const bzrtpContext_t* zrtpContext, bzrtpChannelContext_t* zrtpChannelContext, bzrtpPacket_t* zrtpPacket);
+static int bzrtp_buildAndSendTransientPacket(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket);
+static void bzrtp_discoveryBudgetExhausted(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext);
 
 /*
  * @brief This is the initial state
@@ -59,6 +63,7 @@ int state_discovery_init(bzrtpEvent_t event) {
 	/* We are supposed to send Hello packet, it shall be already present int the selfPackets(created at channel init) */
 	if (event.eventType == BZRTP_EVENT_INIT) {
 		bctbx_message("Entering state discovery init on channel [%p]", zrtpChannelContext);
+		bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ONGOING);
 		if (zrtpChannelContext->selfPackets[HELLO_MESSAGE_STORE_ID] == NULL) {
 			/* We shall never go through this one because Hello packet shall be created at channel init */
 			int retval;
@@ -78,8 +83,9 @@ int state_discovery_init(bzrtpEvent_t event) {
 			bctbx_warning("Hello packet created at discovery_init state, it should be performed at chennel initialisation");
 		}
 
-		/* it is the first call to this function, so we must also set the timer for retransmissions */
-		zrtpChannelContext->timer.status = BZRTP_TIMER_ON;
+		/* it is the first call to this function, so we must also set the timer for retransmissions, unless client suspended the Hello sending */
+		zrtpChannelContext->timer.status = (zrtpChannelContext->helloSuspended == 1)?BZRTP_TIMER_OFF:BZRTP_TIMER_ON;
+		zrtpChannelContext->discoveryBytesSent = 0;
 		zrtpChannelContext->timer.firingTime = 0; /* we must send a first hello message as soon as possible, to do it at first timer tick, we can't do it now because still in initialisation phase and the RTP session may not be ready to send a message */
 		zrtpChannelContext->timer.firingCount = 0;
 		zrtpChannelContext->timer.timerStep = HELLO_BASE_RETRANSMISSION_STEP;
@@ -107,23 +113,9 @@ int state_discovery_init(bzrtpEvent_t event) {
 		/* packet is valid, set the sequence Number in channel context */
 		zrtpChannelContext->peerSequenceNumber = zrtpPacket->sequenceNumber;
 
-		/* if we have an Hello packet, we must use it to determine which algo we will agree on */
+		/* if we have an Hello packet, we must use it to determine which algo we will agree on, then wait for peer's HelloACK */
 		if (zrtpPacket->messageType == MSGTYPE_HELLO) {
-			retval = bzrtp_responseToHelloMessage(zrtpContext, zrtpChannelContext, zrtpPacket);
-			if (retval != 0) {
-				return retval;
-			}
-
-			/* reset the sending Hello timer as peer may have started slowly and lost all our Hello packets */
-			zrtpChannelContext->timer.status = BZRTP_TIMER_ON;
-			zrtpChannelContext->timer.firingTime = 0;
-			zrtpChannelContext->timer.firingCount = 0;
-			zrtpChannelContext->timer.timerStep = HELLO_BASE_RETRANSMISSION_STEP;
-
-			/* set next state (do not call it as we will just be waiting for a HelloACK packet from peer, nothing to do) */
-			zrtpChannelContext->stateMachine = state_discovery_waitingForHelloAck;
-			bctbx_message("Entering state discovery waiting for HelloACK on channel [%p]", zrtpChannelContext);
-			return 0;
+			return bzrtp_responseToHelloMessage(zrtpContext, zrtpChannelContext, zrtpPacket, state_discovery_waitingForHelloAck);
 		}
 
 		/* if we have a HelloACK packet, stop the timer and  set next state to state_discovery_waitingForHello */
@@ -145,19 +137,35 @@ int state_discovery_init(bzrtpEvent_t event) {
 
 	/*** Manage timer event ***/
 	if (event.eventType == BZRTP_EVENT_TIMER) {
+		const bzrtpDiscoveryPolicy_t *policy = &zrtpContext->discoveryPolicy;
+		bzrtpPacket_t *helloPacket = zrtpChannelContext->selfPackets[HELLO_MESSAGE_STORE_ID];
+		uint32_t helloLength = helloPacket->messageLength + ZRTP_PACKET_OVERHEAD;
+
+		/* first Hello of the discovery starts the time budget */
+		if (zrtpChannelContext->discoveryBytesSent == 0) {
+			zrtpChannelContext->discoveryStartTime = zrtpContext->timeReference;
+		}
+
+		/* check the time and byte budgets before sending anything */
+		if ((policy->timeBudget > 0 && zrtpContext->timeReference - zrtpChannelContext->discoveryStartTime >= policy->timeBudget)
+			|| (policy->byteBudget > 0 && zrtpChannelContext->discoveryBytesSent + helloLength > policy->byteBudget)) {
+			bzrtp_discoveryBudgetExhausted(zrtpContext, zrtpChannelContext);
+			return 0;
+		}
 
 		/* adjust timer for next time : check we didn't reach the max retransmissions adjust the step(double it until reaching the cap) */
-		if (zrtpChannelContext->timer.firingCount<=HELLO_MAX_RETRANSMISSION_NUMBER) {
+		if (zrtpChannelContext->timer.firingCount<=policy->maxHelloCount) {
 			if (2*zrtpChannelContext->timer.timerStep<=HELLO_CAP_RETRANSMISSION_STEP) {
 				zrtpChannelContext->timer.timerStep *= 2;
 			}
 			zrtpChannelContext->timer.firingTime = zrtpContext->timeReference + zrtpChannelContext->timer.timerStep;
-		} else { /* we have done enough retransmissions, stop it */
-			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+		} else { /* we have done enough retransmissions, this one is the last */
+			bzrtp_discoveryBudgetExhausted(zrtpContext, zrtpChannelContext);
 		}
 
 		/* We must resend a Hello packet */
-		return bzrtp_sendPacket(zrtpContext, zrtpChannelContext, zrtpChannelContext->selfPackets[HELLO_MESSAGE_STORE_ID]);
+		zrtpChannelContext->discoveryBytesSent += helloLength;
+		return bzrtp_sendPacket(zrtpContext, zrtpChannelContext, helloPacket);
 	}
 	return 0;
 }
@@ -183,7 +191,6 @@ int state_discovery_waitingForHello(bzrtpEvent_t event)  {
 
 	/*** Manage message event ***/
 	if (event.eventType == BZRTP_EVENT_MESSAGE) {
-		bzrtpEvent_t initEvent;
 		int retval;
 
 		bzrtpPacket_t *zrtpPacket = event.bzrtpPacket;
@@ -203,24 +210,8 @@ int state_discovery_waitingForHello(bzrtpEvent_t event)  {
 		/* packet is valid, set the sequence Number in channel context */
 		zrtpChannelContext->peerSequenceNumber = zrtpPacket->sequenceNumber;
 
-		retval = bzrtp_responseToHelloMessage(zrtpContext, zrtpChannelContext, zrtpPacket);
-		if (retval != 0) {
-			return retval;
-		}
-
-		/* set next state state_keyAgreement_sendingCommit */
-		zrtpChannelContext->stateMachine = state_keyAgreement_sendingCommit;
-
-		/* create the init event for next state */
-		initEvent.eventType = BZRTP_EVENT_INIT;
-		initEvent.bzrtpPacketString = NULL;
-		initEvent.bzrtpPacketStringLength = 0;
-		initEvent.bzrtpPacket = NULL;
-		initEvent.zrtpContext = zrtpContext;
-		initEvent.zrtpChannelContext = zrtpChannelContext;
-
-		/* call the next state */
-		return zrtpChannelContext->stateMachine(initEvent);
+		/* respond to it and go on with state_keyAgreement_sendingCommit */
+		return bzrtp_responseToHelloMessage(zrtpContext, zrtpChannelContext, zrtpPacket, state_keyAgreement_sendingCommit);
 	}
 
 	/*** Manage timer event ***/
@@ -284,17 +275,8 @@ int state_discovery_waitingForHelloAck(bzrtpEvent_t event) {
 			if (retval != 0) {
 				return retval; /* no need to free the Hello message as it is attached to the context, it will be freed when destroying it */
 			}
-			retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, helloACKPacket);
-			if (retval != 0) {
-				bzrtp_freeZrtpPacket(helloACKPacket);
-				return retval;
-			} else {
-				/* send the message */
-				retval = bzrtp_sendPacket(zrtpContext, zrtpChannelContext, helloACKPacket);
-				/* sent HelloACK is not stored, free it */
-				bzrtp_freeZrtpPacket(helloACKPacket);
-			}
-			return retval;
+			/* sent HelloACK is not stored */
+			return bzrtp_buildAndSendTransientPacket(zrtpContext, zrtpChannelContext, helloACKPacket);
 		}
 
 		/* parse the packet wich is either HelloACK or Commit */
@@ -334,7 +316,7 @@ int state_discovery_waitingForHelloAck(bzrtpEvent_t event) {
 		/* if we have a Commit packet we shall turn into responder role
 		 * then transit to state_keyAgreement_responderSendingDHPart1 or state_confirmation_responderSendingConfirm1 depending on which mode (Multi/PreShared or DHM) we are using and execute it with an init event */
 		if (zrtpPacket->messageType == MSGTYPE_COMMIT) {
-			bzrtpCommitMessage_t *commitMessage = (bzrtpCommitMessage_t *)zrtpPacket->messageData;
+			bzrtpCommitMessage_t *commitMessage = &zrtpPacket->message.commit;
 
 			/* this will stop the timer, update the context channel and run the next state according to current mode */
 			return bzrtp_turnIntoResponder(zrtpContext, zrtpChannelContext, zrtpPacket, commitMessage);
@@ -352,8 +334,9 @@ int state_discovery_waitingForHelloAck(bzrtpEvent_t event) {
 				zrtpChannelContext->timer.timerStep *= 2;
 			}
 			zrtpChannelContext->timer.firingTime = zrtpContext->timeReference + zrtpChannelContext->timer.timerStep;
-		} else { /* we have done enough retransmissions, stop it */
+		} else { /* we have done enough retransmissions, stop it: peer is not answering, the channel failed */
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+			bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ERROR);
 		}
 
 		/* We must resend a Hello packet */
@@ -363,6 +346,83 @@ int state_discovery_waitingForHelloAck(bzrtpEvent_t event) {
 	return 0;
 }
 
+/*
+ * @brief Peer Hello is accepted but the secrets associated to the peer are still being read from cache by the application.
+ * Hello repetitions are deduplicated, the Hello processing resumes on the cache read completion event
+ *
+ * Arrives from :
+ * 	- state_discovery_init upon Hello reception
+ * 	- state_discovery_waitingForHello upon Hello reception
+ * Goes to:
+ * 	- state_discovery_waitingForHelloAck upon cache read completion, when coming from state_discovery_init and no HelloACK was received
+ * 	- state_keyAgreement_sendingCommit upon cache read completion otherwise
+ * Send :
+ * 	- Hello until timer's end or HelloACK reception, when coming from state_discovery_init
+ *
+ */
+int state_discovery_waitingForCache(bzrtpEvent_t event) {
+	/* get the contextes from the event */
+	bzrtpContext_t *zrtpContext = event.zrtpContext;
+	bzrtpChannelContext_t *zrtpChannelContext = event.zrtpChannelContext;
+	int retval;
+
+	/*** Manage cache read completion ***/
+	if (event.eventType == BZRTP_EVENT_CACHEREAD) {
+		/* the application could not perform the read, do it now */
+		if (zrtpChannelContext->cacheReadStatus != BZRTP_CACHEREAD_DONE) {
+			bzrtp_getPeerAssociatedSecrets(zrtpContext, zrtpContext->peerZID);
+		}
+		zrtpChannelContext->cacheReadStatus = BZRTP_CACHEREAD_NONE;
+
+		retval = bzrtp_completeResponseToHelloMessage(zrtpContext, zrtpChannelContext, 1);
+		if (retval != 0) {
+			return retval;
+		}
+		return bzrtp_enterNextDiscoveryState(zrtpContext, zrtpChannelContext, zrtpChannelContext->cacheReadNextState);
+	}
+
+	/*** Manage message event ***/
+	if (event.eventType == BZRTP_EVENT_MESSAGE) {
+		bzrtpPacket_t *zrtpPacket = event.bzrtpPacket;
+
+		/* peer keeps sending its Hello until we acknowledge it: it shall be the one we are processing, drop it */
+		if (zrtpPacket->messageType == MSGTYPE_HELLO) {
+			if (zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->messageLength != zrtpPacket->messageLength
+				|| memcmp(event.bzrtpPacketString+ZRTP_PACKET_HEADER_LENGTH, zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->packetString+ZRTP_PACKET_HEADER_LENGTH, zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->messageLength) != 0) {
+				bzrtp_freeZrtpPacket(zrtpPacket);
+				return BZRTP_ERROR_UNMATCHINGPACKETREPETITION;
+			}
+			zrtpChannelContext->peerSequenceNumber = zrtpPacket->sequenceNumber;
+			bzrtp_freeZrtpPacket(zrtpPacket);
+			return 0;
+		}
+
+		/* peer got our Hello: stop sending it and go straight to the Commit once the cache is read */
+		if (zrtpPacket->messageType == MSGTYPE_HELLOACK && zrtpChannelContext->cacheReadNextState == state_discovery_waitingForHelloAck) {
+			retval = bzrtp_packetParser(zrtpContext, zrtpChannelContext, event.bzrtpPacketString, event.bzrtpPacketStringLength, zrtpPacket);
+			if (retval == 0) {
+				zrtpChannelContext->peerSequenceNumber = zrtpPacket->sequenceNumber;
+				zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+				zrtpChannelContext->cacheReadNextState = state_keyAgreement_sendingCommit;
+			}
+			bzrtp_freeZrtpPacket(zrtpPacket);
+			return retval;
+		}
+
+		/* anything else (peer's Commit) is retransmitted by peer until we answer it, ignore it for now */
+		bzrtp_freeZrtpPacket(zrtpPacket);
+		return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
+	}
+
+	/*** Manage timer event ***/
+	/* the timer is on only when we still wait for peer's HelloACK: keep sending our Hello */
+	if (event.eventType == BZRTP_EVENT_TIMER) {
+		return state_discovery_waitingForHelloAck(event);
+	}
+
+	return 0;
+}
+
 /*
  * @brief For any kind of key agreement (DHM, Mult, PreShared), we keep sending commit.
  *
@@ -470,7 +530,7 @@ int state_keyAgreement_sendingCommit(bzrtpEvent_t event) {
 			/* stop the timer */
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
 
-			dhPart1Message = (bzrtpDHPartMessage_t *)zrtpPacket->messageData;
+			dhPart1Message = &zrtpPacket->message.dhPart;
 
 			/* Check shared secret hash found in the DHPart1 message */
 			/* if we do not have the secret, don't check it as we do not expect the other part to have it neither */
@@ -583,7 +643,7 @@ int state_keyAgreement_sendingCommit(bzrtpEvent_t event) {
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
 
 			/* save the message and extract some information from it to the channel context */
-			confirm1Message = (bzrtpConfirmMessage_t *)zrtpPacket->messageData;
+			confirm1Message = &zrtpPacket->message.confirm;
 			memcpy(zrtpChannelContext->peerH[0], confirm1Message->H0, 32);
 
 			/* As we are in NON-DHM mode, condition will be always false
@@ -606,8 +666,8 @@ int state_keyAgreement_sendingCommit(bzrtpEvent_t event) {
 
 		/* we have a commit - do commit contention as in rfc section 4.2 - if we are initiator, keep sending Commits, otherwise stop the timer and go to state_keyAgreement_responderSendingDHPart1 if we are DHM mode or state_confirmation_responderSendingConfirm1 in Multi or PreShared mode */
 		if(zrtpPacket->messageType == MSGTYPE_COMMIT) {
-			bzrtpCommitMessage_t *peerCommitMessage = (bzrtpCommitMessage_t *)zrtpPacket->messageData;
-			bzrtpCommitMessage_t *selfCommitMessage = (bzrtpCommitMessage_t *)zrtpChannelContext->selfPackets[COMMIT_MESSAGE_STORE_ID]->messageData;
+			bzrtpCommitMessage_t *peerCommitMessage = &zrtpPacket->message.commit;
+			bzrtpCommitMessage_t *selfCommitMessage = &zrtpChannelContext->selfPackets[COMMIT_MESSAGE_STORE_ID]->message.commit;
 			/* - If one Commit is for a DH mode while the other is for Preshared mode, then the Preshared Commit MUST be discarded and the DH Commit proceeds
 			 *
 			 * - If the two Commits are both Preshared mode, and one party has set the MiTM (M) flag in the Hello message and the other has not, the Commit message from the party who set the (M) flag MUST be discarded, and the one who has not set the (M) flag becomes the initiator, regardless of the nonce values.  In other words, for Preshared mode, the phone is the initiator and the PBX is the responder.
@@ -621,8 +681,8 @@ int state_keyAgreement_sendingCommit(bzrtpEvent_t event) {
 					zrtpChannelContext->role = BZRTP_ROLE_RESPONDER;
 				}
 			} else { /* commit have the same mode */
-				bzrtpHelloMessage_t *peerHelloMessage = (bzrtpHelloMessage_t *)zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->messageData;
-				bzrtpHelloMessage_t *selfHelloMessage = (bzrtpHelloMessage_t *)zrtpChannelContext->selfPackets[HELLO_MESSAGE_STORE_ID]->messageData;
+				bzrtpHelloMessage_t *peerHelloMessage = &zrtpChannelContext->peerPackets[HELLO_MESSAGE_STORE_ID]->message.hello;
+				bzrtpHelloMessage_t *selfHelloMessage = &zrtpChannelContext->selfPackets[HELLO_MESSAGE_STORE_ID]->message.hello;
 
 				if (peerCommitMessage->keyAgreementAlgo ==  ZRTP_KEYAGREEMENT_Prsh && ((selfHelloMessage->M == 1) || (peerHelloMessage->M == 1)) ) {
 					if (selfHelloMessage->M == 1) { /* we are a PBX -> act as responder */
@@ -666,8 +726,9 @@ int state_keyAgreement_sendingCommit(bzrtpEvent_t event) {
 				zrtpChannelContext->timer.timerStep *= 2;
 			}
 			zrtpChannelContext->timer.firingTime = zrtpContext->timeReference + zrtpChannelContext->timer.timerStep;
-		} else { /* we have done enough retransmissions, stop it */
+		} else { /* we have done enough retransmissions, stop it: peer is not answering, the channel failed */
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+			bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ERROR);
 		}
 
 		/* We must resend a Commit packet */
@@ -757,7 +818,7 @@ int state_keyAgreement_responderSendingDHPart1(bzrtpEvent_t event) {
 				return retval;
 			}
 
-			dhPart2Message = (bzrtpDHPartMessage_t *)zrtpPacket->messageData;
+			dhPart2Message = &zrtpPacket->message.dhPart;
 
 			/* Check shared secret hash found in the DHPart2 message */
 			/* if we do not have the secret, don't check it as we do not expect the other part to have it neither */
@@ -973,7 +1034,7 @@ int state_keyAgreement_initiatorSendingDHPart2(bzrtpEvent_t event) {
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
 
 			/* update context with the information found in the packet */
-			confirm1Packet = (bzrtpConfirmMessage_t *)zrtpPacket->messageData;
+			confirm1Packet = &zrtpPacket->message.confirm;
 			memcpy(zrtpChannelContext->peerH[0], confirm1Packet->H0, 32);
 #ifdef GOCLEAR_ENABLED
 			if(zrtpChannelContext->isMainChannel){
@@ -1017,8 +1078,9 @@ int state_keyAgreement_initiatorSendingDHPart2(bzrtpEvent_t event) {
 				zrtpChannelContext->timer.timerStep *= 2;
 			}
 			zrtpChannelContext->timer.firingTime = zrtpContext->timeReference + zrtpChannelContext->timer.timerStep;
-		} else { /* we have done enough retransmissions, stop it */
+		} else { /* we have done enough retransmissions, stop it: peer is not answering, the channel failed */
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+			bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ERROR);
 		}
 
 		/* We must resend a DHPart1 packet */
@@ -1172,7 +1234,7 @@ int state_confirmation_responderSendingConfirm1(bzrtpEvent_t event) {
 			}
 
 			/* update context with the information found in the packet */
-			confirm2Packet = (bzrtpConfirmMessage_t *)zrtpPacket->messageData;
+			confirm2Packet = &zrtpPacket->message.confirm;
 			memcpy(zrtpChannelContext->peerH[0], confirm2Packet->H0, 32);
 #ifdef GOCLEAR_ENABLED
 			if(zrtpChannelContext->isMainChannel){
@@ -1210,14 +1272,7 @@ int state_confirmation_responderSendingConfirm1(bzrtpEvent_t event) {
 			if (retval!=0) {
 				return retval;
 			}
-			retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, conf2ACKPacket);
-			if (retval!=0) {
-				bzrtp_freeZrtpPacket(conf2ACKPacket);
-				return retval;
-			}
-
-			retval = bzrtp_sendPacket(zrtpContext, zrtpChannelContext, conf2ACKPacket);
-			bzrtp_freeZrtpPacket(conf2ACKPacket);
+			retval = bzrtp_buildAndSendTransientPacket(zrtpContext, zrtpChannelContext, conf2ACKPacket);
 			if (retval!=0) {
 				return retval;
 			}
@@ -1401,8 +1456,9 @@ int state_confirmation_initiatorSendingConfirm2(bzrtpEvent_t event) {
 				zrtpChannelContext->timer.timerStep *= 2;
 			}
 			zrtpChannelContext->timer.firingTime = zrtpContext->timeReference + zrtpChannelContext->timer.timerStep;
-		} else { /* we have done enough retransmissions, stop it */
+		} else { /* we have done enough retransmissions, stop it: peer is not answering, the channel failed */
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+			bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ERROR);
 		}
 
 		/* We must resend a Confirm2 packet */
@@ -1445,6 +1501,7 @@ int state_secure(bzrtpEvent_t event) {
 		}
 		/* turn channel isSecure flag to 1 */
 		zrtpChannelContext->isSecure = 1;
+		bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_SECURE);
 
 		/* call the environment to signal we're ready to operate */
 		if (zrtpContext->zrtpCallbacks.bzrtp_startSrtpSession!= NULL) {
@@ -1482,17 +1539,7 @@ int state_secure(bzrtpEvent_t event) {
 			if (retval!=0) {
 				return retval;
 			}
-			retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, conf2ACKPacket);
-			if (retval!=0) {
-				bzrtp_freeZrtpPacket(conf2ACKPacket);
-				return retval;
-			}
-
-			retval = bzrtp_sendPacket(zrtpContext, zrtpChannelContext, conf2ACKPacket);
-			/* free the conf2ACK packet */
-			bzrtp_freeZrtpPacket(conf2ACKPacket);
-
-			return retval;
+			return bzrtp_buildAndSendTransientPacket(zrtpContext, zrtpChannelContext, conf2ACKPacket);
 #ifdef GOCLEAR_ENABLED
 		} else if (zrtpPacket->messageType == MSGTYPE_GOCLEAR && zrtpContext->selfAcceptGoClear) {
 			/* We have a GoClear packet */
@@ -1512,7 +1559,7 @@ int state_secure(bzrtpEvent_t event) {
 				zrtpChannelContext->hmacFunction(zrtpChannelContext->mackeyi, zrtpChannelContext->hashLength, (uint8_t *)"GoClear ", 8, 8, computedClearMAC);
 			}
 
-			bzrtpGoClearMessage_t *goClearMessage = (bzrtpGoClearMessage_t *) zrtpPacket->messageData;
+			bzrtpGoClearMessage_t *goClearMessage = &zrtpPacket->message.goClear;
 			int retval = memcmp(goClearMessage->clear_mac, computedClearMAC, 8);
 
 			/* free the incoming packet */
@@ -1532,24 +1579,14 @@ int state_secure(bzrtpEvent_t event) {
 			if (retval!=0) {
 				return retval;
 			}
-			retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, clearAckPacket);
-			if (retval!=0) {
-				bzrtp_freeZrtpPacket(clearAckPacket);
-				return retval;
-			}
-
 			/* now send the ClearACK message */
-			retval = bzrtp_sendPacket(zrtpContext, zrtpChannelContext, clearAckPacket);
-
-			/* free the ClearACK packet */
-			bzrtp_freeZrtpPacket(clearAckPacket);
-
+			retval = bzrtp_buildAndSendTransientPacket(zrtpContext, zrtpChannelContext, clearAckPacket);
 			if (retval != 0) {
 				return retval;
 			}
 
 			/* destroy all key materials */
-			for (int i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+			for (int i=0; i<zrtpContext->channelContextSize; i++) {
 				if (zrtpContext->channelContext[i]!=NULL) {
 					bzrtp_destroyKeyMaterial(zrtpContext, zrtpContext->channelContext[i]);
 					zrtpContext->channelContext[i]->isSecure = 0;
@@ -1584,7 +1621,7 @@ int state_secure(bzrtpEvent_t event) {
 			}
 
 			/* set the next state to state_clear */
-			for (int i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+			for (int i=0; i<zrtpContext->channelContextSize; i++) {
 				if (zrtpContext->channelContext[i]!=NULL) {
 					zrtpContext->channelContext[i]->stateMachine = state_clear;
 				}
@@ -1616,7 +1653,7 @@ int state_secure(bzrtpEvent_t event) {
 			return BZRTP_ERROR_INVALIDCONTEXT;
 		}
 
-		for (int i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+		for (int i=0; i<zrtpContext->channelContextSize; i++) {
 			if (zrtpContext->channelContext[i]!=NULL) {
 				zrtpContext->channelContext[i]->stateMachine = state_sending_GoClear;
 			}
@@ -1707,7 +1744,7 @@ int state_sending_GoClear(bzrtpEvent_t event){
 			}
 
 			/* destroy all key materials */
-			for (int i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+			for (int i=0; i<zrtpContext->channelContextSize; i++) {
 				if (zrtpContext->channelContext[i]!=NULL) {
 					bzrtp_destroyKeyMaterial(zrtpContext, zrtpContext->channelContext[i]);
 					zrtpContext->channelContext[i]->isSecure = 0;
@@ -1741,7 +1778,7 @@ int state_sending_GoClear(bzrtpEvent_t event){
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
 
 			/* set the next state to state_clear */
-			for (int i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+			for (int i=0; i<zrtpContext->channelContextSize; i++) {
 				if (zrtpContext->channelContext[i]!=NULL) {
 					zrtpContext->channelContext[i]->stateMachine = state_clear;
 				}
@@ -1772,7 +1809,7 @@ int state_sending_GoClear(bzrtpEvent_t event){
 					zrtpChannelContext->hmacFunction(zrtpChannelContext->mackeyi, zrtpChannelContext->hashLength, (uint8_t *)"GoClear ", 8, 8, computedClearMAC);
 				}
 
-				bzrtpGoClearMessage_t *goClearMessage = (bzrtpGoClearMessage_t *) zrtpPacket->messageData;
+				bzrtpGoClearMessage_t *goClearMessage = &zrtpPacket->message.goClear;
 				retval = memcmp(goClearMessage->clear_mac, computedClearMAC, 8);
 
 				if (retval != 0) {
@@ -1802,18 +1839,7 @@ int state_sending_GoClear(bzrtpEvent_t event){
 			if (retval!=0) {
 				return retval;
 			}
-			retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, clearACKPacket);
-			if (retval!=0) {
-				bzrtp_freeZrtpPacket(clearACKPacket);
-				return retval;
-			}
-
-			retval = bzrtp_sendPacket(zrtpContext, zrtpChannelContext, clearACKPacket);
-
-			/* free the ClearACK packet */
-			bzrtp_freeZrtpPacket(clearACKPacket);
-
-			return retval;
+			return bzrtp_buildAndSendTransientPacket(zrtpContext, zrtpChannelContext, clearACKPacket);
 		} else {
 			bzrtp_freeZrtpPacket(zrtpPacket);
 			return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
@@ -1829,8 +1855,9 @@ int state_sending_GoClear(bzrtpEvent_t event){
 				zrtpChannelContext->timer.timerStep *= 2;
 			}
 			zrtpChannelContext->timer.firingTime = zrtpContext->timeReference + zrtpChannelContext->timer.timerStep;
-		} else { /* we have done enough retransmissions, stop it */
+		} else { /* we have done enough retransmissions, stop it: peer is not answering, the channel failed */
 			zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+			bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ERROR);
 		}
 		retval = bzrtp_sendPacket(zrtpContext, zrtpChannelContext, zrtpChannelContext->selfPackets[GOCLEAR_MESSAGE_STORE_ID]);
 		/* We must resend a GoClear packet */
@@ -1872,10 +1899,11 @@ int state_clear(bzrtpEvent_t event){
 		}
 		bctbx_message("Entering state sending clear on channel [%p]", zrtpChannelContext);
 		/* Set all channels to clear and roles to initiator */
-		for (int i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+		for (int i=0; i<zrtpContext->channelContextSize; i++) {
 			if (zrtpContext->channelContext[i]!=NULL) {
 				zrtpContext->channelContext[i]->isClear = 1;
 				zrtpContext->channelContext[i]->role = BZRTP_ROLE_INITIATOR;
+				bzrtp_setChannelStatus(zrtpContext, zrtpContext->channelContext[i], BZRTP_CHANNEL_CLEAR);
 			}
 		}
 	}
@@ -1903,14 +1931,18 @@ int state_clear(bzrtpEvent_t event){
 						zrtpChannelContext->peerPackets[i] = NULL;
 					}
 				}
+				/* peer hash images and MACs will be verified again on the next exchange */
+				zrtpChannelContext->peerHVerified = 0;
+				zrtpChannelContext->peerPacketsMACVerified = 0;
 			}
 
 			zrtpChannelContext->isClear = 0;
+			bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ONGOING);
 
 			/* packet is valid, set the sequence Number in channel context */
 			zrtpChannelContext->peerSequenceNumber = zrtpPacket->sequenceNumber;
 
-			bzrtpCommitMessage_t *peerCommitMessage = (bzrtpCommitMessage_t *)zrtpPacket->messageData;
+			bzrtpCommitMessage_t *peerCommitMessage = &zrtpPacket->message.commit;
 			return bzrtp_turnIntoResponder(zrtpContext, zrtpChannelContext, zrtpPacket, peerCommitMessage);
 
 		} else {
@@ -1941,7 +1973,7 @@ int state_clear(bzrtpEvent_t event){
 		}
 
 		/* Delete all self and peer packets except Hello packets */
-		for (int i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+		for (int i=0; i<zrtpContext->channelContextSize; i++) {
 			if (zrtpContext->channelContext[i]!=NULL) {
 				/* We need to keep Hello packets in case of we're in zrtp mode */
 				for (int j = COMMIT_MESSAGE_STORE_ID ; j < PACKET_STORAGE_CAPACITY ; j++) {
@@ -1957,11 +1989,12 @@ int state_clear(bzrtpEvent_t event){
 			}
 		}
 
-		for (int i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+		for (int i=0; i<zrtpContext->channelContextSize; i++) {
 			if (zrtpContext->channelContext[i]!=NULL) {
 				zrtpContext->channelContext[i]->keyAgreementAlgo = ZRTP_KEYAGREEMENT_Mult;
 				initEvent.zrtpChannelContext = zrtpContext->channelContext[i];
 				zrtpContext->channelContext[i]->isClear = 0;
+				bzrtp_setChannelStatus(zrtpContext, zrtpContext->channelContext[i], BZRTP_CHANNEL_ONGOING);
 				/* set the next state to state_keyAgreement_sendingCommit */
 				zrtpContext->channelContext[i]->stateMachine = state_keyAgreement_sendingCommit;
 				/* call it with the init event */
@@ -1992,17 +2025,8 @@ int state_clear(bzrtpEvent_t event){
 		if (retval!=0) {
 			return retval;
 		}
-		retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, clearAckPacket);
-		if (retval!=0) {
-			bzrtp_freeZrtpPacket(clearAckPacket);
-			return retval;
-		}
-
-		if (retval == 0) {
-			retval = bzrtp_sendPacket(zrtpContext, zrtpChannelContext, clearAckPacket);
-			bzrtp_freeZrtpPacket(clearAckPacket);
-		} else {
-			bzrtp_freeZrtpPacket(clearAckPacket);
+		retval = bzrtp_buildAndSendTransientPacket(zrtpContext, zrtpChannelContext, clearAckPacket);
+		if (retval != 0) {
 			return retval;
 		}
 
@@ -2014,6 +2038,23 @@ int state_clear(bzrtpEvent_t event){
 #endif /* GOCLEAR_ENABLED */
 }
 
+/*
+ * @brief The key agreement was terminated by an Error message, sent or received
+ * This is a final state: there is no timer and every incoming message is dropped
+ *
+ * Arrives from:
+ * 	- any state but state_secure and state_clear on Error reception or fatal local error
+ */
+int state_error(bzrtpEvent_t event) {
+	/*** Manage message event ***/
+	if (event.eventType == BZRTP_EVENT_MESSAGE) {
+		bzrtp_freeZrtpPacket(event.bzrtpPacket);
+		return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
+	}
+
+	return 0;
+}
+
 /************* Local helpers functions *******************/
 
 /**
@@ -2062,9 +2103,12 @@ static int bzrtp_turnIntoResponder(bzrtpContext_t *zrtpContext, bzrtpChannelCont
 		memcpy(zrtpChannelContext->responderAuxsecretID, tmpBuffer, 8);
 
 		if (bzrtp_isKem(zrtpChannelContext->keyAgreementAlgo)) {
-			/* destroy stored KEMContext, we might have created one when receiving peer's Hello */
-			bzrtp_destroyKEMContext((bzrtp_KEMContext_t *)zrtpContext->keyAgreementContext);
+			/* destroy the KEMContext in use, if any its public key was sent in our Commit so it cannot be reused */
+			bzrtp_destroyKeyAgreementContext(zrtpContext->keyAgreementContext, zrtpContext->keyAgreementAlgo);
 			zrtpContext->keyAgreementContext = NULL;
+			zrtpContext->keyAgreementAlgo = ZRTP_UNSET_ALGO;
+			/* a key pair prepared for the initiator role and not disclosed yet can serve a later key exchange */
+			bzrtp_recycleKeyAgreementContext(zrtpContext, BZRTP_ROLE_INITIATOR);
 
 			/* This is a KEM, so we can trash the self DHPART as it was built to be a DHPart2 and we cannot reuse it */
 			bzrtp_freeZrtpPacket(zrtpChannelContext->selfPackets[DHPART_MESSAGE_STORE_ID]);
@@ -2082,17 +2126,13 @@ static int bzrtp_turnIntoResponder(bzrtpContext_t *zrtpContext, bzrtpChannelCont
 			zrtpChannelContext->selfPackets[DHPART_MESSAGE_STORE_ID]->messageType = MSGTYPE_DHPART1;
 
 			/* change the shared secret ID to the responder one (we set them by default to the initiator's one) */
-			selfDHPart1Packet = (bzrtpDHPartMessage_t *)zrtpChannelContext->selfPackets[DHPART_MESSAGE_STORE_ID]->messageData;
+			selfDHPart1Packet = &zrtpChannelContext->selfPackets[DHPART_MESSAGE_STORE_ID]->message.dhPart;
 			memcpy(selfDHPart1Packet->rs1ID, zrtpContext->responderCachedSecretHash.rs1ID, 8);
 			memcpy(selfDHPart1Packet->rs2ID, zrtpContext->responderCachedSecretHash.rs2ID, 8);
 			memcpy(selfDHPart1Packet->auxsecretID, zrtpChannelContext->responderAuxsecretID, 8);
 			memcpy(selfDHPart1Packet->pbxsecretID, zrtpContext->responderCachedSecretHash.pbxsecretID, 8);
-
-			/* free the packet string */
-			free(zrtpChannelContext->selfPackets[DHPART_MESSAGE_STORE_ID]->packetString);
-			zrtpChannelContext->selfPackets[DHPART_MESSAGE_STORE_ID]->packetString = NULL;
 		}
-		/* (re)build the packet */
+		/* (re)build the packet, the packet string is reused as the public value is stored in it */
 		retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, zrtpChannelContext->selfPackets[DHPART_MESSAGE_STORE_ID]);
 		if (retval != 0) {
 			return retval;
@@ -2129,21 +2169,27 @@ static int bzrtp_turnIntoResponder(bzrtpContext_t *zrtpContext, bzrtpChannelCont
  * This message may arrives when in state state_discovery_init or state_discovery_waitingForHello.
  * - Find agreement on algo to use
  * - Check if we have retained secrets in cache matching the peer ZID
+ * - send the HelloACK
  * - if agreed on a DHM mode : compute the public value and prepare a DHPart2 packet(assume we are initiator, change later if needed)
+ *   this key pair serves the responder too: DHPart2 is turned into DHPart1 if peer's Commit wins. In KEM mode prepare the key pair the Commit will hold
  * - if agreed on a non-DHM mode : PreShared not supported, Multistream nothing to do at this point
  *
+ * When the application reads the cache itself (bzrtp_cacheReadRequested callback set), the channel waits for it
+ * in state_discovery_waitingForCache and the processing resumes from there.
+ *
  * @param[in]		zrtpContext				The current zrtp Context
  * @param[in,out]	zrtpChannelContext		The channel we are operating
  * @param[in]		zrtpPacket				The zrtpPacket received, it contains the hello message
+ * @param[in]		nextState				The state to go to once the Hello is processed
  *
  * @return 0 on succes, error code otherwise
  */
-static int bzrtp_responseToHelloMessage(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket) {
+static int bzrtp_responseToHelloMessage(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket, bzrtpStateMachine_t nextState) {
 	int retval;
 	int i;
 	uint8_t peerSupportMultiChannel = 0;
-	bzrtpPacket_t *helloACKPacket;
-	bzrtpHelloMessage_t *helloMessage = (bzrtpHelloMessage_t *)zrtpPacket->messageData;
+	uint8_t useRetainedSecrets = 0;
+	bzrtpHelloMessage_t *helloMessage = &zrtpPacket->message.hello;
 
 	/* check supported version of ZRTP protocol */
 	if (memcmp(helloMessage->version, ZRTP_VERSION, 3) != 0) { /* we support version 1.10 only but checking is done on 1.1? as explained in rfc section 4.1.1 */
@@ -2203,11 +2249,58 @@ static int bzrtp_responseToHelloMessage(bzrtpContext_t *zrtpContext, bzrtpChanne
 			return BZRTP_ERROR_MULTICHANNELNOTSUPPORTEDBYPEER;
 		}
 	} else { /* we are not in multiStream mode, so we shall compute the hash of shared secrets */
+		useRetainedSecrets = 1;
 		/* get from cache, if relevant, the retained secrets associated to the peer ZID */
 		if (zrtpContext->cachedSecret.rs1 == NULL) { /* if we do not have already secret hashes in this session context. Note, they may be updated in cache file but they also will be in the context at the same time, so no need to parse the cache again */
+			/* the application reads the cache on its own thread: wait for it without blocking the other channels */
+			if (zrtpContext->zidCache != NULL && zrtpContext->zrtpCallbacks.bzrtp_cacheReadRequested != NULL) {
+				bzrtpStateMachine_t currentState = zrtpChannelContext->stateMachine;
+
+				zrtpChannelContext->cacheReadNextState = nextState;
+				zrtpChannelContext->cacheReadStatus = BZRTP_CACHEREAD_PENDING;
+				zrtpChannelContext->stateMachine = state_discovery_waitingForCache;
+				if (nextState == state_discovery_waitingForHelloAck) { /* peer may have lost all our Hello packets, keep sending them meanwhile */
+					zrtpChannelContext->timer.status = BZRTP_TIMER_ON;
+					zrtpChannelContext->timer.firingTime = 0;
+					zrtpChannelContext->timer.firingCount = 0;
+					zrtpChannelContext->timer.timerStep = HELLO_BASE_RETRANSMISSION_STEP;
+				}
+				bctbx_message("Entering state discovery waiting for cache on channel [%p]", zrtpChannelContext);
+				if (zrtpContext->zrtpCallbacks.bzrtp_cacheReadRequested(zrtpChannelContext->clientData, zrtpChannelContext->selfSSRC) == 0) {
+					return 0; /* processing resumes on bzrtp_cacheReadCompleted */
+				}
+				/* the application cannot do it, read it now */
+				zrtpChannelContext->cacheReadStatus = BZRTP_CACHEREAD_NONE;
+				zrtpChannelContext->stateMachine = currentState;
+			}
 			bzrtp_getPeerAssociatedSecrets(zrtpContext, helloMessage->ZID);
 		}
+	}
 
+	retval = bzrtp_completeResponseToHelloMessage(zrtpContext, zrtpChannelContext, useRetainedSecrets);
+	if (retval != 0) {
+		return retval;
+	}
+	return bzrtp_enterNextDiscoveryState(zrtpContext, zrtpChannelContext, nextState);
+}
+
+/**
+ * @brief Second part of the Hello processing, once the retained secrets are read from cache
+ * - compute the retained secrets hashes
+ * - send the HelloACK
+ * - prepare the DHPart2 packet in DHM mode
+ *
+ * @param[in]		zrtpContext				The current zrtp Context
+ * @param[in,out]	zrtpChannelContext		The channel we are operating
+ * @param[in]		useRetainedSecrets		1 when not in multistream mode: compute the retained secrets hashes
+ *
+ * @return 0 on succes, error code otherwise
+ */
+static int bzrtp_completeResponseToHelloMessage(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint8_t useRetainedSecrets) {
+	int retval;
+	bzrtpPacket_t *helloACKPacket;
+
+	if (useRetainedSecrets == 1) {
 		/* now compute the retained secret hashes (secrets may be updated but not their hash) as in rfc section 4.3.1 */
 		if (zrtpContext->cachedSecret.rs1!=NULL) {
 			zrtpChannelContext->hmacFunction(zrtpContext->cachedSecret.rs1, zrtpContext->cachedSecret.rs1Length, (uint8_t *)"Initiator", 9, 8, zrtpContext->initiatorCachedSecretHash.rs1ID);
@@ -2251,13 +2344,35 @@ static int bzrtp_responseToHelloMessage(bzrtpContext_t *zrtpContext, bzrtpChanne
 
 	}
 
+	/* now respond to this Hello packet sending a Hello ACK, before generating any key pair so the peer does not wait for it */
+	helloACKPacket = bzrtp_createZrtpPacket(zrtpContext, zrtpChannelContext, MSGTYPE_HELLOACK, &retval);
+	if (retval != 0) {
+		return retval; /* no need to free the Hello message as it is attached to the context, it will be freed when destroying it */
+	}
+	retval = bzrtp_buildAndSendTransientPacket(zrtpContext, zrtpChannelContext, helloACKPacket);
+	if (retval != 0) {
+		return retval;
+	}
+
 	/* When in PreShared mode Derive ZRTPSess, s0 from the retained secret and then all the other keys */
 	if (zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_Prsh) {
 		/*TODO*/
 	} else if (zrtpChannelContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_Mult) { /* when in Multistream mode, do nothing, will derive s0 from ZRTPSess when we know who is initiator */
 
 	} else { /* when in DHM mode : Create the DHPart2 packet (that we then may change to DHPart1 if we ended to be the responder)*/
-		bzrtpPacket_t *selfDHPartPacket = bzrtp_createZrtpPacket(zrtpContext, zrtpChannelContext, MSGTYPE_DHPART2, &retval);
+		bzrtpPacket_t *selfDHPartPacket = NULL;
+
+		/* KEM DHPart2 holds only a nonce, the key pair goes in the Commit: generate it while waiting for peer's HelloACK or Commit.
+		 * If peer's Commit wins, it was never disclosed and goes back to the keypair pool */
+		if (bzrtp_isKem(zrtpChannelContext->keyAgreementAlgo)) {
+			retval = bzrtp_prepareKeyAgreementContext(zrtpContext, zrtpChannelContext, BZRTP_ROLE_INITIATOR);
+			if (retval != 0) { /* we cannot generate a key pair, there is no point for peer to go on */
+				bzrtp_abortKeyAgreement(zrtpContext, zrtpChannelContext, BZRTP_ZRTPERROR_CRITICALSOFTWARE, 1);
+				return retval;
+			}
+		}
+
+		selfDHPartPacket = bzrtp_createZrtpPacket(zrtpContext, zrtpChannelContext, MSGTYPE_DHPART2, &retval);
 		if (retval != 0) {
 			return retval; /* no need to free the Hello message as it is attached to the context, it will be freed when destroying it */
 		}
@@ -2270,24 +2385,49 @@ static int bzrtp_responseToHelloMessage(bzrtpContext_t *zrtpContext, bzrtpChanne
 		}
 	}
 
-	/* now respond to this Hello packet sending a Hello ACK */
-	helloACKPacket = bzrtp_createZrtpPacket(zrtpContext, zrtpChannelContext, MSGTYPE_HELLOACK, &retval);
-	if (retval != 0) {
-		return retval; /* no need to free the Hello message as it is attached to the context, it will be freed when destroying it */
-	}
-	retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, helloACKPacket);
-	if (retval != 0) {
-		bzrtp_freeZrtpPacket(helloACKPacket);
-		return retval;
-	} else {
-		/* send the message */
-		retval = bzrtp_sendPacket ( zrtpContext, zrtpChannelContext, helloACKPacket);
-		bzrtp_freeZrtpPacket(helloACKPacket);
-		return retval;
-	}
+	/* a valid Hello revives a channel whose Hello retransmissions were exhausted before the peer showed up */
+	bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ONGOING);
+
 	return 0;
 }
 
+/**
+ * @brief Leave the discovery state once the peer Hello is processed
+ *
+ * @param[in]		zrtpContext				The current zrtp Context
+ * @param[in,out]	zrtpChannelContext		The channel we are operating
+ * @param[in]		nextState				state_discovery_waitingForHelloAck or state_keyAgreement_sendingCommit
+ *
+ * @return 0 on succes, error code otherwise
+ */
+static int bzrtp_enterNextDiscoveryState(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpStateMachine_t nextState) {
+	bzrtpEvent_t initEvent;
+
+	if (nextState == state_discovery_waitingForHelloAck) {
+		/* reset the sending Hello timer as peer may have started slowly and lost all our Hello packets */
+		zrtpChannelContext->timer.status = BZRTP_TIMER_ON;
+		zrtpChannelContext->timer.firingTime = 0;
+		zrtpChannelContext->timer.firingCount = 0;
+		zrtpChannelContext->timer.timerStep = HELLO_BASE_RETRANSMISSION_STEP;
+
+		/* set next state (do not call it as we will just be waiting for a HelloACK packet from peer, nothing to do) */
+		zrtpChannelContext->stateMachine = state_discovery_waitingForHelloAck;
+		bctbx_message("Entering state discovery waiting for HelloACK on channel [%p]", zrtpChannelContext);
+		return 0;
+	}
+
+	/* set next state and call it with an init event */
+	zrtpChannelContext->stateMachine = nextState;
+
+	initEvent.eventType = BZRTP_EVENT_INIT;
+	initEvent.bzrtpPacketString = NULL;
+	initEvent.bzrtpPacketStringLength = 0;
+	initEvent.bzrtpPacket = NULL;
+	initEvent.zrtpContext = zrtpContext;
+	initEvent.zrtpChannelContext = zrtpChannelContext;
+	return zrtpChannelContext->stateMachine(initEvent);
+}
+
 /**
  * @brief After the DHPart1 or DHPart2 arrives from peer, validity check and shared secret computation
  * call this function to compute s0, KDF Context, ZRTPSess,
@@ -2483,13 +2623,7 @@ static int bzrtp_computeS0DHMMode(bzrtpContext_t *zrtpContext, bzrtpChannelConte
 	}
 
 	/* clean the DHM context (secret and key shall be erased by this operation) */
-	if (zrtpContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH2k || zrtpContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_DH3k) {
-		bctbx_DestroyDHMContext((bctbx_DHMContext_t *)(zrtpContext->keyAgreementContext));
-	} else if (zrtpContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_X255 || zrtpContext->keyAgreementAlgo == ZRTP_KEYAGREEMENT_X448) {
-		bctbx_DestroyECDHContext((bctbx_ECDHContext_t *)(zrtpContext->keyAgreementContext));
-	} else if (bzrtp_isKem(zrtpContext->keyAgreementAlgo)) {
-		bzrtp_destroyKEMContext((bzrtp_KEMContext_t *)(zrtpContext->keyAgreementContext));
-	}
+	bzrtp_destroyKeyAgreementContext(zrtpContext->keyAgreementContext, zrtpContext->keyAgreementAlgo);
 	zrtpContext->keyAgreementContext = NULL;
 	zrtpContext->keyAgreementAlgo = ZRTP_UNSET_ALGO;
 
@@ -2709,6 +2843,48 @@ static int bzrtp_deriveSrtpKeysFromS0(bzrtpContext_t *zrtpContext, bzrtpChannelC
 	return 0;
 }
 
+/**
+ * @brief Send one packet string with the current channel sequence number
+ * When the client provides transport buffers, the packet is written in one and its sequence number and CRC are set there: the stored
+ * packet is left untouched. Otherwise they are set in the packet string which is given to the sendData callback.
+ *
+ * @param[in]		zrtpContext			zrtp context to get the callbacks
+ * @param[in]		zrtpChannelContext	the channel context to get the client data and sequence number
+ * @param[in,out]	zrtpPacket			the packet (or fragment) to be sent
+ * @param[in]		packetLength		length of the packet string: header, message and CRC
+ *
+ * @return 0 on success
+ */
+static int bzrtp_sendPacketString(const bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket, uint16_t packetLength) {
+	const bzrtpCallbacks_t *cbs = &zrtpContext->zrtpCallbacks;
+
+	if (cbs->bzrtp_getSendBuffer!=NULL && cbs->bzrtp_commitSendBuffer!=NULL) {
+		uint8_t *buffer = cbs->bzrtp_getSendBuffer(zrtpChannelContext->clientData, packetLength);
+		if (buffer != NULL) {
+			uint32_t CRC;
+			uint8_t *CRCbuffer = buffer + packetLength - ZRTP_PACKET_CRC_LENGTH;
+
+			memcpy(buffer, zrtpPacket->packetString, packetLength - ZRTP_PACKET_CRC_LENGTH);
+			buffer[2] = (uint8_t)((zrtpChannelContext->selfSequenceNumber>>8)&0x00FF);
+			buffer[3] = (uint8_t)(zrtpChannelContext->selfSequenceNumber&0x00FF);
+			CRC = bzrtp_CRC32(buffer, packetLength - ZRTP_PACKET_CRC_LENGTH);
+			*CRCbuffer++ = (uint8_t)((CRC>>24)&0xFF);
+			*CRCbuffer++ = (uint8_t)((CRC>>16)&0xFF);
+			*CRCbuffer++ = (uint8_t)((CRC>>8)&0xFF);
+			*CRCbuffer = (uint8_t)(CRC&0xFF);
+
+			return cbs->bzrtp_commitSendBuffer(zrtpChannelContext->clientData, buffer, packetLength);
+		}
+	}
+
+	/* no transport buffer available, use the regular callback */
+	if (cbs->bzrtp_sendData == NULL) {
+		return BZRTP_ERROR_INVALIDCONTEXT;
+	}
+	bzrtp_packetSetSequenceNumber(zrtpPacket, zrtpChannelContext->selfSequenceNumber);
+	return cbs->bzrtp_sendData(zrtpChannelContext->clientData, zrtpPacket->packetString, packetLength);
+}
+
 /**
  * @brief Send the given packet, if the packets holds fragments, send them all
  * Insert the packet sequence number and compute the CRC before sending
@@ -2721,19 +2897,17 @@ static int bzrtp_deriveSrtpKeysFromS0(bzrtpContext_t *zrtpContext, bzrtpChannelC
  */
 static int bzrtp_sendPacket ( const bzrtpContext_t* zrtpContext, bzrtpChannelContext_t* zrtpChannelContext, bzrtpPacket_t* zrtpPacket) {
 	int retval = 0;
-	if (zrtpContext->zrtpCallbacks.bzrtp_sendData!=NULL) {
+	if (zrtpContext->zrtpCallbacks.bzrtp_sendData!=NULL || (zrtpContext->zrtpCallbacks.bzrtp_getSendBuffer!=NULL && zrtpContext->zrtpCallbacks.bzrtp_commitSendBuffer!=NULL)) {
 		if (zrtpPacket->fragments == NULL) {
 			/* packet is not fragmented, just send it */
-			bzrtp_packetSetSequenceNumber(zrtpPacket, zrtpChannelContext->selfSequenceNumber);
-			retval = zrtpContext->zrtpCallbacks.bzrtp_sendData(zrtpChannelContext->clientData, zrtpPacket->packetString, zrtpPacket->messageLength+ZRTP_PACKET_OVERHEAD);
+			retval = bzrtp_sendPacketString(zrtpContext, zrtpChannelContext, zrtpPacket, zrtpPacket->messageLength+ZRTP_PACKET_OVERHEAD);
 			zrtpChannelContext->selfSequenceNumber++;
 		} else {
 			/* packet is fragmented, send fragments */
 			bctbx_list_t *fragment = zrtpPacket->fragments;
 			for(; fragment!=NULL; fragment = fragment->next) {
 				bzrtpPacket_t *fragmentPacket = (bzrtpPacket_t *)fragment->data;
-				bzrtp_packetSetSequenceNumber(fragmentPacket, zrtpChannelContext->selfSequenceNumber);
-				retval = zrtpContext->zrtpCallbacks.bzrtp_sendData(zrtpChannelContext->clientData, fragmentPacket->packetString, fragmentPacket->messageLength+ZRTP_FRAGMENTEDPACKET_OVERHEAD);
+				retval = bzrtp_sendPacketString(zrtpContext, zrtpChannelContext, fragmentPacket, fragmentPacket->messageLength+ZRTP_FRAGMENTEDPACKET_OVERHEAD);
 				if (retval != 0) {
 					return retval;
 				}
@@ -2746,6 +2920,70 @@ static int bzrtp_sendPacket ( const bzrtpContext_t* zrtpContext, bzrtpChannelCon
 	return retval;
 }
 
+/* packets built in a transport buffer don't own it: it is handed to the client on commit */
+static void bzrtp_transportBufferRelease(BCTBX_UNUSED(void *clientData), BCTBX_UNUSED(uint8_t *packetString)) {
+}
+
+/**
+ * @brief Build and send a packet which is not stored once sent (HelloACK, Conf2ACK, ClearACK, Error, ErrorACK), then free it
+ * When the client provides transport buffers, the packet is built directly in one: no packet string is allocated nor copied.
+ *
+ * @param[in]		zrtpContext			zrtp context to get the callbacks
+ * @param[in,out]	zrtpChannelContext	the channel context to get the client data and update the sequence number
+ * @param[in]		zrtpPacket			the packet created by bzrtp_createZrtpPacket, it is freed by this function
+ *
+ * @return 0 on success
+ */
+static int bzrtp_buildAndSendTransientPacket(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket) {
+	const bzrtpCallbacks_t *cbs = &zrtpContext->zrtpCallbacks;
+	uint16_t packetLength = bzrtp_packetFixedLength(zrtpPacket->messageType);
+	uint8_t *buffer = NULL;
+	int retval;
+
+	/* fixed length messages are a few words long, they are never fragmented */
+	if (packetLength > 0 && packetLength <= zrtpContext->mtu && cbs->bzrtp_getSendBuffer!=NULL && cbs->bzrtp_commitSendBuffer!=NULL) {
+		buffer = cbs->bzrtp_getSendBuffer(zrtpChannelContext->clientData, packetLength);
+	}
+
+	if (buffer == NULL) {
+		retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, zrtpPacket);
+		if (retval == 0) {
+			retval = bzrtp_sendPacket(zrtpContext, zrtpChannelContext, zrtpPacket);
+		}
+		bzrtp_freeZrtpPacket(zrtpPacket);
+		return retval;
+	}
+
+	/* the builder writes in the packet string it is given */
+	zrtpPacket->packetString = buffer;
+	zrtpPacket->packetStringRelease = bzrtp_transportBufferRelease;
+	retval = bzrtp_packetBuild(zrtpContext, zrtpChannelContext, zrtpPacket);
+	if (retval == 0) {
+		bzrtp_packetSetSequenceNumber(zrtpPacket, zrtpChannelContext->selfSequenceNumber);
+		retval = cbs->bzrtp_commitSendBuffer(zrtpChannelContext->clientData, buffer, packetLength);
+		zrtpChannelContext->selfSequenceNumber++;
+	}
+	bzrtp_freeZrtpPacket(zrtpPacket);
+	return retval;
+}
+
+/**
+ * @brief Stop the Hello sending of a channel whose peer never answered during discovery and tell the client
+ * A Hello from peer arriving later still resumes the negotiation
+ *
+ * @param[in]		zrtpContext			The current zrtp Context
+ * @param[in,out]	zrtpChannelContext	The channel in discovery init state
+ */
+static void bzrtp_discoveryBudgetExhausted(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext) {
+	zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+	bctbx_message("Discovery budget exhausted on channel [%p], peer does not seem to support ZRTP", zrtpChannelContext);
+
+	bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ERROR);
+	if (zrtpContext->zrtpCallbacks.bzrtp_peerNotZRTP != NULL) {
+		zrtpContext->zrtpCallbacks.bzrtp_peerNotZRTP(zrtpChannelContext->clientData, zrtpChannelContext->selfSSRC);
+	}
+}
+
 /*
  * @brief Compute the new rs1 and update the cached secrets according to rfc section 4.6.1
  *
@@ -2841,3 +3079,115 @@ int bzrtp_updateCachedSecrets(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t
 
 	return 0;
 }
+
+void bzrtp_setChannelStatus(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, int status) {
+	if (zrtpChannelContext->channelStatus == status) {
+		return;
+	}
+	zrtpChannelContext->channelStatus = status;
+
+	if (zrtpContext->zrtpCallbacks.bzrtp_channelStatusChanged != NULL) {
+		zrtpContext->zrtpCallbacks.bzrtp_channelStatusChanged(zrtpChannelContext->clientData, zrtpChannelContext->selfSSRC, status);
+	}
+}
+
+/* Error message error codes description - rfc section 5.9 */
+static const char *bzrtp_zrtpErrorToString(uint32_t errorCode) {
+	switch (errorCode) {
+		case BZRTP_ZRTPERROR_MALFORMEDPACKET: return "Malformed packet";
+		case BZRTP_ZRTPERROR_CRITICALSOFTWARE: return "Critical software error";
+		case BZRTP_ZRTPERROR_UNSUPPORTEDVERSION: return "Unsupported ZRTP version";
+		case BZRTP_ZRTPERROR_HELLOCOMPONENTSMISMATCH: return "Hello components mismatch";
+		case BZRTP_ZRTPERROR_UNSUPPORTEDHASH: return "Hash Type not supported";
+		case BZRTP_ZRTPERROR_UNSUPPORTEDCIPHER: return "Cipher Type not supported";
+		case BZRTP_ZRTPERROR_UNSUPPORTEDKEYAGREEMENT: return "Public key exchange not supported";
+		case BZRTP_ZRTPERROR_UNSUPPORTEDAUTHTAG: return "SRTP auth tag not supported";
+		case BZRTP_ZRTPERROR_UNSUPPORTEDSAS: return "SAS rendering scheme not supported";
+		case BZRTP_ZRTPERROR_NOSHAREDSECRET: return "No shared secret available, DH mode required";
+		case BZRTP_ZRTPERROR_BADPV: return "DH Error: bad pvi or pvr";
+		case BZRTP_ZRTPERROR_UNMATCHINGHVI: return "DH Error: hvi != hashed data";
+		case BZRTP_ZRTPERROR_UNTRUSTEDMITM: return "Received relayed SAS from untrusted MiTM";
+		case BZRTP_ZRTPERROR_BADCONFIRMMAC: return "Auth Error: Bad Confirm pkt MAC";
+		case BZRTP_ZRTPERROR_NONCEREUSE: return "Nonce reuse";
+		case BZRTP_ZRTPERROR_EQUALZID: return "Equal ZIDs in Hello";
+		case BZRTP_ZRTPERROR_SSRCCOLLISION: return "SSRC collision";
+		case BZRTP_ZRTPERROR_SERVICEUNAVAILABLE: return "Service unavailable";
+		case BZRTP_ZRTPERROR_PROTOCOLTIMEOUT: return "Protocol timeout error";
+		case BZRTP_ZRTPERROR_GOCLEARNOTALLOWED: return "GoClear message received, but not allowed";
+		default: return "Unknown error";
+	}
+}
+
+int bzrtp_abortKeyAgreement(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, uint32_t errorCode, uint8_t sendError) {
+	int retval = 0;
+	int i;
+
+	/* tell peer, the Error message is not retransmitted: peer acknowledges it or will find out through its own retransmissions timeout */
+	if (sendError == 1) {
+		bzrtpPacket_t *errorPacket = bzrtp_createZrtpPacket(zrtpContext, zrtpChannelContext, MSGTYPE_ERROR, &retval);
+		if (retval == 0) {
+			errorPacket->message.error.errorCode = errorCode;
+			retval = bzrtp_buildAndSendTransientPacket(zrtpContext, zrtpChannelContext, errorPacket);
+		}
+	}
+	bctbx_warning("Key agreement terminated on channel [%p] by %s error 0x%x: %s", zrtpChannelContext, (sendError == 1)?"local":"peer", errorCode, bzrtp_zrtpErrorToString(errorCode));
+
+	/* no more retransmissions on this channel */
+	zrtpChannelContext->timer.status = BZRTP_TIMER_OFF;
+
+	/* stored packets are useless now, release them right away: Commit and DHPart may be several kB long in KEM mode */
+	for (i = COMMIT_MESSAGE_STORE_ID ; i < PACKET_STORAGE_CAPACITY ; i++) {
+		bzrtp_freeZrtpPacket(zrtpChannelContext->selfPackets[i]);
+		zrtpChannelContext->selfPackets[i] = NULL;
+		bzrtp_freeZrtpPacket(zrtpChannelContext->peerPackets[i]);
+		zrtpChannelContext->peerPackets[i] = NULL;
+	}
+
+	/* release the key agreement material, key pairs not used yet go back to the pool */
+	if (zrtpChannelContext->isMainChannel == 1) {
+		bzrtp_recycleKeyAgreementContext(zrtpContext, BZRTP_ROLE_INITIATOR);
+		bzrtp_recycleKeyAgreementContext(zrtpContext, BZRTP_ROLE_RESPONDER);
+		bzrtp_destroyKeyAgreementContext(zrtpContext->keyAgreementContext, zrtpContext->keyAgreementAlgo);
+		zrtpContext->keyAgreementContext = NULL;
+		zrtpContext->keyAgreementAlgo = ZRTP_UNSET_ALGO;
+	}
+	bzrtp_destroyKeyMaterial(zrtpContext, zrtpChannelContext);
+
+	/* this is a final state */
+	zrtpChannelContext->stateMachine = state_error;
+
+	if (zrtpContext->zrtpCallbacks.bzrtp_statusMessage!=NULL && zrtpContext->zrtpCallbacks.bzrtp_messageLevel>=BZRTP_MESSAGE_ERROR) {
+		zrtpContext->zrtpCallbacks.bzrtp_statusMessage(zrtpChannelContext->clientData, BZRTP_MESSAGE_ERROR, (sendError == 1)?BZRTP_MESSAGE_ERRORSENT:BZRTP_MESSAGE_PEERERROR, bzrtp_zrtpErrorToString(errorCode));
+	}
+	bzrtp_setChannelStatus(zrtpContext, zrtpChannelContext, BZRTP_CHANNEL_ERROR);
+
+	return retval;
+}
+
+int bzrtp_processErrorMessage(bzrtpContext_t *zrtpContext, bzrtpChannelContext_t *zrtpChannelContext, bzrtpPacket_t *zrtpPacket) {
+	int retval = 0;
+	bzrtpPacket_t *errorAckPacket;
+
+	/* Error terminates an in-process key agreement only, an unauthenticated Error shall not tear down a secure or clear channel */
+	if (zrtpChannelContext->isSecure == 1
+#ifdef GOCLEAR_ENABLED
+		|| zrtpChannelContext->isClear == 1
+#endif /* GOCLEAR_ENABLED */
+		) {
+		return BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE;
+	}
+
+	/* acknowledge it, even if we already did as peer may have lost our ErrorACK */
+	errorAckPacket = bzrtp_createZrtpPacket(zrtpContext, zrtpChannelContext, MSGTYPE_ERRORACK, &retval);
+	if (retval == 0) {
+		retval = bzrtp_buildAndSendTransientPacket(zrtpContext, zrtpChannelContext, errorAckPacket);
+	}
+
+	/* a repeated Error finds us in error state already */
+	if (zrtpChannelContext->stateMachine == state_error) {
+		return retval;
+	}
+
+	bzrtp_abortKeyAgreement(zrtpContext, zrtpChannelContext, zrtpPacket->message.error.errorCode, 0);
+	return retval;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2014-2019 Belledonne Communications SARL.
+ *
+ * This file is part of bzrtp.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+#include "zidCache.h"
+
+/* One entry per distinct URI in the process, shared by all the contexts using it */
+struct bzrtpInternedURI {
+	std::string uri;
+	int refCount;
+};
+
+/* entries are indexed by the hash of their URI, collisions are resolved by comparing the strings */
+static std::mutex internedURIsMutex;
+static std::unordered_multimap<uint32_t, bzrtpInternedURI *> internedURIs;
+
+/**
+ * @brief FNV-1a hash of a NULL terminated string
+ */
+static uint32_t bzrtp_URIHash(const char *uri) {
+	uint32_t hash = 2166136261U;
+	while (*uri != '\0') {
+		hash ^= (uint8_t)(*uri++);
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+const char *bzrtp_internURI(const char *uri) {
+	if (uri == NULL) {
+		return NULL;
+	}
+
+	uint32_t hash = bzrtp_URIHash(uri);
+	std::lock_guard<std::mutex> lock(internedURIsMutex);
+	auto range = internedURIs.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second->uri == uri) {
+			it->second->refCount++;
+			return it->second->uri.c_str();
+		}
+	}
+
+	bzrtpInternedURI *entry = new bzrtpInternedURI{uri, 1};
+	internedURIs.emplace(hash, entry);
+	return entry->uri.c_str();
+}
+
+void bzrtp_releaseURI(const char *internedURI) {
+	if (internedURI == NULL) {
+		return;
+	}
+
+	uint32_t hash = bzrtp_URIHash(internedURI);
+	std::lock_guard<std::mutex> lock(internedURIsMutex);
+	auto range = internedURIs.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second->uri.c_str() == internedURI) { /* interned URIs are identified by their address */
+			if (--it->second->refCount == 0) {
+				delete it->second;
+				internedURIs.erase(it);
+			}
+			return;
+		}
+	}
+}
+
+int bzrtp_getInternedURIRefCount(const char *uri) {
+	if (uri == NULL) {
+		return 0;
+	}
+
+	uint32_t hash = bzrtp_URIHash(uri);
+	std::lock_guard<std::mutex> lock(internedURIsMutex);
+	auto range = internedURIs.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second->uri == uri) {
+			return it->second->refCount;
+		}
+	}
+	return 0;
+}
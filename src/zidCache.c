@@ -282,8 +282,8 @@ static int bzrtp_getSelfZID_impl(void *dbPointer, const char *selfURI, uint8_t s
 			return BZRTP_ZIDCACHE_UNABLETOUPDATE;
 		}
 		sqlite3_bind_blob(insertStatement, 1, generatedZID, 12, SQLITE_TRANSIENT);
-		sqlite3_bind_text(insertStatement, 2, selfURI,-1,SQLITE_TRANSIENT);
-		sqlite3_bind_text(insertStatement, 3, "self",-1,SQLITE_TRANSIENT);
+		sqlite3_bind_text(insertStatement, 2, selfURI,-1,SQLITE_STATIC);
+		sqlite3_bind_text(insertStatement, 3, "self",-1,SQLITE_STATIC);
 
 		ret = sqlite3_step(insertStatement);
 		if (ret!=SQLITE_DONE) {
@@ -339,6 +339,7 @@ int bzrtp_getPeerAssociatedSecrets(bzrtpContext_t *context, uint8_t peerZID[12])
 	int ret;
 	sqlite3_stmt *sqlStmt = NULL;
 	int length =0;
+	uint32_t sharedCacheGeneration;
 
 	if (context == NULL) {
 		return BZRTP_ZIDCACHE_INVALID_CONTEXT;
@@ -364,6 +365,12 @@ int bzrtp_getPeerAssociatedSecrets(bzrtpContext_t *context, uint8_t peerZID[12])
 		return BZRTP_ZIDCACHE_RUNTIME_CACHELESS;
 	}
 
+	/* hot secrets shared by worker processes: no sqlite access */
+	if (bzrtp_sharedCache_get(context->selfURI, context->peerURI, peerZID, &context->zuid, &context->cachedSecret) == 0) {
+		return 0;
+	}
+	sharedCacheGeneration = bzrtp_sharedCache_generation();
+
 	if (context->zidCacheMutex != NULL) {
 		bctbx_mutex_lock(context->zidCacheMutex);
 	}
@@ -378,8 +385,9 @@ int bzrtp_getPeerAssociatedSecrets(bzrtpContext_t *context, uint8_t peerZID[12])
 		}
 		return BZRTP_ZIDCACHE_UNABLETOREAD;
 	}
-	sqlite3_bind_text(sqlStmt, 1, context->selfURI,-1,SQLITE_TRANSIENT);
-	sqlite3_bind_text(sqlStmt, 2, context->peerURI,-1,SQLITE_TRANSIENT);
+	/* context URIs are interned and outlive the statement: sqlite does not need to copy them */
+	sqlite3_bind_text(sqlStmt, 1, context->selfURI,-1,SQLITE_STATIC);
+	sqlite3_bind_text(sqlStmt, 2, context->peerURI,-1,SQLITE_STATIC);
 	sqlite3_bind_blob(sqlStmt, 3, peerZID, 12, SQLITE_TRANSIENT);
 
 	ret = sqlite3_step(sqlStmt);
@@ -448,6 +456,8 @@ int bzrtp_getPeerAssociatedSecrets(bzrtpContext_t *context, uint8_t peerZID[12])
 	if (context->zidCacheMutex != NULL) {
 		bctbx_mutex_unlock(context->zidCacheMutex);
 	}
+
+	bzrtp_sharedCache_put(context->selfURI, context->peerURI, peerZID, context->zuid, &context->cachedSecret, sharedCacheGeneration);
 	return 0;
 }
 
@@ -495,8 +505,9 @@ int bzrtp_cache_getZuid(void *dbPointer, const char *selfURI, const char *peerUR
 		return BZRTP_ZIDCACHE_UNABLETOREAD;
 	}
 
-	sqlite3_bind_text(sqlStmt, 1, selfURI,-1,SQLITE_TRANSIENT);
-	sqlite3_bind_text(sqlStmt, 2, peerURI,-1,SQLITE_TRANSIENT);
+	/* URIs outlive the statement, finalized before we return */
+	sqlite3_bind_text(sqlStmt, 1, selfURI,-1,SQLITE_STATIC);
+	sqlite3_bind_text(sqlStmt, 2, peerURI,-1,SQLITE_STATIC);
 	sqlite3_bind_blob(sqlStmt, 3, peerZID, 12, SQLITE_TRANSIENT);
 
 	ret = sqlite3_step(sqlStmt);
@@ -539,8 +550,8 @@ int bzrtp_cache_getZuid(void *dbPointer, const char *selfURI, const char *peerUR
 					sqlite3_free(stmt);
 
 					sqlite3_bind_blob(sqlStmt, 1, peerZID, 12, SQLITE_TRANSIENT);
-					sqlite3_bind_text(sqlStmt, 2, selfURI,-1,SQLITE_TRANSIENT);
-					sqlite3_bind_text(sqlStmt, 3, peerURI,-1,SQLITE_TRANSIENT);
+					sqlite3_bind_text(sqlStmt, 2, selfURI,-1,SQLITE_STATIC);
+					sqlite3_bind_text(sqlStmt, 3, peerURI,-1,SQLITE_STATIC);
 
 					ret = sqlite3_step(sqlStmt);
 					if (ret!=SQLITE_DONE) {
@@ -695,7 +706,11 @@ static int bzrtp_cache_write_impl(void *dbPointer, int zuid, const char *tableNa
 
 /* non locking database version of the previous function, is deprecated but kept for compatibility */
 int bzrtp_cache_write(void *dbPointer, int zuid, const char *tableName, const char **columns, uint8_t **values, size_t *lengths, uint8_t columnsCount) {
-	return bzrtp_cache_write_impl(dbPointer, zuid, tableName, columns, values, lengths, columnsCount);
+	int retval = bzrtp_cache_write_impl(dbPointer, zuid, tableName, columns, values, lengths, columnsCount);
+	if (retval == 0 && strcmp(tableName, "zrtp") == 0) {
+		bzrtp_sharedCache_invalidate(zuid);
+	}
+	return retval;
 }
 
 /* locking database version of the previous function */
@@ -709,6 +724,9 @@ int bzrtp_cache_write_lock(void *dbPointer, int zuid, const char *tableName, con
 		retval = bzrtp_cache_write_impl(dbPointer, zuid, tableName, columns, values, lengths, columnsCount);
 		if (retval == 0) {
 			sqlite3_exec((sqlite3 *)dbPointer, "COMMIT;", NULL, NULL, NULL);
+			if (strcmp(tableName, "zrtp") == 0) {
+				bzrtp_sharedCache_invalidate(zuid);
+			}
 		} else {
 			sqlite3_exec((sqlite3 *)dbPointer, "ROLLBACK;", NULL, NULL, NULL);
 		}
@@ -716,7 +734,11 @@ int bzrtp_cache_write_lock(void *dbPointer, int zuid, const char *tableName, con
 		return retval;
 	}
 	else {
-		return bzrtp_cache_write_impl(dbPointer, zuid, tableName, columns, values, lengths, columnsCount);
+		retval = bzrtp_cache_write_impl(dbPointer, zuid, tableName, columns, values, lengths, columnsCount);
+		if (retval == 0 && strcmp(tableName, "zrtp") == 0) {
+			bzrtp_sharedCache_invalidate(zuid);
+		}
+		return retval;
 	}
 }
 
@@ -835,6 +857,9 @@ int bzrtp_cache_write_active(bzrtpContext_t *context, const char *tableName, con
 
 	if (ret == 0) {
 		sqlite3_exec(context->zidCache, "COMMIT;", NULL, NULL, NULL);
+		if (strcmp(tableName, "zrtp") == 0) { /* keep the shared hot secrets of this peer up to date */
+			bzrtp_sharedCache_update(context->selfURI, context->peerURI, context->peerZID, columns, values, lengths, columnsCount);
+		}
 	} else {
 		sqlite3_exec(context->zidCache, "ROLLBACK;", NULL, NULL, NULL);
 	}
@@ -996,7 +1021,7 @@ int bzrtp_cache_getPeerStatus_lock(void *dbPointer, const char *peerURI, bctbx_m
 		return BZRTP_ZIDCACHE_UNABLETOREAD;
 	}
 
-	sqlite3_bind_text(sqlStmt, 1, peerURI, -1, SQLITE_TRANSIENT);
+	sqlite3_bind_text(sqlStmt, 1, peerURI, -1, SQLITE_STATIC);
 
 	ret = sqlite3_step(sqlStmt);
 
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2014-2023 Belledonne Communications SARL.
+ *
+ * This file is part of bzrtp.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedef.h"
+#include <bctoolbox/defs.h>
+#include <bctoolbox/port.h>
+
+#ifdef ZIDCACHE_ENABLED
+#include "sqlite3.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/* the snapshot thread checks every SNAPSHOT_THREAD_POLL_STEP ms if it shall stop */
+#define SNAPSHOT_THREAD_POLL_STEP 100
+
+struct bzrtpMemoryCache_struct {
+	sqlite3 *db; /**< the in-memory cache, given to the bzrtp contexts */
+	bctbx_mutex_t zidCacheMutex; /**< lock access to db, given to the bzrtp contexts */
+	char *snapshotPath; /**< the snapshot file, NULL when the cache is in memory only */
+	char *snapshotTmpPath; /**< snapshots are written in this file first, then renamed to snapshotPath */
+	uint32_t snapshotInterval; /**< interval between background snapshots in ms, 0 when there is no snapshot thread */
+	bctbx_mutex_t snapshotMutex; /**< serialize snapshots and protect the fields below */
+	int lastSnapshotChanges; /**< db total changes count at the last snapshot, -1 if the snapshot file is not up to date */
+	int running; /**< the snapshot thread runs while this flag is set */
+	bctbx_thread_t snapshotThread;
+};
+
+/**
+ * @brief Copy a whole sqlite3 db into another one
+ *
+ * @param[in,out]	destination	The destination db, its previous content is replaced
+ * @param[in]		source		The source db
+ *
+ * @return SQLITE_OK on success, sqlite error code otherwise
+ */
+static int bzrtp_memoryCache_copy(sqlite3 *destination, sqlite3 *source) {
+	int ret;
+	sqlite3_backup *backup = sqlite3_backup_init(destination, "main", source, "main");
+	if (backup == NULL) {
+		return sqlite3_errcode(destination);
+	}
+	sqlite3_backup_step(backup, -1); /* -1: copy all pages at once */
+	ret = sqlite3_backup_finish(backup);
+	return ret;
+}
+
+/* Must be called holding the snapshotMutex */
+static int bzrtp_memoryCache_snapshot_impl(bzrtpMemoryCache_t *cache) {
+	sqlite3 *staging = NULL;
+	sqlite3 *snapshotFile = NULL;
+	int changes;
+	int ret;
+
+	if (cache->snapshotPath == NULL) { /* in memory only */
+		return 0;
+	}
+
+	/* copy the cache in a staging in-memory db: this is the only part holding the cache lock */
+	if (sqlite3_open(":memory:", &staging) != SQLITE_OK) {
+		sqlite3_close(staging);
+		return BZRTP_ZIDCACHE_UNABLETOSNAPSHOT;
+	}
+	bctbx_mutex_lock(&cache->zidCacheMutex);
+	changes = sqlite3_total_changes(cache->db);
+	if (changes == cache->lastSnapshotChanges) { /* nothing changed since the last snapshot */
+		bctbx_mutex_unlock(&cache->zidCacheMutex);
+		sqlite3_close(staging);
+		return 0;
+	}
+	ret = bzrtp_memoryCache_copy(staging, cache->db);
+	bctbx_mutex_unlock(&cache->zidCacheMutex);
+	if (ret != SQLITE_OK) {
+		sqlite3_close(staging);
+		return BZRTP_ZIDCACHE_UNABLETOSNAPSHOT;
+	}
+
+	/* write it to the temporary file, then atomically replace the previous snapshot */
+	remove(cache->snapshotTmpPath);
+	if (sqlite3_open_v2(cache->snapshotTmpPath, &snapshotFile, SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) {
+		sqlite3_close(snapshotFile);
+		sqlite3_close(staging);
+		return BZRTP_ZIDCACHE_UNABLETOSNAPSHOT;
+	}
+	ret = bzrtp_memoryCache_copy(snapshotFile, staging); /* the copy is committed, hence synced, before the file is closed */
+	sqlite3_close(staging);
+	if (sqlite3_close(snapshotFile) != SQLITE_OK || ret != SQLITE_OK) {
+		remove(cache->snapshotTmpPath);
+		return BZRTP_ZIDCACHE_UNABLETOSNAPSHOT;
+	}
+
+#ifdef _WIN32
+	if (MoveFileExA(cache->snapshotTmpPath, cache->snapshotPath, MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH) == 0) {
+#else
+	if (rename(cache->snapshotTmpPath, cache->snapshotPath) != 0) {
+#endif
+		remove(cache->snapshotTmpPath);
+		return BZRTP_ZIDCACHE_UNABLETOSNAPSHOT;
+	}
+
+	cache->lastSnapshotChanges = changes;
+	return 0;
+}
+
+static void *bzrtp_memoryCache_snapshotThread(void *data) {
+	bzrtpMemoryCache_t *cache = (bzrtpMemoryCache_t *)data;
+	uint32_t elapsed = 0;
+
+	while (1) {
+		bctbx_sleep_ms(SNAPSHOT_THREAD_POLL_STEP);
+		elapsed += SNAPSHOT_THREAD_POLL_STEP;
+
+		bctbx_mutex_lock(&cache->snapshotMutex);
+		if (cache->running == 0) {
+			bctbx_mutex_unlock(&cache->snapshotMutex);
+			break;
+		}
+		if (elapsed >= cache->snapshotInterval) {
+			elapsed = 0;
+			if (bzrtp_memoryCache_snapshot_impl(cache) != 0) {
+				bctbx_warning("ZRTP cache snapshot to [%s] failed, retry in %u ms", cache->snapshotPath, cache->snapshotInterval);
+			}
+		}
+		bctbx_mutex_unlock(&cache->snapshotMutex);
+	}
+
+	return NULL;
+}
+
+static void bzrtp_memoryCache_free(bzrtpMemoryCache_t *cache) {
+	sqlite3_close(cache->db);
+	bctbx_mutex_destroy(&cache->zidCacheMutex);
+	bctbx_mutex_destroy(&cache->snapshotMutex);
+	bctbx_free(cache->snapshotPath);
+	bctbx_free(cache->snapshotTmpPath);
+	bctbx_free(cache);
+}
+
+bzrtpMemoryCache_t *bzrtp_memoryCache_open(const char *snapshotPath, uint32_t snapshotInterval, int *exitCode) {
+	bzrtpMemoryCache_t *cache = (bzrtpMemoryCache_t *)bctbx_malloc0(sizeof(bzrtpMemoryCache_t));
+	int loaded = 0;
+	int ret;
+
+	bctbx_mutex_init(&cache->zidCacheMutex, NULL);
+	bctbx_mutex_init(&cache->snapshotMutex, NULL);
+	cache->lastSnapshotChanges = -1;
+
+	if (sqlite3_open(":memory:", &cache->db) != SQLITE_OK) {
+		bzrtp_memoryCache_free(cache);
+		*exitCode = BZRTP_ZIDCACHE_INVALID_CACHE;
+		return NULL;
+	}
+
+	/* load the last snapshot, if any */
+	if (snapshotPath != NULL) {
+		sqlite3 *snapshotFile = NULL;
+
+		cache->snapshotPath = bctbx_strdup(snapshotPath);
+		cache->snapshotTmpPath = bctbx_strdup_printf("%s.tmp", snapshotPath);
+		remove(cache->snapshotTmpPath); /* leftover from a snapshot interrupted by a crash */
+		if (sqlite3_open_v2(snapshotPath, &snapshotFile, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK) {
+			if (bzrtp_memoryCache_copy(cache->db, snapshotFile) != SQLITE_OK) {
+				sqlite3_close(snapshotFile);
+				bzrtp_memoryCache_free(cache);
+				*exitCode = BZRTP_ZIDCACHE_UNABLETOREAD;
+				return NULL;
+			}
+			loaded = 1;
+		}
+		sqlite3_close(snapshotFile); /* no snapshot yet: start with an empty cache */
+	}
+
+	ret = bzrtp_initCache_lock(cache->db, &cache->zidCacheMutex);
+	if (ret != 0 && ret != BZRTP_CACHE_SETUP && ret != BZRTP_CACHE_UPDATE) {
+		bzrtp_memoryCache_free(cache);
+		*exitCode = ret;
+		return NULL;
+	}
+	/* the snapshot is up to date unless the cache was just created or its schema updated */
+	if (loaded == 1 && ret == 0) {
+		cache->lastSnapshotChanges = sqlite3_total_changes(cache->db);
+	}
+
+	if (cache->snapshotPath != NULL && snapshotInterval > 0) {
+		cache->snapshotInterval = snapshotInterval;
+		cache->running = 1;
+		if (bctbx_thread_create(&cache->snapshotThread, NULL, bzrtp_memoryCache_snapshotThread, cache) != 0) {
+			bzrtp_memoryCache_free(cache);
+			*exitCode = BZRTP_ZIDCACHE_INVALID_CACHE;
+			return NULL;
+		}
+	}
+
+	*exitCode = ret;
+	return cache;
+}
+
+void *bzrtp_memoryCache_getDb(bzrtpMemoryCache_t *cache) {
+	return cache->db;
+}
+
+bctbx_mutex_t *bzrtp_memoryCache_getMutex(bzrtpMemoryCache_t *cache) {
+	return &cache->zidCacheMutex;
+}
+
+int bzrtp_memoryCache_snapshot(bzrtpMemoryCache_t *cache) {
+	int ret;
+
+	bctbx_mutex_lock(&cache->snapshotMutex);
+	ret = bzrtp_memoryCache_snapshot_impl(cache);
+	bctbx_mutex_unlock(&cache->snapshotMutex);
+
+	return ret;
+}
+
+int bzrtp_memoryCache_close(bzrtpMemoryCache_t *cache) {
+	int ret;
+
+	if (cache == NULL) {
+		return 0;
+	}
+
+	/* stop the snapshot thread */
+	if (cache->snapshotInterval > 0) {
+		bctbx_mutex_lock(&cache->snapshotMutex);
+		cache->running = 0;
+		bctbx_mutex_unlock(&cache->snapshotMutex);
+		bctbx_thread_join(cache->snapshotThread, NULL);
+	}
+
+	/* last snapshot */
+	ret = bzrtp_memoryCache_snapshot_impl(cache);
+
+	bzrtp_memoryCache_free(cache);
+	return ret;
+}
+
+#else /* ZIDCACHE_ENABLED */
+
+bzrtpMemoryCache_t *bzrtp_memoryCache_open(const char *snapshotPath, uint32_t snapshotInterval, int *exitCode) {
+	*exitCode = BZRTP_ERROR_CACHEDISABLED;
+	return NULL;
+}
+
+void *bzrtp_memoryCache_getDb(bzrtpMemoryCache_t *cache) {
+	return NULL;
+}
+
+bctbx_mutex_t *bzrtp_memoryCache_getMutex(bzrtpMemoryCache_t *cache) {
+	return NULL;
+}
+
+int bzrtp_memoryCache_snapshot(bzrtpMemoryCache_t *cache) {
+	return BZRTP_ERROR_CACHEDISABLED;
+}
+
+int bzrtp_memoryCache_close(bzrtpMemoryCache_t *cache) {
+	return 0;
+}
+#endif /* ZIDCACHE_ENABLED */
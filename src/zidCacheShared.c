@@ -0,0 +1,583 @@
+/*
+ * Copyright (c) 2014-2023 Belledonne Communications SARL.
+ *
+ * This file is part of bzrtp.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "typedef.h"
+#include "zidCache.h"
+
+#if defined(ZIDCACHE_ENABLED) && !defined(_WIN32) && !defined(__ANDROID__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <bctoolbox/logging.h>
+
+/* Linux provides robust process shared mutexes, other platforms (macOS) use a lock word holding the owner pid */
+#ifdef __linux__
+#include <pthread.h>
+#define SHARED_CACHE_ROBUST_MUTEX
+#endif
+
+/* Shared hot secrets cache
+ * A fixed size hash table in a POSIX shared memory segment, in front of the sqlite cache shared by several processes.
+ * - readers never lock: each entry is protected by a sequence number, odd while the entry is written.
+ *   A reader copies the entry and retries if the sequence changed, it falls back to sqlite after a few retries.
+ * - writers are serialized by a robust process shared mutex, or by a lock word holding the owner pid where robust
+ *   mutexes are not available. A writer taking the lock from a dead owner invalidates the entry it was writing.
+ *   Waiting for the lock is bounded: a writer which can't get it in SHARED_CACHE_LOCK_TIMEOUT ms gives up.
+ * - every write increments the segment generation: an entry read from sqlite is inserted only if no write
+ *   happened since the sqlite read started, so an old value can't replace a newer one.
+ */
+#define SHARED_CACHE_MAGIC			0x425a5348 /* "BZSH" */
+#define SHARED_CACHE_LAYOUT_VERSION	1
+#define SHARED_CACHE_DEFAULT_ENTRIES	4096
+#define SHARED_CACHE_BUCKET_SIZE	4 /* an entry may be in one of the 4 slots following its hash index */
+#define SHARED_CACHE_READ_RETRIES	8
+#define SHARED_CACHE_URI_MAX		128 /* entries for longer URIs are not cached */
+#define SHARED_CACHE_SECRET_MAX		64 /* entries holding longer secrets are not cached */
+#define SHARED_CACHE_NO_SLOT		0xFFFFFFFF
+#define SHARED_CACHE_ATTACH_TIMEOUT	1000 /* ms to wait for the creator of the segment to initialise it */
+#define SHARED_CACHE_LOCK_TIMEOUT	1000 /* ms to wait for the writer lock, critical sections only copy one entry */
+#define SHARED_CACHE_LOCK_SPINS		64 /* spins on the pid lock word before sleeping between attempts */
+
+typedef struct {
+	uint32_t sequence; /**< odd while the entry is written */
+	uint32_t valid; /**< 0 for an empty slot */
+	uint64_t keyHash; /**< hash of selfURI, peerURI and peerZID */
+	int32_t zuid;
+	uint8_t peerZID[12];
+	char selfURI[SHARED_CACHE_URI_MAX];
+	char peerURI[SHARED_CACHE_URI_MAX];
+	uint8_t rs1Length;
+	uint8_t rs2Length;
+	uint8_t auxsecretLength;
+	uint8_t pbxsecretLength;
+	uint8_t previouslyVerifiedSas;
+	uint8_t rs1[SHARED_CACHE_SECRET_MAX];
+	uint8_t rs2[SHARED_CACHE_SECRET_MAX];
+	uint8_t auxsecret[SHARED_CACHE_SECRET_MAX];
+	uint8_t pbxsecret[SHARED_CACHE_SECRET_MAX];
+} bzrtpSharedCacheEntry_t;
+
+typedef struct {
+	uint32_t magic; /**< set last by the segment creator, once the header is initialised */
+	uint32_t layoutVersion; /**< processes running a library with another layout can't attach */
+	uint32_t entrySize;
+	uint32_t entriesCount;
+	uint32_t writingSlot; /**< slot being written by the lock owner, SHARED_CACHE_NO_SLOT if none */
+	uint32_t generation; /**< incremented by each update or invalidation */
+#ifdef SHARED_CACHE_ROBUST_MUTEX
+	pthread_mutex_t writerMutex; /**< robust and process shared */
+#else
+	int32_t writerPid; /**< pid of the process holding the writer lock, 0 when free */
+	uint32_t padding;
+#endif
+} bzrtpSharedCacheHeader_t;
+
+/* process wide mapping of the segment, NULL when not attached */
+static bzrtpSharedCacheHeader_t *sharedCacheHeader = NULL;
+static bzrtpSharedCacheEntry_t *sharedCacheEntries = NULL;
+static size_t sharedCacheSize = 0;
+
+static size_t bzrtp_sharedCache_segmentSize(uint32_t entriesCount) {
+	return sizeof(bzrtpSharedCacheHeader_t) + (size_t)entriesCount*sizeof(bzrtpSharedCacheEntry_t);
+}
+
+static uint64_t bzrtp_sharedCache_hashBytes(uint64_t hash, const uint8_t *data, size_t length) {
+	size_t i;
+	for (i=0; i<length; i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static uint64_t bzrtp_sharedCache_keyHash(const char *selfURI, const char *peerURI, const uint8_t peerZID[12]) {
+	uint64_t hash = 14695981039346656037ULL;
+	hash = bzrtp_sharedCache_hashBytes(hash, (const uint8_t *)selfURI, strlen(selfURI)+1); /* include the terminating null char as separator */
+	hash = bzrtp_sharedCache_hashBytes(hash, (const uint8_t *)peerURI, strlen(peerURI)+1);
+	return bzrtp_sharedCache_hashBytes(hash, peerZID, 12);
+}
+
+static int bzrtp_sharedCache_keyMatch(const bzrtpSharedCacheEntry_t *entry, uint64_t keyHash, const char *selfURI, const char *peerURI, const uint8_t peerZID[12]) {
+	return entry->valid != 0 && entry->keyHash == keyHash && memcmp(entry->peerZID, peerZID, 12) == 0
+		&& strncmp(entry->selfURI, selfURI, SHARED_CACHE_URI_MAX) == 0 && strncmp(entry->peerURI, peerURI, SHARED_CACHE_URI_MAX) == 0;
+}
+
+/* Copy a consistent version of an entry, return 0 if it is still written after a few retries */
+static int bzrtp_sharedCache_readEntry(const bzrtpSharedCacheEntry_t *entry, bzrtpSharedCacheEntry_t *copy) {
+	int i;
+	for (i=0; i<SHARED_CACHE_READ_RETRIES; i++) {
+		uint32_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+		if ((sequence&1) == 0) {
+			memcpy(copy, entry, sizeof(bzrtpSharedCacheEntry_t));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&entry->sequence, __ATOMIC_RELAXED) == sequence) {
+				return 1;
+			}
+		}
+		sched_yield();
+	}
+	return 0;
+}
+
+/* Entry writes are bracketed by these two, holding the writer lock */
+static void bzrtp_sharedCache_beginWrite(uint32_t slot) {
+	sharedCacheHeader->writingSlot = slot;
+	__atomic_add_fetch(&sharedCacheEntries[slot].sequence, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void bzrtp_sharedCache_endWrite(uint32_t slot) {
+	__atomic_add_fetch(&sharedCacheEntries[slot].sequence, 1, __ATOMIC_RELEASE);
+	sharedCacheHeader->writingSlot = SHARED_CACHE_NO_SLOT;
+}
+
+/* The previous lock owner died: discard the entry it was writing */
+static void bzrtp_sharedCache_repair(void) {
+	uint32_t slot = sharedCacheHeader->writingSlot;
+	if (slot < sharedCacheHeader->entriesCount) {
+		sharedCacheEntries[slot].valid = 0;
+		if ((sharedCacheEntries[slot].sequence&1) == 1) {
+			bzrtp_sharedCache_endWrite(slot);
+		}
+	}
+	sharedCacheHeader->writingSlot = SHARED_CACHE_NO_SLOT;
+	__atomic_add_fetch(&sharedCacheHeader->generation, 1, __ATOMIC_RELEASE);
+}
+
+#ifdef SHARED_CACHE_ROBUST_MUTEX
+/* Return 0 when the lock is held, -1 if it could not be taken in SHARED_CACHE_LOCK_TIMEOUT ms */
+static int bzrtp_sharedCache_lock(void) {
+	struct timespec deadline;
+	int ret;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += SHARED_CACHE_LOCK_TIMEOUT/1000;
+	deadline.tv_nsec += (SHARED_CACHE_LOCK_TIMEOUT%1000)*1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	ret = pthread_mutex_timedlock(&sharedCacheHeader->writerMutex, &deadline);
+	if (ret == EOWNERDEAD) {
+		bzrtp_sharedCache_repair();
+		pthread_mutex_consistent(&sharedCacheHeader->writerMutex);
+		return 0;
+	}
+	return (ret == 0) ? 0 : -1;
+}
+
+static void bzrtp_sharedCache_unlock(void) {
+	pthread_mutex_unlock(&sharedCacheHeader->writerMutex);
+}
+
+static int bzrtp_sharedCache_initLock(bzrtpSharedCacheHeader_t *header) {
+	pthread_mutexattr_t attr;
+	int ret;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	ret = pthread_mutex_init(&header->writerMutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return ret;
+}
+#else /* SHARED_CACHE_ROBUST_MUTEX */
+/* Return 0 when the lock is held, -1 if it could not be taken in SHARED_CACHE_LOCK_TIMEOUT ms.
+ * The lock is taken over when its owner is dead, or when it was held for the whole timeout: the owner pid was then reused. */
+static int bzrtp_sharedCache_lock(void) {
+	int32_t self = (int32_t)getpid();
+	int32_t owner = 0;
+	int32_t firstOwner = 0;
+	unsigned int spins = 0;
+	unsigned int waited = 0;
+
+	while (1) {
+		owner = 0;
+		if (__atomic_compare_exchange_n(&sharedCacheHeader->writerPid, &owner, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			return 0;
+		}
+		if (++spins < SHARED_CACHE_LOCK_SPINS) {
+			sched_yield();
+			continue;
+		}
+		if (firstOwner == 0) {
+			firstOwner = owner;
+		}
+		if (owner != self && ((kill(owner, 0) != 0 && errno == ESRCH) || (waited >= SHARED_CACHE_LOCK_TIMEOUT && owner == firstOwner))) {
+			if (__atomic_compare_exchange_n(&sharedCacheHeader->writerPid, &owner, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+				bzrtp_sharedCache_repair();
+				return 0;
+			}
+		}
+		if (waited >= SHARED_CACHE_LOCK_TIMEOUT) {
+			return -1;
+		}
+		usleep(1000);
+		waited++;
+	}
+}
+
+static void bzrtp_sharedCache_unlock(void) {
+	__atomic_store_n(&sharedCacheHeader->writerPid, 0, __ATOMIC_RELEASE);
+}
+
+static int bzrtp_sharedCache_initLock(bzrtpSharedCacheHeader_t *header) {
+	header->writerPid = 0;
+	return 0;
+}
+#endif /* SHARED_CACHE_ROBUST_MUTEX */
+
+/* Must hold the writer lock. Return the slot holding this key, SHARED_CACHE_NO_SLOT if not found */
+static uint32_t bzrtp_sharedCache_findSlot(uint64_t keyHash, const char *selfURI, const char *peerURI, const uint8_t peerZID[12]) {
+	uint32_t i;
+	for (i=0; i<SHARED_CACHE_BUCKET_SIZE; i++) {
+		uint32_t slot = (uint32_t)((keyHash+i)%sharedCacheHeader->entriesCount);
+		if (bzrtp_sharedCache_keyMatch(&sharedCacheEntries[slot], keyHash, selfURI, peerURI, peerZID)) {
+			return slot;
+		}
+	}
+	return SHARED_CACHE_NO_SLOT;
+}
+
+int bzrtp_sharedCache_attach(const char *name, uint32_t entriesCount) {
+	int fd;
+	int created = 0;
+	struct stat segmentStat;
+	bzrtpSharedCacheHeader_t *header;
+	size_t size;
+	int waited = 0;
+
+	if (name == NULL || sharedCacheHeader != NULL) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+	if (entriesCount == 0) {
+		entriesCount = SHARED_CACHE_DEFAULT_ENTRIES;
+	}
+
+	/* the segment holds secrets: readable by the owner only */
+	fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR);
+	if (fd >= 0) {
+		created = 1;
+		size = bzrtp_sharedCache_segmentSize(entriesCount);
+		if (ftruncate(fd, (off_t)size) != 0) { /* the segment is zero filled */
+			close(fd);
+			shm_unlink(name);
+			return BZRTP_ZIDCACHE_INVALID_CACHE;
+		}
+	} else if (errno == EEXIST) {
+		fd = shm_open(name, O_RDWR, S_IRUSR|S_IWUSR);
+		if (fd < 0) {
+			return BZRTP_ZIDCACHE_INVALID_CACHE;
+		}
+		/* the creator may not have sized it yet */
+		while (fstat(fd, &segmentStat) == 0 && (size_t)segmentStat.st_size < sizeof(bzrtpSharedCacheHeader_t) && waited < SHARED_CACHE_ATTACH_TIMEOUT) {
+			usleep(1000);
+			waited++;
+		}
+		if (fstat(fd, &segmentStat) != 0 || (size_t)segmentStat.st_size < sizeof(bzrtpSharedCacheHeader_t)) {
+			close(fd);
+			return BZRTP_ZIDCACHE_INVALID_CACHE;
+		}
+		size = (size_t)segmentStat.st_size;
+	} else {
+		return BZRTP_ZIDCACHE_INVALID_CACHE;
+	}
+
+	header = (bzrtpSharedCacheHeader_t *)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (header == MAP_FAILED) {
+		if (created == 1) {
+			shm_unlink(name);
+		}
+		return BZRTP_ZIDCACHE_INVALID_CACHE;
+	}
+
+	if (created == 1) {
+		header->layoutVersion = SHARED_CACHE_LAYOUT_VERSION;
+		header->entrySize = sizeof(bzrtpSharedCacheEntry_t);
+		header->entriesCount = entriesCount;
+		header->writingSlot = SHARED_CACHE_NO_SLOT;
+		if (bzrtp_sharedCache_initLock(header) != 0) {
+			munmap(header, size);
+			shm_unlink(name);
+			return BZRTP_ZIDCACHE_INVALID_CACHE;
+		}
+		__atomic_store_n(&header->magic, SHARED_CACHE_MAGIC, __ATOMIC_RELEASE);
+	} else {
+		while (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHARED_CACHE_MAGIC && waited < SHARED_CACHE_ATTACH_TIMEOUT) {
+			usleep(1000);
+			waited++;
+		}
+		/* refuse segments from another library version or truncated */
+		if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHARED_CACHE_MAGIC
+			|| header->layoutVersion != SHARED_CACHE_LAYOUT_VERSION
+			|| header->entrySize != sizeof(bzrtpSharedCacheEntry_t)
+			|| header->entriesCount == 0
+			|| bzrtp_sharedCache_segmentSize(header->entriesCount) > size) {
+			munmap(header, size);
+			return BZRTP_ZIDCACHE_INVALID_CACHE;
+		}
+	}
+
+	sharedCacheSize = size;
+	sharedCacheEntries = (bzrtpSharedCacheEntry_t *)(header+1);
+	sharedCacheHeader = header;
+	return 0;
+}
+
+void bzrtp_sharedCache_detach(void) {
+	if (sharedCacheHeader != NULL) {
+		munmap(sharedCacheHeader, sharedCacheSize);
+		sharedCacheHeader = NULL;
+		sharedCacheEntries = NULL;
+		sharedCacheSize = 0;
+	}
+}
+
+int bzrtp_sharedCache_unlink(const char *name) {
+	if (name == NULL || shm_unlink(name) != 0) {
+		return BZRTP_ERROR_INVALIDARGUMENT;
+	}
+	return 0;
+}
+
+uint32_t bzrtp_sharedCache_generation(void) {
+	if (sharedCacheHeader == NULL) {
+		return 0;
+	}
+	return __atomic_load_n(&sharedCacheHeader->generation, __ATOMIC_ACQUIRE);
+}
+
+int bzrtp_sharedCache_get(const char *selfURI, const char *peerURI, const uint8_t peerZID[12], int *zuid, cachedSecrets_t *secrets) {
+	uint64_t keyHash;
+	uint32_t i;
+	bzrtpSharedCacheEntry_t entry;
+
+	if (sharedCacheHeader == NULL || selfURI == NULL || peerURI == NULL) {
+		return BZRTP_CACHE_DATA_NOTFOUND;
+	}
+
+	keyHash = bzrtp_sharedCache_keyHash(selfURI, peerURI, peerZID);
+	for (i=0; i<SHARED_CACHE_BUCKET_SIZE; i++) {
+		uint32_t slot = (uint32_t)((keyHash+i)%sharedCacheHeader->entriesCount);
+		/* compare the key on the copy: the slot may be rewritten meanwhile */
+		if (bzrtp_sharedCache_readEntry(&sharedCacheEntries[slot], &entry) == 1
+			&& bzrtp_sharedCache_keyMatch(&entry, keyHash, selfURI, peerURI, peerZID)) {
+			*zuid = entry.zuid;
+			if (entry.rs1Length > 0) {
+				secrets->rs1 = (uint8_t *)malloc(entry.rs1Length);
+				memcpy(secrets->rs1, entry.rs1, entry.rs1Length);
+				secrets->rs1Length = entry.rs1Length;
+			}
+			if (entry.rs2Length > 0) {
+				secrets->rs2 = (uint8_t *)malloc(entry.rs2Length);
+				memcpy(secrets->rs2, entry.rs2, entry.rs2Length);
+				secrets->rs2Length = entry.rs2Length;
+			}
+			if (entry.auxsecretLength > 0) {
+				secrets->auxsecret = (uint8_t *)malloc(entry.auxsecretLength);
+				memcpy(secrets->auxsecret, entry.auxsecret, entry.auxsecretLength);
+				secrets->auxsecretLength = entry.auxsecretLength;
+			}
+			if (entry.pbxsecretLength > 0) {
+				secrets->pbxsecret = (uint8_t *)malloc(entry.pbxsecretLength);
+				memcpy(secrets->pbxsecret, entry.pbxsecret, entry.pbxsecretLength);
+				secrets->pbxsecretLength = entry.pbxsecretLength;
+			}
+			secrets->previouslyVerifiedSas = entry.previouslyVerifiedSas;
+			return 0;
+		}
+	}
+	return BZRTP_CACHE_DATA_NOTFOUND;
+}
+
+void bzrtp_sharedCache_put(const char *selfURI, const char *peerURI, const uint8_t peerZID[12], int zuid, const cachedSecrets_t *secrets, uint32_t generation) {
+	uint64_t keyHash;
+	uint32_t slot;
+	bzrtpSharedCacheEntry_t *entry;
+
+	if (sharedCacheHeader == NULL || selfURI == NULL || peerURI == NULL) {
+		return;
+	}
+	if (strlen(selfURI) >= SHARED_CACHE_URI_MAX || strlen(peerURI) >= SHARED_CACHE_URI_MAX
+		|| secrets->rs1Length > SHARED_CACHE_SECRET_MAX || secrets->rs2Length > SHARED_CACHE_SECRET_MAX
+		|| secrets->auxsecretLength > SHARED_CACHE_SECRET_MAX || secrets->pbxsecretLength > SHARED_CACHE_SECRET_MAX) {
+		return;
+	}
+
+	keyHash = bzrtp_sharedCache_keyHash(selfURI, peerURI, peerZID);
+	if (bzrtp_sharedCache_lock() != 0) { /* not cached this time */
+		return;
+	}
+	/* a write happened since these secrets were read from sqlite: they may be outdated */
+	if (__atomic_load_n(&sharedCacheHeader->generation, __ATOMIC_ACQUIRE) != generation) {
+		bzrtp_sharedCache_unlock();
+		return;
+	}
+	slot = bzrtp_sharedCache_findSlot(keyHash, selfURI, peerURI, peerZID);
+	if (slot == SHARED_CACHE_NO_SLOT) { /* use an empty slot of the bucket, or evict one */
+		uint32_t i;
+		slot = (uint32_t)((keyHash+(keyHash>>32)%SHARED_CACHE_BUCKET_SIZE)%sharedCacheHeader->entriesCount);
+		for (i=0; i<SHARED_CACHE_BUCKET_SIZE; i++) {
+			uint32_t candidate = (uint32_t)((keyHash+i)%sharedCacheHeader->entriesCount);
+			if (sharedCacheEntries[candidate].valid == 0) {
+				slot = candidate;
+				break;
+			}
+		}
+	}
+
+	entry = &sharedCacheEntries[slot];
+	bzrtp_sharedCache_beginWrite(slot);
+	memset((uint8_t *)entry+sizeof(uint32_t), 0, sizeof(bzrtpSharedCacheEntry_t)-sizeof(uint32_t)); /* all but the sequence */
+	entry->keyHash = keyHash;
+	entry->zuid = zuid;
+	memcpy(entry->peerZID, peerZID, 12);
+	strcpy(entry->selfURI, selfURI);
+	strcpy(entry->peerURI, peerURI);
+	entry->rs1Length = secrets->rs1Length;
+	memcpy(entry->rs1, secrets->rs1, secrets->rs1Length);
+	entry->rs2Length = secrets->rs2Length;
+	memcpy(entry->rs2, secrets->rs2, secrets->rs2Length);
+	entry->auxsecretLength = (uint8_t)secrets->auxsecretLength;
+	memcpy(entry->auxsecret, secrets->auxsecret, secrets->auxsecretLength);
+	entry->pbxsecretLength = (uint8_t)secrets->pbxsecretLength;
+	memcpy(entry->pbxsecret, secrets->pbxsecret, secrets->pbxsecretLength);
+	entry->previouslyVerifiedSas = secrets->previouslyVerifiedSas;
+	entry->valid = 1;
+	bzrtp_sharedCache_endWrite(slot);
+	bzrtp_sharedCache_unlock();
+}
+
+void bzrtp_sharedCache_update(const char *selfURI, const char *peerURI, const uint8_t peerZID[12], const char **columns, uint8_t **values, size_t *lengths, uint8_t columnsCount) {
+	uint64_t keyHash;
+	uint32_t slot;
+	bzrtpSharedCacheEntry_t *entry;
+	uint8_t i;
+
+	if (sharedCacheHeader == NULL || selfURI == NULL || peerURI == NULL) {
+		return;
+	}
+
+	keyHash = bzrtp_sharedCache_keyHash(selfURI, peerURI, peerZID);
+	if (bzrtp_sharedCache_lock() != 0) {
+		bctbx_warning("ZRTP shared cache locked for more than %d ms, the cached secrets of [%s] may be outdated", SHARED_CACHE_LOCK_TIMEOUT, peerURI);
+		return;
+	}
+	__atomic_add_fetch(&sharedCacheHeader->generation, 1, __ATOMIC_RELEASE);
+	slot = bzrtp_sharedCache_findSlot(keyHash, selfURI, peerURI, peerZID);
+	if (slot == SHARED_CACHE_NO_SLOT) { /* not cached, next read will get it from sqlite */
+		bzrtp_sharedCache_unlock();
+		return;
+	}
+
+	entry = &sharedCacheEntries[slot];
+	bzrtp_sharedCache_beginWrite(slot);
+	for (i=0; i<columnsCount; i++) {
+		uint8_t *field = NULL;
+		uint8_t *fieldLength = NULL;
+
+		if (strcmp(columns[i], "rs1") == 0) {
+			field = entry->rs1;
+			fieldLength = &entry->rs1Length;
+		} else if (strcmp(columns[i], "rs2") == 0) {
+			field = entry->rs2;
+			fieldLength = &entry->rs2Length;
+		} else if (strcmp(columns[i], "aux") == 0) {
+			field = entry->auxsecret;
+			fieldLength = &entry->auxsecretLength;
+		} else if (strcmp(columns[i], "pbx") == 0) {
+			field = entry->pbxsecret;
+			fieldLength = &entry->pbxsecretLength;
+		} else if (strcmp(columns[i], "pvs") == 0) {
+			/* same interpretation as the sqlite read: anything but a single 0x01 byte is 0 */
+			entry->previouslyVerifiedSas = (lengths[i] == 1 && values[i][0] == 0x01) ? 1 : 0;
+			continue;
+		}
+
+		if (field == NULL || lengths[i] > SHARED_CACHE_SECRET_MAX) { /* can't be represented: drop the entry */
+			entry->valid = 0;
+			break;
+		}
+		*fieldLength = (uint8_t)lengths[i];
+		memcpy(field, values[i], lengths[i]);
+	}
+	bzrtp_sharedCache_endWrite(slot);
+	bzrtp_sharedCache_unlock();
+}
+
+void bzrtp_sharedCache_invalidate(int zuid) {
+	uint32_t slot;
+
+	if (sharedCacheHeader == NULL) {
+		return;
+	}
+
+	/* writes addressed by zuid only are rare (SAS verification status): scan the table */
+	if (bzrtp_sharedCache_lock() != 0) {
+		bctbx_warning("ZRTP shared cache locked for more than %d ms, the cached secrets of zuid %d may be outdated", SHARED_CACHE_LOCK_TIMEOUT, zuid);
+		return;
+	}
+	__atomic_add_fetch(&sharedCacheHeader->generation, 1, __ATOMIC_RELEASE);
+	for (slot=0; slot<sharedCacheHeader->entriesCount; slot++) {
+		if (sharedCacheEntries[slot].valid != 0 && sharedCacheEntries[slot].zuid == zuid) {
+			bzrtp_sharedCache_beginWrite(slot);
+			sharedCacheEntries[slot].valid = 0;
+			bzrtp_sharedCache_endWrite(slot);
+		}
+	}
+	bzrtp_sharedCache_unlock();
+}
+
+#else /* ZIDCACHE_ENABLED && !_WIN32 && !__ANDROID__ */
+
+int bzrtp_sharedCache_attach(const char *name, uint32_t entriesCount) {
+	return BZRTP_ERROR_CACHEDISABLED;
+}
+
+void bzrtp_sharedCache_detach(void) {
+}
+
+int bzrtp_sharedCache_unlink(const char *name) {
+	return BZRTP_ERROR_CACHEDISABLED;
+}
+
+uint32_t bzrtp_sharedCache_generation(void) {
+	return 0;
+}
+
+int bzrtp_sharedCache_get(const char *selfURI, const char *peerURI, const uint8_t peerZID[12], int *zuid, cachedSecrets_t *secrets) {
+	return BZRTP_CACHE_DATA_NOTFOUND;
+}
+
+void bzrtp_sharedCache_put(const char *selfURI, const char *peerURI, const uint8_t peerZID[12], int zuid, const cachedSecrets_t *secrets, uint32_t generation) {
+}
+
+void bzrtp_sharedCache_update(const char *selfURI, const char *peerURI, const uint8_t peerZID[12], const char **columns, uint8_t **values, size_t *lengths, uint8_t columnsCount) {
+}
+
+void bzrtp_sharedCache_invalidate(int zuid) {
+}
+#endif /* ZIDCACHE_ENABLED && !_WIN32 && !__ANDROID__ */
@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2014-2023 Belledonne Communications SARL.
+ *
+ * This file is part of bzrtp.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @brief Benchmark the ZID cache under concurrent handshakes
+ *
+ * Several threads run complete ZRTP handshakes back to back. On each one, the local endpoint (think of a
+ * SBC) uses the one shared cache file under test while the remote endpoint is a simulated device holding
+ * its own in-memory cache. Remote devices are picked according to a peer distribution:
+ *  - hot peers: a small set of devices called most of the time, their cache entries are always found
+ *  - multi-device peers: several devices sharing the same URI, so each one has its own ZID
+ *  - cold peers: a new device on each call, creating new entries in the shared cache
+ *
+ * Two locking strategies are available for the shared cache:
+ *  - mutex: one sqlite connection shared by all threads, serialized by the mutex given to bzrtp.
+ *    The lock wait is sampled by a probe thread acquiring the mutex at regular intervals.
+ *  - connection: one sqlite connection per thread, no mutex, sqlite file locking does the job.
+ *    The lock wait is the time spent in the sqlite busy handler during each handshake.
+ *
+ * The report gives the handshake throughput, the handshake duration and lock wait percentiles and the
+ * number of sqlite busy retries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <bctoolbox/defs.h>
+#include <bctoolbox/logging.h>
+#include <bctoolbox/port.h>
+
+#include <sqlite3.h>
+
+#include "bzrtp/bzrtp.h"
+
+#define BENCH_SELF_URI "sbc@bench.linphone.org"
+#define BENCH_QUEUE_SIZE 16
+#define BENCH_PACKET_MAX_LENGTH 4096
+#define BENCH_HANDSHAKE_TIMEOUT 5000 /* in ms of virtual time */
+#define BENCH_TICK 10 /* virtual clock step, in ms */
+#define BENCH_BUSY_MAX_RETRIES 2000 /* busy handler sleeps 1ms per retry */
+
+#define BENCH_LOCKING_MUTEX 0
+#define BENCH_LOCKING_CONNECTION 1
+
+/*** settings ***/
+typedef struct {
+	int threads;
+	int duration; /**< in s */
+	int locking; /**< BENCH_LOCKING_MUTEX or BENCH_LOCKING_CONNECTION */
+	const char *journal; /**< sqlite journal mode */
+	const char *file; /**< shared cache file */
+	int hotPeers; /**< number of hot peers */
+	int hotShare; /**< percentage of calls to hot peers */
+	int multiDevicePeers; /**< number of peers having several devices */
+	int devicesPerPeer; /**< number of devices of each multi-device peer */
+	int multiDeviceShare; /**< percentage of calls to multi-device peers, cold peers get the rest */
+} benchSettings_t;
+
+/*** remote devices ***/
+typedef struct {
+	char uri[64];
+	sqlite3 *db; /**< in-memory cache of the device */
+	bctbx_mutex_t mutex; /**< the device may be called by several threads at once */
+} benchDevice_t;
+
+/*** samples, for percentiles ***/
+typedef struct {
+	uint64_t *values;
+	size_t count;
+	size_t size;
+} benchSamples_t;
+
+/*** per thread data ***/
+typedef struct {
+	int id;
+	bctbx_thread_t thread;
+	unsigned int seed;
+	sqlite3 *db; /**< connection to the shared cache in connection locking mode */
+	uint64_t handshakes;
+	uint64_t failures;
+	uint64_t cacheMismatches;
+	uint64_t coldPeers; /**< used to build unique cold peer URIs */
+	uint64_t busyRetries;
+	uint64_t busyWaitNs; /**< running total of the time spent in the busy handler */
+	benchSamples_t durations;
+	benchSamples_t lockWaits;
+} benchThread_t;
+
+/*** one end of a handshake ***/
+typedef struct benchEndpoint_struct {
+	bzrtpContext_t *context;
+	uint32_t ssrc;
+	struct benchEndpoint_struct *peer;
+	uint8_t queue[BENCH_QUEUE_SIZE][BENCH_PACKET_MAX_LENGTH]; /**< packets sent by the peer, waiting to be processed */
+	uint16_t queueLengths[BENCH_QUEUE_SIZE];
+	int queueCount;
+	int secure;
+	int cacheMismatch;
+} benchEndpoint_t;
+
+static benchSettings_t settings;
+static benchDevice_t *hotDevices = NULL;
+static benchDevice_t *multiDevices = NULL;
+static sqlite3 *sharedDB = NULL; /* shared connection in mutex locking mode */
+static bctbx_mutex_t sharedMutex;
+static int benchRunning = 0;
+
+static uint64_t benchNowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void benchSamplesAdd(benchSamples_t *samples, uint64_t value) {
+	if (samples->count == samples->size) {
+		samples->size = (samples->size == 0)?1024:2*samples->size;
+		samples->values = (uint64_t *)realloc(samples->values, samples->size*sizeof(uint64_t));
+	}
+	samples->values[samples->count++] = value;
+}
+
+static void benchSamplesMerge(benchSamples_t *samples, const benchSamples_t *other) {
+	size_t i;
+	for (i=0; i<other->count; i++) {
+		benchSamplesAdd(samples, other->values[i]);
+	}
+}
+
+static int benchCompareU64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x>y) - (x<y);
+}
+
+/* samples must be sorted */
+static double benchPercentileMs(const benchSamples_t *samples, int percentile) {
+	size_t index;
+	if (samples->count == 0) {
+		return 0.0;
+	}
+	index = (samples->count*(size_t)percentile)/100;
+	if (index >= samples->count) {
+		index = samples->count-1;
+	}
+	return (double)samples->values[index]/1000000.0;
+}
+
+/*** sqlite ***/
+static int benchBusyHandler(void *data, int count) {
+	benchThread_t *thread = (benchThread_t *)data;
+	uint64_t start;
+
+	if (count >= BENCH_BUSY_MAX_RETRIES) {
+		return 0; /* give up, the statement fails with SQLITE_BUSY */
+	}
+	start = benchNowNs();
+	sqlite3_sleep(1);
+	thread->busyRetries++;
+	thread->busyWaitNs += benchNowNs() - start;
+	return 1;
+}
+
+static int benchOpenSharedCache(sqlite3 **db) {
+	char *sql;
+	int ret = sqlite3_open_v2(settings.file, db, SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE|SQLITE_OPEN_FULLMUTEX, NULL);
+	if (ret != SQLITE_OK) {
+		fprintf(stderr, "unable to open %s: %s\n", settings.file, sqlite3_errmsg(*db));
+		return -1;
+	}
+	sql = sqlite3_mprintf("PRAGMA journal_mode=%s;", settings.journal);
+	ret = sqlite3_exec(*db, sql, NULL, NULL, NULL);
+	sqlite3_free(sql);
+	if (ret != SQLITE_OK) {
+		fprintf(stderr, "unable to set journal mode %s: %s\n", settings.journal, sqlite3_errmsg(*db));
+		return -1;
+	}
+	return 0;
+}
+
+static int benchInitDevice(benchDevice_t *device, const char *uri) {
+	snprintf(device->uri, sizeof(device->uri), "%s", uri);
+	bctbx_mutex_init(&device->mutex, NULL);
+	if (sqlite3_open_v2(":memory:", &device->db, SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE|SQLITE_OPEN_FULLMUTEX, NULL) != SQLITE_OK) {
+		return -1;
+	}
+	bzrtp_initCache_lock(device->db, &device->mutex);
+	return 0;
+}
+
+static void benchDestroyDevice(benchDevice_t *device) {
+	sqlite3_close(device->db);
+	bctbx_mutex_destroy(&device->mutex);
+}
+
+/*** handshake ***/
+static int benchSendData(void *clientData, const uint8_t *packetString, uint16_t packetLength) {
+	benchEndpoint_t *endpoint = (benchEndpoint_t *)clientData;
+	benchEndpoint_t *peer = endpoint->peer;
+
+	if (peer->queueCount == BENCH_QUEUE_SIZE || packetLength > BENCH_PACKET_MAX_LENGTH) {
+		return 0; /* lost, retransmission will take care of it */
+	}
+	memcpy(peer->queue[peer->queueCount], packetString, packetLength);
+	peer->queueLengths[peer->queueCount] = packetLength;
+	peer->queueCount++;
+	return 0;
+}
+
+static int benchStartSrtpSession(void *clientData, BCTBX_UNUSED(const bzrtpSrtpSecrets_t *secrets), BCTBX_UNUSED(int32_t verified)) {
+	((benchEndpoint_t *)clientData)->secure = 1;
+	return 0;
+}
+
+static int benchStatusMessage(void *clientData, BCTBX_UNUSED(const uint8_t messageLevel), const uint8_t messageId, BCTBX_UNUSED(const char *messageString)) {
+	if (messageId == BZRTP_MESSAGE_CACHEMISMATCH) {
+		((benchEndpoint_t *)clientData)->cacheMismatch = 1;
+	}
+	return 0;
+}
+
+static int benchSetUpEndpoint(benchEndpoint_t *endpoint, uint32_t ssrc, sqlite3 *db, bctbx_mutex_t *mutex, const char *selfURI, const char *peerURI) {
+	bzrtpCallbacks_t cbs={0};
+	int retval;
+
+	endpoint->ssrc = ssrc;
+	endpoint->queueCount = 0;
+	endpoint->secure = 0;
+	endpoint->cacheMismatch = 0;
+	endpoint->context = bzrtp_createBzrtpContext();
+	if (endpoint->context == NULL) {
+		return -1;
+	}
+
+	retval = bzrtp_setZIDCache_lock(endpoint->context, db, selfURI, peerURI, mutex);
+	if (retval != 0 && retval != BZRTP_CACHE_SETUP) {
+		return retval;
+	}
+
+	cbs.bzrtp_sendData = benchSendData;
+	cbs.bzrtp_startSrtpSession = benchStartSrtpSession;
+	cbs.bzrtp_statusMessage = benchStatusMessage;
+	cbs.bzrtp_messageLevel = BZRTP_MESSAGE_ERROR;
+	bzrtp_setCallbacks(endpoint->context, &cbs);
+
+	bzrtp_initBzrtpContext(endpoint->context, ssrc);
+	return bzrtp_setClientData(endpoint->context, ssrc, endpoint);
+}
+
+static void benchProcessQueue(benchEndpoint_t *endpoint) {
+	int i;
+	/* processing the packets only feeds the peer queue, this one is not modified meanwhile */
+	for (i=0; i<endpoint->queueCount; i++) {
+		bzrtp_processMessage(endpoint->context, endpoint->ssrc, endpoint->queue[i], endpoint->queueLengths[i]);
+	}
+	endpoint->queueCount = 0;
+}
+
+/* run one handshake between the local endpoint and the given device, return 0 when both ends are secure */
+static int benchHandshake(benchThread_t *thread, benchEndpoint_t *local, benchEndpoint_t *remote, benchDevice_t *device) {
+	sqlite3 *db = (settings.locking == BENCH_LOCKING_MUTEX)?sharedDB:thread->db;
+	bctbx_mutex_t *mutex = (settings.locking == BENCH_LOCKING_MUTEX)?&sharedMutex:NULL;
+	uint32_t ssrc = 0x10000*(uint32_t)(thread->id+1);
+	uint64_t timeReference;
+	int retval = -1;
+
+	local->peer = remote;
+	remote->peer = local;
+	if (benchSetUpEndpoint(local, ssrc, db, mutex, BENCH_SELF_URI, device->uri) != 0
+			|| benchSetUpEndpoint(remote, ssrc+1, device->db, &device->mutex, device->uri, BENCH_SELF_URI) != 0) {
+		goto end;
+	}
+
+	bzrtp_startChannelEngine(local->context, local->ssrc);
+	bzrtp_startChannelEngine(remote->context, remote->ssrc);
+	for (timeReference=1000; timeReference<1000+BENCH_HANDSHAKE_TIMEOUT; timeReference+=BENCH_TICK) {
+		benchProcessQueue(local);
+		benchProcessQueue(remote);
+		if (local->secure && remote->secure) {
+			retval = 0;
+			break;
+		}
+		bzrtp_iterate(local->context, local->ssrc, timeReference);
+		bzrtp_iterate(remote->context, remote->ssrc, timeReference);
+	}
+	if (local->cacheMismatch) {
+		thread->cacheMismatches++;
+	}
+
+end:
+	if (local->context != NULL) {
+		bzrtp_destroyBzrtpContext(local->context, local->ssrc);
+		local->context = NULL;
+	}
+	if (remote->context != NULL) {
+		bzrtp_destroyBzrtpContext(remote->context, remote->ssrc);
+		remote->context = NULL;
+	}
+	return retval;
+}
+
+static void *benchThreadRun(void *arg) {
+	benchThread_t *thread = (benchThread_t *)arg;
+	/* endpoints hold the packet queues, too big for the stack */
+	benchEndpoint_t *endpoints = (benchEndpoint_t *)calloc(2, sizeof(benchEndpoint_t));
+
+	while (__atomic_load_n(&benchRunning, __ATOMIC_RELAXED)) {
+		benchDevice_t coldDevice;
+		benchDevice_t *device = NULL;
+		int pick = rand_r(&thread->seed)%100;
+		uint64_t start, busyWaitNs = thread->busyWaitNs;
+
+		if (pick < settings.hotShare && settings.hotPeers > 0) {
+			device = &hotDevices[rand_r(&thread->seed)%settings.hotPeers];
+		} else if (pick < settings.hotShare + settings.multiDeviceShare && settings.multiDevicePeers > 0) {
+			device = &multiDevices[rand_r(&thread->seed)%(settings.multiDevicePeers*settings.devicesPerPeer)];
+		} else {
+			char uri[64];
+			snprintf(uri, sizeof(uri), "cold%d-%llu@bench.linphone.org", thread->id, (unsigned long long)thread->coldPeers++);
+			if (benchInitDevice(&coldDevice, uri) != 0) {
+				thread->failures++;
+				continue;
+			}
+			device = &coldDevice;
+		}
+
+		start = benchNowNs();
+		if (benchHandshake(thread, &endpoints[0], &endpoints[1], device) != 0) {
+			thread->failures++;
+		}
+		benchSamplesAdd(&thread->durations, benchNowNs() - start);
+		if (settings.locking == BENCH_LOCKING_CONNECTION) {
+			benchSamplesAdd(&thread->lockWaits, thread->busyWaitNs - busyWaitNs);
+		}
+		thread->handshakes++;
+
+		if (device == &coldDevice) {
+			benchDestroyDevice(&coldDevice);
+		}
+	}
+
+	free(endpoints);
+	return NULL;
+}
+
+/* in mutex locking mode, sample the wait any cache access would experience */
+static void *benchProbeRun(void *arg) {
+	benchSamples_t *samples = (benchSamples_t *)arg;
+
+	while (__atomic_load_n(&benchRunning, __ATOMIC_RELAXED)) {
+		uint64_t start = benchNowNs();
+		bctbx_mutex_lock(&sharedMutex);
+		benchSamplesAdd(samples, benchNowNs() - start);
+		bctbx_mutex_unlock(&sharedMutex);
+		bctbx_sleep_ms(1);
+	}
+	return NULL;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [options]\n", name);
+	fprintf(stderr, "  --threads <n>              number of threads running handshakes (default 8)\n");
+	fprintf(stderr, "  --duration <s>             duration of the run (default 10)\n");
+	fprintf(stderr, "  --locking <mutex|connection> shared connection and mutex, or one connection per thread (default mutex)\n");
+	fprintf(stderr, "  --journal <mode>           sqlite journal mode: delete, truncate, persist, memory, wal (default delete)\n");
+	fprintf(stderr, "  --file <path>              shared cache file, overwritten (default bzrtp-cache-bench.sqlite)\n");
+	fprintf(stderr, "  --hot <n> <share>          number of hot peers and percentage of calls to them (default 20 70)\n");
+	fprintf(stderr, "  --multi-device <n> <devices> <share> number of multi-device peers, devices per peer and percentage of calls to them (default 10 3 20)\n");
+	fprintf(stderr, "                             cold peers, seen only once, get the remaining calls\n");
+	fprintf(stderr, "  --verbose                  enable the library logs\n");
+}
+
+int main(int argc, char *argv[]) {
+	benchThread_t *threads = NULL;
+	bctbx_thread_t probeThread;
+	benchSamples_t durations = {NULL, 0, 0};
+	benchSamples_t lockWaits = {NULL, 0, 0};
+	uint64_t handshakes = 0, failures = 0, cacheMismatches = 0, busyRetries = 0;
+	uint64_t start, elapsedNs;
+	void *res;
+	int verbose = 0;
+	int i;
+
+	settings.threads = 8;
+	settings.duration = 10;
+	settings.locking = BENCH_LOCKING_MUTEX;
+	settings.journal = "delete";
+	settings.file = "bzrtp-cache-bench.sqlite";
+	settings.hotPeers = 20;
+	settings.hotShare = 70;
+	settings.multiDevicePeers = 10;
+	settings.devicesPerPeer = 3;
+	settings.multiDeviceShare = 20;
+
+	for (i=1; i<argc; i++) {
+		if (strcmp(argv[i], "--threads") == 0 && i+1<argc) {
+			settings.threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--duration") == 0 && i+1<argc) {
+			settings.duration = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--locking") == 0 && i+1<argc) {
+			i++;
+			if (strcmp(argv[i], "mutex") == 0) {
+				settings.locking = BENCH_LOCKING_MUTEX;
+			} else if (strcmp(argv[i], "connection") == 0) {
+				settings.locking = BENCH_LOCKING_CONNECTION;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--journal") == 0 && i+1<argc) {
+			settings.journal = argv[++i];
+		} else if (strcmp(argv[i], "--file") == 0 && i+1<argc) {
+			settings.file = argv[++i];
+		} else if (strcmp(argv[i], "--hot") == 0 && i+2<argc) {
+			settings.hotPeers = atoi(argv[++i]);
+			settings.hotShare = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--multi-device") == 0 && i+3<argc) {
+			settings.multiDevicePeers = atoi(argv[++i]);
+			settings.devicesPerPeer = atoi(argv[++i]);
+			settings.multiDeviceShare = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--verbose") == 0) {
+			verbose = 1;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (settings.threads <= 0 || settings.duration <= 0 || settings.devicesPerPeer <= 0 || settings.hotShare + settings.multiDeviceShare > 100) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bctbx_set_log_level("bzrtp", verbose?BCTBX_LOG_DEBUG:BCTBX_LOG_ERROR);
+
+	/* fresh shared cache, its schema is created before the threads start */
+	remove(settings.file);
+	if (benchOpenSharedCache(&sharedDB) != 0) {
+		return 1;
+	}
+	bctbx_mutex_init(&sharedMutex, NULL);
+	bzrtp_initCache_lock(sharedDB, &sharedMutex);
+
+	/* remote devices */
+	hotDevices = (benchDevice_t *)calloc((size_t)settings.hotPeers+1, sizeof(benchDevice_t));
+	for (i=0; i<settings.hotPeers; i++) {
+		char uri[64];
+		snprintf(uri, sizeof(uri), "hot%d@bench.linphone.org", i);
+		benchInitDevice(&hotDevices[i], uri);
+	}
+	multiDevices = (benchDevice_t *)calloc((size_t)(settings.multiDevicePeers*settings.devicesPerPeer)+1, sizeof(benchDevice_t));
+	for (i=0; i<settings.multiDevicePeers*settings.devicesPerPeer; i++) {
+		char uri[64];
+		snprintf(uri, sizeof(uri), "multi%d@bench.linphone.org", i/settings.devicesPerPeer);
+		benchInitDevice(&multiDevices[i], uri);
+	}
+
+	threads = (benchThread_t *)calloc((size_t)settings.threads, sizeof(benchThread_t));
+	for (i=0; i<settings.threads; i++) {
+		threads[i].id = i;
+		threads[i].seed = (unsigned int)(i+1);
+		if (settings.locking == BENCH_LOCKING_CONNECTION) {
+			if (benchOpenSharedCache(&threads[i].db) != 0) {
+				return 1;
+			}
+			sqlite3_busy_handler(threads[i].db, benchBusyHandler, &threads[i]);
+		}
+	}
+
+	/* run */
+	__atomic_store_n(&benchRunning, 1, __ATOMIC_SEQ_CST);
+	start = benchNowNs();
+	for (i=0; i<settings.threads; i++) {
+		bctbx_thread_create(&threads[i].thread, NULL, benchThreadRun, &threads[i]);
+	}
+	if (settings.locking == BENCH_LOCKING_MUTEX) {
+		bctbx_thread_create(&probeThread, NULL, benchProbeRun, &lockWaits);
+	}
+	bctbx_sleep_ms(settings.duration*1000);
+	__atomic_store_n(&benchRunning, 0, __ATOMIC_SEQ_CST);
+	for (i=0; i<settings.threads; i++) {
+		bctbx_thread_join(threads[i].thread, &res);
+	}
+	if (settings.locking == BENCH_LOCKING_MUTEX) {
+		bctbx_thread_join(probeThread, &res);
+	}
+	elapsedNs = benchNowNs() - start;
+
+	/* report */
+	for (i=0; i<settings.threads; i++) {
+		handshakes += threads[i].handshakes;
+		failures += threads[i].failures;
+		cacheMismatches += threads[i].cacheMismatches;
+		busyRetries += threads[i].busyRetries;
+		benchSamplesMerge(&durations, &threads[i].durations);
+		benchSamplesMerge(&lockWaits, &threads[i].lockWaits);
+	}
+	qsort(durations.values, durations.count, sizeof(uint64_t), benchCompareU64);
+	qsort(lockWaits.values, lockWaits.count, sizeof(uint64_t), benchCompareU64);
+
+	printf("%d threads, %d s, locking %s, journal %s\n", settings.threads, settings.duration, (settings.locking == BENCH_LOCKING_MUTEX)?"mutex":"connection", settings.journal);
+	printf("peers: %d hot (%d%%), %d multi-device x%d (%d%%), cold (%d%%)\n", settings.hotPeers, settings.hotShare, settings.multiDevicePeers, settings.devicesPerPeer, settings.multiDeviceShare, 100-settings.hotShare-settings.multiDeviceShare);
+	printf("  %-16s %llu (%.1f/s), %llu failed, %llu cache mismatches\n", "handshakes", (unsigned long long)handshakes, (double)handshakes*1000000000.0/(double)elapsedNs, (unsigned long long)failures, (unsigned long long)cacheMismatches);
+	printf("  %-16s p50 %.2f ms, p99 %.2f ms\n", "handshake time", benchPercentileMs(&durations, 50), benchPercentileMs(&durations, 99));
+	printf("  %-16s p50 %.3f ms, p99 %.3f ms (%s)\n", "lock wait", benchPercentileMs(&lockWaits, 50), benchPercentileMs(&lockWaits, 99),
+		(settings.locking == BENCH_LOCKING_MUTEX)?"shared mutex, sampled by a probe thread":"per handshake, time spent in the sqlite busy handler");
+	printf("  %-16s %llu\n", "busy retries", (unsigned long long)busyRetries);
+
+	/* cleaning */
+	for (i=0; i<settings.threads; i++) {
+		if (threads[i].db != NULL) {
+			sqlite3_close(threads[i].db);
+		}
+		free(threads[i].durations.values);
+		free(threads[i].lockWaits.values);
+	}
+	free(threads);
+	for (i=0; i<settings.hotPeers; i++) {
+		benchDestroyDevice(&hotDevices[i]);
+	}
+	free(hotDevices);
+	for (i=0; i<settings.multiDevicePeers*settings.devicesPerPeer; i++) {
+		benchDestroyDevice(&multiDevices[i]);
+	}
+	free(multiDevices);
+	free(durations.values);
+	free(lockWaits.values);
+	sqlite3_close(sharedDB);
+	bctbx_mutex_destroy(&sharedMutex);
+	remove(settings.file);
+	return 0;
+}
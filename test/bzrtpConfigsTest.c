@@ -31,7 +31,7 @@
 #define MAX_PACKET_LENGTH 3000
 #define MAX_QUEUE_SIZE 64
 #define MAX_CRYPTO_ALG 10
-#define MAX_NUM_CHANNEL ZRTP_MAX_CHANNEL_NUMBER
+#define MAX_NUM_CHANNEL 64
 
 typedef struct packetDatas_struct {
 	uint8_t packetString[MAX_PACKET_LENGTH];
@@ -52,6 +52,8 @@ typedef struct clientContext_struct {
 	uint8_t	sendExportedKey[16];
 	uint8_t  recvExportedKey[16];
 	uint32_t peerSSRC; /**< hold the peer SSRC so we can correctly route the packet */
+	int channelStatus; /**< last status signaled by the channelStatusChanged callback */
+	uint8_t peerNotZRTP; /**< set by the peerNotZRTP callback */
 } clientContext_t;
 
 typedef struct cryptoParams_struct {
@@ -119,6 +121,23 @@ static float fadingLostBob=0.0; /* try not to throw away too many packet in a ro
 static int continuousPacketLost=0; /* Enforce not loosing more than 10 consecutive packets so we're sure to complete the exchange */
 static int totalPacketLost=0; /* for statistics */
 static int totalPacketSent=0; /* for statistics */
+static int useTransportBuffers=0; /* when set, packets are written directly into the peer queue using the buffer provider callbacks */
+static int transportBuffersCommitted=0; /* for statistics */
+static int transferReceiveBuffers=0; /* when set, received packets are given to the library in a buffer it takes the ownership of */
+static int receiveBuffersTransferred=0; /* for statistics */
+static int receiveBuffersReleased=0; /* for statistics */
+static int asyncCacheRead=0; /* when set, the cache read on Hello reception is served by the exchange loop, some time after it was requested */
+static int cacheReadsServed=0; /* for statistics */
+
+/* pending asynchronous cache reads */
+#define CACHE_READ_DELAY 100 /* in ms, delay between a cache read request and its completion */
+typedef struct cacheReadRequest_struct {
+	bzrtpContext_t *bzrtpContext;
+	uint32_t selfSSRC;
+	uint64_t requestTime;
+} cacheReadRequest_t;
+static cacheReadRequest_t cacheReadRequests[4];
+static int cacheReadRequestsCount=0;
 
 /* when timeout is set to this specific value, negotiation is aborted but silently fails */
 #define ABORT_NEGOTIATION_TIMEOUT 24
@@ -131,6 +150,14 @@ static void resetGlobalParams(void) {
 	timeOutLimit = 1000;
 	fadingLostBob = 0;
 	fadingLostAlice = 0;
+	useTransportBuffers = 0;
+	transportBuffersCommitted = 0;
+	transferReceiveBuffers = 0;
+	receiveBuffersTransferred = 0;
+	receiveBuffersReleased = 0;
+	asyncCacheRead = 0;
+	cacheReadsServed = 0;
+	cacheReadRequestsCount = 0;
 }
 
 /* time functions, we do not run a real time scenario, go for fast test instead */
@@ -188,6 +215,84 @@ static int sendData(void *clientData, const uint8_t *packetString, uint16_t pack
 	return 0;
 }
 
+/* transport buffer provider: hand out the next slot of the peer queue */
+static uint8_t *getSendBuffer(void *clientData, uint16_t packetLength) {
+	clientContext_t *clientContext = (clientContext_t *)clientData;
+
+	if (packetLength > MAX_PACKET_LENGTH) {
+		return NULL;
+	}
+	if (clientContext->id == ALICE) {
+		return bobQueue[bobQueueIndex].packetString;
+	}
+	return aliceQueue[aliceQueueIndex].packetString;
+}
+
+static int commitSendBuffer(void *clientData, uint8_t *buffer, uint16_t packetLength) {
+	clientContext_t *clientContext = (clientContext_t *)clientData;
+
+	transportBuffersCommitted++;
+	if (clientContext->id == ALICE) {
+		bobQueue[bobQueueIndex].destSSRC = clientContext->peerSSRC;
+		bobQueue[bobQueueIndex++].packetLength = packetLength;
+	} else {
+		aliceQueue[aliceQueueIndex].destSSRC = clientContext->peerSSRC;
+		aliceQueue[aliceQueueIndex++].packetLength = packetLength;
+	}
+	return 0;
+}
+
+/* receive buffers given to the library are released here */
+static void releaseReceiveBuffer(void *clientData, uint8_t *buffer) {
+	receiveBuffersReleased++;
+	free(buffer);
+}
+
+/* hand a received packet to the library, in a buffer it owns when transferReceiveBuffers is set */
+static int processMessage(bzrtpContext_t *zrtpContext, uint32_t selfSSRC, const uint8_t *packetString, uint16_t packetLength) {
+	if (transferReceiveBuffers) {
+		uint8_t *receiveBuffer = (uint8_t *)malloc(packetLength);
+		memcpy(receiveBuffer, packetString, packetLength);
+		receiveBuffersTransferred++;
+		return bzrtp_processMessageTransfer(zrtpContext, selfSSRC, receiveBuffer, packetLength);
+	}
+	return bzrtp_processMessage(zrtpContext, selfSSRC, (uint8_t *)packetString, packetLength);
+}
+
+/* queue the cache read, it is served by serveCacheReads */
+static int cacheReadRequested(void *clientData, uint32_t selfSSRC) {
+	clientContext_t *clientContext = (clientContext_t *)clientData;
+
+	if (cacheReadRequestsCount == 4) {
+		return -1; /* bzrtp shall then read it synchronously */
+	}
+	cacheReadRequests[cacheReadRequestsCount].bzrtpContext = clientContext->bzrtpContext;
+	cacheReadRequests[cacheReadRequestsCount].selfSSRC = selfSSRC;
+	cacheReadRequests[cacheReadRequestsCount].requestTime = msSTC;
+	cacheReadRequestsCount++;
+	return 0;
+}
+
+/* complete the cache reads requested for long enough, peers keep exchanging Hello meanwhile */
+static void serveCacheReads(void) {
+	int i=0;
+
+	while (i<cacheReadRequestsCount) {
+		if (msSTC - cacheReadRequests[i].requestTime >= CACHE_READ_DELAY) {
+			cacheReadRequest_t request = cacheReadRequests[i];
+			/* remove it from the queue before resuming */
+			cacheReadRequests[i] = cacheReadRequests[--cacheReadRequestsCount];
+			BC_ASSERT_EQUAL(bzrtp_readPeerCache(request.bzrtpContext, request.selfSSRC), 0, int, "%x");
+			BC_ASSERT_EQUAL(bzrtp_cacheReadCompleted(request.bzrtpContext, request.selfSSRC), 0, int, "%x");
+			/* only one completion per request */
+			BC_ASSERT_EQUAL(bzrtp_cacheReadCompleted(request.bzrtpContext, request.selfSSRC), BZRTP_ERROR_CONTEXTNOTREADY, int, "%x");
+			cacheReadsServed++;
+		} else {
+			i++;
+		}
+	}
+}
+
 /* get SAS and SRTP keys */
 int getSAS(void *clientData, bzrtpSrtpSecrets_t *secrets, int32_t pvs) {
 	/* get the client context */
@@ -216,6 +321,20 @@ int getMessage(void *clientData, const uint8_t level, const uint8_t message, BCT
 	return 0;
 }
 
+int channelStatusChanged(void *clientData, BCTBX_UNUSED(uint32_t selfSSRC), int status) {
+	/* get the client context */
+	clientContext_t *clientContext = (clientContext_t *)clientData;
+	clientContext->channelStatus = status;
+	return 0;
+}
+
+int peerNotZRTP(void *clientData, BCTBX_UNUSED(uint32_t selfSSRC)) {
+	/* get the client context */
+	clientContext_t *clientContext = (clientContext_t *)clientData;
+	clientContext->peerNotZRTP = 1;
+	return 0;
+}
+
 int computeExportedKeys(void *clientData, BCTBX_UNUSED(int zuid), uint8_t role) {
 	size_t keyLength = 16;
 	/* get the client context */
@@ -242,6 +361,8 @@ static int setUpClientContext(clientContext_t *clientContext, uint8_t clientID,
 	clientContext->peerRequestGoClear=0;
 	clientContext->peerACKGoClear=0;
 	clientContext->peerSSRC=0;
+	clientContext->channelStatus=BZRTP_CHANNEL_INITIALISED;
+	clientContext->peerNotZRTP=0;
 
 	/* create zrtp context */
 	clientContext->bzrtpContext = bzrtp_createBzrtpContext();
@@ -274,6 +395,16 @@ static int setUpClientContext(clientContext_t *clientContext, uint8_t clientID,
 	cbs.bzrtp_statusMessage=getMessage;
 	cbs.bzrtp_messageLevel = BZRTP_MESSAGE_ERROR;
 	cbs.bzrtp_contextReadyForExportedKeys = computeExportedKeys;
+	cbs.bzrtp_channelStatusChanged = channelStatusChanged;
+	cbs.bzrtp_peerNotZRTP = peerNotZRTP;
+	cbs.bzrtp_releaseReceiveBuffer = releaseReceiveBuffer;
+	if (asyncCacheRead) {
+		cbs.bzrtp_cacheReadRequested = cacheReadRequested;
+	}
+	if (useTransportBuffers) {
+		cbs.bzrtp_getSendBuffer = getSendBuffer;
+		cbs.bzrtp_commitSendBuffer = commitSendBuffer;
+	}
 	if ((retval = bzrtp_setCallbacks(clientContext->bzrtpContext, &cbs))!=0) {
 		bzrtp_message("ERROR: bzrtp_setCallbacks returned %0x, client id is %d\n", retval, clientID);
 		return -3;
@@ -474,7 +605,7 @@ uint32_t multichannel_exchange_full_params(cryptoParams_t *aliceCryptoParams, //
 			if (mtu > 0) { // Check the packet size we received
 				BC_ASSERT_LOWER(aliceQueue[i].packetLength, mtu, size_t, "%zu");
 			}
-			retval = bzrtp_processMessage(Alice.bzrtpContext, aliceSSRC, aliceQueue[i].packetString, aliceQueue[i].packetLength);
+			retval = processMessage(Alice.bzrtpContext, aliceSSRC, aliceQueue[i].packetString, aliceQueue[i].packetLength);
 #if 0 // uncomment for improved trace
 			bool_t isFragmented = aliceQueue[i].packetString[0] == 0x11?TRUE:FALSE;
 			if (isFragmented) {
@@ -501,13 +632,16 @@ uint32_t multichannel_exchange_full_params(cryptoParams_t *aliceCryptoParams, //
 			if (mtu > 0) { // Check the packet size we received
 				BC_ASSERT_LOWER(bobQueue[i].packetLength, mtu, size_t, "%zu");
 			}
-			retval = bzrtp_processMessage(Bob.bzrtpContext, bobSSRC, bobQueue[i].packetString, bobQueue[i].packetLength);
+			retval = processMessage(Bob.bzrtpContext, bobSSRC, bobQueue[i].packetString, bobQueue[i].packetLength);
 			//bzrtp_message("%ld Bob processed a %.8s and returns %x\n",msSTC, (bobQueue[i].packetString)+16, retval);
 			memset(bobQueue[i].packetString, 0, MAX_PACKET_LENGTH); /* destroy the packet after sending it to the ZRTP engine */
 			lastPacketSentTime=getSimulatedTime();
 		}
 		bobQueueIndex = 0;
 
+		/* complete the pending cache reads, if any */
+		serveCacheReads();
+
 		/* send the actual time to the zrtpContext */
 		retval = bzrtp_iterate(Alice.bzrtpContext, aliceSSRC, getSimulatedTime());
 		retval = bzrtp_iterate(Bob.bzrtpContext, bobSSRC, getSimulatedTime());
@@ -552,6 +686,9 @@ uint32_t multichannel_exchange_full_params(cryptoParams_t *aliceCryptoParams, //
 		BC_ASSERT_EQUAL(retval, BZRTP_CHANNEL_SECURE, int, "%0x");
 		return retval;
 	}
+	/* the status callback shall have followed the channel status */
+	BC_ASSERT_EQUAL(Alice.channelStatus, BZRTP_CHANNEL_SECURE, int, "%0x");
+	BC_ASSERT_EQUAL(Bob.channelStatus, BZRTP_CHANNEL_SECURE, int, "%0x");
 
 	bzrtp_message("ZRTP algo used during negotiation: Cipher: %s - KeyAgreement: %s - Hash: %s - AuthTag: %s - Sas Rendering: %s\n", bzrtp_algoToString(Alice.secrets->cipherAlgo), bzrtp_algoToString(Alice.secrets->keyAgreementAlgo), bzrtp_algoToString(Alice.secrets->hashAlgo), bzrtp_algoToString(Alice.secrets->authTagAlgo), bzrtp_algoToString(Alice.secrets->sasAlgo));
 
@@ -622,7 +759,7 @@ uint32_t multichannel_exchange_full_params(cryptoParams_t *aliceCryptoParams, //
 			int i;
 			/* check the message queue */
 			for (i=0; i<aliceQueueIndex; i++) {
-				retval = bzrtp_processMessage(Alice.bzrtpContext, aliceSSRC, aliceQueue[i].packetString, aliceQueue[i].packetLength);
+				retval = processMessage(Alice.bzrtpContext, aliceSSRC, aliceQueue[i].packetString, aliceQueue[i].packetLength);
 				//bzrtp_message("%ld Alice processed a %.8s and returns %x\n",msSTC, aliceQueue[i].packetString+16, retval);
 				memset(aliceQueue[i].packetString, 0, MAX_PACKET_LENGTH); /* destroy the packet after sending it to the ZRTP engine */
 				lastPacketSentTime=getSimulatedTime();
@@ -630,13 +767,16 @@ uint32_t multichannel_exchange_full_params(cryptoParams_t *aliceCryptoParams, //
 			aliceQueueIndex = 0;
 
 			for (i=0; i<bobQueueIndex; i++) {
-				retval = bzrtp_processMessage(Bob.bzrtpContext, bobSSRC, bobQueue[i].packetString, bobQueue[i].packetLength);
+				retval = processMessage(Bob.bzrtpContext, bobSSRC, bobQueue[i].packetString, bobQueue[i].packetLength);
 				//bzrtp_message("%ld Bob processed a %.8s and returns %x\n",msSTC, bobQueue[i].packetString+16, retval);
 				memset(bobQueue[i].packetString, 0, MAX_PACKET_LENGTH); /* destroy the packet after sending it to the ZRTP engine */
 				lastPacketSentTime=getSimulatedTime();
 			}
 			bobQueueIndex = 0;
 
+			/* complete the pending cache reads, if any */
+			serveCacheReads();
+
 			/* send the actual time to the zrtpContext */
 			retval = bzrtp_iterate(Alice.bzrtpContext, aliceSSRC, getSimulatedTime());
 			retval = bzrtp_iterate(Bob.bzrtpContext, bobSSRC, getSimulatedTime());
@@ -1035,6 +1175,135 @@ static void test_loosy_network(void) {
 	}
 }
 
+/* run Alice alone for the given time, peer never answers, return the number of packets she sent */
+static int discovery_run(clientContext_t *Alice, uint32_t aliceSSRC, uint64_t duration) {
+	uint64_t initialTime = getSimulatedTime();
+	bobQueueIndex = 0;
+	while (getSimulatedTime()-initialTime < duration) {
+		bzrtp_iterate(Alice->bzrtpContext, aliceSSRC, getSimulatedTime());
+		STC_sleep(10);
+	}
+	return bobQueueIndex;
+}
+
+static void test_discovery_budget(void) {
+	clientContext_t Alice;
+	uint32_t aliceSSRC = ALICE_SSRC_BASE;
+	bzrtpDiscoveryPolicy_t policy;
+	int packetsSent;
+
+	/* default policy: all the Hello retransmissions are sent and peer is then declared not ZRTP */
+	resetGlobalParams();
+	BC_ASSERT_EQUAL(setUpClientContext(&Alice, ALICE, aliceSSRC, NULL, NULL, NULL, NULL, NULL), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_getDiscoveryPolicy(Alice.bzrtpContext, &policy), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_startChannelEngine(Alice.bzrtpContext, aliceSSRC), 0, int, "%x");
+	BC_ASSERT_EQUAL(discovery_run(&Alice, aliceSSRC, 10000), policy.maxHelloCount+1, int, "%d");
+	BC_ASSERT_EQUAL(Alice.peerNotZRTP, 1, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_getChannelStatus(Alice.bzrtpContext, aliceSSRC), BZRTP_CHANNEL_ERROR, int, "%x");
+	bzrtp_destroyBzrtpContext(Alice.bzrtpContext, aliceSSRC);
+
+	/* time budget stops the discovery earlier */
+	resetGlobalParams();
+	BC_ASSERT_EQUAL(setUpClientContext(&Alice, ALICE, aliceSSRC, NULL, NULL, NULL, NULL, NULL), 0, int, "%x");
+	policy.timeBudget = 500;
+	BC_ASSERT_EQUAL(bzrtp_setDiscoveryPolicy(Alice.bzrtpContext, &policy), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_startChannelEngine(Alice.bzrtpContext, aliceSSRC), 0, int, "%x");
+	packetsSent = discovery_run(&Alice, aliceSSRC, 10000);
+	BC_ASSERT_TRUE(packetsSent > 0 && packetsSent < policy.maxHelloCount);
+	BC_ASSERT_EQUAL(Alice.peerNotZRTP, 1, int, "%d");
+	bzrtp_destroyBzrtpContext(Alice.bzrtpContext, aliceSSRC);
+
+	/* a byte budget smaller than a Hello forbids any Hello */
+	resetGlobalParams();
+	BC_ASSERT_EQUAL(setUpClientContext(&Alice, ALICE, aliceSSRC, NULL, NULL, NULL, NULL, NULL), 0, int, "%x");
+	policy.timeBudget = 0;
+	policy.byteBudget = 1;
+	BC_ASSERT_EQUAL(bzrtp_setDiscoveryPolicy(Alice.bzrtpContext, &policy), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_startChannelEngine(Alice.bzrtpContext, aliceSSRC), 0, int, "%x");
+	BC_ASSERT_EQUAL(discovery_run(&Alice, aliceSSRC, 1000), 0, int, "%d");
+	BC_ASSERT_EQUAL(Alice.peerNotZRTP, 1, int, "%d");
+	bzrtp_destroyBzrtpContext(Alice.bzrtpContext, aliceSSRC);
+
+	/* suspended Hello: nothing is sent until resumed */
+	resetGlobalParams();
+	BC_ASSERT_EQUAL(setUpClientContext(&Alice, ALICE, aliceSSRC, NULL, NULL, NULL, NULL, NULL), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_setHelloSuspended(Alice.bzrtpContext, aliceSSRC, 1), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_startChannelEngine(Alice.bzrtpContext, aliceSSRC), 0, int, "%x");
+	BC_ASSERT_EQUAL(discovery_run(&Alice, aliceSSRC, 1000), 0, int, "%d");
+	BC_ASSERT_EQUAL(Alice.peerNotZRTP, 0, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_getChannelStatus(Alice.bzrtpContext, aliceSSRC), BZRTP_CHANNEL_ONGOING, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_setHelloSuspended(Alice.bzrtpContext, aliceSSRC, 0), 0, int, "%x");
+	BC_ASSERT_TRUE(discovery_run(&Alice, aliceSSRC, 100) > 0);
+	bzrtp_destroyBzrtpContext(Alice.bzrtpContext, aliceSSRC);
+	bobQueueIndex = 0;
+}
+
+/* the channel table grows far beyond the multichannel exchange tests and channels are still found by their SSRC */
+static void test_channel_table(void) {
+	clientContext_t Alice;
+	uint32_t aliceSSRC = ALICE_SSRC_BASE;
+	int i;
+
+	resetGlobalParams();
+	BC_ASSERT_EQUAL(setUpClientContext(&Alice, ALICE, aliceSSRC, NULL, NULL, NULL, NULL, NULL), 0, int, "%x");
+	BC_ASSERT_EQUAL(Alice.bzrtpContext->channelContextSize, 1, int, "%d");
+
+	for (i=1; i<300; i++) {
+		BC_ASSERT_EQUAL(bzrtp_addChannel(Alice.bzrtpContext, aliceSSRC+i), 0, int, "%x");
+	}
+	BC_ASSERT_EQUAL(Alice.bzrtpContext->channelContextSize, 512, int, "%d");
+	/* an SSRC is unique in a context */
+	BC_ASSERT_EQUAL(bzrtp_addChannel(Alice.bzrtpContext, aliceSSRC+42), BZRTP_ERROR_UNABLETOADDCHANNEL, int, "%x");
+	for (i=0; i<300; i++) {
+		BC_ASSERT_EQUAL(bzrtp_getChannelStatus(Alice.bzrtpContext, aliceSSRC+i), BZRTP_CHANNEL_INITIALISED, int, "%x");
+	}
+	BC_ASSERT_EQUAL(bzrtp_getChannelStatus(Alice.bzrtpContext, aliceSSRC+300), BZRTP_CHANNEL_NOTFOUND, int, "%x");
+
+	/* remove every other channel, the remaining ones are still reachable and the freed slots are reused */
+	for (i=1; i<300; i+=2) {
+		BC_ASSERT_EQUAL(bzrtp_destroyBzrtpContext(Alice.bzrtpContext, aliceSSRC+i), 299-(i/2), int, "%d");
+	}
+	for (i=0; i<300; i++) {
+		BC_ASSERT_EQUAL(bzrtp_getChannelStatus(Alice.bzrtpContext, aliceSSRC+i), (i%2)?BZRTP_CHANNEL_NOTFOUND:BZRTP_CHANNEL_INITIALISED, int, "%x");
+	}
+	BC_ASSERT_EQUAL(bzrtp_addChannel(Alice.bzrtpContext, aliceSSRC+1000), 0, int, "%x");
+	BC_ASSERT_TRUE(Alice.bzrtpContext->channelContext[1] != NULL && Alice.bzrtpContext->channelContext[1]->selfSSRC == aliceSSRC+1000);
+	BC_ASSERT_EQUAL(Alice.bzrtpContext->channelContextSize, 512, int, "%d");
+
+	/* destroy all, the last one frees the context */
+	bzrtp_destroyBzrtpContext(Alice.bzrtpContext, aliceSSRC+1000);
+	for (i=298; i>0; i-=2) {
+		bzrtp_destroyBzrtpContext(Alice.bzrtpContext, aliceSSRC+i);
+	}
+	BC_ASSERT_EQUAL(bzrtp_destroyBzrtpContext(Alice.bzrtpContext, aliceSSRC), 0, int, "%d");
+}
+
+/* outgoing packets are written straight into the transport buffers and the exchange still completes */
+static void test_transport_buffers(void) {
+	resetGlobalParams();
+	useTransportBuffers = 1;
+	BC_ASSERT_EQUAL(multichannel_exchange(NULL, NULL, defaultCryptoAlgoSelection(), NULL, NULL, NULL, NULL), 0, int, "%x");
+	BC_ASSERT_TRUE(transportBuffersCommitted > 0);
+	resetGlobalParams();
+}
+
+/* retained packets reference the transferred receive buffers which are all given back */
+static void test_receive_buffers_transfer(void) {
+	resetGlobalParams();
+	transferReceiveBuffers = 1;
+	BC_ASSERT_EQUAL(multichannel_exchange(NULL, NULL, defaultCryptoAlgoSelection(), NULL, NULL, NULL, NULL), 0, int, "%x");
+	BC_ASSERT_TRUE(receiveBuffersTransferred > 0);
+	BC_ASSERT_EQUAL(receiveBuffersReleased, receiveBuffersTransferred, int, "%d");
+
+	/* with lost packets, repetitions are checked against the transferred buffers */
+	resetGlobalParams();
+	transferReceiveBuffers = 1;
+	loosePacketPercentage = 20;
+	BC_ASSERT_EQUAL(multichannel_exchange(NULL, NULL, defaultCryptoAlgoSelection(), NULL, NULL, NULL, NULL), 0, int, "%x");
+	BC_ASSERT_EQUAL(receiveBuffersReleased, receiveBuffersTransferred, int, "%d");
+	resetGlobalParams();
+}
+
 static void test_mtu(void) {
 #ifdef HAVE_BCTBXPQ
 	cryptoParams_t *pattern;
@@ -1233,6 +1502,47 @@ static void test_cache_enabled_exchange(void) {
 		test_cache_enabled_exchange_params(&cryptoParams, &cryptoParams, &cryptoParams);
 	}
 }
+/* the cache is read asynchronously when a Hello arrives, the retained secrets still match on the second exchange */
+static void test_async_cache_read(void) {
+#ifdef ZIDCACHE_ENABLED
+	sqlite3 *aliceDB=NULL;
+	sqlite3 *bobDB=NULL;
+	char *aliceTesterFile = bc_tester_file("tmpZIDAlice_asyncCacheRead.sqlite");
+	char *bobTesterFile = bc_tester_file("tmpZIDBob_asyncCacheRead.sqlite");
+
+	resetGlobalParams();
+	asyncCacheRead = 1;
+
+	remove(aliceTesterFile);
+	remove(bobTesterFile);
+	bzrtptester_sqlite3_open(aliceTesterFile, &aliceDB);
+	bzrtptester_sqlite3_open(bobTesterFile, &bobDB);
+
+	/* the main channels read the cache, secondary ones are in multistream mode and do not */
+	BC_ASSERT_EQUAL(multichannel_exchange(NULL, NULL, defaultCryptoAlgoSelection(), aliceDB, "alice@sip.linphone.org", bobDB, "bob@sip.linphone.org"), 0, int, "%x");
+	BC_ASSERT_EQUAL(cacheReadsServed, 2, int, "%d");
+
+	/* second exchange finds the retained secrets: no cache mismatch */
+	cacheReadsServed = 0;
+	BC_ASSERT_EQUAL(multichannel_exchange(NULL, NULL, defaultCryptoAlgoSelection(), aliceDB, "alice@sip.linphone.org", bobDB, "bob@sip.linphone.org"), 0, int, "%x");
+	BC_ASSERT_EQUAL(cacheReadsServed, 2, int, "%d");
+
+	/* with lost packets */
+	loosePacketPercentage = 20;
+	BC_ASSERT_EQUAL(multichannel_exchange(NULL, NULL, defaultCryptoAlgoSelection(), aliceDB, "alice@sip.linphone.org", bobDB, "bob@sip.linphone.org"), 0, int, "%x");
+	resetGlobalParams();
+
+	sqlite3_close(aliceDB);
+	sqlite3_close(bobDB);
+	remove(aliceTesterFile);
+	remove(bobTesterFile);
+	bc_free(aliceTesterFile);
+	bc_free(bobTesterFile);
+#else /* ZIDCACHE_ENABLED */
+	bctbx_warning("Test skipped as ZID cache is disabled\n");
+#endif /* ZIDCACHE_ENABLED */
+}
+
 /* first perform an exchange to establish a correct shared cache, then modify one of them and perform an other exchange to check we have a cache mismatch warning */
 static void test_cache_mismatch_exchange(void) {
 #ifdef ZIDCACHE_ENABLED
@@ -1571,7 +1881,7 @@ static int test_auxiliary_secret_params(uint8_t *aliceAuxSecret, size_t aliceAux
 		int i;
 		/* check the message queue */
 		for (i=0; i<aliceQueueIndex; i++) {
-			retval = bzrtp_processMessage(Alice.bzrtpContext, aliceSSRC, aliceQueue[i].packetString, aliceQueue[i].packetLength);
+			retval = processMessage(Alice.bzrtpContext, aliceSSRC, aliceQueue[i].packetString, aliceQueue[i].packetLength);
 			//bzrtp_message("%ld Alice processed a %.8s and returns %x\n", msSTC, (aliceQueue[i].packetString)+16, retval);
 			memset(aliceQueue[i].packetString, 0, MAX_PACKET_LENGTH); /* destroy the packet after sending it to the ZRTP engine */
 			lastPacketSentTime=getSimulatedTime();
@@ -1579,7 +1889,7 @@ static int test_auxiliary_secret_params(uint8_t *aliceAuxSecret, size_t aliceAux
 		aliceQueueIndex = 0;
 
 		for (i=0; i<bobQueueIndex; i++) {
-			retval = bzrtp_processMessage(Bob.bzrtpContext, bobSSRC, bobQueue[i].packetString, bobQueue[i].packetLength);
+			retval = processMessage(Bob.bzrtpContext, bobSSRC, bobQueue[i].packetString, bobQueue[i].packetLength);
 			//bzrtp_message("%ld Bob processed a %.8s and returns %x\n",msSTC, (bobQueue[i].packetString)+16, retval);
 			memset(bobQueue[i].packetString, 0, MAX_PACKET_LENGTH); /* destroy the packet after sending it to the ZRTP engine */
 			lastPacketSentTime=getSimulatedTime();
@@ -2050,11 +2360,13 @@ static int processMessageQueues(bzrtpContext_t *aliceContext, uint32_t aliceSSRC
 		bobQueueIndex = 0;
 
 		/* send the actual time to the zrtpContext for each zrtpChannelContext */
-		for(int i = 0 ; i < MAX_NUM_CHANNEL ; i++){
+		for(int i = 0 ; i < aliceContext->channelContextSize ; i++){
 			if(aliceContext->channelContext[i] != NULL){
 				retval = bzrtp_iterate(aliceContext, aliceContext->channelContext[i]->selfSSRC, getSimulatedTime());
 				//printf("retval = %d\n", retval);
 			}
+		}
+		for(int i = 0 ; i < bobContext->channelContextSize ; i++){
 			if(bobContext->channelContext[i] != NULL){
 				retval = bzrtp_iterate(bobContext, bobContext->channelContext[i]->selfSSRC, getSimulatedTime());
 				//printf("retval = %d\n", retval);
@@ -2085,14 +2397,15 @@ static int processMessageQueues(bzrtpContext_t *aliceContext, uint32_t aliceSSRC
  * @param aliceSSRC	SSRC identifing the channel of Alice
  * @param Bob		Second clientContext to init
  * @param bobSSRC	SSRC identifying the channel of Bob
+ * @param cryptoParams	crypto algorithms used by both parties on a main channel, default ones when NULL
  * @return
  */
-static int goToSecureMode(clientContext_t *Alice, uint32_t aliceSSRC, uint8_t aliceAcceptGoClear, clientContext_t *Bob, uint32_t bobSSRC, uint8_t bobAcceptGoClear, uint8_t isMain){
+static int goToSecureMode_params(clientContext_t *Alice, uint32_t aliceSSRC, uint8_t aliceAcceptGoClear, clientContext_t *Bob, uint32_t bobSSRC, uint8_t bobAcceptGoClear, uint8_t isMain, cryptoParams_t *cryptoParams){
 	int retval = 0;
 
 	if (isMain) {
 		/*** Create the main channel */
-		if ((retval=setUpClientContext(Alice, ALICE, aliceSSRC, NULL, NULL, NULL, NULL, NULL))!=0) {
+		if ((retval=setUpClientContext(Alice, ALICE, aliceSSRC, NULL, NULL, NULL, NULL, cryptoParams))!=0) {
 			bzrtp_message("ERROR: can't init setup client context id %d\n", ALICE);
 			BC_ASSERT_EQUAL(retval, 0, uint32_t, "0x%08x");
 			return retval;
@@ -2100,7 +2413,7 @@ static int goToSecureMode(clientContext_t *Alice, uint32_t aliceSSRC, uint8_t al
 
 		bzrtp_setFlags(Alice->bzrtpContext, BZRTP_SELF_ACCEPT_GOCLEAR, aliceAcceptGoClear);
 
-		if ((retval=setUpClientContext(Bob, BOB, bobSSRC, NULL, NULL, NULL, NULL, NULL))!=0) {
+		if ((retval=setUpClientContext(Bob, BOB, bobSSRC, NULL, NULL, NULL, NULL, cryptoParams))!=0) {
 			bzrtp_message("ERROR: can't init setup client context id %d\n", BOB);
 			BC_ASSERT_EQUAL(retval, 0, uint32_t, "0x%08x");
 			return retval;
@@ -2159,14 +2472,18 @@ static int goToSecureMode(clientContext_t *Alice, uint32_t aliceSSRC, uint8_t al
 	return 0;
 }
 
-static int goclear_singleChannel(void){
+static int goToSecureMode(clientContext_t *Alice, uint32_t aliceSSRC, uint8_t aliceAcceptGoClear, clientContext_t *Bob, uint32_t bobSSRC, uint8_t bobAcceptGoClear, uint8_t isMain){
+	return goToSecureMode_params(Alice, aliceSSRC, aliceAcceptGoClear, Bob, bobSSRC, bobAcceptGoClear, isMain, NULL);
+}
+
+static int goclear_singleChannel_params(BCTBX_UNUSED(cryptoParams_t *cryptoParams)){
 #ifdef GOCLEAR_ENABLED
 	int retval;
 	clientContext_t Alice,Bob;
 	uint32_t aliceSSRC = ALICE_SSRC_BASE;
 	uint32_t bobSSRC = BOB_SSRC_BASE;
 
-	if(goToSecureMode(&Alice, aliceSSRC, 1, &Bob, bobSSRC, 1, 1)){
+	if(goToSecureMode_params(&Alice, aliceSSRC, 1, &Bob, bobSSRC, 1, 1, cryptoParams)){
 		return 1;
 	}
 
@@ -2195,6 +2512,8 @@ static int goclear_singleChannel(void){
 		BC_ASSERT_EQUAL(retval, BZRTP_CHANNEL_CLEAR, int, "%0x");
 		return 1;
 	}
+	BC_ASSERT_EQUAL(Alice.channelStatus, BZRTP_CHANNEL_CLEAR, int, "%0x");
+	BC_ASSERT_EQUAL(Bob.channelStatus, BZRTP_CHANNEL_CLEAR, int, "%0x");
 
 	/* Back to secure mode */
 	bzrtp_backToSecureMode(Alice.bzrtpContext, aliceSSRC);
@@ -2232,6 +2551,10 @@ static int goclear_singleChannel(void){
 	return 0;
 }
 
+static int goclear_singleChannel(void){
+	return goclear_singleChannel_params(NULL);
+}
+
 static int goclear_multiChannel(void){
 #ifdef GOCLEAR_ENABLED
 	int retval;
@@ -2282,7 +2605,7 @@ static int goclear_multiChannel(void){
 	bzrtp_confirmGoClear(Bob.bzrtpContext, bobSSRC_channel1);
 
 	/* Check all channels are in clear state */
-	for(int i = 0 ; i < MAX_NUM_CHANNEL ; i++){
+	for(int i = 0 ; i < Alice.bzrtpContext->channelContextSize && i < Bob.bzrtpContext->channelContextSize ; i++){
 		if(Alice.bzrtpContext->channelContext[i] != NULL && Bob.bzrtpContext->channelContext[i] != NULL){
 			if ((retval=bzrtp_getChannelStatus(Alice.bzrtpContext, Alice.bzrtpContext->channelContext[i]->selfSSRC))!=BZRTP_CHANNEL_CLEAR) {
 				BC_ASSERT_EQUAL(retval, BZRTP_CHANNEL_CLEAR, int, "%0x");
@@ -2495,6 +2818,112 @@ static void test_loosy_network_goclear_multiChannel(void) {
 #endif /* GOCLEAR_ENABLED */
 }
 
+static int keyAgreementAvailable(uint8_t keyAgreement) {
+	uint8_t availableTypes[256];
+	uint8_t availableTypesCount = bzrtp_available_key_agreement(availableTypes);
+	int i;
+
+	for (i=0; i<availableTypesCount; i++) {
+		if (availableTypes[i] == keyAgreement) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* count the key pairs a context kept aside: prepared for a role or pooled for a later key exchange */
+static int pendingKeyPairs(bzrtpContext_t *zrtpContext, uint8_t keyAgreementAlgo) {
+	int i, count = 0;
+
+	for (i=0; i<KEYPAIR_POOL_CAPACITY; i++) {
+		if (zrtpContext->keyPairPool[i].context != NULL) {
+			BC_ASSERT_EQUAL(zrtpContext->keyPairPool[i].algo, keyAgreementAlgo, int, "%d");
+			count++;
+		}
+	}
+	BC_ASSERT_PTR_NULL(zrtpContext->preparedKeyAgreement[BZRTP_ROLE_INITIATOR].context);
+	BC_ASSERT_PTR_NULL(zrtpContext->preparedKeyAgreement[BZRTP_ROLE_RESPONDER].context);
+	return count;
+}
+
+/* key pairs are prepared, used and recycled by the state machine: once secure, none is left prepared and
+ * only an undisclosed KEM initiator key pair - prepared on Hello by the party which ended responder - may be pooled */
+static void test_key_agreement_contexts(void) {
+	cryptoParams_t params[] = {
+		{{ZRTP_CIPHER_AES1},1,{ZRTP_HASH_S256},1,{ZRTP_KEYAGREEMENT_DH3k},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS32},1,0},
+		{{ZRTP_CIPHER_AES1},1,{ZRTP_HASH_S256},1,{ZRTP_KEYAGREEMENT_X255},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS32},1,0},
+		{{ZRTP_CIPHER_AES1},1,{ZRTP_HASH_S256},1,{ZRTP_KEYAGREEMENT_KYB1},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS32},1,0},
+	};
+	size_t i;
+
+	for (i=0; i<sizeof(params)/sizeof(params[0]); i++) {
+		clientContext_t Alice,Bob;
+		uint32_t aliceSSRC = ALICE_SSRC_BASE;
+		uint32_t bobSSRC = BOB_SSRC_BASE;
+		uint8_t keyAgreementAlgo = params[i].keyAgreement[0];
+		int pooled;
+
+		if (keyAgreementAvailable(keyAgreementAlgo) == 0) {
+			continue;
+		}
+		resetGlobalParams();
+		if (goToSecureMode_params(&Alice, aliceSSRC, 1, &Bob, bobSSRC, 1, 1, &params[i]) == 0) {
+			pooled = pendingKeyPairs(Alice.bzrtpContext, keyAgreementAlgo) + pendingKeyPairs(Bob.bzrtpContext, keyAgreementAlgo);
+			if (keyAgreementAlgo == ZRTP_KEYAGREEMENT_KYB1) {
+				/* none when both parties sent a Commit: the loser's key pair was disclosed */
+				BC_ASSERT_TRUE(pooled <= 1);
+			} else {
+				/* each party generates only the key pair of the role it plays */
+				BC_ASSERT_EQUAL(pooled, 0, int, "%d");
+			}
+		}
+		bzrtp_destroyBzrtpContext(Alice.bzrtpContext, aliceSSRC);
+		bzrtp_destroyBzrtpContext(Bob.bzrtpContext, bobSSRC);
+	}
+}
+
+/* wait for the reserve background refill, in real time */
+static int waitReservedKeyPairs(uint8_t keyAgreementAlgo, int count) {
+	int i;
+	for (i=0; i<500 && bzrtp_getReservedKeyPairsCount(keyAgreementAlgo, ZRTP_CIPHER_AES1) != count; i++) {
+		bctbx_sleep_ms(10);
+	}
+	return bzrtp_getReservedKeyPairsCount(keyAgreementAlgo, ZRTP_CIPHER_AES1);
+}
+
+/* a key pair from the process wide reserve agrees with the peer's one, generated on the spot or by the refill, and is used only once */
+static void test_key_pairs_reserve(void) {
+	cryptoParams_t params[] = {
+		{{ZRTP_CIPHER_AES1},1,{ZRTP_HASH_S256},1,{ZRTP_KEYAGREEMENT_DH3k},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS32},1,0},
+		{{ZRTP_CIPHER_AES1},1,{ZRTP_HASH_S256},1,{ZRTP_KEYAGREEMENT_X255},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS32},1,0},
+	};
+	size_t i;
+
+	for (i=0; i<sizeof(params)/sizeof(params[0]); i++) {
+		uint8_t keyAgreementAlgo = params[i].keyAgreement[0];
+
+		if (keyAgreementAvailable(keyAgreementAlgo) == 0) {
+			continue;
+		}
+		resetGlobalParams();
+		bzrtp_clearKeyPairReserve();
+		BC_ASSERT_EQUAL(bzrtp_reserveKeyPairs(keyAgreementAlgo, ZRTP_CIPHER_AES1, 2), 2, int, "%d");
+		BC_ASSERT_EQUAL(bzrtp_getReservedKeyPairsCount(keyAgreementAlgo, ZRTP_CIPHER_AES1), 2, int, "%d");
+		BC_ASSERT_EQUAL(monochannel_exchange(&params[i], &params[i], &params[i], NULL, NULL, NULL, NULL), 0, int, "%x");
+
+		/* the key pairs used are replaced in background */
+		BC_ASSERT_EQUAL(waitReservedKeyPairs(keyAgreementAlgo, 2), 2, int, "%d");
+		BC_ASSERT_EQUAL(monochannel_exchange(&params[i], &params[i], &params[i], NULL, NULL, NULL, NULL), 0, int, "%x");
+		BC_ASSERT_EQUAL(waitReservedKeyPairs(keyAgreementAlgo, 2), 2, int, "%d");
+
+		/* clearing stops the refill: the exchange generates its key pairs and the reserve stays empty */
+		bzrtp_clearKeyPairReserve();
+		BC_ASSERT_EQUAL(bzrtp_getReservedKeyPairsCount(keyAgreementAlgo, ZRTP_CIPHER_AES1), 0, int, "%d");
+		BC_ASSERT_EQUAL(monochannel_exchange(&params[i], &params[i], &params[i], NULL, NULL, NULL, NULL), 0, int, "%x");
+		BC_ASSERT_EQUAL(bzrtp_getReservedKeyPairsCount(keyAgreementAlgo, ZRTP_CIPHER_AES1), 0, int, "%d");
+	}
+}
+
 static test_t key_exchange_tests[] = {
 	TEST_NO_TAG("Cacheless multi channel", test_cacheless_exchange),
 	TEST_NO_TAG("Config contraints", test_config_contraints),
@@ -2506,7 +2935,14 @@ static test_t key_exchange_tests[] = {
 	TEST_NO_TAG("Cached PVS", test_cache_sas_not_confirmed),
 	TEST_NO_TAG("Auxiliary Secret", test_auxiliary_secret),
 	TEST_NO_TAG("Abort and retry", test_abort_retry),
+	TEST_NO_TAG("Key agreement contexts", test_key_agreement_contexts),
+	TEST_NO_TAG("Key pairs reserve", test_key_pairs_reserve),
 	TEST_NO_TAG("Active flag", test_active_flag),
+	TEST_NO_TAG("Discovery budget", test_discovery_budget),
+	TEST_NO_TAG("Channel table", test_channel_table),
+	TEST_NO_TAG("Transport buffers", test_transport_buffers),
+	TEST_NO_TAG("Receive buffers transfer", test_receive_buffers_transfer),
+	TEST_NO_TAG("Async cache read", test_async_cache_read),
 	TEST_NO_TAG("Cache concurrent access", test_cache_concurrent_access),
 	TEST_NO_TAG("Go Clear Single channel", test_goclear_singleChannel),
 	TEST_NO_TAG("Go Clear Single channel Bob doesnt accept", test_goclear_singleChannel_BobDoesntAccept),
@@ -2527,3 +2963,306 @@ test_suite_t key_exchange_test_suite = {
 	key_exchange_tests,
 	0
 };
+
+/* Allocation budget: canonical exchanges run under the counting allocator and their
+ * allocations are checked against the upper bounds kept in allocationBudgets.txt */
+#define ALLOCATION_BUDGETS_FILE "allocationBudgets.txt"
+#define ALLOCATION_BUDGETS_VERSION 1
+#define ALLOCATION_BUDGETS_MAX 64
+#define ALLOCATION_BUDGETS_HEADROOM 20 /* recorded budgets are the measure plus 1/20th */
+
+int recordAllocationBudgets = 0;
+
+typedef struct allocationBudget_struct {
+	char scenario[32];
+	char keyAgreement[32];
+	uint64_t allocations; /**< maximum number of allocations for one handshake */
+	uint64_t peakBytes; /**< maximum peak of allocated bytes during one handshake */
+} allocationBudget_t;
+
+static allocationBudget_t allocationBudgets[ALLOCATION_BUDGETS_MAX];
+static int allocationBudgetsCount = 0;
+
+typedef struct allocationBudgetFamily_struct {
+	const char *name; /**< key agreement name as found in the budgets file */
+	cryptoParams_t cryptoParams;
+} allocationBudgetFamily_t;
+
+static allocationBudgetFamily_t allocationBudgetFamilies[] = {
+	{"DH2k", {{ZRTP_CIPHER_AES1},1,{ZRTP_HASH_S256},1,{ZRTP_KEYAGREEMENT_DH2k},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS32},1,0}},
+	{"DH3k", {{ZRTP_CIPHER_AES1},1,{ZRTP_HASH_S256},1,{ZRTP_KEYAGREEMENT_DH3k},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS32},1,0}},
+	{"X255", {{ZRTP_CIPHER_AES1},1,{ZRTP_HASH_S256},1,{ZRTP_KEYAGREEMENT_X255},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS80},1,0}},
+	{"X448", {{ZRTP_CIPHER_AES3},1,{ZRTP_HASH_S384},1,{ZRTP_KEYAGREEMENT_X448},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS80},1,0}},
+	{"K255_KYB512", {{ZRTP_CIPHER_AES3},1,{ZRTP_HASH_S512},1,{ZRTP_KEYAGREEMENT_K255_KYB512},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS80},1,0}},
+	{"K448_KYB1024_HQC256", {{ZRTP_CIPHER_AES3},1,{ZRTP_HASH_S512},1,{ZRTP_KEYAGREEMENT_K448_KYB1024_HQC256},1,{ZRTP_SAS_B32},1,{ZRTP_AUTHTAG_HS80},1,0}},
+};
+
+static allocationBudget_t *findAllocationBudget(const char *scenario, const char *keyAgreement) {
+	int i;
+	for (i=0; i<allocationBudgetsCount; i++) {
+		if (strcmp(allocationBudgets[i].scenario, scenario) == 0 && strcmp(allocationBudgets[i].keyAgreement, keyAgreement) == 0) {
+			return &allocationBudgets[i];
+		}
+	}
+	return NULL;
+}
+
+static int allocation_budget_before_all(void) {
+	char *budgetsFile = bc_tester_res(ALLOCATION_BUDGETS_FILE);
+	FILE *fp = NULL;
+	char line[256];
+	int version = 0;
+
+	allocationBudgetsCount = 0;
+	if (budgetsFile != NULL) {
+		fp = fopen(budgetsFile, "r");
+		bc_free(budgetsFile);
+	}
+	if (fp == NULL) {
+		bzrtp_message("Error: unable to find %s file. Did you set correctly the --resource-dir argument?", ALLOCATION_BUDGETS_FILE);
+		return recordAllocationBudgets?0:-1;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		allocationBudget_t *budget = &allocationBudgets[allocationBudgetsCount];
+		unsigned long long allocations = 0, peakBytes = 0;
+
+		if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+			continue;
+		}
+		if (version == 0) { /* first line holds the file format version */
+			if (sscanf(line, "version %d", &version) != 1 || version != ALLOCATION_BUDGETS_VERSION) {
+				bzrtp_message("Error: %s has an unsupported format version", ALLOCATION_BUDGETS_FILE);
+				fclose(fp);
+				return -1;
+			}
+			continue;
+		}
+		if (allocationBudgetsCount == ALLOCATION_BUDGETS_MAX) {
+			bzrtp_message("Error: %s holds more than %d budgets", ALLOCATION_BUDGETS_FILE, ALLOCATION_BUDGETS_MAX);
+			break;
+		}
+		if (sscanf(line, "%31s %31s %llu %llu", budget->scenario, budget->keyAgreement, &allocations, &peakBytes) == 4) {
+			budget->allocations = allocations;
+			budget->peakBytes = peakBytes;
+			allocationBudgetsCount++;
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+static int allocation_budget_after_all(void) {
+	char *budgetsFile = NULL;
+	FILE *fp = NULL;
+	int i;
+
+	if (recordAllocationBudgets == 0) {
+		return 0;
+	}
+
+	/* written in the writable dir, to be reviewed and copied over the one in the sources */
+	budgetsFile = bc_tester_file(ALLOCATION_BUDGETS_FILE);
+	fp = fopen(budgetsFile, "w");
+	if (fp == NULL) {
+		bzrtp_message("Error: unable to write allocation budgets to %s", budgetsFile);
+		bc_free(budgetsFile);
+		return -1;
+	}
+	fprintf(fp, "# Allocation budgets, checked by the \"Allocation budget\" suite of bzrtp-allocation-tester.\n");
+	fprintf(fp, "# Upper bounds, for one handshake between Alice and Bob, on the number of allocations\n");
+	fprintf(fp, "# and on the peak of allocated bytes. A missing or zero budget fails the suite.\n");
+	fprintf(fp, "# Regenerate with: bzrtp-allocation-tester --record-allocation-budgets\n");
+	fprintf(fp, "version %d\n", ALLOCATION_BUDGETS_VERSION);
+	fprintf(fp, "# scenario\tkey agreement\tallocations\tpeak bytes\n");
+	for (i=0; i<allocationBudgetsCount; i++) {
+		fprintf(fp, "%s\t%s\t%llu\t%llu\n", allocationBudgets[i].scenario, allocationBudgets[i].keyAgreement, (unsigned long long)allocationBudgets[i].allocations, (unsigned long long)allocationBudgets[i].peakBytes);
+	}
+	fclose(fp);
+	bzrtp_message("Allocation budgets written to %s", budgetsFile);
+	bc_free(budgetsFile);
+	return 0;
+}
+
+static void checkAllocationBudget(const char *scenario, const char *keyAgreement, bzrtptesterAllocationStats_t *stats) {
+	allocationBudget_t *budget = findAllocationBudget(scenario, keyAgreement);
+
+	bzrtp_message("Allocation budget %s %s: %llu allocations, %llu peak bytes", scenario, keyAgreement, (unsigned long long)stats->allocations, (unsigned long long)stats->peakBytes);
+
+	if (recordAllocationBudgets) {
+		if (budget == NULL) {
+			if (allocationBudgetsCount == ALLOCATION_BUDGETS_MAX) {
+				BC_FAIL("too many allocation budgets");
+				return;
+			}
+			budget = &allocationBudgets[allocationBudgetsCount++];
+			snprintf(budget->scenario, sizeof(budget->scenario), "%s", scenario);
+			snprintf(budget->keyAgreement, sizeof(budget->keyAgreement), "%s", keyAgreement);
+		}
+		budget->allocations = stats->allocations + stats->allocations/ALLOCATION_BUDGETS_HEADROOM;
+		budget->peakBytes = stats->peakBytes + stats->peakBytes/ALLOCATION_BUDGETS_HEADROOM;
+		return;
+	}
+
+	if (budget == NULL || budget->allocations == 0 || budget->peakBytes == 0) {
+		bzrtp_message("Error: no allocation budget for %s %s in %s, record it with --record-allocation-budgets", scenario, keyAgreement, ALLOCATION_BUDGETS_FILE);
+		BC_FAIL("missing allocation budget");
+		return;
+	}
+	if (stats->allocations > budget->allocations) {
+		bzrtp_message("Error: %s %s handshake made %llu allocations, budget is %llu", scenario, keyAgreement, (unsigned long long)stats->allocations, (unsigned long long)budget->allocations);
+		BC_FAIL("allocations over budget");
+	}
+	if (stats->peakBytes > budget->peakBytes) {
+		bzrtp_message("Error: %s %s handshake peaked at %llu allocated bytes, budget is %llu", scenario, keyAgreement, (unsigned long long)stats->peakBytes, (unsigned long long)budget->peakBytes);
+		BC_FAIL("peak allocated bytes over budget");
+	}
+}
+
+/* budgets are recorded at default log level: logs formatting allocates too */
+static int allocationBudgetCheckable(void) {
+	if (bzrtptester_allocation_counter_available() == 0) {
+		bctbx_warning("Test skipped as the allocation counter is not available on this platform");
+		return 0;
+	}
+	if (verbose) {
+		bctbx_warning("Test skipped in verbose mode");
+		return 0;
+	}
+	return 1;
+}
+
+#define ALLOCATION_SCENARIO_MONOCHANNEL 0
+#define ALLOCATION_SCENARIO_MULTICHANNEL 1
+#define ALLOCATION_SCENARIO_MTU 2
+#define ALLOCATION_SCENARIO_CACHE 3
+#define ALLOCATION_SCENARIO_GOCLEAR 4
+
+static const char *allocationScenarioNames[] = {"monochannel", "multichannel", "mtu", "cache", "goclear"};
+
+/* run one handshake of the given scenario with every available key agreement family */
+static void test_allocation_budget_scenario(int scenario) {
+	size_t i;
+
+	if (allocationBudgetCheckable() == 0) {
+		return;
+	}
+
+	for (i=0; i<sizeof(allocationBudgetFamilies)/sizeof(allocationBudgetFamilies[0]); i++) {
+		allocationBudgetFamily_t *family = &allocationBudgetFamilies[i];
+		cryptoParams_t *params = &family->cryptoParams;
+		bzrtptesterAllocationStats_t stats = {0, 0, 0};
+		int retval = 0;
+#ifdef ZIDCACHE_ENABLED
+		sqlite3 *aliceDB=NULL;
+		sqlite3 *bobDB=NULL;
+		char *aliceTesterFile = NULL;
+		char *bobTesterFile = NULL;
+#endif /* ZIDCACHE_ENABLED */
+
+		if (keyAgreementAvailable(params->keyAgreement[0]) == 0) {
+			continue;
+		}
+		resetGlobalParams();
+
+		switch (scenario) {
+			case ALLOCATION_SCENARIO_MONOCHANNEL:
+				bzrtptester_allocation_counter_start();
+				retval = monochannel_exchange(params, params, params, NULL, NULL, NULL, NULL);
+				bzrtptester_allocation_counter_stop(&stats);
+				break;
+			case ALLOCATION_SCENARIO_MULTICHANNEL:
+				bzrtptester_allocation_counter_start();
+				retval = multichannel_exchange(params, params, params, NULL, NULL, NULL, NULL);
+				bzrtptester_allocation_counter_stop(&stats);
+				break;
+			case ALLOCATION_SCENARIO_MTU:
+				bzrtptester_allocation_counter_start();
+				retval = multichannel_exchange_mtu(params, params, params, 800);
+				bzrtptester_allocation_counter_stop(&stats);
+				break;
+			case ALLOCATION_SCENARIO_CACHE:
+#ifdef ZIDCACHE_ENABLED
+				aliceTesterFile = bc_tester_file("tmpZIDAlice_allocationBudget.sqlite");
+				bobTesterFile = bc_tester_file("tmpZIDBob_allocationBudget.sqlite");
+				remove(aliceTesterFile);
+				remove(bobTesterFile);
+				bzrtptester_sqlite3_open(aliceTesterFile, &aliceDB);
+				bzrtptester_sqlite3_open(bobTesterFile, &bobDB);
+				/* first exchange fills the caches, the second one measured finds the retained secrets */
+				retval = multichannel_exchange(params, params, params, aliceDB, "alice@sip.linphone.org", bobDB, "bob@sip.linphone.org");
+				if (retval == 0) {
+					bzrtptester_allocation_counter_start();
+					retval = multichannel_exchange(params, params, params, aliceDB, "alice@sip.linphone.org", bobDB, "bob@sip.linphone.org");
+					bzrtptester_allocation_counter_stop(&stats);
+				}
+				sqlite3_close(aliceDB);
+				sqlite3_close(bobDB);
+				remove(aliceTesterFile);
+				remove(bobTesterFile);
+				bc_free(aliceTesterFile);
+				bc_free(bobTesterFile);
+#else /* ZIDCACHE_ENABLED */
+				bctbx_warning("Test skipped as ZID cache is disabled");
+				return;
+#endif /* ZIDCACHE_ENABLED */
+				break;
+			case ALLOCATION_SCENARIO_GOCLEAR:
+#ifdef GOCLEAR_ENABLED
+				bzrtptester_allocation_counter_start();
+				retval = goclear_singleChannel_params(params);
+				bzrtptester_allocation_counter_stop(&stats);
+#else /* GOCLEAR_ENABLED */
+				bctbx_warning("Test skipped as GoClear feature is disabled");
+				return;
+#endif /* GOCLEAR_ENABLED */
+				break;
+			default:
+				return;
+		}
+
+		BC_ASSERT_EQUAL(retval, 0, int, "%x");
+		if (retval == 0) {
+			checkAllocationBudget(allocationScenarioNames[scenario], family->name, &stats);
+		}
+	}
+}
+
+static void test_allocation_budget_monochannel(void) {
+	test_allocation_budget_scenario(ALLOCATION_SCENARIO_MONOCHANNEL);
+}
+
+static void test_allocation_budget_multichannel(void) {
+	test_allocation_budget_scenario(ALLOCATION_SCENARIO_MULTICHANNEL);
+}
+
+static void test_allocation_budget_mtu(void) {
+	test_allocation_budget_scenario(ALLOCATION_SCENARIO_MTU);
+}
+
+static void test_allocation_budget_cache(void) {
+	test_allocation_budget_scenario(ALLOCATION_SCENARIO_CACHE);
+}
+
+static void test_allocation_budget_goclear(void) {
+	test_allocation_budget_scenario(ALLOCATION_SCENARIO_GOCLEAR);
+}
+
+static test_t allocation_budget_tests[] = {
+	TEST_NO_TAG("Mono channel", test_allocation_budget_monochannel),
+	TEST_NO_TAG("Multi channel", test_allocation_budget_multichannel),
+	TEST_NO_TAG("Packet Fragmentation", test_allocation_budget_mtu),
+	TEST_NO_TAG("Cached", test_allocation_budget_cache),
+	TEST_NO_TAG("Go Clear cycle", test_allocation_budget_goclear),
+};
+
+test_suite_t allocation_budget_test_suite = {
+	"Allocation budget",
+	allocation_budget_before_all,
+	allocation_budget_after_all,
+	NULL,
+	NULL,
+	sizeof(allocation_budget_tests) / sizeof(allocation_budget_tests[0]),
+	allocation_budget_tests,
+	0
+};
@@ -177,11 +177,11 @@ static int testAlgoType(uint8_t algoType, uint8_t *packetTypes, uint8_t packetTy
 
 	helloPacket = bzrtp_createZrtpPacket(zrtpContext, zrtpContext->channelContext[0], MSGTYPE_HELLO, &retval);
 	if (packetTypes != NULL) {
-		bzrtpHelloMessage_t *helloMessage = (bzrtpHelloMessage_t *)helloPacket->messageData;
+		bzrtpHelloMessage_t *helloMessage = &helloPacket->message.hello;
 		setHelloMessageAlgo(helloMessage, algoType, packetTypes, packetTypesCount);
 	}
 
-	BC_ASSERT_FALSE(bzrtp_cryptoAlgoAgreement(zrtpContext, zrtpContext->channelContext[0], static_cast<bzrtpHelloMessage_t*>(helloPacket->messageData)));
+	BC_ASSERT_FALSE(bzrtp_cryptoAlgoAgreement(zrtpContext, zrtpContext->channelContext[0], &helloPacket->message.hello));
 	retval = compareAllAlgoTypesWithExpectedChangedOnly(zrtpContext->channelContext[0], algoType, expectedType);
 
 	bzrtp_freeZrtpPacket(helloPacket);
@@ -545,6 +545,44 @@ struct st_add_crypto {
 	uint8_t expectedTypesCount;
 };
 
+static void test_cryptoProfile(void) {
+	uint8_t keyAgreement[7] = {ZRTP_KEYAGREEMENT_DH2k};
+	uint8_t expectedKeyAgreement[7] = {ZRTP_KEYAGREEMENT_DH2k, ZRTP_KEYAGREEMENT_DH3k, ZRTP_KEYAGREEMENT_Mult};
+	uint8_t compareTypes[7];
+	uint8_t compareTypesCount;
+
+	bzrtpCryptoProfile_t *profile = bzrtp_createCryptoProfile();
+	BC_ASSERT_EQUAL(bzrtp_setCryptoProfileSupportedTypes(profile, ZRTP_KEYAGREEMENT_TYPE, keyAgreement, 1), 0, int, "%x");
+
+	/* contexts created with the profile get its lists and hold a reference on it */
+	bzrtpContext_t *alice = bzrtp_createBzrtpContextWithProfile(profile);
+	bzrtpContext_t *bob = bzrtp_createBzrtpContextWithProfile(profile);
+	BC_ASSERT_EQUAL(profile->refCount, 3, int, "%d");
+	compareTypesCount = bzrtp_getSupportedCryptoTypes(alice, ZRTP_KEYAGREEMENT_TYPE, compareTypes);
+	BC_ASSERT_TRUE(compareAlgoTypes(compareTypes, compareTypesCount, expectedKeyAgreement, 3));
+	compareTypesCount = bzrtp_getSupportedCryptoTypes(bob, ZRTP_KEYAGREEMENT_TYPE, compareTypes);
+	BC_ASSERT_TRUE(compareAlgoTypes(compareTypes, compareTypesCount, expectedKeyAgreement, 3));
+
+	/* the profile is now immutable and lives as long as contexts use it */
+	BC_ASSERT_EQUAL(bzrtp_setCryptoProfileSupportedTypes(profile, ZRTP_KEYAGREEMENT_TYPE, keyAgreement, 1), BZRTP_ERROR_CONTEXTNOTREADY, int, "%x");
+	bzrtp_cryptoProfileUnref(profile);
+	BC_ASSERT_EQUAL(profile->refCount, 2, int, "%d");
+
+	/* a context setting its own lists releases the profile */
+	keyAgreement[0] = ZRTP_KEYAGREEMENT_DH3k;
+	BC_ASSERT_EQUAL(bzrtp_setSupportedCryptoTypes(bob, ZRTP_KEYAGREEMENT_TYPE, keyAgreement, 1), 0, int, "%x");
+	BC_ASSERT_TRUE(bob->cryptoProfile == NULL);
+	BC_ASSERT_EQUAL(profile->refCount, 1, int, "%d");
+	compareTypesCount = bzrtp_getSupportedCryptoTypes(bob, ZRTP_KEYAGREEMENT_TYPE, compareTypes);
+	BC_ASSERT_TRUE(compareAlgoTypes(compareTypes, compareTypesCount, expectedKeyAgreement+1, 2));
+
+	/* contexts are used as any other one */
+	BC_ASSERT_EQUAL(bzrtp_initBzrtpContext(alice, 0x12345678), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_initBzrtpContext(bob, 0x87654321), 0, int, "%x");
+	bzrtp_destroyBzrtpContext(bob, 0x87654321);
+	bzrtp_destroyBzrtpContext(alice, 0x12345678); /* last reference on the profile */
+}
+
 static void test_addMandatoryCryptoTypesIfNeeded(void) {
 	struct st_add_crypto crypto_types[] = {
 		/* mandatory types */
@@ -584,12 +622,75 @@ static void test_addMandatoryCryptoTypesIfNeeded(void) {
 	}
 }
 
+/* reserved key pairs are used by the key exchanges: see the "Key pairs reserve" key exchange test */
+static void test_keyPairReserve(void) {
+	bzrtp_clearKeyPairReserve();
+
+	/* KEM are not reserved */
+	BC_ASSERT_EQUAL(bzrtp_reserveKeyPairs(ZRTP_KEYAGREEMENT_KYB1, ZRTP_CIPHER_AES1, 1), 0, int, "%d");
+	/* DHM key pairs are reserved for a secret length, given by the cipher */
+	BC_ASSERT_EQUAL(bzrtp_reserveKeyPairs(ZRTP_KEYAGREEMENT_DH2k, ZRTP_CIPHER_AES3, 1), 1, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_reserveKeyPairs(ZRTP_KEYAGREEMENT_DH2k, ZRTP_CIPHER_AES1, 1), 1, int, "%d");
+	/* the reserve is bounded */
+	BC_ASSERT_EQUAL(bzrtp_reserveKeyPairs(ZRTP_KEYAGREEMENT_DH2k, ZRTP_CIPHER_AES1, KEYPAIR_RESERVE_CAPACITY), KEYPAIR_RESERVE_CAPACITY-2, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_reserveKeyPairs(ZRTP_KEYAGREEMENT_DH2k, ZRTP_CIPHER_AES1, 1), 0, int, "%d");
+
+	/* clearing empties it */
+	bzrtp_clearKeyPairReserve();
+	BC_ASSERT_EQUAL(bzrtp_reserveKeyPairs(ZRTP_KEYAGREEMENT_DH2k, ZRTP_CIPHER_AES1, 1), 1, int, "%d");
+	bzrtp_clearKeyPairReserve();
+}
+
+static void test_ECDHKeyPairsBatch(void) {
+	uint8_t keyAgreementAlgos[2] = {ZRTP_KEYAGREEMENT_X255, ZRTP_KEYAGREEMENT_X448};
+	uint8_t bctbxAlgos[2] = {BCTBX_ECDH_X25519, BCTBX_ECDH_X448};
+	bctbx_rng_context_t *RNGContext;
+	int i,j;
+
+	if (!bctbx_crypto_have_ecc()) {
+		bzrtp_message("Test skipped as ECDH is not available\n");
+		return;
+	}
+
+	RNGContext = bctbx_rng_context_new();
+	BC_ASSERT_EQUAL(bzrtp_createECDHKeyPairs(ZRTP_KEYAGREEMENT_DH3k, RNGContext, NULL, 4), 0, int, "%d");
+
+	for (i=0; i<2; i++) {
+		bctbx_ECDHContext_t *batch[4];
+
+		BC_ASSERT_EQUAL(bzrtp_createECDHKeyPairs(keyAgreementAlgos[i], RNGContext, batch, 4), 4, int, "%d");
+		for (j=0; j<4; j++) {
+			/* a key pair generated by the scalar path */
+			bctbx_ECDHContext_t *scalar = bctbx_CreateECDHContext(bctbxAlgos[i]);
+			bctbx_ECDHCreateKeyPair(scalar, (int (*)(void *, uint8_t *, size_t))bctbx_rng_get, RNGContext);
+
+			/* each batch key pair is distinct and agrees on the same secret with the scalar one */
+			BC_ASSERT_NOT_EQUAL(memcmp(batch[j]->selfPublic, batch[(j+1)%4]->selfPublic, scalar->pointCoordinateLength), 0, int, "%d");
+			batch[j]->peerPublic = (uint8_t *)malloc(scalar->pointCoordinateLength);
+			memcpy(batch[j]->peerPublic, scalar->selfPublic, scalar->pointCoordinateLength);
+			scalar->peerPublic = (uint8_t *)malloc(scalar->pointCoordinateLength);
+			memcpy(scalar->peerPublic, batch[j]->selfPublic, scalar->pointCoordinateLength);
+			bctbx_ECDHComputeSecret(batch[j], (int (*)(void *, uint8_t *, size_t))bctbx_rng_get, RNGContext);
+			bctbx_ECDHComputeSecret(scalar, (int (*)(void *, uint8_t *, size_t))bctbx_rng_get, RNGContext);
+			BC_ASSERT_EQUAL(memcmp(batch[j]->sharedSecret, scalar->sharedSecret, scalar->pointCoordinateLength), 0, int, "%d");
+			bctbx_DestroyECDHContext(scalar);
+		}
+		for (j=0; j<4; j++) {
+			bctbx_DestroyECDHContext(batch[j]);
+		}
+	}
+	bctbx_rng_context_free(RNGContext);
+}
+
 static test_t crypto_utils_tests[] = {
 	TEST_NO_TAG("zrtpKDF", test_zrtpKDF),
 	TEST_NO_TAG("CRC32", test_CRC32),
 	TEST_NO_TAG("algo agreement", test_algoAgreement),
 	TEST_NO_TAG("context algo setter and getter", test_algoSetterGetter),
-	TEST_NO_TAG("adding mandatory crypto algorithms if needed", test_addMandatoryCryptoTypesIfNeeded)
+	TEST_NO_TAG("shared crypto profile", test_cryptoProfile),
+	TEST_NO_TAG("adding mandatory crypto algorithms if needed", test_addMandatoryCryptoTypesIfNeeded),
+	TEST_NO_TAG("process wide key pairs reserve", test_keyPairReserve),
+	TEST_NO_TAG("batch ECDH key pairs generation", test_ECDHKeyPairsBatch),
 };
 
 test_suite_t crypto_utils_test_suite = {
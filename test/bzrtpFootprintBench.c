@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2014-2023 Belledonne Communications SARL.
+ *
+ * This file is part of bzrtp.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @brief Measure the footprint of idle secured channels and how it scales
+ *
+ * For each requested count N, N pairs of contexts are created and their handshakes completed, one pair
+ * after the other. Once all of them are secure the benchmark measures:
+ *  - the memory they use: heap in use (glibc mallinfo) and resident set size (Linux), per secured channel
+ *  - the cost of one tick of bzrtp_iterate over all the channels, as an application timer would do
+ *  - the time needed to destroy all the contexts
+ *
+ * It runs cacheless and, when the ZID cache is enabled, with each side of the pairs using a cache file.
+ * The output is CSV, one line per configuration and count, ready to be plotted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <bctoolbox/defs.h>
+#include <bctoolbox/logging.h>
+
+#ifdef ZIDCACHE_ENABLED
+#include <sqlite3.h>
+#endif /* ZIDCACHE_ENABLED */
+
+#include "bzrtp/bzrtp.h"
+
+#define FOOTPRINT_QUEUE_SIZE 16
+#define FOOTPRINT_PACKET_MAX_LENGTH 4096
+#define FOOTPRINT_HANDSHAKE_TIMEOUT 5000 /* in ms of virtual time */
+#define FOOTPRINT_TICK 10 /* virtual clock step, in ms */
+#define FOOTPRINT_MAX_COUNTS 16
+
+#define FOOTPRINT_LOCAL_FILE "bzrtp-footprint-local.sqlite"
+#define FOOTPRINT_REMOTE_FILE "bzrtp-footprint-remote.sqlite"
+
+/*** packets in flight during a handshake, shared by all the pairs as they are run one after the other ***/
+typedef struct {
+	uint8_t queue[2][FOOTPRINT_QUEUE_SIZE][FOOTPRINT_PACKET_MAX_LENGTH]; /**< packets waiting for each side */
+	uint16_t queueLengths[2][FOOTPRINT_QUEUE_SIZE];
+	int queueCount[2];
+} footprintTransport_t;
+
+/*** a secured channel, kept as small as possible as it is not part of the measure ***/
+typedef struct {
+	bzrtpContext_t *context;
+	uint32_t ssrc;
+	uint8_t side; /**< 0 for the local end, 1 for the remote one */
+	uint8_t secure;
+	footprintTransport_t *transport; /**< set during the handshake only, later packets are dropped */
+} footprintChannel_t;
+
+typedef struct {
+	const char *name;
+	size_t pairs;
+	double handshakeMs; /**< time to complete all the handshakes */
+	int64_t heapBytes; /**< heap in use by the secured channels */
+	int64_t rssBytes; /**< resident memory used by the secured channels */
+	double iterateNs; /**< one bzrtp_iterate call on every channel */
+	double teardownMs;
+	size_t failures;
+} footprintResult_t;
+
+static footprintTransport_t *transport = NULL;
+static uint8_t keyAgreement = ZRTP_KEYAGREEMENT_DH3k;
+
+static uint64_t footprintNowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* heap in use, in bytes, 0 when not available */
+static int64_t footprintHeapBytes(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	struct mallinfo2 mi = mallinfo2();
+	return (int64_t)(mi.uordblks + mi.hblkhd);
+#elif defined(__GLIBC__)
+	struct mallinfo mi = mallinfo();
+	return (int64_t)(unsigned int)mi.uordblks + (int64_t)(unsigned int)mi.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+/* resident set size, in bytes, 0 when not available */
+static int64_t footprintRssBytes(void) {
+	long long pages = 0, resident = 0;
+	FILE *fp = fopen("/proc/self/statm", "r");
+
+	if (fp == NULL) {
+		return 0;
+	}
+	if (fscanf(fp, "%lld %lld", &pages, &resident) != 2) {
+		resident = 0;
+	}
+	fclose(fp);
+	return (int64_t)resident*(int64_t)sysconf(_SC_PAGESIZE);
+}
+
+/*** handshake ***/
+static int footprintSendData(void *clientData, const uint8_t *packetString, uint16_t packetLength) {
+	footprintChannel_t *channel = (footprintChannel_t *)clientData;
+	footprintTransport_t *t = channel->transport;
+	int peerSide = 1 - channel->side;
+
+	if (t == NULL || t->queueCount[peerSide] == FOOTPRINT_QUEUE_SIZE || packetLength > FOOTPRINT_PACKET_MAX_LENGTH) {
+		return 0; /* lost */
+	}
+	memcpy(t->queue[peerSide][t->queueCount[peerSide]], packetString, packetLength);
+	t->queueLengths[peerSide][t->queueCount[peerSide]] = packetLength;
+	t->queueCount[peerSide]++;
+	return 0;
+}
+
+static int footprintStartSrtpSession(void *clientData, BCTBX_UNUSED(const bzrtpSrtpSecrets_t *secrets), BCTBX_UNUSED(int32_t verified)) {
+	((footprintChannel_t *)clientData)->secure = 1;
+	return 0;
+}
+
+static int footprintSetUpChannel(footprintChannel_t *channel, uint32_t ssrc, uint8_t side, void *db, const char *selfURI, const char *peerURI) {
+	bzrtpCallbacks_t cbs={0};
+	uint8_t keyAgreements[1];
+
+	channel->ssrc = ssrc;
+	channel->side = side;
+	channel->secure = 0;
+	channel->transport = transport;
+	channel->context = bzrtp_createBzrtpContext();
+	if (channel->context == NULL) {
+		return -1;
+	}
+
+#ifdef ZIDCACHE_ENABLED
+	if (db != NULL) {
+		int retval = bzrtp_setZIDCache_lock(channel->context, db, selfURI, peerURI, NULL);
+		if (retval != 0 && retval != BZRTP_CACHE_SETUP) {
+			return retval;
+		}
+	}
+#endif /* ZIDCACHE_ENABLED */
+
+	cbs.bzrtp_sendData = footprintSendData;
+	cbs.bzrtp_startSrtpSession = footprintStartSrtpSession;
+	bzrtp_setCallbacks(channel->context, &cbs);
+
+	keyAgreements[0] = keyAgreement;
+	bzrtp_setSupportedCryptoTypes(channel->context, ZRTP_KEYAGREEMENT_TYPE, keyAgreements, 1);
+
+	bzrtp_initBzrtpContext(channel->context, ssrc);
+	return bzrtp_setClientData(channel->context, ssrc, channel);
+}
+
+static void footprintProcessQueue(footprintChannel_t *channel) {
+	int i;
+	for (i=0; i<transport->queueCount[channel->side]; i++) {
+		bzrtp_processMessage(channel->context, channel->ssrc, transport->queue[channel->side][i], transport->queueLengths[channel->side][i]);
+	}
+	transport->queueCount[channel->side] = 0;
+}
+
+/* bring a pair of channels to secure state, return 0 on success */
+static int footprintHandshake(footprintChannel_t *local, footprintChannel_t *remote, uint64_t *timeReference) {
+	uint64_t timeout = *timeReference + FOOTPRINT_HANDSHAKE_TIMEOUT;
+	int retval = -1;
+
+	transport->queueCount[0] = 0;
+	transport->queueCount[1] = 0;
+	bzrtp_startChannelEngine(local->context, local->ssrc);
+	bzrtp_startChannelEngine(remote->context, remote->ssrc);
+	for (; *timeReference<timeout; *timeReference+=FOOTPRINT_TICK) {
+		footprintProcessQueue(local);
+		footprintProcessQueue(remote);
+		if (local->secure && remote->secure) {
+			retval = 0;
+			break;
+		}
+		bzrtp_iterate(local->context, local->ssrc, *timeReference);
+		bzrtp_iterate(remote->context, remote->ssrc, *timeReference);
+	}
+	/* the handshake is over, idle channels have nothing to send */
+	local->transport = NULL;
+	remote->transport = NULL;
+	return retval;
+}
+
+/*** one measure: N pairs in the given configuration ***/
+static int footprintRun(footprintResult_t *result, size_t pairs, int withCache, int ticks) {
+	footprintChannel_t *channels = (footprintChannel_t *)calloc(2*pairs, sizeof(footprintChannel_t));
+	void *localDB = NULL, *remoteDB = NULL;
+	uint64_t timeReference = 1000;
+	int64_t heapStart, rssStart;
+	uint64_t start;
+	size_t i;
+	int tick;
+
+	if (channels == NULL) {
+		return -1;
+	}
+	memset(result, 0, sizeof(footprintResult_t));
+	result->name = withCache?"cache":"cacheless";
+	result->pairs = pairs;
+
+#ifdef ZIDCACHE_ENABLED
+	if (withCache) {
+		remove(FOOTPRINT_LOCAL_FILE);
+		remove(FOOTPRINT_REMOTE_FILE);
+		sqlite3 *db = NULL;
+		if (sqlite3_open(FOOTPRINT_LOCAL_FILE, &db) != SQLITE_OK) {
+			free(channels);
+			return -1;
+		}
+		localDB = db;
+		if (sqlite3_open(FOOTPRINT_REMOTE_FILE, &db) != SQLITE_OK) {
+			sqlite3_close((sqlite3 *)localDB);
+			free(channels);
+			return -1;
+		}
+		remoteDB = db;
+		bzrtp_initCache_lock(localDB, NULL);
+		bzrtp_initCache_lock(remoteDB, NULL);
+	}
+#endif /* ZIDCACHE_ENABLED */
+
+	/* handshakes */
+	heapStart = footprintHeapBytes();
+	rssStart = footprintRssBytes();
+	start = footprintNowNs();
+	for (i=0; i<pairs; i++) {
+		footprintChannel_t *local = &channels[2*i];
+		footprintChannel_t *remote = &channels[2*i+1];
+		char peerURI[64];
+
+		/* every pair has its own remote peer */
+		snprintf(peerURI, sizeof(peerURI), "peer%zu@footprint.linphone.org", i);
+		if (footprintSetUpChannel(local, (uint32_t)(2*i+1), 0, localDB, "local@footprint.linphone.org", peerURI) != 0
+				|| footprintSetUpChannel(remote, (uint32_t)(2*i+2), 1, remoteDB, peerURI, "local@footprint.linphone.org") != 0
+				|| footprintHandshake(local, remote, &timeReference) != 0) {
+			result->failures++;
+		}
+	}
+	result->handshakeMs = (double)(footprintNowNs() - start)/1000000.0;
+	result->heapBytes = footprintHeapBytes() - heapStart;
+	result->rssBytes = footprintRssBytes() - rssStart;
+
+	/* idle ticks */
+	start = footprintNowNs();
+	for (tick=0; tick<ticks; tick++) {
+		timeReference += FOOTPRINT_TICK;
+		for (i=0; i<2*pairs; i++) {
+			if (channels[i].context != NULL) {
+				bzrtp_iterate(channels[i].context, channels[i].ssrc, timeReference);
+			}
+		}
+	}
+	result->iterateNs = (ticks>0)?(double)(footprintNowNs() - start)/(double)ticks:0.0;
+
+	/* teardown */
+	start = footprintNowNs();
+	for (i=0; i<2*pairs; i++) {
+		if (channels[i].context != NULL) {
+			bzrtp_destroyBzrtpContext(channels[i].context, channels[i].ssrc);
+		}
+	}
+	result->teardownMs = (double)(footprintNowNs() - start)/1000000.0;
+
+#ifdef ZIDCACHE_ENABLED
+	if (withCache) {
+		sqlite3_close((sqlite3 *)localDB);
+		sqlite3_close((sqlite3 *)remoteDB);
+		remove(FOOTPRINT_LOCAL_FILE);
+		remove(FOOTPRINT_REMOTE_FILE);
+	}
+#endif /* ZIDCACHE_ENABLED */
+
+	free(channels);
+	return 0;
+}
+
+static void footprintPrint(const footprintResult_t *result) {
+	double channels = (double)(2*result->pairs);
+	printf("%s,%zu,%zu,%.1f,%.0f,%.0f,%.0f,%.1f,%.3f,%.1f\n", result->name, 2*result->pairs, result->failures, result->handshakeMs,
+		(double)result->heapBytes/channels, (double)result->rssBytes/channels,
+		result->iterateNs, result->iterateNs/channels,
+		result->teardownMs, result->teardownMs*1000000.0/channels);
+	fflush(stdout);
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [options]\n", name);
+	fprintf(stderr, "  --counts <n,n,...>   numbers of context pairs to measure, up to %d values (default 1,10,100,1000,10000)\n", FOOTPRINT_MAX_COUNTS);
+	fprintf(stderr, "  --ticks <n>          number of idle bzrtp_iterate ticks measured (default 100)\n");
+	fprintf(stderr, "  --cacheless          skip the cache-backed configuration\n");
+	fprintf(stderr, "  --verbose            enable the library logs\n");
+	fprintf(stderr, "Output is CSV: configuration, secured channels, failed handshakes, handshakes time (ms),\n");
+	fprintf(stderr, "heap bytes per channel, resident bytes per channel, tick cost (ns), tick cost per channel (ns),\n");
+	fprintf(stderr, "teardown time (ms), teardown time per channel (ns)\n");
+}
+
+int main(int argc, char *argv[]) {
+	size_t counts[FOOTPRINT_MAX_COUNTS] = {1, 10, 100, 1000, 10000};
+	int countsNb = 5;
+	int ticks = 100;
+	int withCache = 1;
+	int verbose = 0;
+	uint8_t availableTypes[256];
+	uint8_t availableTypesCount;
+	int i, j;
+
+	for (i=1; i<argc; i++) {
+		if (strcmp(argv[i], "--counts") == 0 && i+1<argc) {
+			char *list = argv[++i];
+			countsNb = 0;
+			while (*list != '\0' && countsNb < FOOTPRINT_MAX_COUNTS) {
+				char *end = NULL;
+				unsigned long long count = strtoull(list, &end, 10);
+				if (end == list || count == 0) {
+					usage(argv[0]);
+					return 1;
+				}
+				counts[countsNb++] = (size_t)count;
+				list = (*end == ',')?end+1:end;
+			}
+		} else if (strcmp(argv[i], "--ticks") == 0 && i+1<argc) {
+			ticks = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--cacheless") == 0) {
+			withCache = 0;
+		} else if (strcmp(argv[i], "--verbose") == 0) {
+			verbose = 1;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (countsNb == 0 || ticks < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+#ifndef ZIDCACHE_ENABLED
+	withCache = 0;
+#endif /* ZIDCACHE_ENABLED */
+
+	bctbx_set_log_level("bzrtp", verbose?BCTBX_LOG_DEBUG:BCTBX_LOG_ERROR);
+
+	/* the fastest key agreement available keeps the set up time reasonable on large counts */
+	availableTypesCount = bzrtp_available_key_agreement(availableTypes);
+	for (i=0; i<availableTypesCount; i++) {
+		if (availableTypes[i] == ZRTP_KEYAGREEMENT_X255) {
+			keyAgreement = ZRTP_KEYAGREEMENT_X255;
+		}
+	}
+
+	transport = (footprintTransport_t *)calloc(1, sizeof(footprintTransport_t));
+	printf("configuration,channels,failures,handshakes_ms,heap_bytes_per_channel,rss_bytes_per_channel,tick_ns,tick_ns_per_channel,teardown_ms,teardown_ns_per_channel\n");
+	for (j=0; j<=withCache; j++) {
+		for (i=0; i<countsNb; i++) {
+			footprintResult_t result;
+			if (footprintRun(&result, counts[i], j, ticks) != 0) {
+				fprintf(stderr, "unable to run %zu pairs\n", counts[i]);
+				free(transport);
+				return 1;
+			}
+			footprintPrint(&result);
+		}
+	}
+	free(transport);
+	return 0;
+}
@@ -229,9 +229,7 @@ void test_parser_param(uint8_t hvi_trick) {
 			}
 			freePacketFlag = 0;
 		}
-		/* free the packet string as will be created again by the packetBuild function and might have been copied by packetParser */
-		free(zrtpPacket->packetString);
-		/* build a packet string from the parser packet*/
+		/* build a packet string from the parser packet, packetBuild reuses the packet string allocated by the parser */
 		retval = bzrtp_packetBuild((patternZRTPMetaData[i][2]==0x12345678)?context12345678:context87654321, (patternZRTPMetaData[i][2]==0x12345678)?context12345678->channelContext[0]:context87654321->channelContext[0], zrtpPacket);
 		bzrtp_packetSetSequenceNumber(zrtpPacket, patternZRTPMetaData[i][1]);
 		/* if (retval ==0) {
@@ -252,7 +250,7 @@ void test_parser_param(uint8_t hvi_trick) {
 			if (zrtpPacket->messageType==MSGTYPE_COMMIT) {
 				if (patternZRTPMetaData[i][2]==0x87654321) {
 					bzrtpCommitMessage_t *peerCommitMessageData;
-					peerCommitMessageData = (bzrtpCommitMessage_t *)zrtpPacket->messageData;
+					peerCommitMessageData = &zrtpPacket->message.commit;
 					peerCommitMessageData->hvi[0]=0xFF;
 				}
 			}
@@ -375,8 +373,8 @@ static void test_parserComplete(void) {
 		contextAlice->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID] = alice_HelloFromBob;
 
 		/* determine crypto Algo to use */
-		alice_HelloFromBob_message = (bzrtpHelloMessage_t *)alice_HelloFromBob->messageData;
-		retval = bzrtp_cryptoAlgoAgreement(contextAlice, contextAlice->channelContext[0], contextAlice->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID]->messageData);
+		alice_HelloFromBob_message = &alice_HelloFromBob->message.hello;
+		retval = bzrtp_cryptoAlgoAgreement(contextAlice, contextAlice->channelContext[0], &contextAlice->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID]->message.hello);
 		if (retval == 0) {
 			bzrtp_message ("Alice selected algo %x\n", contextAlice->channelContext[0]->keyAgreementAlgo);
 			memcpy(contextAlice->peerZID, alice_HelloFromBob_message->ZID, 12);
@@ -403,8 +401,8 @@ static void test_parserComplete(void) {
 		contextBob->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID] = bob_HelloFromAlice;
 
 		/* determine crypto Algo to use */
-		bob_HelloFromAlice_message = (bzrtpHelloMessage_t *)bob_HelloFromAlice->messageData;
-		retval = bzrtp_cryptoAlgoAgreement(contextBob, contextBob->channelContext[0], contextBob->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID]->messageData);
+		bob_HelloFromAlice_message = &bob_HelloFromAlice->message.hello;
+		retval = bzrtp_cryptoAlgoAgreement(contextBob, contextBob->channelContext[0], &contextBob->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID]->message.hello);
 		if (retval == 0) {
 			bzrtp_message ("Bob selected algo %x\n", contextBob->channelContext[0]->keyAgreementAlgo);
 			memcpy(contextBob->peerZID, bob_HelloFromAlice_message->ZID, 12);
@@ -419,9 +417,9 @@ static void test_parserComplete(void) {
 	}
 
 	/* update context with hello message information : H3  and compute initiator and responder's shared secret Hashs */
-	alice_HelloFromBob_message = (bzrtpHelloMessage_t *)alice_HelloFromBob->messageData;
+	alice_HelloFromBob_message = &alice_HelloFromBob->message.hello;
 	memcpy(contextAlice->channelContext[0]->peerH[3], alice_HelloFromBob_message->H3, 32);
-	bob_HelloFromAlice_message = (bzrtpHelloMessage_t *)bob_HelloFromAlice->messageData;
+	bob_HelloFromAlice_message = &bob_HelloFromAlice->message.hello;
 	memcpy(contextBob->channelContext[0]->peerH[3], bob_HelloFromAlice_message->H3, 32);
 
 	/* get the secrets associated to peer ZID */
@@ -623,7 +621,7 @@ static void test_parserComplete(void) {
 	bzrtp_message ("Bob parsing Commit returns %x\n", retval);
 	if (retval==0) {
 		/* update context with the information found in the packet */
-		bzrtpCommitMessage_t *bob_CommitFromAlice_message = (bzrtpCommitMessage_t *)bob_CommitFromAlice->messageData;
+		bzrtpCommitMessage_t *bob_CommitFromAlice_message = &bob_CommitFromAlice->message.commit;
 		contextBob->channelContext[0]->peerSequenceNumber = bob_CommitFromAlice->sequenceNumber;
 		memcpy(contextBob->channelContext[0]->peerH[2], bob_CommitFromAlice_message->H2, 32);
 		contextBob->channelContext[0]->peerPackets[COMMIT_MESSAGE_STORE_ID] = bob_CommitFromAlice;
@@ -638,7 +636,7 @@ static void test_parserComplete(void) {
 		/* update context with the information found in the packet */
 		contextAlice->channelContext[0]->peerSequenceNumber = alice_CommitFromBob->sequenceNumber;
 		/* Alice will be the initiator (commit contention not implemented in this test) so just discard bob's commit */
-		/*bzrtpCommirMessage_t *alice_CommitFromBob_message = (bzrtpCommitMessage_t *)alice_CommitFromBob->messageData;
+		/*bzrtpCommirMessage_t *alice_CommitFromBob_message = &alice_CommitFromBob->message.commit;
 		memcpy(contextAlice->channelContext[0]->peerH[2], alice_CommitFromBob_message->H2, 32);
 		contextAlice->channelContext[0]->peerPackets[COMMIT_MESSAGE_STORE_ID] = alice_CommitFromBob;*/
 	}
@@ -660,14 +658,14 @@ static void test_parserComplete(void) {
 	memcpy(contextBob->channelContext[0]->responderAuxsecretID, tmpBuffer, 8);
 
 	contextBob->channelContext[0]->selfPackets[DHPART_MESSAGE_STORE_ID]->messageType = MSGTYPE_DHPART1; /* we are now part 1*/
-	bob_DHPart1 = (bzrtpDHPartMessage_t *)contextBob->channelContext[0]->selfPackets[DHPART_MESSAGE_STORE_ID]->messageData;
+	bob_DHPart1 = &contextBob->channelContext[0]->selfPackets[DHPART_MESSAGE_STORE_ID]->message.dhPart;
 	/* change the shared secret ID to the responder one (we set them by default to the initiator's one) */
 	memcpy(bob_DHPart1->rs1ID, contextBob->responderCachedSecretHash.rs1ID, 8);
 	memcpy(bob_DHPart1->rs2ID, contextBob->responderCachedSecretHash.rs2ID, 8);
 	memcpy(bob_DHPart1->auxsecretID, contextBob->channelContext[0]->responderAuxsecretID, 8);
 	memcpy(bob_DHPart1->pbxsecretID, contextBob->responderCachedSecretHash.pbxsecretID, 8);
 
-	free(contextBob->channelContext[0]->selfPackets[DHPART_MESSAGE_STORE_ID]->packetString);
+	/* rebuild the packet: packetBuild reuses the packet string which already holds the public value */
 	retval +=bzrtp_packetBuild(contextBob, contextBob->channelContext[0], contextBob->channelContext[0]->selfPackets[DHPART_MESSAGE_STORE_ID]);
 	retval += bzrtp_packetSetSequenceNumber(contextBob->channelContext[0]->selfPackets[DHPART_MESSAGE_STORE_ID], contextBob->channelContext[0]->selfSequenceNumber);
 	if (retval == 0) {
@@ -684,11 +682,14 @@ static void test_parserComplete(void) {
 	if (retval==0) {
 		/* update context with the information found in the packet */
 		contextAlice->channelContext[0]->peerSequenceNumber = alice_DHPart1FromBob->sequenceNumber;
-		alice_DHPart1FromBob_message = (bzrtpDHPartMessage_t *)alice_DHPart1FromBob->messageData;
+		alice_DHPart1FromBob_message = &alice_DHPart1FromBob->message.dhPart;
 		memcpy(contextAlice->channelContext[0]->peerH[1], alice_DHPart1FromBob_message->H1, 32);
 		contextAlice->channelContext[0]->peerPackets[DHPART_MESSAGE_STORE_ID] = alice_DHPart1FromBob;
 	}
 	packetDump(alice_DHPart1FromBob, 1);
+	/* Alice has verified Bob's hash chain from H1 up to H3 and his Hello MAC, they won't be computed again */
+	BC_ASSERT_EQUAL(contextAlice->channelContext[0]->peerHVerified, 0x0E, int, "%d");
+	BC_ASSERT_TRUE((contextAlice->channelContext[0]->peerPacketsMACVerified & (1<<HELLO_MESSAGE_STORE_ID)) != 0);
 
 	/* Now Alice may check which shared secret she expected and if they are valid in bob's DHPart1 */
 	if (contextAlice->cachedSecret.rs1!=NULL) {
@@ -749,7 +750,7 @@ static void test_parserComplete(void) {
 	if (retval==0) {
 		/* update context with the information found in the packet */
 		contextBob->channelContext[0]->peerSequenceNumber = bob_DHPart2FromAlice->sequenceNumber;
-		bob_DHPart2FromAlice_message = (bzrtpDHPartMessage_t *)bob_DHPart2FromAlice->messageData;
+		bob_DHPart2FromAlice_message = &bob_DHPart2FromAlice->message.dhPart;
 		memcpy(contextBob->channelContext[0]->peerH[1], bob_DHPart2FromAlice_message->H1, 32);
 		contextBob->channelContext[0]->peerPackets[DHPART_MESSAGE_STORE_ID] = bob_DHPart2FromAlice;
 	}
@@ -1193,7 +1194,7 @@ static void test_parserComplete(void) {
 	if (retval==0) {
 		/* update context with the information found in the packet */
 		contextAlice->channelContext[0]->peerSequenceNumber = alice_Confirm1FromBob->sequenceNumber;
-		alice_Confirm1FromBob_message = (bzrtpConfirmMessage_t *)alice_Confirm1FromBob->messageData;
+		alice_Confirm1FromBob_message = &alice_Confirm1FromBob->message.confirm;
 		memcpy(contextAlice->channelContext[0]->peerH[0], alice_Confirm1FromBob_message->H0, 32);
 	}
 
@@ -1219,7 +1220,7 @@ static void test_parserComplete(void) {
 	if (retval==0) {
 		/* update context with the information found in the packet */
 		contextBob->channelContext[0]->peerSequenceNumber = bob_Confirm2FromAlice->sequenceNumber;
-		bob_Confirm2FromAlice_message = (bzrtpConfirmMessage_t *)bob_Confirm2FromAlice->messageData;
+		bob_Confirm2FromAlice_message = &bob_Confirm2FromAlice->message.confirm;
 		memcpy(contextBob->channelContext[0]->peerH[0], bob_Confirm2FromAlice_message->H0, 32);
 		/* set bob's status to secure */
 		contextBob->isSecure = 1;
@@ -1295,7 +1296,7 @@ static void test_parserComplete(void) {
 		contextAlice->channelContext[1]->peerPackets[HELLO_MESSAGE_STORE_ID] = alice_HelloFromBob;
 
 		/* we are already secured (shall check isSecure==1), so we just need to check that peer Hello have the Mult in his key agreement list of supported algo */
-		alice_HelloFromBob_message = (bzrtpHelloMessage_t *)alice_HelloFromBob->messageData;
+		alice_HelloFromBob_message = &alice_HelloFromBob->message.hello;
 		for (i=0; i<alice_HelloFromBob_message->kc; i++) {
 			if (alice_HelloFromBob_message->supportedKeyAgreement[i] == ZRTP_KEYAGREEMENT_Mult) {
 				checkPeerSupportMultiChannel = 1;
@@ -1335,7 +1336,7 @@ static void test_parserComplete(void) {
 		contextBob->channelContext[1]->peerPackets[HELLO_MESSAGE_STORE_ID] = bob_HelloFromAlice;
 
 		/* we are already secured (shall check isSecure==1), so we just need to check that peer Hello have the Mult in his key agreement list of supported algo */
-		bob_HelloFromAlice_message = (bzrtpHelloMessage_t *)bob_HelloFromAlice->messageData;
+		bob_HelloFromAlice_message = &bob_HelloFromAlice->message.hello;
 		for (i=0; i<bob_HelloFromAlice_message->kc; i++) {
 			if (bob_HelloFromAlice_message->supportedKeyAgreement[i] == ZRTP_KEYAGREEMENT_Mult) {
 				checkPeerSupportMultiChannel = 1;
@@ -1361,9 +1362,9 @@ static void test_parserComplete(void) {
 	}
 
 	/* update context with hello message information : H3  and compute initiator and responder's shared secret Hashs */
-	alice_HelloFromBob_message = (bzrtpHelloMessage_t *)alice_HelloFromBob->messageData;
+	alice_HelloFromBob_message = &alice_HelloFromBob->message.hello;
 	memcpy(contextAlice->channelContext[1]->peerH[3], alice_HelloFromBob_message->H3, 32);
-	bob_HelloFromAlice_message = (bzrtpHelloMessage_t *)bob_HelloFromAlice->messageData;
+	bob_HelloFromAlice_message = &bob_HelloFromAlice->message.hello;
 	memcpy(contextBob->channelContext[1]->peerH[3], bob_HelloFromAlice_message->H3, 32);
 
 
@@ -1391,7 +1392,7 @@ static void test_parserComplete(void) {
 		/* update context with the information found in the packet */
 		contextAlice->channelContext[1]->peerSequenceNumber = alice_CommitFromBob->sequenceNumber;
 		/* Alice will be the initiator (commit contention not implemented in this test) so just discard bob's commit */
-		alice_CommitFromBob_message = (bzrtpCommitMessage_t *)alice_CommitFromBob->messageData;
+		alice_CommitFromBob_message = &alice_CommitFromBob->message.commit;
 		memcpy(contextAlice->channelContext[1]->peerH[2], alice_CommitFromBob_message->H2, 32);
 		contextAlice->channelContext[1]->peerPackets[COMMIT_MESSAGE_STORE_ID] = alice_CommitFromBob;
 	}
@@ -1524,7 +1525,7 @@ static void test_parserComplete(void) {
 	if (retval==0) {
 		/* update context with the information found in the packet */
 		contextBob->channelContext[1]->peerSequenceNumber = bob_Confirm1FromAlice->sequenceNumber;
-		bob_Confirm1FromAlice_message = (bzrtpConfirmMessage_t *)bob_Confirm1FromAlice->messageData;
+		bob_Confirm1FromAlice_message = &bob_Confirm1FromAlice->message.confirm;
 		memcpy(contextBob->channelContext[1]->peerH[0], bob_Confirm1FromAlice_message->H0, 32);
 	}
 
@@ -1547,7 +1548,7 @@ static void test_parserComplete(void) {
 	if (retval==0) {
 		/* update context with the information found in the packet */
 		contextAlice->channelContext[1]->peerSequenceNumber = alice_Confirm2FromBob->sequenceNumber;
-		alice_Confirm2FromBob_message = (bzrtpConfirmMessage_t *)alice_Confirm2FromBob->messageData;
+		alice_Confirm2FromBob_message = &alice_Confirm2FromBob->message.confirm;
 		memcpy(contextAlice->channelContext[1]->peerH[0], alice_Confirm2FromBob_message->H0, 32);
 	}
 
@@ -1878,6 +1879,272 @@ static void test_stateMachine(void) {
 
 }
 
+/* peer rejects the negotiation with an Error message: check we acknowledge it and stop the channel right away */
+static void test_errorMessage(void) {
+	int retval;
+	int i;
+	my_Context_t aliceClientData, bobClientData;
+	bzrtpPacket_t *errorPacket;
+	bzrtpCallbacks_t cbs={0} ;
+
+	/* Create zrtp Context */
+	bzrtpContext_t *contextAlice = bzrtp_createBzrtpContext();
+	bzrtpContext_t *contextBob = bzrtp_createBzrtpContext();
+
+	cbs.bzrtp_sendData=bzrtp_sendData;
+	bzrtp_setCallbacks(contextAlice, &cbs);
+	bzrtp_setCallbacks(contextBob, &cbs);
+
+	/* create the client Data and associate them to the channel contexts */
+	memcpy(aliceClientData.nom, "Alice", 6);
+	memcpy(bobClientData.nom, "Bob", 4);
+	aliceClientData.peerContext = contextBob;
+	bobClientData.peerContext = contextAlice;
+
+	bzrtp_initBzrtpContext(contextAlice, 0x12345678);
+	bzrtp_initBzrtpContext(contextBob, 0x87654321);
+	aliceClientData.peerChannelContext = contextBob->channelContext[0];
+	bobClientData.peerChannelContext = contextAlice->channelContext[0];
+	bzrtp_setClientData(contextAlice, 0x12345678, (void *)&aliceClientData);
+	bzrtp_setClientData(contextBob, 0x87654321, (void *)&bobClientData);
+
+	/* start both and give Bob's Hello to Alice, she is now waiting for Bob to go on */
+	aliceQueueIndex = 0;
+	bobQueueIndex = 0;
+	BC_ASSERT_EQUAL(bzrtp_startChannelEngine(contextAlice, 0x12345678), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_startChannelEngine(contextBob, 0x87654321), 0, int, "%x");
+	for (i=0; i<aliceQueueIndex; i++) {
+		bzrtp_processMessage(contextAlice, 0x12345678, aliceQueue[i].packetString, aliceQueue[i].packetLength);
+	}
+	aliceQueueIndex = 0;
+	bobQueueIndex = 0;
+	BC_ASSERT_EQUAL(bzrtp_getChannelStatus(contextAlice, 0x12345678), BZRTP_CHANNEL_ONGOING, int, "%x");
+
+	/* Bob rejects the negotiation */
+	errorPacket = bzrtp_createZrtpPacket(contextBob, contextBob->channelContext[0], MSGTYPE_ERROR, &retval);
+	BC_ASSERT_EQUAL(retval, 0, int, "%x");
+	errorPacket->message.error.errorCode = BZRTP_ZRTPERROR_UNSUPPORTEDKEYAGREEMENT;
+	BC_ASSERT_EQUAL(bzrtp_packetBuild(contextBob, contextBob->channelContext[0], errorPacket), 0, int, "%x");
+	bzrtp_packetSetSequenceNumber(errorPacket, contextBob->channelContext[0]->selfSequenceNumber++);
+
+	retval = bzrtp_processMessage(contextAlice, 0x12345678, errorPacket->packetString, errorPacket->messageLength+ZRTP_PACKET_OVERHEAD);
+	BC_ASSERT_EQUAL(retval, 0, int, "%x");
+
+	/* Alice acknowledged it, stopped her timer and reports the error */
+	BC_ASSERT_EQUAL(bobQueueIndex, 1, int, "%d");
+	BC_ASSERT_EQUAL(memcmp(bobQueue[0].packetString+ZRTP_PACKET_HEADER_LENGTH+4, "ErrorACK", 8), 0, int, "%d");
+	BC_ASSERT_EQUAL(contextAlice->channelContext[0]->timer.status, BZRTP_TIMER_OFF, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_getChannelStatus(contextAlice, 0x12345678), BZRTP_CHANNEL_ERROR, int, "%x");
+
+	/* Bob gets the ErrorACK */
+	BC_ASSERT_EQUAL(bzrtp_processMessage(contextBob, 0x87654321, bobQueue[0].packetString, bobQueue[0].packetLength), 0, int, "%x");
+	bobQueueIndex = 0;
+
+	/* Alice does not retransmit anything anymore */
+	bzrtp_iterate(contextAlice, 0x12345678, getCurrentTimeInMs()+10000);
+	BC_ASSERT_EQUAL(bobQueueIndex, 0, int, "%d");
+
+	bzrtp_freeZrtpPacket(errorPacket);
+	bzrtp_destroyBzrtpContext(contextAlice, 0x12345678);
+	bzrtp_destroyBzrtpContext(contextBob, 0x87654321);
+	aliceQueueIndex = 0;
+	bobQueueIndex = 0;
+}
+
+/* an Error is not authenticated: one forged during discovery ends the key agreement, as RFC 6189 section 5.9 allows.
+ * Check it is acknowledged, the channel stops for good and ignores the genuine peer afterward */
+static void test_forgedErrorMessage(void) {
+	int retval;
+	int i;
+	my_Context_t aliceClientData, bobClientData;
+	bzrtpPacket_t *errorPacket;
+	bzrtpCallbacks_t cbs={0} ;
+
+	bzrtpContext_t *contextAlice = bzrtp_createBzrtpContext();
+	bzrtpContext_t *contextBob = bzrtp_createBzrtpContext();
+	/* the attacker forges the Error with a context of its own, on Bob's SSRC */
+	bzrtpContext_t *contextMallory = bzrtp_createBzrtpContext();
+
+	cbs.bzrtp_sendData=bzrtp_sendData;
+	bzrtp_setCallbacks(contextAlice, &cbs);
+	bzrtp_setCallbacks(contextBob, &cbs);
+
+	memcpy(aliceClientData.nom, "Alice", 6);
+	memcpy(bobClientData.nom, "Bob", 4);
+	aliceClientData.peerContext = contextBob;
+	bobClientData.peerContext = contextAlice;
+
+	bzrtp_initBzrtpContext(contextAlice, 0x12345678);
+	bzrtp_initBzrtpContext(contextBob, 0x87654321);
+	bzrtp_initBzrtpContext(contextMallory, 0x87654321);
+	aliceClientData.peerChannelContext = contextBob->channelContext[0];
+	bobClientData.peerChannelContext = contextAlice->channelContext[0];
+	bzrtp_setClientData(contextAlice, 0x12345678, (void *)&aliceClientData);
+	bzrtp_setClientData(contextBob, 0x87654321, (void *)&bobClientData);
+
+	/* Alice starts and sends her Hello, she did not hear from Bob yet */
+	aliceQueueIndex = 0;
+	bobQueueIndex = 0;
+	BC_ASSERT_EQUAL(bzrtp_startChannelEngine(contextAlice, 0x12345678), 0, int, "%x");
+	BC_ASSERT_EQUAL(bobQueueIndex, 1, int, "%d");
+	bobQueueIndex = 0;
+
+	errorPacket = bzrtp_createZrtpPacket(contextMallory, contextMallory->channelContext[0], MSGTYPE_ERROR, &retval);
+	BC_ASSERT_EQUAL(retval, 0, int, "%x");
+	errorPacket->message.error.errorCode = BZRTP_ZRTPERROR_SERVICEUNAVAILABLE;
+	BC_ASSERT_EQUAL(bzrtp_packetBuild(contextMallory, contextMallory->channelContext[0], errorPacket), 0, int, "%x");
+	bzrtp_packetSetSequenceNumber(errorPacket, contextMallory->channelContext[0]->selfSequenceNumber++);
+
+	retval = bzrtp_processMessage(contextAlice, 0x12345678, errorPacket->packetString, errorPacket->messageLength+ZRTP_PACKET_OVERHEAD);
+	BC_ASSERT_EQUAL(retval, 0, int, "%x");
+
+	/* Alice acknowledges it and stops: no more Hello retransmissions */
+	BC_ASSERT_EQUAL(bobQueueIndex, 1, int, "%d");
+	BC_ASSERT_EQUAL(memcmp(bobQueue[0].packetString+ZRTP_PACKET_HEADER_LENGTH+4, "ErrorACK", 8), 0, int, "%d");
+	bobQueueIndex = 0;
+	BC_ASSERT_EQUAL(contextAlice->channelContext[0]->timer.status, BZRTP_TIMER_OFF, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_getChannelStatus(contextAlice, 0x12345678), BZRTP_CHANNEL_ERROR, int, "%x");
+	bzrtp_iterate(contextAlice, 0x12345678, getCurrentTimeInMs()+10000);
+	BC_ASSERT_EQUAL(bobQueueIndex, 0, int, "%d");
+
+	/* the genuine Bob shows up too late: his Hello is dropped and does not revive the channel */
+	BC_ASSERT_EQUAL(bzrtp_startChannelEngine(contextBob, 0x87654321), 0, int, "%x");
+	BC_ASSERT_EQUAL(aliceQueueIndex, 1, int, "%d");
+	for (i=0; i<aliceQueueIndex; i++) {
+		retval = bzrtp_processMessage(contextAlice, 0x12345678, aliceQueue[i].packetString, aliceQueue[i].packetLength);
+		BC_ASSERT_EQUAL(retval, BZRTP_PARSER_ERROR_UNEXPECTEDMESSAGE, int, "%x");
+	}
+	aliceQueueIndex = 0;
+	BC_ASSERT_EQUAL(bobQueueIndex, 0, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_getChannelStatus(contextAlice, 0x12345678), BZRTP_CHANNEL_ERROR, int, "%x");
+
+	bzrtp_freeZrtpPacket(errorPacket);
+	bzrtp_destroyBzrtpContext(contextAlice, 0x12345678);
+	bzrtp_destroyBzrtpContext(contextBob, 0x87654321);
+	bzrtp_destroyBzrtpContext(contextMallory, 0x87654321);
+	aliceQueueIndex = 0;
+	bobQueueIndex = 0;
+}
+
+/* answer a Ping with the stateless responder, then through a context whose channel is not started yet */
+/* transport buffer provider used by the Ping test: count buffers requested and committed */
+static int pingTransportBuffersRequested = 0;
+static int pingTransportBuffersCommitted = 0;
+static uint8_t *pingGetSendBuffer(void *clientData, uint16_t packetLength) {
+	pingTransportBuffersRequested++;
+	return bobQueue[bobQueueIndex].packetString;
+}
+
+static int pingCommitSendBuffer(void *clientData, uint8_t *buffer, uint16_t packetLength) {
+	pingTransportBuffersCommitted++;
+	bobQueue[bobQueueIndex++].packetLength = packetLength;
+	return 0;
+}
+
+static void test_pingAck(void) {
+	int retval;
+	uint32_t CRC;
+	uint8_t pingPacketString[BZRTP_PING_PACKET_LENGTH];
+	uint8_t pingAckPacketString[BZRTP_PINGACK_PACKET_LENGTH];
+	uint16_t pingAckPacketLength;
+	uint8_t endpointHash[8] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef};
+	uint8_t *input;
+	uint16_t inputLength;
+	bzrtpPacket_t *zrtpPacket;
+	my_Context_t aliceClientData;
+	bzrtpCallbacks_t cbs={0} ;
+	bzrtpContext_t *contextAlice;
+
+	/* a Ping from SSRC 0x87654321, sequence number 0x0102 */
+	memcpy(pingPacketString, "\x10\x00\x01\x02\x5a\x52\x54\x50\x87\x65\x43\x21\x50\x5a\x00\x06Ping    1.10", 28);
+	memcpy(pingPacketString+28, endpointHash, 8);
+	CRC = bzrtp_CRC32(pingPacketString, BZRTP_PING_PACKET_LENGTH-4);
+	pingPacketString[36] = (uint8_t)((CRC>>24)&0xFF);
+	pingPacketString[37] = (uint8_t)((CRC>>16)&0xFF);
+	pingPacketString[38] = (uint8_t)((CRC>>8)&0xFF);
+	pingPacketString[39] = (uint8_t)(CRC&0xFF);
+
+	/* output buffer too small */
+	pingAckPacketLength = BZRTP_PINGACK_PACKET_LENGTH-1;
+	retval = bzrtp_buildPingAck(pingPacketString, BZRTP_PING_PACKET_LENGTH, (uint8_t *)"ABCDEFGH", 0x12345678, 0x0304, pingAckPacketString, &pingAckPacketLength);
+	BC_ASSERT_EQUAL(retval, BZRTP_ERROR_OUTPUTBUFFER_LENGTH, int, "%x");
+
+	/* valid ping */
+	pingAckPacketLength = BZRTP_PINGACK_PACKET_LENGTH;
+	retval = bzrtp_buildPingAck(pingPacketString, BZRTP_PING_PACKET_LENGTH, (uint8_t *)"ABCDEFGH", 0x12345678, 0x0304, pingAckPacketString, &pingAckPacketLength);
+	BC_ASSERT_EQUAL(retval, 0, int, "%x");
+	BC_ASSERT_EQUAL(pingAckPacketLength, BZRTP_PINGACK_PACKET_LENGTH, int, "%d");
+
+	/* the PingACK must pass the regular packet check */
+	contextAlice = bzrtp_createBzrtpContext();
+	bzrtp_initBzrtpContext(contextAlice, 0x87654321);
+	contextAlice->channelContext[0]->peerSequenceNumber = 0;
+	input = pingAckPacketString;
+	inputLength = pingAckPacketLength;
+	zrtpPacket = bzrtp_packetCheck(&input, &inputLength, contextAlice->channelContext[0], &retval);
+	BC_ASSERT_EQUAL(retval, 0, int, "%x");
+	if (retval == 0) {
+		BC_ASSERT_EQUAL(zrtpPacket->messageType, MSGTYPE_PINGACK, int, "%x");
+		BC_ASSERT_EQUAL(zrtpPacket->messageLength, BZRTP_PINGACK_PACKET_LENGTH-ZRTP_PACKET_OVERHEAD, int, "%d");
+		BC_ASSERT_EQUAL(zrtpPacket->sequenceNumber, 0x0304, int, "%x");
+		BC_ASSERT_EQUAL(zrtpPacket->sourceIdentifier, 0x12345678, int, "%x");
+		bzrtp_freeZrtpPacket(zrtpPacket);
+	}
+	/* message content: version, our endpoint hash, the received one and the SSRC of the Ping */
+	BC_ASSERT_EQUAL(memcmp(pingAckPacketString+ZRTP_PACKET_HEADER_LENGTH+12, ZRTP_VERSION, 4), 0, int, "%d");
+	BC_ASSERT_EQUAL(memcmp(pingAckPacketString+ZRTP_PACKET_HEADER_LENGTH+16, "ABCDEFGH", 8), 0, int, "%d");
+	BC_ASSERT_EQUAL(memcmp(pingAckPacketString+ZRTP_PACKET_HEADER_LENGTH+24, endpointHash, 8), 0, int, "%d");
+	BC_ASSERT_EQUAL(memcmp(pingAckPacketString+ZRTP_PACKET_HEADER_LENGTH+32, "\x87\x65\x43\x21", 4), 0, int, "%d");
+	bzrtp_destroyBzrtpContext(contextAlice, 0x87654321);
+
+	/* a channel answers the Ping before it is started */
+	contextAlice = bzrtp_createBzrtpContext();
+	cbs.bzrtp_sendData=bzrtp_sendData;
+	bzrtp_setCallbacks(contextAlice, &cbs);
+	memcpy(aliceClientData.nom, "Alice", 6);
+	bzrtp_initBzrtpContext(contextAlice, 0x12345678);
+	bzrtp_setClientData(contextAlice, 0x12345678, (void *)&aliceClientData);
+	bobQueueIndex = 0;
+	BC_ASSERT_EQUAL(bzrtp_processMessage(contextAlice, 0x12345678, pingPacketString, BZRTP_PING_PACKET_LENGTH), 0, int, "%x");
+	BC_ASSERT_EQUAL(bobQueueIndex, 1, int, "%d");
+	if (bobQueueIndex == 1) {
+		BC_ASSERT_EQUAL(bobQueue[0].packetLength, BZRTP_PINGACK_PACKET_LENGTH, int, "%d");
+		BC_ASSERT_EQUAL(memcmp(bobQueue[0].packetString+ZRTP_PACKET_HEADER_LENGTH+4, "PingACK ", 8), 0, int, "%d");
+		BC_ASSERT_EQUAL(memcmp(bobQueue[0].packetString+ZRTP_PACKET_HEADER_LENGTH+16, contextAlice->selfZID, 8), 0, int, "%d");
+	}
+	bobQueueIndex = 0;
+
+	/* corrupted ping is not answered */
+	pingPacketString[30] ^= 0xFF;
+	pingAckPacketLength = BZRTP_PINGACK_PACKET_LENGTH;
+	retval = bzrtp_buildPingAck(pingPacketString, BZRTP_PING_PACKET_LENGTH, (uint8_t *)"ABCDEFGH", 0x12345678, 0x0304, pingAckPacketString, &pingAckPacketLength);
+	BC_ASSERT_EQUAL(retval, BZRTP_ERROR_INVALIDARGUMENT, int, "%x");
+	bzrtp_processMessage(contextAlice, 0x12345678, pingPacketString, BZRTP_PING_PACKET_LENGTH);
+	BC_ASSERT_EQUAL(bobQueueIndex, 0, int, "%d");
+
+	/* with transport buffers, a corrupted ping must not get one: it would never be committed */
+	cbs.bzrtp_getSendBuffer = pingGetSendBuffer;
+	cbs.bzrtp_commitSendBuffer = pingCommitSendBuffer;
+	bzrtp_setCallbacks(contextAlice, &cbs);
+	bzrtp_processMessage(contextAlice, 0x12345678, pingPacketString, BZRTP_PING_PACKET_LENGTH);
+	BC_ASSERT_EQUAL(pingTransportBuffersRequested, 0, int, "%d");
+	BC_ASSERT_EQUAL(bobQueueIndex, 0, int, "%d");
+
+	/* the valid ping is answered in the transport buffer */
+	pingPacketString[30] ^= 0xFF;
+	BC_ASSERT_EQUAL(bzrtp_processMessage(contextAlice, 0x12345678, pingPacketString, BZRTP_PING_PACKET_LENGTH), 0, int, "%x");
+	BC_ASSERT_EQUAL(pingTransportBuffersRequested, 1, int, "%d");
+	BC_ASSERT_EQUAL(pingTransportBuffersCommitted, 1, int, "%d");
+	BC_ASSERT_EQUAL(bobQueueIndex, 1, int, "%d");
+	if (bobQueueIndex == 1) {
+		BC_ASSERT_EQUAL(bobQueue[0].packetLength, BZRTP_PINGACK_PACKET_LENGTH, int, "%d");
+		BC_ASSERT_EQUAL(memcmp(bobQueue[0].packetString+ZRTP_PACKET_HEADER_LENGTH+4, "PingACK ", 8), 0, int, "%d");
+	}
+
+	bzrtp_destroyBzrtpContext(contextAlice, 0x12345678);
+	bobQueueIndex = 0;
+}
+
 /* first parse a packet and then try good and bad zrtp-hash, then do it the other way : set the zrtp-hash and then parse packet */
 static void test_zrtphash(void) {
 	bzrtpPacket_t *zrtpPacket;
@@ -1934,6 +2201,9 @@ static test_t packet_parser_tests[] = {
 	TEST_NO_TAG("Parse hvi check fail", test_parser_hvi),
 	TEST_NO_TAG("Parse Exchange", test_parserComplete),
 	TEST_NO_TAG("State machine", test_stateMachine),
+	TEST_NO_TAG("Error message", test_errorMessage),
+	TEST_NO_TAG("Forged Error message during discovery", test_forgedErrorMessage),
+	TEST_NO_TAG("Ping", test_pingAck),
 	TEST_NO_TAG("ZRTP-hash", test_zrtphash)
 };
 
@@ -0,0 +1,613 @@
+/*
+ * Copyright (c) 2014-2023 Belledonne Communications SARL.
+ *
+ * This file is part of bzrtp.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @brief Replay ZRTP handshakes captured in a pcap file against the library and profile them
+ *
+ * The ZRTP packets found in the capture are demultiplexed by SSRC: each stream is fed to its own
+ * bzrtp context playing the receiving endpoint. The capture timestamps drive a virtual clock given
+ * to bzrtp_iterate so the retransmission timers behave as they would have during the capture.
+ *
+ * As the peer secrets are not available, the handshake cannot complete. Use --until-mac to run only
+ * the packet check and parser up to the hash chain and MAC verifications (Hello, Commit, DHPart),
+ * the Confirm messages are then counted but not processed.
+ *
+ * CPU time is measured per phase (message type received and timer ticks). On glibc the allocations
+ * performed during each phase are counted too, with the bzrtp-tester counting allocator.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <bctoolbox/defs.h>
+#include <bctoolbox/logging.h>
+
+#include "bzrtp/bzrtp.h"
+#include "typedef.h"
+#include "packetParser.h"
+#include "cryptoUtils.h"
+#include "testUtils.h"
+
+/*** Profiling phases ***/
+#define PHASE_HELLO		0
+#define PHASE_HELLOACK	1
+#define PHASE_COMMIT	2
+#define PHASE_DHPART	3
+#define PHASE_CONFIRM	4
+#define PHASE_CONF2ACK	5
+#define PHASE_OTHER		6
+#define PHASE_TIMER		7
+#define PHASE_COUNT		8
+
+static const char *phaseNames[PHASE_COUNT] = {"Hello", "HelloACK", "Commit", "DHPart", "Confirm", "Conf2ACK", "Other", "Timer"};
+
+typedef struct {
+	uint64_t count; /**< number of events processed in this phase */
+	uint64_t rejected; /**< number of events for which the library returned an error */
+	uint64_t cpuNs; /**< CPU time spent in the library, in ns */
+	uint64_t allocCount; /**< number of allocations performed */
+	uint64_t allocBytes; /**< number of bytes allocated */
+} replayPhaseStats_t;
+
+/*** ZRTP streams ***/
+typedef struct replayStream_struct {
+	uint32_t peerSSRC; /**< the SSRC found in the capture */
+	uint32_t selfSSRC; /**< SSRC of the local channel receiving the stream */
+	uint8_t srcAddr[16], dstAddr[16]; /**< UDP addresses, IPv4 ones use the first 4 bytes */
+	uint16_t srcPort, dstPort;
+	struct replayStream_struct *reverse; /**< the stream flowing in the opposite direction, if any */
+	bzrtpContext_t *context;
+	bzrtpPacket_t *ownHello; /**< our own Hello saved while the reverse stream one is used in --until-mac mode */
+	uint64_t nextTick; /**< next virtual time the context shall be iterated, in ms */
+	uint64_t sentPackets; /**< packets produced by the context, discarded */
+	replayPhaseStats_t stats[PHASE_COUNT];
+} replayStream_t;
+
+typedef struct {
+	int untilMac; /**< only check and parse packets up to the MAC/hash chain checks */
+	uint32_t ssrcFilter; /**< replay only this SSRC when filterSet is set */
+	int filterSet;
+	uint64_t tickMs; /**< virtual clock step */
+	replayStream_t **streams;
+	size_t streamsCount;
+} replayContext_t;
+
+static uint64_t replayCpuTimeNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* snapshot taken at the begining of a profiled section */
+typedef struct {
+	uint64_t cpuNs;
+	bzrtptesterAllocationStats_t alloc;
+} replayProbe_t;
+
+static void replayProbeStart(replayProbe_t *probe) {
+	bzrtptester_allocation_counter_read(&probe->alloc);
+	probe->cpuNs = replayCpuTimeNs();
+}
+
+static void replayProbeStop(const replayProbe_t *probe, replayPhaseStats_t *stats, int retval) {
+	uint64_t cpuNs = replayCpuTimeNs();
+	bzrtptesterAllocationStats_t alloc;
+	bzrtptester_allocation_counter_read(&alloc);
+	stats->count++;
+	stats->cpuNs += cpuNs - probe->cpuNs;
+	stats->allocCount += alloc.allocations - probe->alloc.allocations;
+	stats->allocBytes += alloc.allocatedBytes - probe->alloc.allocatedBytes;
+	if (retval != 0) {
+		stats->rejected++;
+	}
+}
+
+static int replayMessagePhase(const uint8_t *zrtpPacket, size_t zrtpPacketLength) {
+	/* message type is after the packet header(12 bytes), preambule and length(4 bytes) */
+	const uint8_t *messageType = zrtpPacket + ZRTP_PACKET_HEADER_LENGTH + 4;
+	if (zrtpPacketLength < ZRTP_PACKET_HEADER_LENGTH + 12 || zrtpPacket[0] != 0x10) { /* fragments are accounted as other */
+		return PHASE_OTHER;
+	}
+	if (memcmp(messageType, "Hello   ", 8) == 0) return PHASE_HELLO;
+	if (memcmp(messageType, "HelloACK", 8) == 0) return PHASE_HELLOACK;
+	if (memcmp(messageType, "Commit  ", 8) == 0) return PHASE_COMMIT;
+	if (memcmp(messageType, "DHPart1 ", 8) == 0 || memcmp(messageType, "DHPart2 ", 8) == 0) return PHASE_DHPART;
+	if (memcmp(messageType, "Confirm1", 8) == 0 || memcmp(messageType, "Confirm2", 8) == 0) return PHASE_CONFIRM;
+	if (memcmp(messageType, "Conf2ACK", 8) == 0) return PHASE_CONF2ACK;
+	return PHASE_OTHER;
+}
+
+/*** bzrtp callbacks ***/
+static int replaySendData(void *clientData, BCTBX_UNUSED(const uint8_t *packetString), BCTBX_UNUSED(uint16_t packetLength)) {
+	replayStream_t *stream = (replayStream_t *)clientData;
+	stream->sentPackets++;
+	return 0;
+}
+
+/*** streams management ***/
+static replayStream_t *replayGetStream(replayContext_t *replay, uint32_t ssrc, const uint8_t *srcAddr, const uint8_t *dstAddr, uint16_t srcPort, uint16_t dstPort) {
+	size_t i;
+	replayStream_t *stream;
+	bzrtpCallbacks_t cbs={0};
+
+	for (i=0; i<replay->streamsCount; i++) {
+		if (replay->streams[i]->peerSSRC == ssrc) {
+			return replay->streams[i];
+		}
+	}
+
+	stream = (replayStream_t *)calloc(1, sizeof(replayStream_t));
+	stream->peerSSRC = ssrc;
+	stream->selfSSRC = ~ssrc;
+	memcpy(stream->srcAddr, srcAddr, 16);
+	memcpy(stream->dstAddr, dstAddr, 16);
+	stream->srcPort = srcPort;
+	stream->dstPort = dstPort;
+
+	/* pair it with the stream flowing in the other direction */
+	for (i=0; i<replay->streamsCount; i++) {
+		replayStream_t *other = replay->streams[i];
+		if (other->reverse == NULL && other->srcPort == dstPort && other->dstPort == srcPort
+				&& memcmp(other->srcAddr, dstAddr, 16) == 0 && memcmp(other->dstAddr, srcAddr, 16) == 0) {
+			other->reverse = stream;
+			stream->reverse = other;
+			break;
+		}
+	}
+
+	stream->context = bzrtp_createBzrtpContext();
+	cbs.bzrtp_sendData = replaySendData;
+	bzrtp_setCallbacks(stream->context, &cbs);
+	bzrtp_initBzrtpContext(stream->context, stream->selfSSRC);
+	bzrtp_setClientData(stream->context, stream->selfSSRC, stream);
+
+	replay->streams = (replayStream_t **)realloc(replay->streams, (replay->streamsCount+1)*sizeof(replayStream_t *));
+	replay->streams[replay->streamsCount++] = stream;
+	return stream;
+}
+
+static void replayDestroyStreams(replayContext_t *replay) {
+	size_t i;
+	/* first give back their own Hello to the channels borrowing the reverse stream one */
+	for (i=0; i<replay->streamsCount; i++) {
+		replayStream_t *stream = replay->streams[i];
+		if (stream->ownHello != NULL) {
+			stream->context->channelContext[0]->selfPackets[HELLO_MESSAGE_STORE_ID] = stream->ownHello;
+		}
+	}
+	for (i=0; i<replay->streamsCount; i++) {
+		bzrtp_destroyBzrtpContext(replay->streams[i]->context, replay->streams[i]->selfSSRC);
+		free(replay->streams[i]);
+	}
+	free(replay->streams);
+	replay->streams = NULL;
+	replay->streamsCount = 0;
+}
+
+/*** full replay: feed the packets to the state machine ***/
+static void replayAdvanceClock(replayContext_t *replay, uint64_t timeMs) {
+	size_t i;
+	for (i=0; i<replay->streamsCount; i++) {
+		replayStream_t *stream = replay->streams[i];
+		if (stream->context->channelContext[0]->stateMachine == NULL) { /* engine not started yet */
+			continue;
+		}
+		while (stream->nextTick <= timeMs) {
+			replayProbe_t probe;
+			int retval;
+			replayProbeStart(&probe);
+			retval = bzrtp_iterate(stream->context, stream->selfSSRC, stream->nextTick);
+			replayProbeStop(&probe, &stream->stats[PHASE_TIMER], retval);
+			stream->nextTick += replay->tickMs;
+		}
+	}
+}
+
+static void replayProcessMessage(replayStream_t *stream, uint8_t *zrtpPacket, uint16_t zrtpPacketLength, uint64_t timeMs) {
+	replayProbe_t probe;
+	int retval;
+	int phase = replayMessagePhase(zrtpPacket, zrtpPacketLength);
+
+	/* start the engine at the first packet received on this stream */
+	if (stream->context->channelContext[0]->stateMachine == NULL) {
+		bzrtp_iterate(stream->context, stream->selfSSRC, timeMs);
+		bzrtp_startChannelEngine(stream->context, stream->selfSSRC);
+		stream->nextTick = timeMs;
+	}
+
+	replayProbeStart(&probe);
+	retval = bzrtp_processMessage(stream->context, stream->selfSSRC, zrtpPacket, zrtpPacketLength);
+	replayProbeStop(&probe, &stream->stats[phase], retval);
+}
+
+/*** --until-mac replay: check and parse the packets only ***/
+static void replayParseMessage(replayStream_t *stream, uint8_t *zrtpPacket, uint16_t zrtpPacketLength) {
+	replayProbe_t probe;
+	int retval = 0;
+	int phase = replayMessagePhase(zrtpPacket, zrtpPacketLength);
+	bzrtpContext_t *zrtpContext = stream->context;
+	bzrtpChannelContext_t *zrtpChannelContext = zrtpContext->channelContext[0];
+	bzrtpPacket_t *packet;
+	uint8_t *input = zrtpPacket;
+	uint16_t inputLength = zrtpPacketLength;
+	int storeId = -1;
+
+	/* Confirm messages need the secrets to be decrypted, do not go further */
+	if (phase == PHASE_CONFIRM || phase == PHASE_CONF2ACK || phase == PHASE_OTHER) {
+		stream->stats[phase].count++;
+		return;
+	}
+
+	/* the DHPart type tells the role of the peer: a DHPart2 comes from the initiator */
+	if (phase == PHASE_DHPART) {
+		zrtpChannelContext->role = (zrtpPacket[ZRTP_PACKET_HEADER_LENGTH+10]=='2')?BZRTP_ROLE_RESPONDER:BZRTP_ROLE_INITIATOR;
+		/* the hvi check is performed against the Hello sent by the responder: the one in the reverse stream */
+		if (zrtpChannelContext->role == BZRTP_ROLE_RESPONDER && stream->ownHello == NULL
+				&& stream->reverse != NULL && stream->reverse->context->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID] != NULL) {
+			stream->ownHello = zrtpChannelContext->selfPackets[HELLO_MESSAGE_STORE_ID];
+			zrtpChannelContext->selfPackets[HELLO_MESSAGE_STORE_ID] = stream->reverse->context->channelContext[0]->peerPackets[HELLO_MESSAGE_STORE_ID];
+		}
+	}
+
+	replayProbeStart(&probe);
+	packet = bzrtp_packetCheck(&input, &inputLength, zrtpChannelContext, &retval);
+	if (retval == 0) {
+		retval = bzrtp_packetParser(zrtpContext, zrtpChannelContext, input, inputLength, packet);
+	}
+	replayProbeStop(&probe, &stream->stats[phase], (retval==BZRTP_PARSER_INFO_PACKETFRAGMENT)?0:retval);
+
+	if (retval != 0) {
+		bzrtp_freeZrtpPacket(packet);
+		return;
+	}
+	zrtpChannelContext->peerSequenceNumber = packet->sequenceNumber;
+
+	switch (packet->messageType) {
+		case MSGTYPE_HELLO:
+			storeId = HELLO_MESSAGE_STORE_ID;
+			break;
+		case MSGTYPE_COMMIT:
+			storeId = COMMIT_MESSAGE_STORE_ID;
+			if (zrtpChannelContext->peerPackets[COMMIT_MESSAGE_STORE_ID] == NULL) {
+				/* the algorithms selected in the commit are used by both directions */
+				bzrtpCommitMessage_t *commitMessage = &packet->message.commit;
+				bzrtpChannelContext_t *channels[2] = {zrtpChannelContext, (stream->reverse!=NULL)?stream->reverse->context->channelContext[0]:NULL};
+				int i;
+				for (i=0; i<2 && channels[i]!=NULL; i++) {
+					channels[i]->hashAlgo = commitMessage->hashAlgo;
+					channels[i]->cipherAlgo = commitMessage->cipherAlgo;
+					channels[i]->authTagAlgo = commitMessage->authTagAlgo;
+					channels[i]->keyAgreementAlgo = commitMessage->keyAgreementAlgo;
+					channels[i]->sasAlgo = commitMessage->sasAlgo;
+					bzrtp_updateCryptoFunctionPointers(channels[i]);
+				}
+			}
+			break;
+		case MSGTYPE_DHPART1:
+		case MSGTYPE_DHPART2:
+			storeId = DHPART_MESSAGE_STORE_ID;
+			break;
+	}
+
+	/* keep the first one, retransmissions are just profiled */
+	if (storeId >= 0 && zrtpChannelContext->peerPackets[storeId] == NULL) {
+		zrtpChannelContext->peerPackets[storeId] = packet;
+	} else {
+		bzrtp_freeZrtpPacket(packet);
+	}
+}
+
+/*** pcap reading ***/
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+
+#define LINKTYPE_NULL		0
+#define LINKTYPE_ETHERNET	1
+#define LINKTYPE_RAW		101
+#define LINKTYPE_LINUX_SLL	113
+#define LINKTYPE_LINUX_SLL2	276
+
+static uint32_t readU32(const uint8_t *buffer, int swap) {
+	if (swap) {
+		return ((uint32_t)buffer[3]<<24) | ((uint32_t)buffer[2]<<16) | ((uint32_t)buffer[1]<<8) | (uint32_t)buffer[0];
+	}
+	return ((uint32_t)buffer[0]<<24) | ((uint32_t)buffer[1]<<16) | ((uint32_t)buffer[2]<<8) | (uint32_t)buffer[3];
+}
+
+static uint16_t readBE16(const uint8_t *buffer) {
+	return (uint16_t)(((uint16_t)buffer[0]<<8) | buffer[1]);
+}
+
+/**
+ * @brief Extract the UDP payload from a captured frame
+ *
+ * @return 0 on success, -1 if the frame is not a UDP datagram we can decode
+ */
+static int replayGetUdpPayload(uint32_t linkType, const uint8_t *frame, size_t frameLength,
+		uint8_t srcAddr[16], uint8_t dstAddr[16], uint16_t *srcPort, uint16_t *dstPort, const uint8_t **payload, size_t *payloadLength) {
+	size_t offset = 0;
+	uint16_t etherType = 0x0800;
+	const uint8_t *udp;
+	size_t udpLength;
+
+	switch (linkType) {
+		case LINKTYPE_NULL:
+			if (frameLength < 4) return -1;
+			/* address family in host order of the capturing machine: 2 is AF_INET, greater values are IPv6 ones */
+			etherType = (frame[0]==2 || frame[3]==2)?0x0800:0x86DD;
+			offset = 4;
+			break;
+		case LINKTYPE_ETHERNET:
+			if (frameLength < 14) return -1;
+			etherType = readBE16(frame+12);
+			offset = 14;
+			while (etherType == 0x8100 && frameLength >= offset+4) { /* skip VLAN tags */
+				etherType = readBE16(frame+offset+2);
+				offset += 4;
+			}
+			break;
+		case LINKTYPE_RAW:
+			if (frameLength < 1) return -1;
+			etherType = ((frame[0]>>4) == 6)?0x86DD:0x0800;
+			break;
+		case LINKTYPE_LINUX_SLL:
+			if (frameLength < 16) return -1;
+			etherType = readBE16(frame+14);
+			offset = 16;
+			break;
+		case LINKTYPE_LINUX_SLL2:
+			if (frameLength < 20) return -1;
+			etherType = readBE16(frame);
+			offset = 20;
+			break;
+		default:
+			return -1;
+	}
+
+	memset(srcAddr, 0, 16);
+	memset(dstAddr, 0, 16);
+	if (etherType == 0x0800) { /* IPv4 */
+		size_t ihl;
+		if (frameLength < offset+20) return -1;
+		ihl = (size_t)(frame[offset]&0x0F)*4;
+		if (frame[offset+9] != 17) return -1; /* not UDP */
+		if ((readBE16(frame+offset+6)&0x3FFF) != 0) return -1; /* IP fragments are not supported */
+		memcpy(srcAddr, frame+offset+12, 4);
+		memcpy(dstAddr, frame+offset+16, 4);
+		offset += ihl;
+	} else if (etherType == 0x86DD) { /* IPv6, extension headers are not supported */
+		if (frameLength < offset+40) return -1;
+		if (frame[offset+6] != 17) return -1;
+		memcpy(srcAddr, frame+offset+8, 16);
+		memcpy(dstAddr, frame+offset+24, 16);
+		offset += 40;
+	} else {
+		return -1;
+	}
+
+	if (frameLength < offset+8) return -1;
+	udp = frame+offset;
+	udpLength = readBE16(udp+4);
+	if (udpLength < 8 || frameLength < offset+udpLength) return -1;
+	*srcPort = readBE16(udp);
+	*dstPort = readBE16(udp+2);
+	*payload = udp+8;
+	*payloadLength = udpLength-8;
+	return 0;
+}
+
+static int replayIsZrtp(const uint8_t *payload, size_t payloadLength) {
+	if (payloadLength < ZRTP_PACKET_OVERHEAD || payloadLength > 0xFFFF) {
+		return 0;
+	}
+	if ((payload[0]&0xF0) != 0x10) {
+		return 0;
+	}
+	return readU32(payload+4, 0) == ZRTP_MAGIC_COOKIE;
+}
+
+static int replayPcap(replayContext_t *replay, const char *filename) {
+	uint8_t globalHeader[24];
+	uint8_t recordHeader[16];
+	uint8_t *frame = NULL;
+	size_t frameBufferLength = 0;
+	uint32_t magic, linkType;
+	int swap = 0, nano = 0;
+	int64_t firstTimeMs = -1;
+	uint64_t zrtpPackets = 0;
+	FILE *fp = fopen(filename, "rb");
+
+	if (fp == NULL) {
+		fprintf(stderr, "Unable to open %s\n", filename);
+		return -1;
+	}
+
+	if (fread(globalHeader, 1, 24, fp) != 24) {
+		fprintf(stderr, "%s is not a pcap file\n", filename);
+		fclose(fp);
+		return -1;
+	}
+
+	magic = readU32(globalHeader, 0);
+	if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC) {
+		swap = 0;
+	} else {
+		magic = readU32(globalHeader, 1);
+		if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+			fprintf(stderr, "%s is not a pcap file (pcapng is not supported)\n", filename);
+			fclose(fp);
+			return -1;
+		}
+		swap = 1;
+	}
+	nano = (magic == PCAP_MAGIC_NSEC);
+	linkType = readU32(globalHeader+20, swap)&0x0FFFFFFF;
+
+	while (fread(recordHeader, 1, 16, fp) == 16) {
+		uint32_t seconds = readU32(recordHeader, swap);
+		uint32_t fraction = readU32(recordHeader+4, swap);
+		uint32_t capturedLength = readU32(recordHeader+8, swap);
+		uint64_t timeMs;
+		uint8_t srcAddr[16], dstAddr[16];
+		uint16_t srcPort, dstPort;
+		const uint8_t *payload;
+		size_t payloadLength;
+		replayStream_t *stream;
+		uint8_t *zrtpPacket;
+
+		if (capturedLength > frameBufferLength) {
+			frame = (uint8_t *)realloc(frame, capturedLength);
+			frameBufferLength = capturedLength;
+		}
+		if (fread(frame, 1, capturedLength, fp) != capturedLength) {
+			break;
+		}
+
+		if (replayGetUdpPayload(linkType, frame, capturedLength, srcAddr, dstAddr, &srcPort, &dstPort, &payload, &payloadLength) != 0
+				|| !replayIsZrtp(payload, payloadLength)) {
+			continue;
+		}
+
+		/* virtual clock starts at the first ZRTP packet, shift it to avoid a 0 time reference */
+		timeMs = (uint64_t)seconds*1000 + (nano?fraction/1000000:fraction/1000);
+		if (firstTimeMs < 0) {
+			firstTimeMs = (int64_t)timeMs;
+		}
+		timeMs = timeMs - (uint64_t)firstTimeMs + 1000;
+
+		if (replay->filterSet && readU32(payload+8, 0) != replay->ssrcFilter) {
+			continue;
+		}
+		zrtpPackets++;
+		stream = replayGetStream(replay, readU32(payload+8, 0), srcAddr, dstAddr, srcPort, dstPort);
+
+		/* the library may modify the buffer (fragments reassembly), give it a copy */
+		zrtpPacket = (uint8_t *)malloc(payloadLength);
+		memcpy(zrtpPacket, payload, payloadLength);
+		if (replay->untilMac) {
+			replayParseMessage(stream, zrtpPacket, (uint16_t)payloadLength);
+		} else {
+			replayAdvanceClock(replay, timeMs);
+			replayProcessMessage(stream, zrtpPacket, (uint16_t)payloadLength, timeMs);
+		}
+		free(zrtpPacket);
+	}
+
+	free(frame);
+	fclose(fp);
+	printf("%s: %llu ZRTP packets in %zu streams\n", filename, (unsigned long long)zrtpPackets, replay->streamsCount);
+	return 0;
+}
+
+/*** report ***/
+static void replayPrintStats(const char *title, const replayPhaseStats_t *stats) {
+	int i;
+	printf("%s\n", title);
+	printf("  %-10s %8s %8s %12s %10s %12s\n", "phase", "events", "rejected", "cpu(us)", "allocs", "bytes");
+	for (i=0; i<PHASE_COUNT; i++) {
+		if (stats[i].count == 0) {
+			continue;
+		}
+		if (bzrtptester_allocation_counter_available()) {
+			printf("  %-10s %8llu %8llu %12.1f %10llu %12llu\n", phaseNames[i], (unsigned long long)stats[i].count, (unsigned long long)stats[i].rejected,
+				(double)stats[i].cpuNs/1000.0, (unsigned long long)stats[i].allocCount, (unsigned long long)stats[i].allocBytes);
+		} else {
+			printf("  %-10s %8llu %8llu %12.1f %10s %12s\n", phaseNames[i], (unsigned long long)stats[i].count, (unsigned long long)stats[i].rejected,
+				(double)stats[i].cpuNs/1000.0, "n/a", "n/a");
+		}
+	}
+}
+
+static void replayReport(const replayContext_t *replay) {
+	replayPhaseStats_t total[PHASE_COUNT];
+	size_t i;
+	int j;
+
+	memset(total, 0, sizeof(total));
+	for (i=0; i<replay->streamsCount; i++) {
+		char title[128];
+		replayStream_t *stream = replay->streams[i];
+		snprintf(title, sizeof(title), "stream SSRC 0x%08x (%llu packets sent by the local endpoint)", stream->peerSSRC, (unsigned long long)stream->sentPackets);
+		replayPrintStats(title, stream->stats);
+		for (j=0; j<PHASE_COUNT; j++) {
+			total[j].count += stream->stats[j].count;
+			total[j].rejected += stream->stats[j].rejected;
+			total[j].cpuNs += stream->stats[j].cpuNs;
+			total[j].allocCount += stream->stats[j].allocCount;
+			total[j].allocBytes += stream->stats[j].allocBytes;
+		}
+	}
+	replayPrintStats("total", total);
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [options] <capture.pcap>\n", name);
+	fprintf(stderr, "  --until-mac     only check and parse the packets up to the hash chain and MAC verifications\n");
+	fprintf(stderr, "  --ssrc <hex>    replay only the stream with this SSRC\n");
+	fprintf(stderr, "  --tick <ms>     virtual clock step given to bzrtp_iterate (default 10)\n");
+	fprintf(stderr, "  --verbose       enable the library logs\n");
+}
+
+int main(int argc, char *argv[]) {
+	replayContext_t replay;
+	const char *filename = NULL;
+	int i;
+
+	memset(&replay, 0, sizeof(replay));
+	replay.tickMs = 10;
+
+	for (i=1; i<argc; i++) {
+		if (strcmp(argv[i], "--until-mac") == 0) {
+			replay.untilMac = 1;
+		} else if (strcmp(argv[i], "--ssrc") == 0 && i+1<argc) {
+			replay.ssrcFilter = (uint32_t)strtoul(argv[++i], NULL, 16);
+			replay.filterSet = 1;
+		} else if (strcmp(argv[i], "--tick") == 0 && i+1<argc) {
+			replay.tickMs = strtoull(argv[++i], NULL, 10);
+			if (replay.tickMs == 0) {
+				replay.tickMs = 1;
+			}
+		} else if (strcmp(argv[i], "--verbose") == 0) {
+			verbose = 1;
+		} else if (argv[i][0] != '-' && filename == NULL) {
+			filename = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (filename == NULL) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bctbx_set_log_level("bzrtp", verbose?BCTBX_LOG_DEBUG:BCTBX_LOG_ERROR);
+	bzrtptester_allocation_counter_start();
+
+	if (replayPcap(&replay, filename) != 0) {
+		replayDestroyStreams(&replay);
+		return 1;
+	}
+	replayReport(&replay);
+	replayDestroyStreams(&replay);
+	return 0;
+}
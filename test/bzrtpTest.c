@@ -20,6 +20,7 @@
 #include <bctoolbox/defs.h>
 
 #include <stdio.h>
+#include <string.h>
 #include "bzrtpTest.h"
 #include "typedef.h"
 #include "testUtils.h"
@@ -88,10 +89,15 @@ void bzrtp_tester_init(void(*ftester_printf)(int level, const char *fmt, va_list
 	if (ftester_printf == NULL) ftester_printf = log_handler;
 	bc_tester_init(ftester_printf, BCTBX_LOG_MESSAGE, BCTBX_LOG_ERROR, "patternZIDAlice.sqlite");
 
+#ifdef BZRTPTESTER_COUNT_ALLOCATIONS
+	/* the counting allocator interposes malloc for the whole process, the budget suite gets its own executable */
+	bc_tester_add_suite(&allocation_budget_test_suite);
+#else /* BZRTPTESTER_COUNT_ALLOCATIONS */
 	bc_tester_add_suite(&crypto_utils_test_suite);
 	bc_tester_add_suite(&packet_parser_test_suite);
 	bc_tester_add_suite(&key_exchange_test_suite);
 	bc_tester_add_suite(&zidcache_test_suite);
+#endif /* BZRTPTESTER_COUNT_ALLOCATIONS */
 }
 
 void bzrtp_tester_uninit(void) {
@@ -115,12 +121,23 @@ int main(int argc, char *argv[]) {
 	}
 
 	for(i = 1; i < argc; ++i) {
-		int ret = bc_tester_parse_args(argc, argv, i);
+		int ret;
+#ifdef BZRTPTESTER_COUNT_ALLOCATIONS
+		if (strcmp(argv[i], "--record-allocation-budgets") == 0) {
+			recordAllocationBudgets = 1;
+			continue;
+		}
+#endif /* BZRTPTESTER_COUNT_ALLOCATIONS */
+		ret = bc_tester_parse_args(argc, argv, i);
 		if (ret>0) {
 			i += ret - 1;
 			continue;
 		} else if (ret<0) {
+#ifdef BZRTPTESTER_COUNT_ALLOCATIONS
+			bc_tester_helper(argv[0], "\t\t\t--record-allocation-budgets (write the measured allocations to the writable dir allocationBudgets.txt)\n");
+#else /* BZRTPTESTER_COUNT_ALLOCATIONS */
 			bc_tester_helper(argv[0], NULL);
+#endif /* BZRTPTESTER_COUNT_ALLOCATIONS */
 		}
 		return ret;
 	}
@@ -34,8 +34,10 @@ extern test_suite_t crypto_utils_test_suite;
 extern test_suite_t packet_parser_test_suite;
 extern test_suite_t zidcache_test_suite;
 extern test_suite_t key_exchange_test_suite;
+extern test_suite_t allocation_budget_test_suite;
 
 extern int verbose;
+extern int recordAllocationBudgets;
 
 #ifdef __cplusplus
 };
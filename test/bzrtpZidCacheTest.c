@@ -28,6 +28,10 @@
 #include "sqlite3.h"
 #endif /* ZIDCACHE_ENABLED */
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 
 
 static void test_cache_getSelfZID(void) {
@@ -199,9 +203,197 @@ static void test_cache_zrtpSecrets(void) {
 #endif /* ZIDCACHE_ENABLED */
 }
 
+static void test_cache_internedURI(void) {
+#ifdef ZIDCACHE_ENABLED
+	bzrtpContext_t *aliceContext = bzrtp_createBzrtpContext();
+	bzrtpContext_t *aliceContext2 = bzrtp_createBzrtpContext();
+	char selfURI[] = "interned-alice@sip.linphone.org";
+
+	/* contexts with the same URIs share a single copy of them, which is not the caller's buffer */
+	BC_ASSERT_EQUAL(bzrtp_setZIDCache(aliceContext, NULL, selfURI, "interned-bob@sip.linphone.org"), BZRTP_ZIDCACHE_RUNTIME_CACHELESS, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_setZIDCache(aliceContext2, NULL, selfURI, "interned-carol@sip.linphone.org"), BZRTP_ZIDCACHE_RUNTIME_CACHELESS, int, "%x");
+	BC_ASSERT_TRUE(aliceContext->selfURI == aliceContext2->selfURI);
+	BC_ASSERT_TRUE(aliceContext->selfURI != selfURI);
+	BC_ASSERT_TRUE(aliceContext->peerURI != aliceContext2->peerURI);
+	BC_ASSERT_EQUAL(bzrtp_getInternedURIRefCount(selfURI), 2, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_getInternedURIRefCount("interned-bob@sip.linphone.org"), 1, int, "%d");
+
+	/* changing the URIs of a context releases the previous ones */
+	BC_ASSERT_EQUAL(bzrtp_setZIDCache(aliceContext2, NULL, selfURI, "interned-bob@sip.linphone.org"), BZRTP_ZIDCACHE_RUNTIME_CACHELESS, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_getInternedURIRefCount("interned-carol@sip.linphone.org"), 0, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_getInternedURIRefCount("interned-bob@sip.linphone.org"), 2, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_getInternedURIRefCount(selfURI), 2, int, "%d");
+
+	/* URIs are freed with the last context using them */
+	bzrtp_destroyBzrtpContext(aliceContext, 0);
+	BC_ASSERT_EQUAL(bzrtp_getInternedURIRefCount(selfURI), 1, int, "%d");
+	bzrtp_destroyBzrtpContext(aliceContext2, 0);
+	BC_ASSERT_EQUAL(bzrtp_getInternedURIRefCount(selfURI), 0, int, "%d");
+	BC_ASSERT_EQUAL(bzrtp_getInternedURIRefCount("interned-bob@sip.linphone.org"), 0, int, "%d");
+#else /* ZIDCACHE_ENABLED */
+	bzrtp_message("Test skipped as ZID cache is disabled\n");
+#endif /* ZIDCACHE_ENABLED */
+}
+
+#ifdef ZIDCACHE_ENABLED
+static int file_exists(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return 0;
+	}
+	fclose(file);
+	return 1;
+}
+#endif /* ZIDCACHE_ENABLED */
+
+static void test_cache_memory(void) {
+#ifdef ZIDCACHE_ENABLED
+	bzrtpContext_t *aliceContext;
+	bzrtpMemoryCache_t *cache;
+	uint8_t selfZIDalice[12];
+	int exitCode = 0;
+	char *snapshotFile = bc_tester_file("tmpZIDAliceSnapshot.sqlite");
+	char *snapshotTmpFile = bc_tester_file("tmpZIDAliceSnapshot.sqlite.tmp");
+	FILE *tmpFile;
+
+	remove(snapshotFile);
+	aliceContext = bzrtp_createBzrtpContext();
+
+	/* a new cache is setup in memory, the contexts use it like any other cache */
+	cache = bzrtp_memoryCache_open(snapshotFile, 0, &exitCode);
+	BC_ASSERT_PTR_NOT_NULL(cache);
+	BC_ASSERT_EQUAL(exitCode, BZRTP_CACHE_SETUP, int, "%x");
+	if (cache == NULL) {
+		bzrtp_destroyBzrtpContext(aliceContext, 0);
+		bc_free(snapshotFile);
+		bc_free(snapshotTmpFile);
+		return;
+	}
+	BC_ASSERT_EQUAL(bzrtp_setZIDCache_lock(aliceContext, bzrtp_memoryCache_getDb(cache), "alice@sip.linphone.org", "bob@sip.linphone.org", bzrtp_memoryCache_getMutex(cache)), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_getSelfZID_lock(aliceContext->zidCache, aliceContext->selfURI, selfZIDalice, aliceContext->RNGContext, aliceContext->zidCacheMutex), 0, int, "%x");
+
+	/* nothing is written to disk until a snapshot */
+	BC_ASSERT_FALSE(file_exists(snapshotFile));
+	BC_ASSERT_EQUAL(bzrtp_memoryCache_snapshot(cache), 0, int, "%x");
+	BC_ASSERT_TRUE(file_exists(snapshotFile));
+	BC_ASSERT_EQUAL(bzrtp_memoryCache_close(cache), 0, int, "%x");
+	bzrtp_destroyBzrtpContext(aliceContext, 0);
+
+	/* a leftover of an interrupted snapshot does not prevent the next one */
+	tmpFile = fopen(snapshotTmpFile, "wb");
+	if (tmpFile != NULL) {
+		fputs("interrupted snapshot", tmpFile);
+		fclose(tmpFile);
+	}
+
+	/* reopen from the snapshot: the self ZID is found without generating a new one */
+	cache = bzrtp_memoryCache_open(snapshotFile, 50, &exitCode);
+	BC_ASSERT_PTR_NOT_NULL(cache);
+	BC_ASSERT_EQUAL(exitCode, 0, int, "%x");
+	if (cache != NULL) {
+		uint8_t selfZIDcheck[12];
+		BC_ASSERT_EQUAL(bzrtp_getSelfZID_lock(bzrtp_memoryCache_getDb(cache), "alice@sip.linphone.org", selfZIDcheck, NULL, bzrtp_memoryCache_getMutex(cache)), 0, int, "%x");
+		BC_ASSERT_EQUAL(memcmp(selfZIDcheck, selfZIDalice, 12), 0, int, "%d");
+		BC_ASSERT_EQUAL(bzrtp_memoryCache_close(cache), 0, int, "%x");
+	}
+	BC_ASSERT_FALSE(file_exists(snapshotTmpFile));
+
+	remove(snapshotFile);
+	bc_free(snapshotFile);
+	bc_free(snapshotTmpFile);
+#else /* ZIDCACHE_ENABLED */
+	bzrtp_message("Test skipped as ZID cache is disabled\n");
+#endif /* ZIDCACHE_ENABLED */
+}
+
+static void test_cache_shared(void) {
+#if defined(ZIDCACHE_ENABLED) && !defined(_WIN32)
+	bzrtpContext_t *aliceContext, *workerContext;
+	bzrtpMemoryCache_t *cache, *workerCache;
+	uint8_t selfZIDalice[12];
+	uint8_t peerZIDbob[12] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, 0xed, 0xcb, 0xa9, 0x87,};
+	uint8_t rs1[32] = {0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10, 0x12};
+	uint8_t updatedRs1[32] = {0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55};
+	uint8_t pvs = 1;
+	const char *rs1Columns[] = {"rs1"};
+	const char *pvsColumns[] = {"pvs"};
+	uint8_t *values[1];
+	size_t lengths[1];
+	char segmentName[64];
+	int zuid = 0;
+	int exitCode = 0;
+	int ret;
+
+	snprintf(segmentName, sizeof(segmentName), "/bzrtp-tester-%d", (int)getpid());
+	ret = bzrtp_sharedCache_attach(segmentName, 64);
+	if (ret == BZRTP_ERROR_CACHEDISABLED) {
+		bzrtp_message("Test skipped as the shared cache is not supported\n");
+		return;
+	}
+	BC_ASSERT_EQUAL(ret, 0, int, "%x");
+	if (ret != 0) {
+		return;
+	}
+
+	/* alice holds the secrets of bob in her cache */
+	cache = bzrtp_memoryCache_open(NULL, 0, &exitCode);
+	aliceContext = bzrtp_createBzrtpContext();
+	BC_ASSERT_EQUAL(bzrtp_setZIDCache_lock(aliceContext, bzrtp_memoryCache_getDb(cache), "alice@sip.linphone.org", "bob@sip.linphone.org", bzrtp_memoryCache_getMutex(cache)), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_getSelfZID_lock(aliceContext->zidCache, aliceContext->selfURI, selfZIDalice, aliceContext->RNGContext, aliceContext->zidCacheMutex), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_cache_getZuid(aliceContext->zidCache, aliceContext->selfURI, aliceContext->peerURI, peerZIDbob, BZRTP_ZIDCACHE_INSERT_ZUID, &zuid, aliceContext->zidCacheMutex), 0, int, "%x");
+	values[0] = rs1;
+	lengths[0] = sizeof(rs1);
+	BC_ASSERT_EQUAL(bzrtp_cache_write_lock(aliceContext->zidCache, zuid, "zrtp", rs1Columns, values, lengths, 1, aliceContext->zidCacheMutex), 0, int, "%x");
+
+	/* reading them from the cache shares them with the other workers: a worker with an empty cache gets them */
+	BC_ASSERT_EQUAL(bzrtp_getPeerAssociatedSecrets(aliceContext, peerZIDbob), 0, int, "%x");
+	BC_ASSERT_EQUAL(aliceContext->zuid, zuid, int, "%d");
+	workerCache = bzrtp_memoryCache_open(NULL, 0, &exitCode);
+	workerContext = bzrtp_createBzrtpContext();
+	BC_ASSERT_EQUAL(bzrtp_setZIDCache_lock(workerContext, bzrtp_memoryCache_getDb(workerCache), "alice@sip.linphone.org", "bob@sip.linphone.org", bzrtp_memoryCache_getMutex(workerCache)), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_getPeerAssociatedSecrets(workerContext, peerZIDbob), 0, int, "%x");
+	BC_ASSERT_EQUAL(workerContext->zuid, zuid, int, "%d");
+	BC_ASSERT_EQUAL(workerContext->cachedSecret.rs1Length, sizeof(rs1), int, "%d");
+	BC_ASSERT_EQUAL(memcmp(workerContext->cachedSecret.rs1, rs1, sizeof(rs1)), 0, int, "%d");
+	BC_ASSERT_PTR_NULL(workerContext->cachedSecret.rs2);
+
+	/* new retained secrets are written through */
+	memcpy(aliceContext->peerZID, peerZIDbob, 12);
+	values[0] = updatedRs1;
+	BC_ASSERT_EQUAL(bzrtp_cache_write_active(aliceContext, "zrtp", rs1Columns, values, lengths, 1), 0, int, "%x");
+	BC_ASSERT_EQUAL(bzrtp_getPeerAssociatedSecrets(workerContext, peerZIDbob), 0, int, "%x");
+	BC_ASSERT_EQUAL(memcmp(workerContext->cachedSecret.rs1, updatedRs1, sizeof(updatedRs1)), 0, int, "%d");
+
+	/* a write addressed by zuid drops the entry: the worker reads its own, empty, cache */
+	values[0] = &pvs;
+	lengths[0] = 1;
+	BC_ASSERT_EQUAL(bzrtp_cache_write_lock(aliceContext->zidCache, zuid, "zrtp", pvsColumns, values, lengths, 1, aliceContext->zidCacheMutex), 0, int, "%x");
+	bzrtp_getPeerAssociatedSecrets(workerContext, peerZIDbob);
+	BC_ASSERT_PTR_NULL(workerContext->cachedSecret.rs1);
+	BC_ASSERT_EQUAL(bzrtp_getPeerAssociatedSecrets(aliceContext, peerZIDbob), 0, int, "%x");
+	BC_ASSERT_EQUAL(aliceContext->cachedSecret.previouslyVerifiedSas, 1, int, "%d");
+
+	/* once detached, only the local cache is used */
+	bzrtp_sharedCache_detach();
+	bzrtp_getPeerAssociatedSecrets(workerContext, peerZIDbob);
+	BC_ASSERT_PTR_NULL(workerContext->cachedSecret.rs1);
+	BC_ASSERT_EQUAL(bzrtp_sharedCache_unlink(segmentName), 0, int, "%x");
+
+	bzrtp_destroyBzrtpContext(aliceContext, 0);
+	bzrtp_destroyBzrtpContext(workerContext, 0);
+	bzrtp_memoryCache_close(cache);
+	bzrtp_memoryCache_close(workerCache);
+#else /* ZIDCACHE_ENABLED && !_WIN32 */
+	bzrtp_message("Test skipped as the shared cache is not supported\n");
+#endif /* ZIDCACHE_ENABLED && !_WIN32 */
+}
+
 static test_t zidcache_tests[] = {
 	TEST_NO_TAG("SelfZID", test_cache_getSelfZID),
 	TEST_NO_TAG("ZRTP secrets", test_cache_zrtpSecrets),
+	TEST_NO_TAG("Interned URI", test_cache_internedURI),
+	TEST_NO_TAG("In-memory cache", test_cache_memory),
+	TEST_NO_TAG("Shared hot secrets cache", test_cache_shared),
 };
 
 test_suite_t zidcache_test_suite = {
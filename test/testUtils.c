@@ -72,7 +72,7 @@ void packetDump(bzrtpPacket_t *zrtpPacket, uint8_t addRawMessage) {
 					uint8_t algoTypeString[4];
 
 					printf(" - Message Type : Hello\n");
-					messageData = (bzrtpHelloMessage_t *)zrtpPacket->messageData;
+					messageData = &zrtpPacket->message.hello;
 					printf ("Version %.4s\nIdentifier %.16s\n", messageData->version, messageData->clientIdentifier);
 					printHex ("H3", messageData->H3, 32);
 					printHex ("ZID", messageData->ZID, 12);
@@ -119,7 +119,7 @@ void packetDump(bzrtpPacket_t *zrtpPacket, uint8_t addRawMessage) {
 					bzrtpCommitMessage_t *messageData;
 
 					printf(" - Message Type : Commit\n");
-					messageData = (bzrtpCommitMessage_t *)zrtpPacket->messageData;
+					messageData = &zrtpPacket->message.commit;
 					printHex("H2", messageData->H2, 32);
 					printHex("ZID", messageData->ZID, 12);
 					bzrtp_cryptoAlgoTypeIntToString(messageData->hashAlgo, algoTypeString);
@@ -157,7 +157,7 @@ void packetDump(bzrtpPacket_t *zrtpPacket, uint8_t addRawMessage) {
 					} else {
 						printf(" - Message Type : DHPart2\n");
 					}
-					messageData = (bzrtpDHPartMessage_t *)zrtpPacket->messageData;
+					messageData = &zrtpPacket->message.dhPart;
 					printHex ("H1", messageData->H1, 32);
 					printHex ("rs1ID", messageData->rs1ID, 8);
 					printHex ("rs2ID", messageData->rs2ID, 8);
@@ -180,7 +180,7 @@ void packetDump(bzrtpPacket_t *zrtpPacket, uint8_t addRawMessage) {
 					} else {
 						printf(" - Message Type : Confirm2\n");
 					}
-					messageData = (bzrtpConfirmMessage_t *)zrtpPacket->messageData;
+					messageData = &zrtpPacket->message.confirm;
 					printHex("H0", messageData->H0, 32);
 					printf("sig_len %d\n", messageData->sig_len);
 					printf("E %d V %d A %d D %d\n", messageData->E,  messageData->V, messageData->A, messageData->D);
@@ -208,7 +208,7 @@ void dumpContext(char *title, bzrtpContext_t *zrtpContext) {
 		printHex("selfZID", zrtpContext->selfZID, 12);
 		printHex("peerZID", zrtpContext->peerZID, 12);
 
-		for (i=0; i<ZRTP_MAX_CHANNEL_NUMBER; i++) {
+		for (i=0; i<zrtpContext->channelContextSize; i++) {
 			if (zrtpContext->channelContext[i] != NULL) {
 				bzrtpChannelContext_t *channelContext = zrtpContext->channelContext[i];
 				printf("Channel %i\n  self: %08x\n", i, channelContext->selfSSRC);
@@ -303,3 +303,166 @@ int bzrtptester_sqlite3_open(const char *db_file, sqlite3 **db) {
 	return ret;
 }
 #endif /* ZIDCACHE_ENABLED */
+
+/* Counting allocator: built in the executables defining BZRTPTESTER_COUNT_ALLOCATIONS. On glibc
+ * platforms they provide their own malloc family, aligned allocators included, forwarding to the
+ * libc one. The symbols interpose the libc ones for every shared library, bzrtp and its
+ * dependencies included. */
+#if defined(BZRTPTESTER_COUNT_ALLOCATIONS) && defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define BZRTPTESTER_ALLOCATION_COUNTER
+#endif
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#undef BZRTPTESTER_ALLOCATION_COUNTER
+#endif
+#endif
+
+#ifdef BZRTPTESTER_ALLOCATION_COUNTER
+#include <errno.h>
+#include <malloc.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+extern void __libc_free(void *ptr);
+
+static int allocationCounterOn = 0;
+static int64_t allocationCount = 0;
+static int64_t allocationBytesTotal = 0;
+static int64_t allocatedBytes = 0; /* may go negative when freeing blocks allocated before the counter started */
+static int64_t allocatedBytesPeak = 0;
+
+static void allocationCounterAdd(void *ptr) {
+	int64_t size, current, peak;
+
+	if (ptr == NULL || __atomic_load_n(&allocationCounterOn, __ATOMIC_RELAXED) == 0) {
+		return;
+	}
+
+	size = (int64_t)malloc_usable_size(ptr);
+	__atomic_add_fetch(&allocationCount, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocationBytesTotal, size, __ATOMIC_RELAXED);
+	current = __atomic_add_fetch(&allocatedBytes, size, __ATOMIC_RELAXED);
+	peak = __atomic_load_n(&allocatedBytesPeak, __ATOMIC_RELAXED);
+	while (current > peak && !__atomic_compare_exchange_n(&allocatedBytesPeak, &peak, current, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void allocationCounterRemove(size_t size) {
+	if (__atomic_load_n(&allocationCounterOn, __ATOMIC_RELAXED) != 0) {
+		__atomic_sub_fetch(&allocatedBytes, (int64_t)size, __ATOMIC_RELAXED);
+	}
+}
+
+void *malloc(size_t size) {
+	void *ptr = __libc_malloc(size);
+	allocationCounterAdd(ptr);
+	return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	void *ptr = __libc_calloc(nmemb, size);
+	allocationCounterAdd(ptr);
+	return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+	size_t previousSize = (ptr == NULL)?0:malloc_usable_size(ptr);
+	void *newPtr = __libc_realloc(ptr, size);
+
+	if (newPtr != NULL || size == 0) { /* on failure, the original block is left untouched */
+		allocationCounterRemove(previousSize);
+	}
+	allocationCounterAdd(newPtr);
+	return newPtr;
+}
+
+/* aligned blocks are released by free too: they must be counted or the allocated bytes would drift */
+void *memalign(size_t alignment, size_t size) {
+	void *ptr = __libc_memalign(alignment, size);
+	allocationCounterAdd(ptr);
+	return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+	void *ptr = NULL;
+
+	if (alignment == 0 || alignment%sizeof(void *) != 0 || (alignment & (alignment-1)) != 0) {
+		return EINVAL;
+	}
+	ptr = memalign(alignment, size);
+	if (ptr == NULL) {
+		return ENOMEM;
+	}
+	*memptr = ptr;
+	return 0;
+}
+
+void *valloc(size_t size) {
+	void *ptr = __libc_valloc(size);
+	allocationCounterAdd(ptr);
+	return ptr;
+}
+
+void *pvalloc(size_t size) {
+	void *ptr = __libc_pvalloc(size);
+	allocationCounterAdd(ptr);
+	return ptr;
+}
+
+void free(void *ptr) {
+	if (ptr != NULL) {
+		allocationCounterRemove(malloc_usable_size(ptr));
+	}
+	__libc_free(ptr);
+}
+
+int bzrtptester_allocation_counter_available(void) {
+	return 1;
+}
+
+void bzrtptester_allocation_counter_start(void) {
+	__atomic_store_n(&allocationCount, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&allocationBytesTotal, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&allocatedBytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&allocatedBytesPeak, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&allocationCounterOn, 1, __ATOMIC_SEQ_CST);
+}
+
+void bzrtptester_allocation_counter_read(bzrtptesterAllocationStats_t *stats) {
+	stats->allocations = (uint64_t)__atomic_load_n(&allocationCount, __ATOMIC_RELAXED);
+	stats->allocatedBytes = (uint64_t)__atomic_load_n(&allocationBytesTotal, __ATOMIC_RELAXED);
+	stats->peakBytes = (uint64_t)__atomic_load_n(&allocatedBytesPeak, __ATOMIC_RELAXED);
+}
+
+void bzrtptester_allocation_counter_stop(bzrtptesterAllocationStats_t *stats) {
+	__atomic_store_n(&allocationCounterOn, 0, __ATOMIC_SEQ_CST);
+	bzrtptester_allocation_counter_read(stats);
+}
+
+#else /* BZRTPTESTER_ALLOCATION_COUNTER */
+
+int bzrtptester_allocation_counter_available(void) {
+	return 0;
+}
+
+void bzrtptester_allocation_counter_start(void) {
+}
+
+void bzrtptester_allocation_counter_read(bzrtptesterAllocationStats_t *stats) {
+	stats->allocations = 0;
+	stats->allocatedBytes = 0;
+	stats->peakBytes = 0;
+}
+
+void bzrtptester_allocation_counter_stop(bzrtptesterAllocationStats_t *stats) {
+	bzrtptester_allocation_counter_read(stats);
+}
+
+#endif /* BZRTPTESTER_ALLOCATION_COUNTER */
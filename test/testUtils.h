@@ -35,6 +35,21 @@ void dumpContext(char *title, bzrtpContext_t *zrtpContext);
 //const char *bzrtp_cipher_toString(uint8_t cipherAlgo);
 //const char *bzrtp_authtag_toString(uint8_t authtagAlgo);
 //const char *bzrtp_sas_toString(uint8_t sasAlgo);
+/* allocations made while the counter runs */
+typedef struct {
+	uint64_t allocations; /**< number of blocks allocated */
+	uint64_t allocatedBytes; /**< total size of the blocks allocated */
+	uint64_t peakBytes; /**< highest amount of memory allocated at once on top of what was already there when the counter started */
+} bzrtptesterAllocationStats_t;
+
+/* the counter is available in executables built with BZRTPTESTER_COUNT_ALLOCATIONS, on glibc platforms when not
+ * running under a sanitizer, stats are zeroed otherwise */
+int bzrtptester_allocation_counter_available(void);
+void bzrtptester_allocation_counter_start(void);
+/* read the stats without stopping the counter */
+void bzrtptester_allocation_counter_read(bzrtptesterAllocationStats_t *stats);
+void bzrtptester_allocation_counter_stop(bzrtptesterAllocationStats_t *stats);
+
 #ifdef ZIDCACHE_ENABLED
 int bzrtptester_sqlite3_open(const char *db_file, sqlite3 **db);
 #endif /* ZIDCACHE_ENABLED */